@@ -5,13 +5,20 @@
       "include_dirs": [ 'deps/libgit2/include' ],
       "sources": [ "src/binding.cc"
       , "src/common.cc"
+      , "src/scheduler.cc"
+      , "src/cancel.cc"
       , "src/error.cc"
       , "src/message.cc"
+      , "src/options.cc"
       , "src/object.cc"
       , "src/oid.cc"
+      , "src/oidarray.cc"
       , "src/reference.cc"
       , "src/commit.cc"
+      , "src/blob.cc"
       , "src/repository.cc"
+      , "src/walker.cc"
+      , "src/diff.cc"
       ],
 
       "libraries": [
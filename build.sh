@@ -11,7 +11,7 @@ fi
 
 mkdir -p deps/libgit2/build && \
     cd deps/libgit2/build && \
-    cmake -D CMAKE_BUILD_TYPE=Release -D BUILD_SHARED_LIBS=false -D BUILD_CLAR=false .. && \
+    cmake -D CMAKE_BUILD_TYPE=Release -D BUILD_SHARED_LIBS=false -D BUILD_CLAR=false -D THREADSAFE=true .. && \
     cmake --build . && \
     cd ../../.. && \
     node-gyp rebuild;
@@ -0,0 +1,116 @@
+#include <git2.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Measures how object lookups through the cache scale with threads:
+ * every object of the repository is loaded once, then 1, 2, 4... up to
+ * <threads> threads look them up again, all sharing one git_repository.
+ * Every lookup is a cache hit, so nothing but the cache is measured.
+ */
+
+static git_repository *repo;
+static git_oid *oids;
+static size_t count, alloc, lookups;
+
+static int collect(const git_oid *oid, void *payload)
+{
+	(void)payload;
+
+	if (count == alloc) {
+		alloc = alloc ? alloc * 2 : 1024;
+		oids = realloc(oids, alloc * sizeof(git_oid));
+		if (oids == NULL)
+			return -1;
+	}
+
+	git_oid_cpy(&oids[count++], oid);
+	return 0;
+}
+
+static void *run(void *data)
+{
+	size_t i, pos = (size_t)data;
+
+	for (i = 0; i < lookups; ++i) {
+		git_object *object;
+
+		/* a different stride per thread, so they don't go in lockstep */
+		pos = (pos + 7919) % count;
+		if (git_object_lookup(&object, repo, &oids[pos], GIT_OBJ_ANY) < 0)
+			abort();
+		git_object_free(object);
+	}
+
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	git_odb *odb;
+	pthread_t *threads;
+	size_t max_threads = 8, n, i;
+	double base = 0;
+
+	if (argc < 2 || argc > 4) {
+		fprintf(stderr, "usage: cachebench <repo-dir> [<threads>] [<lookups>]\n");
+		return 1;
+	}
+
+	if (argc > 2)
+		max_threads = strtoul(argv[2], NULL, 10);
+	lookups = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000000;
+
+	git_threads_init();
+
+	if (git_repository_open(&repo, argv[1]) < 0 ||
+		git_repository_odb(&odb, repo) < 0 ||
+		git_odb_foreach(odb, collect, NULL) < 0 || count == 0) {
+		fprintf(stderr, "cannot list the objects of %s\n", argv[1]);
+		return 1;
+	}
+	git_odb_free(odb);
+
+	/* make room for everything, and load it */
+	git_repository_set_cache_limit(repo, GIT_OBJ_ANY, (size_t)1 << 30);
+	git_repository_set_cache_limit(repo, GIT_OBJ_BLOB, (size_t)1 << 30);
+	lookups = count;
+	run(NULL);
+	lookups = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000000;
+
+	printf("%u objects, %u lookups per thread\n",
+		(unsigned)count, (unsigned)lookups);
+	printf("threads  lookups/s  speedup\n");
+
+	threads = calloc(max_threads, sizeof(pthread_t));
+
+	for (n = 1; n <= max_threads; n *= 2) {
+		double start = now(), rate;
+
+		for (i = 0; i < n; ++i)
+			pthread_create(&threads[i], NULL, run, (void *)(i * 104729));
+		for (i = 0; i < n; ++i)
+			pthread_join(threads[i], NULL);
+
+		rate = n * lookups / (now() - start);
+		if (n == 1)
+			base = rate;
+
+		printf("%7u  %9.0f  %7.2f\n", (unsigned)n, rate, rate / base);
+	}
+
+	free(threads);
+	free(oids);
+	git_repository_free(repo);
+	git_threads_shutdown();
+	return 0;
+}
@@ -172,8 +172,11 @@ typedef struct git_checkout_opts {
 		void *payload);
 	void *conflict_payload;
 
-	/* Optional callback to notify the consumer of checkout progress. */
-	void (*progress_cb)(
+	/** Optional callback to notify the consumer of checkout progress.
+	 *  Return a non-zero value to abort the checkout (with GIT_EUSER);
+	 *  files already written are left in place.
+	 */
+	int (*progress_cb)(
 		const char *path,
 		size_t completed_steps,
 		size_t total_steps,
@@ -123,6 +123,103 @@ enum {
  */
 GIT_EXTERN(int) git_libgit2_capabilities(void);
 
+/**
+ * Global library options, for use with `git_libgit2_opts`
+ */
+typedef enum {
+	GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT,
+	GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT,
+	GIT_OPT_GET_DELTA_BASE_CACHE_STATS,
+	GIT_OPT_GET_INDEXER_THREADS,
+	GIT_OPT_SET_INDEXER_THREADS,
+	GIT_OPT_GET_MWINDOW_SIZE,
+	GIT_OPT_SET_MWINDOW_SIZE,
+	GIT_OPT_GET_MWINDOW_MAPPED_LIMIT,
+	GIT_OPT_SET_MWINDOW_MAPPED_LIMIT,
+	GIT_OPT_GET_MWINDOW_FILE_LIMIT,
+	GIT_OPT_SET_MWINDOW_FILE_LIMIT,
+	GIT_OPT_GET_MWINDOW_STATS,
+	GIT_OPT_GET_WORKDIR_THREADS,
+	GIT_OPT_SET_WORKDIR_THREADS,
+	GIT_OPT_GET_CHECKOUT_THREADS,
+	GIT_OPT_SET_CHECKOUT_THREADS
+} git_libgit2_opt_t;
+
+/**
+ * Set or query a global library option.
+ *
+ * Available options:
+ *
+ * - GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT, size_t *:
+ *   Get the number of bytes the packfile delta base cache may use.
+ *
+ * - GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT, size_t:
+ *   Set the number of bytes the packfile delta base cache may use.
+ *   The cache is shared by every open packfile; a limit of 0
+ *   disables it.
+ *
+ * - GIT_OPT_GET_DELTA_BASE_CACHE_STATS, git_cache_stats *:
+ *   Get a snapshot of the delta base cache counters.
+ *
+ * - GIT_OPT_GET_INDEXER_THREADS, unsigned int *:
+ *   Get the number of threads new pack indexers resolve deltas with.
+ *
+ * - GIT_OPT_SET_INDEXER_THREADS, unsigned int:
+ *   Set the number of threads new pack indexers resolve deltas with;
+ *   0 means one per CPU. The default is 1.
+ *
+ * - GIT_OPT_GET_MWINDOW_SIZE, size_t *:
+ *   Get the size of the windows packfiles are memory-mapped with.
+ *
+ * - GIT_OPT_SET_MWINDOW_SIZE, size_t:
+ *   Set the size of the windows packfiles are memory-mapped with. It
+ *   must be a non-zero multiple of 128KiB and only applies to windows
+ *   mapped from then on.
+ *
+ * - GIT_OPT_GET_MWINDOW_MAPPED_LIMIT, size_t *:
+ *   Get the number of bytes of packfiles that may be mapped at once.
+ *
+ * - GIT_OPT_SET_MWINDOW_MAPPED_LIMIT, size_t:
+ *   Set the number of bytes of packfiles that may be mapped at once.
+ *   This is a soft limit: unused windows are unmapped to stay below
+ *   it, but a window in use never is.
+ *
+ * - GIT_OPT_GET_MWINDOW_FILE_LIMIT, unsigned int *:
+ *   Get the number of packfiles that may be kept open at once.
+ *
+ * - GIT_OPT_SET_MWINDOW_FILE_LIMIT, unsigned int:
+ *   Set the number of packfiles that may be kept open at once; the
+ *   least recently used ones without windows in use are closed, and
+ *   reopened when needed again. 0, the default, means no limit.
+ *
+ * - GIT_OPT_GET_MWINDOW_STATS, git_mwindow_stats *:
+ *   Get a snapshot of the process-wide mapped window counters.
+ *
+ * - GIT_OPT_GET_WORKDIR_THREADS, unsigned int *:
+ *   Get the number of threads the working directory is scanned with.
+ *
+ * - GIT_OPT_SET_WORKDIR_THREADS, unsigned int:
+ *   Set the number of threads the working directory is scanned with,
+ *   by status and diffs against it: directories are read ahead of the
+ *   walk, and files whose stat data changed are hashed, on that many
+ *   threads. 0 means one per CPU. The default is 1.
+ *
+ * - GIT_OPT_GET_CHECKOUT_THREADS, unsigned int *:
+ *   Get the number of threads checkouts write files with.
+ *
+ * - GIT_OPT_SET_CHECKOUT_THREADS, unsigned int:
+ *   Set the number of threads checkouts write files with: blobs are
+ *   read, filtered and written out on that many threads, while
+ *   directories, links and submodules are still created in order,
+ *   and progress is still reported in order. 0 means one per CPU.
+ *   The default is 1.
+ *
+ * @param option Option key
+ * @param ... value(s) for the option, see above
+ * @return 0 on success, -1 on error
+ */
+GIT_EXTERN(int) git_libgit2_opts(int option, ...);
+
 /** @} */
 GIT_END_DECL
 
@@ -31,6 +31,67 @@ GIT_BEGIN_DECL
  */
 GIT_EXTERN(int) git_graph_ahead_behind(size_t *ahead, size_t *behind, git_repository *repo, const git_oid *one, const git_oid *two);
 
+/**
+ * Count the unique commits between a base and each of several commits
+ *
+ * This gives the same counts as calling `git_graph_ahead_behind` with
+ * `base` as `one` and each of `targets` as `two`, but in a single walk
+ * shared by all of them, which stops as soon as the rest of the history
+ * is common to everything (sooner with a commit-graph, see
+ * `git_graph_write`). Unlike `git_graph_ahead_behind`, commits with no
+ * common history with the base are not an error.
+ *
+ * @param ahead array of `count` entries, the number of commits reachable
+ *        from each target but not from the base
+ * @param behind array of `count` entries, the number of commits reachable
+ *        from the base but not from each target
+ * @param repo the repository where the commits exist
+ * @param base the commit to compare every target with
+ * @param targets the commits to compare
+ * @param count number of commits in `targets`
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_ahead_behind_many(size_t *ahead, size_t *behind, git_repository *repo, const git_oid *base, const git_oid targets[], size_t count);
+
+/**
+ * Determine whether an object is reachable from any of a set of commits
+ *
+ * An object is reachable from a commit when it is the commit itself or
+ * can be reached from it through parents, trees and tag targets. For a
+ * commit this is a walk of the history of `from`, which goes no deeper
+ * than the target's generation when there's a commit-graph (see
+ * `git_graph_write`); for any other object, the walk stops at the
+ * commits that have a reachability bitmap (see `git_pack_write_bitmaps`).
+ *
+ * @param repo the repository where the objects exist
+ * @param oid the object to look for
+ * @param from the commits (or tags) to look from
+ * @param count number of entries in `from`
+ * @return 1 if `oid` is reachable, 0 if not, or an error code
+ */
+GIT_EXTERN(int) git_graph_reachable_from_any(git_repository *repo, const git_oid *oid, const git_oid from[], size_t count);
+
+/**
+ * Write or refresh the commit-graph file of a repository
+ *
+ * The commit-graph (`objects/info/commit-graph`, in the format core Git
+ * uses) keeps the parents, commit time, tree and generation number of
+ * every commit in it, so revision walks, merge bases and ahead/behind
+ * counts can skip reading and parsing those commits from the ODB.
+ *
+ * The new file has every commit the current one has, whose data is
+ * reused, plus the commits reachable from `tips`; so refreshing it
+ * after new commits are made only reads the new commits.
+ *
+ * @param count number of commits in the new file (may be NULL)
+ * @param repo the repository
+ * @param tips commits to include, along with their history; if NULL,
+ *        those pointed to by every reference are used
+ * @param length number of commits in `tips`
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_graph_write(size_t *count, git_repository *repo, const git_oid tips[], size_t length);
+
 /** @} */
 GIT_END_DECL
 #endif
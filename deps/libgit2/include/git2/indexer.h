@@ -26,8 +26,11 @@ typedef struct git_transfer_progress {
 
 /**
  * Type for progress callbacks during indexing
+ *
+ * Returning a non-zero value cancels the transfer or indexing, which
+ * then fails with GIT_EUSER.
  */
-typedef void (*git_transfer_progress_callback)(const git_transfer_progress *stats, void *payload);
+typedef int (*git_transfer_progress_callback)(const git_transfer_progress *stats, void *payload);
 
 typedef struct git_indexer git_indexer;
 typedef struct git_indexer_stream git_indexer_stream;
@@ -65,6 +68,20 @@ GIT_EXTERN(int) git_indexer_stream_add(git_indexer_stream *idx, const void *data
  */
 GIT_EXTERN(int) git_indexer_stream_finalize(git_indexer_stream *idx, git_transfer_progress *stats);
 
+/**
+ * Set the number of threads used to resolve deltas
+ *
+ * When the pack is finalized, its deltas can be resolved on several
+ * threads at once. The default is taken from the
+ * GIT_OPT_SET_INDEXER_THREADS library option, which is 1 unless
+ * changed. Without thread support this has no effect.
+ *
+ * @param idx the indexer
+ * @param n the number of threads; 0 means one per CPU
+ * @return the number of threads that will be used
+ */
+GIT_EXTERN(unsigned int) git_indexer_stream_set_threads(git_indexer_stream *idx, unsigned int n);
+
 /**
  * Get the packfile's hash
  *
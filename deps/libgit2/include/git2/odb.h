@@ -180,6 +180,62 @@ GIT_EXTERN(int) git_odb_read_prefix(git_odb_object **out, git_odb *db, const git
  */
 GIT_EXTERN(int) git_odb_read_header(size_t *len_out, git_otype *type_out, git_odb *db, const git_oid *id);
 
+/**
+ * Set the memory budget of the ODB cache of raw objects.
+ *
+ * Objects over the budget are evicted following a CLOCK policy
+ * (recently used objects get a second chance).
+ *
+ * @param db database to configure
+ * @param type GIT_OBJ_ANY to set the overall budget, or an object
+ * type to limit only the space taken by objects of that type
+ * @param max_bytes the new budget, in bytes; 0 disables caching
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_odb_set_cache_limit(git_odb *db, git_otype type, size_t max_bytes);
+
+/**
+ * Get the usage counters of the ODB cache of raw objects.
+ *
+ * @param out structure to fill
+ * @param db database to query
+ */
+GIT_EXTERN(void) git_odb_cache_stats(git_cache_stats *out, git_odb *db);
+
+/**
+ * Limit the memory-mapped windows and open files of the packfiles
+ * of this database.
+ *
+ * These apply on top of the process-wide limits set through
+ * `git_libgit2_opts`: the least recently used windows and files of
+ * this database are closed when it goes over its own budget. Packs
+ * that were loaded before the pack backend was added to the
+ * database are only subject to the global limits.
+ *
+ * @param db database to configure
+ * @param window_size size of the windows to map, a multiple of
+ * 128KiB; 0 to use the global setting
+ * @param mapped_limit bytes that may be mapped at once; 0 for no
+ * limit besides the global one
+ * @param file_limit packfiles that may be open at once; 0 for no
+ * limit besides the global one
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_odb_set_mwindow_limits(
+	git_odb *db, size_t window_size, size_t mapped_limit, unsigned int file_limit);
+
+/**
+ * Get the usage counters of the packfile windows of this database.
+ *
+ * The limits reported are the ones in effect, whether set on the
+ * database or inherited from the global settings.
+ *
+ * @param out structure to fill
+ * @param db database to query
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_odb_mwindow_stats(git_mwindow_stats *out, git_odb *db);
+
 /**
  * Determine if the given object can be found in the object database.
  *
@@ -258,16 +314,19 @@ GIT_EXTERN(int) git_odb_open_wstream(git_odb_stream **out, git_odb *db, size_t s
 /**
  * Open a stream to read an object from the ODB
  *
- * Note that most backends do *not* support streaming reads
- * because they store their objects as compressed/delta'ed blobs.
+ * Loose objects and undeltified packed objects are inflated as
+ * they are read. Objects no backend can stream (such as deltas,
+ * which need their whole base) are read in one go when the stream
+ * is opened, so this works on all backends.
  *
- * It's recommended to use `git_odb_read` instead, which is
- * assured to work on all backends.
+ * Use `git_odb_read_header` to learn the size and type of the
+ * object beforehand.
  *
  * The returned stream will be of type `GIT_STREAM_RDONLY` and
  * will have the following methods:
  *
- *		- stream->read: read `n` bytes from the stream
+ *		- stream->read: read up to `n` bytes from the stream; returns
+ *		  the number of bytes read, 0 at the end, or an error code
  *		- stream->free: free the stream
  *
  * The stream must always be free'd or will leak memory.
@@ -68,6 +68,29 @@ GIT_EXTERN(int) git_packbuilder_insert(git_packbuilder *pb, const git_oid *id, c
  */
 GIT_EXTERN(int) git_packbuilder_insert_tree(git_packbuilder *pb, const git_oid *id);
 
+/**
+ * Insert every object reachable from some commits but not from others
+ *
+ * This is what a fetch or a clone has to send: everything reachable
+ * from `wants` that isn't reachable from `haves`. When one of the packs
+ * of the repository has reachability bitmaps (see
+ * `git_pack_write_bitmaps`), the objects are enumerated from them,
+ * walking only the history above the nearest commits that have one.
+ *
+ * Objects are inserted without names, so deltas are only looked for
+ * among objects of the same type and close in size.
+ *
+ * @param pb The packbuilder
+ * @param wants commits (or tags) to pack the history of
+ * @param nwants number of entries in `wants`
+ * @param haves commits (or tags) whose history is left out; the ones
+ *        missing from the repository are ignored
+ * @param nhaves number of entries in `haves`
+ *
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_packbuilder_insert_reachable(git_packbuilder *pb, const git_oid wants[], size_t nwants, const git_oid haves[], size_t nhaves);
+
 /**
  * Write the new pack and the corresponding index to path
  *
@@ -112,6 +135,28 @@ GIT_EXTERN(uint32_t) git_packbuilder_written(git_packbuilder *pb);
  */
 GIT_EXTERN(void) git_packbuilder_free(git_packbuilder *pb);
 
+/**
+ * Write reachability bitmaps for a pack of a repository
+ *
+ * The bitmaps (`pack-*.bitmap`, next to the pack, in the format core
+ * Git uses) record the objects reachable from the commits referenced
+ * by the repository and from some of the commits below them, provided
+ * all those objects are in the pack; it's meant to be run right after
+ * everything has been repacked into a single pack. They speed up
+ * `git_packbuilder_insert_reachable` and
+ * `git_graph_reachable_from_any`.
+ *
+ * Only one pack of a repository is used for bitmaps, so the ones of
+ * other packs should be removed.
+ *
+ * @param count number of commits with a bitmap (may be NULL)
+ * @param repo the repository
+ * @param pack path to the .pack (or .idx) file of one of the packs of
+ *        the repository, or NULL for the one with the most objects
+ * @return 0, GIT_ENOTFOUND if there is no such pack, or an error code
+ */
+GIT_EXTERN(int) git_pack_write_bitmaps(size_t *count, git_repository *repo, const char *pack);
+
 /** @} */
 GIT_END_DECL
 #endif
@@ -390,6 +390,61 @@ GIT_EXTERN(int) git_reference_foreach_glob(
 	git_reference_foreach_cb callback,
 	void *payload);
 
+/**
+ * A reference and what it points to, as given by
+ * `git_reference_foreach_target()`.
+ */
+typedef struct {
+	/** Name of the reference */
+	const char *name;
+
+	/** What a symbolic reference points to; NULL for a direct one */
+	const char *symbolic;
+
+	/**
+	 * The object the reference points to. For a symbolic reference,
+	 * the one it resolves to if resolving was asked and it could be
+	 * resolved; zero otherwise.
+	 */
+	git_oid target;
+
+	/**
+	 * `target` peeled past any annotated tag, when the packed-refs
+	 * file tells it (this is `target` itself for anything but an
+	 * annotated tag); zero when unknown.
+	 */
+	git_oid peeled;
+} git_reference_target_entry;
+
+typedef int (*git_reference_target_cb)(
+	const git_reference_target_entry *entry, void *payload);
+
+/**
+ * Perform a callback on each reference in the repository, along with
+ * its target.
+ *
+ * This gives the same references as `git_reference_foreach_glob()`
+ * with `GIT_REF_LISTALL`, without looking each one up again: the
+ * packed-refs file is loaded once, and loose references are read as
+ * they are listed. A loose reference hides a packed one of the same
+ * name, as it does for lookups.
+ *
+ * @param repo Repository where to find the refs
+ * @param glob Pattern to match (fnmatch-style) against reference
+ *		names, or NULL for all of them
+ * @param resolve Non-zero to resolve symbolic references
+ * @param callback Function which will be called for every listed ref;
+ *		the entry is only valid during the call
+ * @param payload Additional data to pass to the callback
+ * @return 0 on success, GIT_EUSER on non-zero callback, or error code
+ */
+GIT_EXTERN(int) git_reference_foreach_target(
+	git_repository *repo,
+	const char *glob,
+	int resolve,
+	git_reference_target_cb callback,
+	void *payload);
+
 /**
  * Check if a reflog exists for the specified reference.
  *
@@ -608,6 +608,74 @@ typedef enum {
 	GIT_REPOSITORY_STATE_APPLY_MAILBOX_OR_REBASE,
 } git_repository_state_t;
 
+/**
+ * Set the memory budget of the repository cache of parsed objects.
+ *
+ * This doesn't affect the cache of the object database; see
+ * `git_odb_set_cache_limit` for that one.
+ *
+ * @param repo Repository pointer
+ * @param type GIT_OBJ_ANY to set the overall budget, or an object
+ * type to limit only the space taken by objects of that type
+ * @param max_bytes the new budget, in bytes; 0 disables caching
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_repository_set_cache_limit(
+	git_repository *repo, git_otype type, size_t max_bytes);
+
+/**
+ * Get the usage counters of the repository cache of parsed objects.
+ *
+ * @param out structure to fill
+ * @param repo Repository pointer
+ */
+GIT_EXTERN(void) git_repository_cache_stats(
+	git_cache_stats *out, git_repository *repo);
+
+/**
+ * Counters of the working directory monitor
+ */
+typedef struct {
+	int enabled;
+	size_t directories; /* directories watched */
+	size_t hits;        /* directories that didn't have to be read again */
+	size_t misses;      /* directories that had to be read */
+	size_t updates;     /* files stat()ed again after they were written */
+	size_t overflows;   /* times the kernel dropped events */
+} git_workdir_monitor_stats;
+
+/**
+ * Watch the working directory for changes, so that status and diffs
+ * against it don't read it all every time.
+ *
+ * Once enabled, the contents of the directories walked are kept, and
+ * the kernel is asked to report changes to them. The next walks only
+ * read again the directories where files were added, removed or
+ * renamed, and lstat() again the files that were written to; nothing
+ * else is looked at. If the kernel drops events, everything is read
+ * again.
+ *
+ * This is only supported on Linux (with inotify), and is meant for
+ * long-lived processes which query the same repository again and
+ * again. Each watched directory takes an inotify watch; directories
+ * that can't be watched are just read every time.
+ *
+ * @param repo Repository pointer
+ * @param enabled 1 to start watching, 0 to stop and forget everything
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_repository_set_workdir_monitor(
+	git_repository *repo, int enabled);
+
+/**
+ * Get the counters of the working directory monitor.
+ *
+ * @param out structure to fill
+ * @param repo Repository pointer
+ */
+GIT_EXTERN(void) git_repository_workdir_monitor_stats(
+	git_workdir_monitor_stats *out, git_repository *repo);
+
 /**
  * Determines the status of a git repository - ie, whether an operation
  * (merge, cherry-pick, etc) is in progress.
@@ -127,6 +127,10 @@ typedef enum {
  *   will.
  * - GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH indicates that the given path
  *   will be treated as a literal path, and not as a pathspec.
+ * - GIT_STATUS_OPT_UPDATE_INDEX allows the index file to be written, to
+ *   keep what the walk learned about untracked directories (when the
+ *   `core.untrackedCache` setting is on).  Without it, status never
+ *   writes to the repository.
  *
  * Calling `git_status_foreach()` is like calling the extended version
  * with: GIT_STATUS_OPT_INCLUDE_IGNORED, GIT_STATUS_OPT_INCLUDE_UNTRACKED,
@@ -139,6 +143,7 @@ typedef enum {
 	GIT_STATUS_OPT_EXCLUDE_SUBMODULES = (1 << 3),
 	GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS = (1 << 4),
 	GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH = (1 << 5),
+	GIT_STATUS_OPT_UPDATE_INDEX = (1 << 6),
 } git_status_opt_t;
 
 /**
@@ -175,6 +180,10 @@ typedef struct {
  * in what order.  See the `git_status_options` structure for details
  * about the additional controls that this makes available.
  *
+ * Status calls on the same repository must not run at the same time:
+ * with `core.untrackedCache` on, they read and update the cache kept
+ * in its index, which isn't locked.
+ *
  * @param repo Repository object
  * @param opts Status options structure
  * @param callback The function to call on each file
@@ -80,6 +80,31 @@ typedef enum {
 /** An open object database handle. */
 typedef struct git_odb git_odb;
 
+/** Usage counters for an object cache */
+typedef struct {
+	size_t count;		/**< Number of objects currently cached */
+	size_t used;		/**< Approximate memory taken by them, in bytes */
+	size_t limit;		/**< Memory budget of the cache, in bytes */
+	size_t hits;		/**< Lookups answered from the cache */
+	size_t misses;		/**< Lookups that had to go to the backends */
+	size_t evictions;	/**< Objects dropped to stay within budget */
+} git_cache_stats;
+
+/** Usage counters for the memory-mapped windows into packfiles */
+typedef struct {
+	size_t window_size;		/**< Size of newly mapped windows */
+	size_t mapped;			/**< Bytes currently mapped */
+	size_t peak_mapped;		/**< Most bytes ever mapped at once */
+	size_t mapped_limit;		/**< Soft limit on the mapped bytes */
+	unsigned int open_windows;	/**< Windows currently mapped */
+	unsigned int peak_open_windows;	/**< Most windows ever mapped at once */
+	unsigned int mmap_calls;	/**< Windows mapped so far */
+	unsigned int open_files;	/**< Packfiles currently open */
+	unsigned int peak_open_files;	/**< Most packfiles ever open at once */
+	unsigned int file_limit;	/**< Limit on the open packfiles; 0 for none */
+	unsigned int file_closes;	/**< Packfiles closed to honor that limit */
+} git_mwindow_stats;
+
 /** A custom backend in an ODB */
 typedef struct git_odb_backend git_odb_backend;
 
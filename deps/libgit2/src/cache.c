@@ -13,98 +13,498 @@
 #include "cache.h"
 #include "git2/oid.h"
 
+/*
+ * The cache is split in GIT_CACHE_SHARDS partitions, picked by the first
+ * byte of the OID, each one with its own lock, table and share of the
+ * memory budget. When a shard goes over budget, entries are evicted
+ * following the CLOCK algorithm: the hand sweeps the entries, giving a
+ * second chance to those that were hit since it last passed by.
+ *
+ * Lookups take no lock. Each shard keeps its entries in an open-addressed
+ * table of pointers that writers (under the shard lock) only change with
+ * single pointer stores: a free slot gets an entry, a removed entry
+ * becomes a tombstone, and a table that fills up is replaced by a new
+ * one as a whole. A reader may thus find an entry that is being evicted,
+ * so evicted entries and replaced tables are not freed right away but
+ * retired: a reader registers in the current epoch of the shard for the
+ * duration of its lookup, and what was retired in an epoch is freed once
+ * the epoch is over and its last reader gone.
+ */
+
+#define SHARD_FOR(cache, oid) (&(cache)->shards[(oid)->id[0] & (GIT_CACHE_SHARDS - 1)])
+
+/* Slots of removed entries; probing goes on past them */
+static char tombstone;
+#define TOMBSTONE ((git_cached_obj *)&tombstone)
+
+#define TABLE_MIN_SLOTS 32
+
+GIT_INLINE(bool) valid_type(int type)
+{
+	return type > 0 && type < GIT_CACHE_TYPES;
+}
+
+/* The first byte picks the shard, the next ones the slot */
+GIT_INLINE(size_t) slot_for(const git_cache_table *table, const git_oid *oid)
+{
+	uint32_t hash;
+
+	memcpy(&hash, oid->id + 1, sizeof(hash));
+	return (size_t)hash & table->mask;
+}
+
+static git_cache_table *table_alloc(size_t slots)
+{
+	git_cache_table *table = git__calloc(1,
+		sizeof(git_cache_table) + slots * sizeof(git_cached_obj *));
+
+	if (table != NULL)
+		table->mask = slots - 1;
+
+	return table;
+}
+
+/* Can run concurrently with the writers: there is always a free slot */
+static git_cached_obj *table_lookup(git_cache_table *table, const git_oid *oid)
+{
+	size_t pos = slot_for(table, oid);
+	git_cached_obj *entry;
+
+	while ((entry = table->slots[pos]) != NULL) {
+		if (entry != TOMBSTONE && git_oid_cmp(&entry->oid, oid) == 0)
+			return entry;
+		pos = (pos + 1) & table->mask;
+	}
+
+	return NULL;
+}
+
+/* Store `entry`, known not to be there; the table must have room */
+static void table_insert(git_cache_table *table, git_cached_obj *entry)
+{
+	size_t pos = slot_for(table, &entry->oid);
+
+	while (table->slots[pos] != NULL && table->slots[pos] != TOMBSTONE)
+		pos = (pos + 1) & table->mask;
+
+	if (table->slots[pos] == NULL)
+		table->filled++;
+
+	/* the entry must be complete before readers can find it */
+	git_memory_barrier();
+	table->slots[pos] = entry;
+}
+
+static void table_remove(git_cache_table *table, git_cached_obj *entry)
+{
+	size_t pos = slot_for(table, &entry->oid);
+
+	while (table->slots[pos] != NULL) {
+		if (table->slots[pos] == entry) {
+			table->slots[pos] = TOMBSTONE;
+			return;
+		}
+		pos = (pos + 1) & table->mask;
+	}
+}
+
+/*
+ * Register as a reader of the shard. The epoch is checked again once
+ * registered: if a writer ended it meanwhile, it may already have freed
+ * what was retired in it without seeing us, so we go for the new one.
+ */
+GIT_INLINE(int) shard_enter(git_cache_shard *shard)
+{
+	for (;;) {
+		int epoch = git_atomic_get(&shard->epoch) & 1;
+
+		git_atomic_inc(&shard->readers[epoch]);
+		if ((git_atomic_get(&shard->epoch) & 1) == epoch)
+			return epoch;
+		git_atomic_dec(&shard->readers[epoch]);
+	}
+}
+
+GIT_INLINE(void) shard_leave(git_cache_shard *shard, int epoch)
+{
+	git_atomic_dec(&shard->readers[epoch]);
+}
+
+static void shard_free_retired(git_cache *cache, git_cache_shard *shard, int epoch)
+{
+	while (shard->retired[epoch] != NULL) {
+		git_cached_obj *entry = shard->retired[epoch];
+		shard->retired[epoch] = entry->retired_next;
+		git_cached_obj_decref(entry, cache->free_obj);
+	}
+
+	while (shard->retired_tables[epoch] != NULL) {
+		git_cache_table *table = shard->retired_tables[epoch];
+		shard->retired_tables[epoch] = table->retired_next;
+		git__free(table);
+	}
+}
+
+/*
+ * Free what can be freed, and end the current epoch if something was
+ * retired in it, so it can be freed next time. The shard must be locked.
+ */
+static void shard_reclaim(git_cache *cache, git_cache_shard *shard)
+{
+	int i;
+
+	for (i = 0; i < 2; ++i) {
+		int current = shard->epoch.val & 1, previous = current ^ 1;
+
+		if (git_atomic_get(&shard->readers[previous]) != 0)
+			break;
+
+		shard_free_retired(cache, shard, previous);
+
+		if (shard->retired[current] == NULL &&
+			shard->retired_tables[current] == NULL)
+			break;
+
+		git_atomic_inc(&shard->epoch);
+	}
+}
+
+GIT_INLINE(void) shard_retire(git_cache_shard *shard, git_cached_obj *entry)
+{
+	int epoch = shard->epoch.val & 1;
+
+	entry->retired_next = shard->retired[epoch];
+	shard->retired[epoch] = entry;
+}
+
+static void shard_retire_table(git_cache_shard *shard, git_cache_table *table)
+{
+	int epoch = shard->epoch.val & 1;
+
+	table->retired_next = shard->retired_tables[epoch];
+	shard->retired_tables[epoch] = table;
+}
+
+/* Make room in the table for one more entry; the shard must be locked */
+static int shard_reserve(git_cache_shard *shard)
+{
+	git_cache_table *table = shard->table, *grown;
+	size_t slots = TABLE_MIN_SLOTS, i;
+
+	/* keep a quarter of the slots free, so probe sequences stay short */
+	if ((table->filled + 1) * 4 <= (table->mask + 1) * 3)
+		return 0;
+
+	/* the new table starts half full at most, without the tombstones */
+	while (slots < (shard->length + 1) * 2)
+		slots *= 2;
+
+	grown = table_alloc(slots);
+	GITERR_CHECK_ALLOC(grown);
+
+	for (i = 0; i < shard->length; ++i)
+		table_insert(grown, shard->entries[i]);
+
+	git_memory_barrier();
+	shard->table = grown;
+	shard_retire_table(shard, table);
+	return 0;
+}
+
 int git_cache_init(git_cache *cache, size_t size, git_cached_obj_freeptr free_ptr)
 {
-	if (size < 8)
-		size = 8;
-	size = git__size_t_powerof2(size);
+	int i;
+
+	memset(cache, 0x0, sizeof(git_cache));
 
-	cache->size_mask = size - 1;
-	cache->lru_count = 0;
 	cache->free_obj = free_ptr;
+	cache->limit = size;
+
+	for (i = 0; i < GIT_CACHE_TYPES; ++i)
+		cache->type_limit[i] = size;
 
-	git_mutex_init(&cache->lock);
+	/* don't let big blobs push out the commits and trees */
+	cache->type_limit[GIT_OBJ_BLOB] = size / 4;
 
-	cache->nodes = git__malloc(size * sizeof(git_cached_obj *));
-	GITERR_CHECK_ALLOC(cache->nodes);
+	for (i = 0; i < GIT_CACHE_SHARDS; ++i) {
+		git_cache_shard *shard = &cache->shards[i];
+
+		git_mutex_init(&shard->lock);
+		shard->table = table_alloc(TABLE_MIN_SLOTS);
+		GITERR_CHECK_ALLOC(shard->table);
+	}
 
-	memset(cache->nodes, 0x0, size * sizeof(git_cached_obj *));
 	return 0;
 }
 
-void git_cache_free(git_cache *cache)
+/* Drop every entry; the shard must be locked */
+static int shard_clear(git_cache *cache, git_cache_shard *shard)
 {
+	git_cache_table *empty = table_alloc(TABLE_MIN_SLOTS);
 	size_t i;
 
-	for (i = 0; i < (cache->size_mask + 1); ++i) {
-		if (cache->nodes[i] != NULL)
-			git_cached_obj_decref(cache->nodes[i], cache->free_obj);
-	}
+	GITERR_CHECK_ALLOC(empty);
+
+	git_memory_barrier();
+	shard_retire_table(shard, shard->table);
+	shard->table = empty;
+
+	for (i = 0; i < shard->length; ++i)
+		shard_retire(shard, shard->entries[i]);
 
-	git_mutex_free(&cache->lock);
-	git__free(cache->nodes);
+	shard->length = 0;
+	shard->hand = 0;
+	shard->used = 0;
+	memset(shard->used_by_type, 0x0, sizeof(shard->used_by_type));
+
+	shard_reclaim(cache, shard);
+	return 0;
 }
 
-void *git_cache_get(git_cache *cache, const git_oid *oid)
+void git_cache_clear(git_cache *cache)
 {
-	uint32_t hash;
-	git_cached_obj *node = NULL, *result = NULL;
+	int i;
 
-	memcpy(&hash, oid->id, sizeof(hash));
+	for (i = 0; i < GIT_CACHE_SHARDS; ++i) {
+		git_cache_shard *shard = &cache->shards[i];
 
-	if (git_mutex_lock(&cache->lock)) {
-		giterr_set(GITERR_THREAD, "unable to lock cache mutex");
-		return NULL;
+		if (git_mutex_lock(&shard->lock) < 0)
+			continue;
+		shard_clear(cache, shard);
+		git_mutex_unlock(&shard->lock);
+	}
+}
+
+/* Nobody may be using the cache anymore */
+void git_cache_free(git_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < GIT_CACHE_SHARDS; ++i) {
+		git_cache_shard *shard = &cache->shards[i];
+		size_t j;
+
+		if (shard->table == NULL)
+			continue;
+
+		for (j = 0; j < shard->length; ++j)
+			git_cached_obj_decref(shard->entries[j], cache->free_obj);
+
+		shard_free_retired(cache, shard, 0);
+		shard_free_retired(cache, shard, 1);
+
+		git__free(shard->table);
+		git__free(shard->entries);
+		git_mutex_free(&shard->lock);
 	}
+}
+
+/* Drop the entry at `pos`; the shard must be locked */
+static void shard_remove(git_cache_shard *shard, size_t pos)
+{
+	git_cached_obj *entry = shard->entries[pos];
 
-	{
-		node = cache->nodes[hash & cache->size_mask];
+	table_remove(shard->table, entry);
 
-		if (node != NULL && git_oid_cmp(&node->oid, oid) == 0) {
-			git_cached_obj_incref(node);
-			result = node;
+	shard->used -= entry->size;
+	shard->used_by_type[(int)entry->type] -= entry->size;
+	shard->entries[pos] = shard->entries[--shard->length];
+	shard->evictions++;
+
+	/* lookups may still be holding it */
+	shard_retire(shard, entry);
+}
+
+GIT_INLINE(bool) shard_over_type(git_cache *cache, git_cache_shard *shard, int type)
+{
+	return shard->used_by_type[type] > cache->type_limit[type] / GIT_CACHE_SHARDS;
+}
+
+GIT_INLINE(bool) shard_over(git_cache *cache, git_cache_shard *shard)
+{
+	return shard->used > cache->limit / GIT_CACHE_SHARDS;
+}
+
+/*
+ * Run the CLOCK hand until the shard fits its budget again. If only
+ * the budget for `type` is exceeded, only entries of that type are
+ * considered. Two full turns are enough to clear every second chance.
+ */
+static void shard_evict(git_cache *cache, git_cache_shard *shard, int type)
+{
+	size_t steps = shard->length * 2;
+
+	while (shard->length > 0 && steps-- > 0) {
+		git_cached_obj *entry;
+		bool over = shard_over(cache, shard);
+
+		if (!over && !(type > 0 && shard_over_type(cache, shard, type)))
+			break;
+
+		if (shard->hand >= shard->length)
+			shard->hand = 0;
+
+		entry = shard->entries[shard->hand];
+
+		if (!over && entry->type != type) {
+			shard->hand++;
+			continue;
+		}
+
+		if (entry->referenced) {
+			entry->referenced = 0;
+			shard->hand++;
+			continue;
 		}
+
+		shard_remove(shard, shard->hand);
+	}
+
+	shard_reclaim(cache, shard);
+}
+
+void *git_cache_get(git_cache *cache, const git_oid *oid)
+{
+	git_cache_shard *shard = SHARD_FOR(cache, oid);
+	git_cached_obj *result;
+	int epoch = shard_enter(shard);
+
+	result = table_lookup(shard->table, oid);
+	if (result != NULL) {
+		/* even if evicted meanwhile, the cache's reference is still there */
+		git_cached_obj_incref(result);
+
+		/* don't dirty the cache line when the bit is already set */
+		if (!result->referenced)
+			result->referenced = 1;
 	}
-	git_mutex_unlock(&cache->lock);
 
+	shard_leave(shard, epoch);
+
+	git_atomic_ssize_add(result ? &shard->hits : &shard->misses, 1);
 	return result;
 }
 
 void *git_cache_try_store(git_cache *cache, void *_entry)
 {
 	git_cached_obj *entry = _entry;
-	uint32_t hash;
+	git_cache_shard *shard = SHARD_FOR(cache, &entry->oid);
+	git_cached_obj *node;
+	int type = valid_type(entry->type) ? entry->type : 0;
 
-	memcpy(&hash, &entry->oid, sizeof(uint32_t));
+	/* objects that would take a whole shard aren't worth caching */
+	if (entry->size > cache->limit / GIT_CACHE_SHARDS ||
+		entry->size > cache->type_limit[type] / GIT_CACHE_SHARDS) {
+		git_cached_obj_incref(entry);
+		return entry;
+	}
 
-	if (git_mutex_lock(&cache->lock)) {
+	if (git_mutex_lock(&shard->lock)) {
 		giterr_set(GITERR_THREAD, "unable to lock cache mutex");
 		return NULL;
 	}
 
-	{
-		git_cached_obj *node = cache->nodes[hash & cache->size_mask];
-
-		/* increase the refcount on this object, because
-		 * the cache now owns it */
+	node = table_lookup(shard->table, &entry->oid);
+	if (node != NULL) {
+		/* somebody stored it first: use theirs */
 		git_cached_obj_incref(entry);
+		git_cached_obj_decref(entry, cache->free_obj);
+
+		node->referenced = 1;
+		git_cached_obj_incref(node);
+		git_mutex_unlock(&shard->lock);
+		return node;
+	}
 
-		if (node == NULL) {
-			cache->nodes[hash & cache->size_mask] = entry;
-		} else if (git_oid_cmp(&node->oid, &entry->oid) == 0) {
-			git_cached_obj_decref(entry, cache->free_obj);
-			entry = node;
-		} else {
-			git_cached_obj_decref(node, cache->free_obj);
-			cache->nodes[hash & cache->size_mask] = entry;
+	if (shard->length == shard->alloc) {
+		size_t alloc = shard->alloc ? shard->alloc * 2 : 32;
+		git_cached_obj **entries =
+			git__realloc(shard->entries, alloc * sizeof(git_cached_obj *));
+
+		if (entries == NULL) {
+			git_mutex_unlock(&shard->lock);
+			/* not cached, but still usable */
+			git_cached_obj_incref(entry);
+			return entry;
 		}
 
-		/* increase the refcount again, because we are
-		 * returning it to the user */
-		git_cached_obj_incref(entry);
+		shard->entries = entries;
+		shard->alloc = alloc;
+	}
 
+	if (shard_reserve(shard) < 0) {
+		git_mutex_unlock(&shard->lock);
+		git_cached_obj_incref(entry);
+		return entry;
 	}
-	git_mutex_unlock(&cache->lock);
+
+	/* one reference is owned by the cache */
+	git_cached_obj_incref(entry);
+	entry->type = (signed char)type;
+	entry->referenced = 1;
+	entry->retired_next = NULL;
+
+	/* and another one goes to the user */
+	git_cached_obj_incref(entry);
+
+	table_insert(shard->table, entry);
+	shard->entries[shard->length++] = entry;
+	shard->used += entry->size;
+	shard->used_by_type[type] += entry->size;
+
+	shard_evict(cache, shard, type);
+
+	git_mutex_unlock(&shard->lock);
 
 	return entry;
 }
+
+int git_cache_set_limit(git_cache *cache, git_otype type, size_t max_bytes)
+{
+	int i;
+
+	if (type == GIT_OBJ_ANY)
+		cache->limit = max_bytes;
+	else if (valid_type(type))
+		cache->type_limit[type] = max_bytes;
+	else {
+		giterr_set(GITERR_INVALID, "Invalid object type for the cache");
+		return -1;
+	}
+
+	for (i = 0; i < GIT_CACHE_SHARDS; ++i) {
+		git_cache_shard *shard = &cache->shards[i];
+
+		if (git_mutex_lock(&shard->lock) < 0) {
+			giterr_set(GITERR_THREAD, "unable to lock cache mutex");
+			return -1;
+		}
+		shard_evict(cache, shard, type == GIT_OBJ_ANY ? 0 : type);
+		git_mutex_unlock(&shard->lock);
+	}
+
+	return 0;
+}
+
+void git_cache_get_stats(git_cache_stats *out, git_cache *cache)
+{
+	int i;
+
+	memset(out, 0x0, sizeof(git_cache_stats));
+	out->limit = cache->limit;
+
+	for (i = 0; i < GIT_CACHE_SHARDS; ++i) {
+		git_cache_shard *shard = &cache->shards[i];
+
+		if (git_mutex_lock(&shard->lock) < 0)
+			continue;
+
+		out->count += shard->length;
+		out->used += shard->used;
+		out->hits += (size_t)shard->hits.val;
+		out->misses += (size_t)shard->misses.val;
+		out->evictions += shard->evictions;
+
+		git_mutex_unlock(&shard->lock);
+	}
+}
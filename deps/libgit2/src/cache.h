@@ -13,30 +13,86 @@
 
 #include "thread-utils.h"
 
-#define GIT_DEFAULT_CACHE_SIZE 128
+/* Default memory budget of a cache, in bytes */
+#define GIT_DEFAULT_CACHE_SIZE (32 * 1024 * 1024)
+
+/* Number of independently locked partitions (power of two) */
+#define GIT_CACHE_SHARDS 16
+
+/* Object types are used to index the per-type budgets */
+#define GIT_CACHE_TYPES (GIT_OBJ_REF_DELTA + 1)
 
 typedef void (*git_cached_obj_freeptr)(void *);
 
-typedef struct {
+typedef struct git_cached_obj {
 	git_oid oid;
 	git_atomic refcount;
+	size_t size;			/* approximate memory used, for the budget */
+	signed char type;		/* git_otype */
+	volatile char referenced;	/* CLOCK bit, set on every hit */
+
+	/* link in the shard's list of evicted entries waiting for readers */
+	struct git_cached_obj *retired_next;
 } git_cached_obj;
 
+/* Open-addressed table of entries, readable without the shard lock */
+typedef struct git_cache_table {
+	size_t mask;		/* number of slots - 1 */
+	size_t filled;		/* live entries and tombstones */
+	struct git_cache_table *retired_next;
+	git_cached_obj *volatile slots[GIT_FLEX_ARRAY];
+} git_cache_table;
+
 typedef struct {
-	git_cached_obj **nodes;
+	/* taken by writers only; readers go through `table` */
 	git_mutex lock;
+	git_cache_table *volatile table;
+
+	/*
+	 * Readers register in the current epoch. Entries and tables
+	 * dropped by writers are retired in that same epoch, and freed
+	 * once no reader is left in it.
+	 */
+	git_atomic epoch;
+	git_atomic readers[2];
+	git_cached_obj *retired[2];
+	git_cache_table *retired_tables[2];
+
+	/* all entries, swept by the CLOCK hand on eviction */
+	git_cached_obj **entries;
+	size_t length, alloc, hand;
+
+	size_t used;
+	size_t used_by_type[GIT_CACHE_TYPES];
+
+	git_atomic_ssize hits, misses;
+	size_t evictions;
+} git_cache_shard;
+
+typedef struct {
+	git_cache_shard shards[GIT_CACHE_SHARDS];
+
+	size_t limit;
+	size_t type_limit[GIT_CACHE_TYPES];
 
-	unsigned int lru_count;
-	size_t size_mask;
 	git_cached_obj_freeptr free_obj;
 } git_cache;
 
 int git_cache_init(git_cache *cache, size_t size, git_cached_obj_freeptr free_ptr);
 void git_cache_free(git_cache *cache);
+void git_cache_clear(git_cache *cache);
 
 void *git_cache_try_store(git_cache *cache, void *entry);
 void *git_cache_get(git_cache *cache, const git_oid *oid);
 
+/*
+ * Set the memory budget for objects of the given type, or
+ * the overall budget if `type` is GIT_OBJ_ANY. Entries over
+ * the new limits are evicted right away.
+ */
+int git_cache_set_limit(git_cache *cache, git_otype type, size_t max_bytes);
+void git_cache_get_stats(git_cache_stats *out, git_cache *cache);
+
 GIT_INLINE(void) git_cached_obj_incref(void *_obj)
 {
 	git_cached_obj *obj = _obj;
@@ -23,6 +23,31 @@
 #include "blob.h"
 #include "diff.h"
 #include "pathspec.h"
+#include "threadpool.h"
+#include "thread-utils.h"
+#include "checkout.h"
+
+/* 0 means one thread per CPU; see git_checkout__set_threads */
+static unsigned int checkout_threads = 1;
+
+void git_checkout__set_threads(unsigned int n)
+{
+	checkout_threads = n;
+}
+
+unsigned int git_checkout__default_threads(void)
+{
+	return checkout_threads;
+}
+
+unsigned int git_checkout__threads(void)
+{
+#ifdef GIT_THREADS
+	return checkout_threads ? checkout_threads : (unsigned int)git_online_cpus();
+#else
+	return 1;
+#endif
+}
 
 typedef struct {
 	git_repository *repo;
@@ -36,18 +61,15 @@ typedef struct {
 	size_t completed_steps;
 } checkout_diff_data;
 
+/* The directories leading to `path` have to exist already */
 static int buffer_to_file(
 	git_buf *buffer,
 	const char *path,
-	mode_t dir_mode,
 	int file_open_flags,
 	mode_t file_mode)
 {
 	int fd, error;
 
-	if ((error = git_futils_mkpath2file(path, dir_mode)) < 0)
-		return error;
-
 	if ((fd = p_open(path, file_open_flags, file_mode)) < 0) {
 		giterr_set(GITERR_OS, "Could not open '%s' for writing", path);
 		return fd;
@@ -69,42 +91,38 @@ static int buffer_to_file(
 	return error;
 }
 
-static int blob_content_to_file(
+static int load_filters(
+	git_vector *filters,
+	git_repository *repo,
+	const char *path,
+	git_checkout_opts *opts)
+{
+	if (opts->disable_filters)
+		return 0;
+
+	return git_filters_load(filters, repo, path, GIT_FILTER_TO_WORKTREE);
+}
+
+/* Write `blob` to `path` once `filters` were applied to it */
+static int filtered_blob_to_file(
 	git_blob *blob,
+	git_vector *filters,
 	const char *path,
 	mode_t entry_filemode,
 	git_checkout_opts *opts)
 {
-	int error = -1, nb_filters = 0;
+	int error;
 	mode_t file_mode = opts->file_mode;
-	bool dont_free_filtered = false;
 	git_buf unfiltered = GIT_BUF_INIT, filtered = GIT_BUF_INIT;
-	git_vector filters = GIT_VECTOR_INIT;
-
-	if (opts->disable_filters ||
-		(nb_filters = git_filters_load(
-			&filters,
-			git_object_owner((git_object *)blob),
-			path,
-			GIT_FILTER_TO_WORKTREE)) == 0) {
 
+	if (filters->length > 0) {
+		if ((error = git_blob__getbuf(&unfiltered, blob)) < 0 ||
+			(error = git_filters_apply(&filtered, &unfiltered, filters)) < 0)
+			goto cleanup;
+	} else {
 		/* Create a fake git_buf from the blob raw data... */
 		filtered.ptr = blob->odb_object->raw.data;
 		filtered.size = blob->odb_object->raw.len;
-
-		/* ... and make sure it doesn't get unexpectedly freed */
-		dont_free_filtered = true;
-	}
-
-	if (nb_filters < 0)
-		return nb_filters;
-
-	if (nb_filters > 0)	 {
-		if ((error = git_blob__getbuf(&unfiltered, blob)) < 0)
-			goto cleanup;
-
-		if ((error = git_filters_apply(&filtered, &unfiltered, &filters)) < 0)
-			goto cleanup;
 	}
 
 	/* Allow overriding of file mode */
@@ -112,17 +130,39 @@ static int blob_content_to_file(
 		file_mode = entry_filemode;
 
 	error = buffer_to_file(
-		&filtered, path, opts->dir_mode, opts->file_open_flags, file_mode);
+		&filtered, path, opts->file_open_flags, file_mode);
 
 cleanup:
-	git_filters_free(&filters);
 	git_buf_free(&unfiltered);
-	if (!dont_free_filtered)
+	/* ... and make sure it doesn't get unexpectedly freed */
+	if (filters->length > 0)
 		git_buf_free(&filtered);
 
 	return error;
 }
 
+static int blob_content_to_file(
+	git_blob *blob,
+	const char *path,
+	mode_t entry_filemode,
+	git_checkout_opts *opts)
+{
+	int error;
+	git_vector filters = GIT_VECTOR_INIT;
+
+	if ((error = load_filters(
+			&filters, git_object_owner((git_object *)blob), path, opts)) < 0)
+		return error;
+
+	if (!(error = git_futils_mkpath2file(path, opts->dir_mode)))
+		error = filtered_blob_to_file(
+			blob, &filters, path, entry_filemode, opts);
+
+	git_filters_free(&filters);
+
+	return error;
+}
+
 static int blob_content_to_link(
 	git_blob *blob, const char *path, bool can_symlink)
 {
@@ -167,14 +207,17 @@ static int checkout_submodule(
 	return 0;
 }
 
-static void report_progress(
+static int report_progress(
 	checkout_diff_data *data,
 	const char *path)
 {
-	if (data->opts->progress_cb)
+	if (data->opts->progress_cb &&
 		data->opts->progress_cb(
 			path, data->completed_steps, data->total_steps,
-			data->opts->progress_payload);
+			data->opts->progress_payload))
+		return GIT_EUSER;
+
+	return 0;
 }
 
 static int checkout_blob(
@@ -551,13 +594,271 @@ static int checkout_remove_the_old(
 				return error;
 
 			data->completed_steps++;
-			report_progress(data, delta->new_file.path);
+			if ((error = report_progress(data, delta->new_file.path)) < 0)
+				return error;
 		}
 	}
 
 	return 0;
 }
 
+/*
+ * Blobs are written on a pool of threads, which look them up, filter
+ * them and write them out. What can't be done on them is done before
+ * they're handed out, in the order of the diff: the filters are loaded
+ * (attributes can only be looked up from here), the directories are
+ * created, and links are written right away. Progress is reported here
+ * as well, in that same order, once each blob was written.
+ */
+typedef struct checkout_writer checkout_writer;
+
+typedef struct {
+	checkout_writer *writer;
+	const git_diff_file *file;
+	git_buf path;
+	git_vector filters;
+	bool done;
+	int error;
+	int error_class;
+	char *error_message; /* errors are per-thread */
+} checkout_blob_job;
+
+struct checkout_writer {
+	checkout_diff_data *data;
+	git_threadpool *pool;
+	git_vector jobs; /* in the order of the diff; NULL once reported */
+	size_t reported;
+	git_buf last_dir; /* the directory created last */
+	bool stop; /* the checkout failed, don't write what's left */
+
+#ifdef GIT_THREADS
+	git_mutex lock;
+	git_cond done;
+#endif
+};
+
+/* Keep up to that many blobs queued per thread */
+#define CHECKOUT_JOBS_PER_THREAD 16
+
+static void checkout_blob_job_run(void *payload)
+{
+	checkout_blob_job *job = payload;
+	checkout_writer *writer = job->writer;
+	checkout_diff_data *data = writer->data;
+	const git_error *err;
+	git_blob *blob;
+	bool stop;
+
+	git_mutex_lock(&writer->lock);
+	stop = writer->stop;
+	git_mutex_unlock(&writer->lock);
+
+	if (!stop &&
+		!(job->error = git_blob_lookup(&blob, data->repo, &job->file->oid))) {
+		if (S_ISLNK(job->file->mode))
+			job->error = blob_content_to_link(
+				blob, git_buf_cstr(&job->path), data->can_symlink);
+		else
+			job->error = filtered_blob_to_file(
+				blob, &job->filters, git_buf_cstr(&job->path),
+				job->file->mode, data->opts);
+
+		git_blob_free(blob);
+	}
+
+	if (job->error < 0 && (err = giterr_last()) != NULL) {
+		job->error_class = err->klass;
+		job->error_message = git__strdup(err->message);
+		giterr_clear();
+	}
+
+	git_mutex_lock(&writer->lock);
+	job->done = true;
+	git_cond_broadcast(&writer->done);
+	git_mutex_unlock(&writer->lock);
+}
+
+static void checkout_blob_job_free(checkout_blob_job *job)
+{
+	if (job == NULL)
+		return;
+
+	git_buf_free(&job->path);
+	git_filters_free(&job->filters);
+	git__free(job->error_message);
+	git__free(job);
+}
+
+static int checkout_writer_init(
+	checkout_writer *writer, checkout_diff_data *data, unsigned int nr_threads)
+{
+	git_odb *odb;
+
+	memset(writer, 0, sizeof(checkout_writer));
+	writer->data = data;
+	git_buf_init(&writer->last_dir, 0);
+
+#ifdef GIT_THREADS
+	git_mutex_init(&writer->lock);
+	git_cond_init(&writer->done);
+#endif
+
+	/* the threads only look it up */
+	if (git_repository_odb__weakptr(&odb, data->repo) < 0 ||
+		git_vector_init(&writer->jobs, 0, NULL) < 0)
+		return -1;
+
+	return git_threadpool_new(&writer->pool, nr_threads);
+}
+
+static void checkout_writer_free(checkout_writer *writer)
+{
+	size_t i;
+	checkout_blob_job *job;
+
+	if (writer->pool != NULL) {
+		git_mutex_lock(&writer->lock);
+		writer->stop = true;
+		git_mutex_unlock(&writer->lock);
+
+		/* runs whatever is left, so the jobs can go */
+		git_threadpool_free(writer->pool);
+	}
+
+	git_vector_foreach(&writer->jobs, i, job)
+		checkout_blob_job_free(job);
+
+	git_vector_free(&writer->jobs);
+	git_buf_free(&writer->last_dir);
+
+#ifdef GIT_THREADS
+	git_cond_free(&writer->done);
+	git_mutex_free(&writer->lock);
+#endif
+}
+
+/* Create the directories leading to `path`, unless they were just created */
+static int checkout_writer_mkpath(checkout_writer *writer, const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	size_t dir_len = slash ? (size_t)(slash - path) : 0;
+	int error;
+
+	if (dir_len == git_buf_len(&writer->last_dir) &&
+		!memcmp(path, git_buf_cstr(&writer->last_dir), dir_len))
+		return 0;
+
+	if ((error = git_futils_mkpath2file(
+			path, writer->data->opts->dir_mode)) < 0)
+		return error;
+
+	return git_buf_set(&writer->last_dir, path, dir_len);
+}
+
+/*
+ * Report the blobs which were written since the last time, in order;
+ * when `wait_until` is past them, wait for the ones before it
+ */
+static int checkout_writer_report(checkout_writer *writer, size_t wait_until)
+{
+	checkout_diff_data *data = writer->data;
+	checkout_blob_job *job;
+	int error;
+
+	while (writer->reported < writer->jobs.length) {
+		bool must_wait = writer->reported < wait_until;
+
+		job = git_vector_get(&writer->jobs, writer->reported);
+
+		git_mutex_lock(&writer->lock);
+		while (must_wait && !job->done)
+			git_cond_wait(&writer->done, &writer->lock);
+		must_wait = !job->done;
+		git_mutex_unlock(&writer->lock);
+
+		if (must_wait)
+			break;
+
+		if ((error = job->error) < 0) {
+			giterr_set(job->error_class ? job->error_class : GITERR_OS, "%s",
+				job->error_message ?
+				job->error_message : "Failed to write checked out file");
+			return error;
+		}
+
+		data->completed_steps++;
+		if ((error = report_progress(data, job->file->path)) < 0)
+			return error;
+
+		writer->jobs.contents[writer->reported++] = NULL;
+		checkout_blob_job_free(job);
+	}
+
+	return 0;
+}
+
+static int checkout_writer_add(
+	checkout_writer *writer, const git_diff_file *file, size_t window)
+{
+	checkout_diff_data *data = writer->data;
+	checkout_blob_job *job;
+
+	job = git__calloc(1, sizeof(checkout_blob_job));
+	GITERR_CHECK_ALLOC(job);
+
+	job->writer = writer;
+	job->file = file;
+
+	if (git_vector_insert(&writer->jobs, job) < 0) {
+		git__free(job);
+		return -1;
+	}
+
+	if (git_buf_put(&job->path, git_buf_cstr(data->path), data->workdir_len) < 0 ||
+		git_buf_puts(&job->path, file->path) < 0)
+		return -1;
+
+	if (S_ISLNK(file->mode))
+		/* links are few and small; they're written in order */
+		checkout_blob_job_run(job);
+	else if (load_filters(&job->filters,
+			data->repo, git_buf_cstr(&job->path), data->opts) < 0 ||
+		checkout_writer_mkpath(writer, git_buf_cstr(&job->path)) < 0 ||
+		git_threadpool_submit(writer->pool, checkout_blob_job_run, job) < 0)
+		return -1;
+
+	return checkout_writer_report(writer,
+		writer->jobs.length > window ? writer->jobs.length - window : 0);
+}
+
+static int checkout_create_the_new_threaded(
+	git_diff_list *diff,
+	unsigned int *actions,
+	checkout_diff_data *data,
+	unsigned int nr_threads)
+{
+	checkout_writer writer;
+	git_diff_delta *delta;
+	size_t i, window = nr_threads * CHECKOUT_JOBS_PER_THREAD;
+	int error;
+
+	if ((error = checkout_writer_init(&writer, data, nr_threads)) < 0)
+		goto cleanup;
+
+	git_vector_foreach(&diff->deltas, i, delta) {
+		if ((actions[i] & CHECKOUT_ACTION__UPDATE_BLOB) != 0 &&
+			(error = checkout_writer_add(
+				&writer, &delta->old_file, window)) < 0)
+			goto cleanup;
+	}
+
+	error = checkout_writer_report(&writer, writer.jobs.length);
+
+cleanup:
+	checkout_writer_free(&writer);
+	return error;
+}
+
 static int checkout_create_the_new(
 	git_diff_list *diff,
 	unsigned int *actions,
@@ -565,6 +866,11 @@ static int checkout_create_the_new(
 {
 	git_diff_delta *delta;
 	size_t i;
+	unsigned int nr_threads = git_checkout__threads();
+
+	if (nr_threads > 1)
+		return checkout_create_the_new_threaded(
+			diff, actions, data, nr_threads);
 
 	git_vector_foreach(&diff->deltas, i, delta) {
 		if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB) {
@@ -573,7 +879,8 @@ static int checkout_create_the_new(
 				return error;
 
 			data->completed_steps++;
-			report_progress(data, delta->old_file.path);
+			if ((error = report_progress(data, delta->old_file.path)) < 0)
+				return error;
 		}
 	}
 
@@ -595,7 +902,8 @@ static int checkout_create_submodules(
 				return error;
 
 			data->completed_steps++;
-			report_progress(data, delta->old_file.path);
+			if ((error = report_progress(data, delta->old_file.path)) < 0)
+				return error;
 		}
 	}
 
@@ -666,7 +974,9 @@ int git_checkout_index(
 	if ((error = retrieve_symlink_caps(repo, &data.can_symlink)) < 0)
 		goto cleanup;
 
-	report_progress(&data, NULL); /* establish 0 baseline */
+	/* establish 0 baseline */
+	if ((error = report_progress(&data, NULL)) < 0)
+		goto cleanup;
 
 	if (counts[CHECKOUT_ACTION__REMOVE] > 0 &&
 		(error = checkout_remove_the_old(diff, actions, &data)) < 0)
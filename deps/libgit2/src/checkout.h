@@ -0,0 +1,22 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_checkout_h__
+#define INCLUDE_checkout_h__
+
+#include "common.h"
+
+/*
+ * The number of threads checkouts write blobs out with; 0 means one
+ * per CPU
+ */
+extern void git_checkout__set_threads(unsigned int n);
+extern unsigned int git_checkout__default_threads(void);
+
+/* The same, resolved to an actual number of threads */
+extern unsigned int git_checkout__threads(void);
+
+#endif
@@ -0,0 +1,753 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "commit_graph.h"
+#include "fileops.h"
+#include "filebuf.h"
+#include "hash.h"
+#include "odb.h"
+#include "oidmap.h"
+#include "repository.h"
+#include "vector.h"
+
+#include "git2/commit.h"
+#include "git2/refs.h"
+
+GIT__USE_OIDMAP;
+
+#define COMMIT_GRAPH_SIGNATURE 0x43475048 /* "CGPH" */
+#define COMMIT_GRAPH_VERSION 1
+#define COMMIT_GRAPH_HASH_VERSION 1 /* SHA-1 */
+
+#define COMMIT_GRAPH_HEADER_SIZE 8
+#define COMMIT_GRAPH_CHUNK_ENTRY_SIZE 12
+
+#define CHUNK_OID_FANOUT 0x4f494446 /* "OIDF" */
+#define CHUNK_OID_LOOKUP 0x4f49444c /* "OIDL" */
+#define CHUNK_COMMIT_DATA 0x43444154 /* "CDAT" */
+#define CHUNK_EXTRA_EDGES 0x45444745 /* "EDGE" */
+
+#define OID_FANOUT_SIZE (256 * 4)
+#define COMMIT_DATA_SIZE (GIT_OID_RAWSZ + 16)
+
+#define PARENT_NONE 0x70000000
+#define PARENT_EXTRA_EDGES 0x80000000
+#define EDGE_LAST 0x80000000
+#define EDGE_MASK 0x7fffffff
+
+GIT_INLINE(uint32_t) get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+GIT_INLINE(void) put_be32(unsigned char *p, uint32_t n)
+{
+	p[0] = (unsigned char)(n >> 24);
+	p[1] = (unsigned char)(n >> 16);
+	p[2] = (unsigned char)(n >> 8);
+	p[3] = (unsigned char)n;
+}
+
+static int commit_graph_error(const char *message)
+{
+	giterr_set(GITERR_ODB, "Invalid commit-graph file - %s", message);
+	return -1;
+}
+
+/*
+ * Reading
+ */
+
+static int commit_graph_parse(git_commit_graph *graph)
+{
+	const unsigned char *data = graph->map.data, *table;
+	size_t len = graph->map.len, chunk_start, chunk_end, chunk_size;
+	uint32_t i, num_chunks, prev = 0;
+	git_oid checksum;
+
+	if (len < COMMIT_GRAPH_HEADER_SIZE + GIT_OID_RAWSZ)
+		return commit_graph_error("file is too short");
+
+	if (get_be32(data) != COMMIT_GRAPH_SIGNATURE ||
+		data[4] != COMMIT_GRAPH_VERSION ||
+		data[5] != COMMIT_GRAPH_HASH_VERSION)
+		return commit_graph_error("unsupported format");
+
+	/* split graphs (data[7] != 0) refer to other files */
+	if (data[7] != 0)
+		return commit_graph_error("base graphs are not supported");
+
+	num_chunks = data[6];
+	table = data + COMMIT_GRAPH_HEADER_SIZE;
+	if ((size_t)(num_chunks + 1) * COMMIT_GRAPH_CHUNK_ENTRY_SIZE >
+		len - COMMIT_GRAPH_HEADER_SIZE - GIT_OID_RAWSZ)
+		return commit_graph_error("chunk table is truncated");
+
+	for (i = 0; i < num_chunks; ++i) {
+		const unsigned char *entry = table + i * COMMIT_GRAPH_CHUNK_ENTRY_SIZE;
+		const unsigned char *next = entry + COMMIT_GRAPH_CHUNK_ENTRY_SIZE;
+
+		/* offsets are 64-bit, but the file was mmapped whole */
+		if (get_be32(entry + 4) != 0 || get_be32(next + 4) != 0)
+			return commit_graph_error("chunk offset is out of bounds");
+
+		chunk_start = get_be32(entry + 8);
+		chunk_end = get_be32(next + 8);
+		if (chunk_start < prev || chunk_end < chunk_start ||
+			chunk_end > len - GIT_OID_RAWSZ)
+			return commit_graph_error("chunk offset is out of bounds");
+
+		prev = (uint32_t)chunk_end;
+		chunk_size = chunk_end - chunk_start;
+
+		switch (get_be32(entry)) {
+		case CHUNK_OID_FANOUT:
+			if (chunk_size != OID_FANOUT_SIZE)
+				return commit_graph_error("fanout table has the wrong size");
+			graph->oid_fanout = data + chunk_start;
+			break;
+
+		case CHUNK_OID_LOOKUP:
+			if (chunk_size % GIT_OID_RAWSZ)
+				return commit_graph_error("OID table has the wrong size");
+			graph->oid_lookup = (const git_oid *)(data + chunk_start);
+			graph->num_commits = (uint32_t)(chunk_size / GIT_OID_RAWSZ);
+			break;
+
+		case CHUNK_COMMIT_DATA:
+			graph->commit_data = data + chunk_start;
+			break;
+
+		case CHUNK_EXTRA_EDGES:
+			if (chunk_size % 4)
+				return commit_graph_error("extra edges have the wrong size");
+			graph->extra_edges = data + chunk_start;
+			graph->num_extra_edges = (uint32_t)(chunk_size / 4);
+			break;
+
+		default:
+			/* unknown chunks are optional by definition */
+			break;
+		}
+	}
+
+	if (!graph->oid_fanout || !graph->oid_lookup || !graph->commit_data)
+		return commit_graph_error("missing required chunks");
+
+	/* the fanout is what bounds lookups, so it must agree with the rest */
+	for (i = 0, prev = 0; i < 256; ++i) {
+		uint32_t n = get_be32(graph->oid_fanout + i * 4);
+		if (n < prev)
+			return commit_graph_error("fanout table is not sorted");
+		prev = n;
+	}
+
+	if (prev != graph->num_commits)
+		return commit_graph_error("fanout table doesn't match the OIDs");
+
+	/* the trailer is the SHA-1 of everything before it */
+	if (git_hash_buf(&checksum, data, len - GIT_OID_RAWSZ) < 0)
+		return -1;
+	if (memcmp(checksum.id, data + len - GIT_OID_RAWSZ, GIT_OID_RAWSZ) != 0)
+		return commit_graph_error("checksum doesn't match");
+
+	for (i = 0; i < num_chunks; ++i) {
+		const unsigned char *entry = table + i * COMMIT_GRAPH_CHUNK_ENTRY_SIZE;
+		if (get_be32(entry) == CHUNK_COMMIT_DATA &&
+			get_be32(entry + COMMIT_GRAPH_CHUNK_ENTRY_SIZE + 8) - get_be32(entry + 8) !=
+			(size_t)graph->num_commits * COMMIT_DATA_SIZE)
+			return commit_graph_error("commit data has the wrong size");
+	}
+
+	return 0;
+}
+
+int git_commit_graph_open(git_commit_graph **out, const char *path)
+{
+	git_commit_graph *graph;
+	git_file fd;
+	git_off_t len;
+	int error;
+
+	if ((fd = git_futils_open_ro(path)) < 0)
+		return fd;
+
+	len = git_futils_filesize(fd);
+	if (len < COMMIT_GRAPH_HEADER_SIZE + GIT_OID_RAWSZ || !git__is_sizet(len)) {
+		p_close(fd);
+		return commit_graph_error("file is too short or too large");
+	}
+
+	graph = git__calloc(1, sizeof(git_commit_graph));
+	if (graph == NULL) {
+		p_close(fd);
+		return -1;
+	}
+
+	error = git_futils_mmap_ro(&graph->map, fd, 0, (size_t)len);
+	p_close(fd);
+
+	if (error < 0) {
+		git__free(graph);
+		return error;
+	}
+
+	if (commit_graph_parse(graph) < 0) {
+		git_futils_mmap_free(&graph->map);
+		git__free(graph);
+		return -1;
+	}
+
+	git_atomic_set(&graph->refcount, 1);
+	*out = graph;
+	return 0;
+}
+
+void git_commit_graph_free(git_commit_graph *graph)
+{
+	if (graph == NULL || git_atomic_dec(&graph->refcount) > 0)
+		return;
+
+	git_futils_mmap_free(&graph->map);
+	git__free(graph);
+}
+
+int git_commit_graph_find(
+	uint32_t *pos, const git_commit_graph *graph, const git_oid *oid)
+{
+	uint32_t lo, hi;
+	int first = oid->id[0];
+
+	lo = first ? get_be32(graph->oid_fanout + (first - 1) * 4) : 0;
+	hi = get_be32(graph->oid_fanout + first * 4);
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp = git_oid_cmp(oid, &graph->oid_lookup[mid]);
+
+		if (!cmp) {
+			*pos = mid;
+			return 0;
+		}
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+int git_commit_graph_entry_read(
+	git_commit_graph_entry *entry, const git_commit_graph *graph, uint32_t pos)
+{
+	const unsigned char *data;
+	uint32_t parent1, parent2, generation_time;
+
+	assert(pos < graph->num_commits);
+	data = graph->commit_data + (size_t)pos * COMMIT_DATA_SIZE;
+
+	memcpy(entry->tree.id, data, GIT_OID_RAWSZ);
+	parent1 = get_be32(data + GIT_OID_RAWSZ);
+	parent2 = get_be32(data + GIT_OID_RAWSZ + 4);
+	generation_time = get_be32(data + GIT_OID_RAWSZ + 8);
+
+	entry->generation = generation_time >> 2;
+	entry->time = ((git_time_t)(generation_time & 0x3) << 32) |
+		get_be32(data + GIT_OID_RAWSZ + 12);
+
+	entry->parents[0] = parent1;
+	entry->parents[1] = parent2;
+	entry->extra = 0;
+
+	if (parent1 == PARENT_NONE) {
+		entry->parent_count = 0;
+	} else if (parent2 == PARENT_NONE) {
+		entry->parent_count = 1;
+	} else if (!(parent2 & PARENT_EXTRA_EDGES)) {
+		entry->parent_count = 2;
+	} else {
+		uint32_t edge = parent2 & EDGE_MASK;
+
+		entry->extra = edge;
+		entry->parent_count = 1;
+
+		do {
+			if (edge >= graph->num_extra_edges)
+				return commit_graph_error("extra edges are truncated");
+			entry->parent_count++;
+		} while (!(get_be32(graph->extra_edges + 4 * edge++) & EDGE_LAST));
+	}
+
+	return 0;
+}
+
+int git_commit_graph_parent(
+	uint32_t *pos, const git_commit_graph *graph,
+	const git_commit_graph_entry *entry, size_t n)
+{
+	assert(n < entry->parent_count);
+
+	if (n < 2 && entry->parent_count <= 2)
+		*pos = entry->parents[n];
+	else if (n == 0)
+		*pos = entry->parents[0];
+	else
+		*pos = get_be32(graph->extra_edges + 4 * (entry->extra + n - 1)) & EDGE_MASK;
+
+	if (*pos >= graph->num_commits)
+		return commit_graph_error("parent is out of bounds");
+
+	return 0;
+}
+
+/*
+ * Writing
+ */
+
+typedef struct {
+	git_oid oid;
+	git_oid tree;
+	git_time_t time;
+	uint32_t generation;
+	uint32_t pos;
+	size_t parent_count;
+	git_oid *parents;
+} graph_commit;
+
+typedef struct {
+	git_repository *repo;
+	git_oidmap *map;
+	git_vector commits;
+	git_vector todo;
+	int error; /* from add_reference_tip */
+} graph_writer;
+
+static graph_commit *graph_commit_alloc(graph_writer *w, size_t parent_count)
+{
+	graph_commit *commit = git__calloc(1,
+		sizeof(graph_commit) + parent_count * sizeof(git_oid));
+
+	if (commit == NULL)
+		return NULL;
+
+	commit->parent_count = parent_count;
+	commit->parents = (git_oid *)(commit + 1);
+
+	if (git_vector_insert(&w->commits, commit) < 0) {
+		git__free(commit);
+		return NULL;
+	}
+
+	return commit;
+}
+
+static int graph_commit_register(graph_writer *w, graph_commit *commit)
+{
+	int ret;
+	khiter_t pos = kh_put(oid, w->map, &commit->oid, &ret);
+
+	if (ret < 0) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	kh_value(w->map, pos) = commit;
+	return 0;
+}
+
+static graph_commit *graph_commit_find(graph_writer *w, const git_oid *oid)
+{
+	khiter_t pos = kh_get(oid, w->map, oid);
+	return pos == kh_end(w->map) ? NULL : kh_value(w->map, pos);
+}
+
+/* every commit of the current graph goes into the new one, as is */
+static int add_graph_commits(graph_writer *w, git_commit_graph *graph)
+{
+	git_commit_graph_entry entry;
+	graph_commit *commit;
+	uint32_t i, parent;
+	size_t n;
+
+	for (i = 0; i < graph->num_commits; ++i) {
+		if (git_commit_graph_entry_read(&entry, graph, i) < 0 ||
+			(commit = graph_commit_alloc(w, entry.parent_count)) == NULL)
+			return -1;
+
+		git_oid_cpy(&commit->oid, git_commit_graph_oid(graph, i));
+		git_oid_cpy(&commit->tree, &entry.tree);
+		commit->time = entry.time;
+		commit->generation = entry.generation;
+
+		for (n = 0; n < entry.parent_count; ++n) {
+			if (git_commit_graph_parent(&parent, graph, &entry, n) < 0)
+				return -1;
+			git_oid_cpy(&commit->parents[n], git_commit_graph_oid(graph, parent));
+		}
+
+		if (graph_commit_register(w, commit) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int add_commit(graph_writer *w, const git_oid *oid)
+{
+	git_commit *object;
+	graph_commit *commit;
+	unsigned int n;
+	int error;
+
+	if (graph_commit_find(w, oid) != NULL)
+		return 0;
+
+	if ((error = git_commit_lookup(&object, w->repo, oid)) < 0)
+		return error;
+
+	commit = graph_commit_alloc(w, git_commit_parentcount(object));
+	if (commit == NULL) {
+		git_commit_free(object);
+		return -1;
+	}
+
+	git_oid_cpy(&commit->oid, oid);
+	git_oid_cpy(&commit->tree, git_commit_tree_id(object));
+	commit->time = git_commit_time(object);
+
+	for (n = 0; n < commit->parent_count; ++n)
+		git_oid_cpy(&commit->parents[n], git_commit_parent_id(object, n));
+
+	git_commit_free(object);
+
+	if (graph_commit_register(w, commit) < 0 ||
+		git_vector_insert(&w->todo, commit) < 0)
+		return -1;
+
+	return 0;
+}
+
+static int add_reference_tip(const char *name, void *payload)
+{
+	graph_writer *w = payload;
+	git_reference *ref;
+	git_object *peeled;
+	int error;
+
+	if (git_reference_lookup(&ref, w->repo, name) < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	/* references to anything but commits (or to nothing) are skipped */
+	error = git_reference_peel(&peeled, ref, GIT_OBJ_COMMIT);
+	git_reference_free(ref);
+
+	if (error < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	w->error = add_commit(w, git_object_id(peeled));
+	git_object_free(peeled);
+	return w->error;
+}
+
+static int add_reachable_commits(graph_writer *w)
+{
+	graph_commit *commit;
+	size_t n;
+
+	while ((commit = git_vector_last(&w->todo)) != NULL) {
+		git_vector_pop(&w->todo);
+
+		for (n = 0; n < commit->parent_count; ++n) {
+			if (add_commit(w, &commit->parents[n]) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* generation numbers: 1 for roots, one more than the highest parent otherwise */
+static int compute_generations(graph_writer *w)
+{
+	graph_commit *commit, *top, *parent;
+	unsigned int i;
+	size_t n;
+
+	git_vector_foreach(&w->commits, i, commit) {
+		if (commit->generation)
+			continue;
+
+		if (git_vector_insert(&w->todo, commit) < 0)
+			return -1;
+
+		while ((top = git_vector_last(&w->todo)) != NULL) {
+			uint32_t max = 0;
+			bool ready = true;
+
+			if (top->generation) {
+				git_vector_pop(&w->todo);
+				continue;
+			}
+
+			for (n = 0; n < top->parent_count; ++n) {
+				if ((parent = graph_commit_find(w, &top->parents[n])) == NULL)
+					return commit_graph_error("parent is missing");
+
+				if (!parent->generation) {
+					ready = false;
+					if (git_vector_insert(&w->todo, parent) < 0)
+						return -1;
+				} else if (parent->generation > max)
+					max = parent->generation;
+			}
+
+			if (ready) {
+				top->generation = max < GIT_COMMIT_GRAPH_GENERATION_MAX ?
+					max + 1 : GIT_COMMIT_GRAPH_GENERATION_MAX;
+				git_vector_pop(&w->todo);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int parent_pos(uint32_t *pos, graph_writer *w, const git_oid *oid)
+{
+	graph_commit *parent = graph_commit_find(w, oid);
+	if (parent == NULL)
+		return commit_graph_error("parent is missing");
+
+	*pos = parent->pos;
+	return 0;
+}
+
+static int write_chunk_entry(git_filebuf *file, uint32_t id, size_t offset)
+{
+	unsigned char entry[COMMIT_GRAPH_CHUNK_ENTRY_SIZE];
+
+	put_be32(entry, id);
+	put_be32(entry + 4, (uint32_t)((uint64_t)offset >> 32));
+	put_be32(entry + 8, (uint32_t)offset);
+
+	return git_filebuf_write(file, entry, sizeof(entry));
+}
+
+static int write_graph(git_filebuf *file, graph_writer *w)
+{
+	unsigned char header[COMMIT_GRAPH_HEADER_SIZE], data[COMMIT_DATA_SIZE];
+	graph_commit *commit;
+	git_oid checksum;
+	size_t num_edges = 0, offset, n;
+	uint32_t pos, fanout = 0, edge = 0;
+	unsigned int i;
+	int num_chunks, first = 0;
+
+	git_vector_foreach(&w->commits, i, commit) {
+		if (commit->parent_count > 2)
+			num_edges += commit->parent_count - 1;
+	}
+
+	num_chunks = num_edges ? 4 : 3;
+
+	put_be32(header, COMMIT_GRAPH_SIGNATURE);
+	header[4] = COMMIT_GRAPH_VERSION;
+	header[5] = COMMIT_GRAPH_HASH_VERSION;
+	header[6] = (unsigned char)num_chunks;
+	header[7] = 0;
+
+	if (git_filebuf_write(file, header, sizeof(header)) < 0)
+		return -1;
+
+	offset = COMMIT_GRAPH_HEADER_SIZE + (num_chunks + 1) * COMMIT_GRAPH_CHUNK_ENTRY_SIZE;
+
+	if (write_chunk_entry(file, CHUNK_OID_FANOUT, offset) < 0)
+		return -1;
+	offset += OID_FANOUT_SIZE;
+
+	if (write_chunk_entry(file, CHUNK_OID_LOOKUP, offset) < 0)
+		return -1;
+	offset += w->commits.length * GIT_OID_RAWSZ;
+
+	if (write_chunk_entry(file, CHUNK_COMMIT_DATA, offset) < 0)
+		return -1;
+	offset += w->commits.length * COMMIT_DATA_SIZE;
+
+	if (num_edges) {
+		if (write_chunk_entry(file, CHUNK_EXTRA_EDGES, offset) < 0)
+			return -1;
+		offset += num_edges * 4;
+	}
+
+	if (write_chunk_entry(file, 0, offset) < 0)
+		return -1;
+
+	/* OIDF */
+	i = 0;
+	for (first = 0; first < 256; ++first) {
+		unsigned char count[4];
+
+		while (i < w->commits.length &&
+			((graph_commit *)git_vector_get(&w->commits, i))->oid.id[0] == first) {
+			fanout++;
+			i++;
+		}
+
+		put_be32(count, fanout);
+		if (git_filebuf_write(file, count, sizeof(count)) < 0)
+			return -1;
+	}
+
+	/* OIDL */
+	git_vector_foreach(&w->commits, i, commit) {
+		if (git_filebuf_write(file, commit->oid.id, GIT_OID_RAWSZ) < 0)
+			return -1;
+	}
+
+	/* CDAT */
+	git_vector_foreach(&w->commits, i, commit) {
+		memcpy(data, commit->tree.id, GIT_OID_RAWSZ);
+		put_be32(data + GIT_OID_RAWSZ, PARENT_NONE);
+		put_be32(data + GIT_OID_RAWSZ + 4, PARENT_NONE);
+
+		if (commit->parent_count > 0) {
+			if (parent_pos(&pos, w, &commit->parents[0]) < 0)
+				return -1;
+			put_be32(data + GIT_OID_RAWSZ, pos);
+		}
+
+		if (commit->parent_count == 2) {
+			if (parent_pos(&pos, w, &commit->parents[1]) < 0)
+				return -1;
+			put_be32(data + GIT_OID_RAWSZ + 4, pos);
+		} else if (commit->parent_count > 2) {
+			put_be32(data + GIT_OID_RAWSZ + 4, PARENT_EXTRA_EDGES | edge);
+			edge += (uint32_t)(commit->parent_count - 1);
+		}
+
+		put_be32(data + GIT_OID_RAWSZ + 8, (commit->generation << 2) |
+			(uint32_t)(((uint64_t)commit->time >> 32) & 0x3));
+		put_be32(data + GIT_OID_RAWSZ + 12, (uint32_t)commit->time);
+
+		if (git_filebuf_write(file, data, sizeof(data)) < 0)
+			return -1;
+	}
+
+	/* EDGE */
+	git_vector_foreach(&w->commits, i, commit) {
+		for (n = 1; commit->parent_count > 2 && n < commit->parent_count; ++n) {
+			unsigned char entry[4];
+
+			if (parent_pos(&pos, w, &commit->parents[n]) < 0)
+				return -1;
+
+			put_be32(entry, n == commit->parent_count - 1 ? pos | EDGE_LAST : pos);
+			if (git_filebuf_write(file, entry, sizeof(entry)) < 0)
+				return -1;
+		}
+	}
+
+	git_filebuf_hash(&checksum, file);
+	return git_filebuf_write(file, checksum.id, GIT_OID_RAWSZ);
+}
+
+static int graph_commit_cmp(const void *a, const void *b)
+{
+	return git_oid_cmp(&((const graph_commit *)a)->oid, &((const graph_commit *)b)->oid);
+}
+
+int git_commit_graph_write(
+	size_t *count, git_repository *repo, const git_oid *tips, size_t length)
+{
+	graph_writer w;
+	git_commit_graph *graph = NULL;
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	graph_commit *commit;
+	unsigned int i;
+	int error = -1;
+
+	memset(&w, 0x0, sizeof(w));
+	w.repo = repo;
+
+	if ((w.map = git_oidmap_alloc()) == NULL) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	if (git_vector_init(&w.commits, 0, graph_commit_cmp) < 0 ||
+		git_vector_init(&w.todo, 0, NULL) < 0)
+		goto cleanup;
+
+	/* a broken graph is rebuilt from scratch rather than refreshed */
+	if (git_repository__commit_graph(&graph, repo) < 0)
+		giterr_clear();
+
+	if (graph != NULL && add_graph_commits(&w, graph) < 0)
+		goto cleanup;
+
+	if (tips != NULL) {
+		for (i = 0; i < length; ++i) {
+			if ((error = add_commit(&w, &tips[i])) < 0)
+				goto cleanup;
+		}
+	} else if ((error = git_reference_foreach(
+			repo, GIT_REF_LISTALL, add_reference_tip, &w)) < 0) {
+		if (error == GIT_EUSER)
+			error = w.error;
+		goto cleanup;
+	}
+
+	if ((error = add_reachable_commits(&w)) < 0)
+		goto cleanup;
+
+	error = -1;
+
+	if (compute_generations(&w) < 0)
+		goto cleanup;
+
+	git_vector_sort(&w.commits);
+	git_vector_foreach(&w.commits, i, commit)
+		commit->pos = i;
+
+	if (git_buf_joinpath(&path, repo->path_repository, GIT_OBJECTS_DIR) < 0 ||
+		git_buf_puts(&path, GIT_COMMIT_GRAPH_FILE) < 0 ||
+		git_futils_mkpath2file(path.ptr, GIT_OBJECT_DIR_MODE) < 0 ||
+		git_filebuf_open(&file, path.ptr, GIT_FILEBUF_HASH_CONTENTS) < 0)
+		goto cleanup;
+
+	if (write_graph(&file, &w) < 0 ||
+		git_filebuf_commit(&file, GIT_OBJECT_FILE_MODE) < 0)
+		goto cleanup;
+
+	git_repository__commit_graph_reset(repo);
+
+	if (count)
+		*count = w.commits.length;
+	error = 0;
+
+cleanup:
+	git_filebuf_cleanup(&file);
+	git_buf_free(&path);
+	git_commit_graph_free(graph);
+
+	git_vector_foreach(&w.commits, i, commit)
+		git__free(commit);
+	git_vector_free(&w.commits);
+	git_vector_free(&w.todo);
+	git_oidmap_free(w.map);
+
+	return error;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_commit_graph_h__
+#define INCLUDE_commit_graph_h__
+
+#include "common.h"
+#include "map.h"
+#include "thread-utils.h"
+#include "git2/oid.h"
+#include "git2/types.h"
+
+/*
+ * The commit-graph file (objects/info/commit-graph), in the same format
+ * core Git writes: the parents, commit time, tree and generation number
+ * of every commit in it, so history can be walked without reading and
+ * parsing the commits themselves. The set of commits is closed: every
+ * parent of a commit in the graph is in the graph too.
+ */
+
+#define GIT_COMMIT_GRAPH_FILE "info/commit-graph"
+
+#define GIT_COMMIT_GRAPH_GENERATION_MAX 0x3FFFFFFF
+
+typedef struct {
+	git_atomic refcount;
+	git_map map;
+
+	const unsigned char *oid_fanout;
+	const git_oid *oid_lookup;
+	const unsigned char *commit_data;
+	const unsigned char *extra_edges;
+	uint32_t num_commits;
+	uint32_t num_extra_edges;
+} git_commit_graph;
+
+typedef struct {
+	git_oid tree;
+	git_time_t time;
+	uint32_t generation; /* 0 if the writer didn't compute them */
+	size_t parent_count;
+
+	/*
+	 * graph positions of the first two parents; when there are more than
+	 * two, the second and later ones are in the extra edges list, starting
+	 * at `extra`. See git_commit_graph_parent.
+	 */
+	uint32_t parents[2];
+	uint32_t extra;
+} git_commit_graph_entry;
+
+/* Maps the file at `path`; GIT_ENOTFOUND if there's none */
+extern int git_commit_graph_open(git_commit_graph **out, const char *path);
+extern void git_commit_graph_free(git_commit_graph *graph);
+
+/* Finds the position of a commit; GIT_ENOTFOUND if it's not in the graph */
+extern int git_commit_graph_find(
+	uint32_t *pos, const git_commit_graph *graph, const git_oid *oid);
+
+GIT_INLINE(const git_oid *) git_commit_graph_oid(
+	const git_commit_graph *graph, uint32_t pos)
+{
+	return &graph->oid_lookup[pos];
+}
+
+extern int git_commit_graph_entry_read(
+	git_commit_graph_entry *entry, const git_commit_graph *graph, uint32_t pos);
+
+/* Position of the n-th parent, or -1 if the file is corrupted */
+extern int git_commit_graph_parent(
+	uint32_t *pos, const git_commit_graph *graph,
+	const git_commit_graph_entry *entry, size_t n);
+
+/*
+ * Writes a new graph file for the given repository with every commit of
+ * the current one (whose data is reused as is) plus every commit
+ * reachable from `tips`.
+ */
+extern int git_commit_graph_write(
+	size_t *count, git_repository *repo, const git_oid *tips, size_t length);
+
+#endif
@@ -10,6 +10,7 @@
 #include "revwalk.h"
 #include "pool.h"
 #include "odb.h"
+#include "vector.h"
 
 int git_commit_list_time_cmp(void *a, void *b)
 {
@@ -19,6 +20,22 @@ int git_commit_list_time_cmp(void *a, void *b)
 	return (commit_a->time < commit_b->time);
 }
 
+/*
+ * Unlike commit times, generation numbers never go backwards: every
+ * parent sorts after its children. Times only break ties, and order
+ * the commits that aren't in the commit-graph, which come first.
+ */
+int git_commit_list_generation_cmp(void *a, void *b)
+{
+	git_commit_list_node *commit_a = (git_commit_list_node *)a;
+	git_commit_list_node *commit_b = (git_commit_list_node *)b;
+
+	if (commit_a->generation != commit_b->generation)
+		return (commit_a->generation < commit_b->generation);
+
+	return (commit_a->time < commit_b->time);
+}
+
 git_commit_list *git_commit_list_insert(git_commit_list_node *item, git_commit_list **list_p)
 {
 	git_commit_list *new_list = git__malloc(sizeof(git_commit_list));
@@ -35,8 +52,9 @@ git_commit_list *git_commit_list_insert_by_date(git_commit_list_node *item, git_
 	git_commit_list **pp = list_p;
 	git_commit_list *p;
 
+	/* newest first; the cmp is a boolean, "p is older than item" */
 	while ((p = *pp) != NULL) {
-		if (git_commit_list_time_cmp(p->item, item) < 0)
+		if (git_commit_list_time_cmp(p->item, item))
 			break;
 
 		pp = &p->next;
@@ -167,6 +185,37 @@ static int commit_quick_parse(git_revwalk *walk, git_commit_list_node *commit, g
 		return commit_error(commit, "cannot parse commit time");
 
 	commit->time = (time_t)commit_time;
+	commit->generation = GENERATION_INFINITY;
+	commit->parsed = 1;
+	return 0;
+}
+
+static int commit_parse_from_graph(git_revwalk *walk, git_commit_list_node *commit, uint32_t pos)
+{
+	git_commit_graph_entry entry;
+	uint32_t parent;
+	size_t i;
+
+	if (git_commit_graph_entry_read(&entry, walk->graph, pos) < 0)
+		return -1;
+
+	commit->parents = alloc_parents(walk, commit, entry.parent_count);
+	GITERR_CHECK_ALLOC(commit->parents);
+
+	for (i = 0; i < entry.parent_count; ++i) {
+		if (git_commit_graph_parent(&parent, walk->graph, &entry, i) < 0)
+			return -1;
+
+		commit->parents[i] = git_revwalk__commit_lookup(
+			walk, git_commit_graph_oid(walk->graph, parent));
+		if (commit->parents[i] == NULL)
+			return -1;
+	}
+
+	commit->out_degree = (unsigned short)entry.parent_count;
+	commit->time = entry.time;
+	/* older writers leave generations at zero */
+	commit->generation = entry.generation ? entry.generation : GENERATION_INFINITY;
 	commit->parsed = 1;
 	return 0;
 }
@@ -174,11 +223,15 @@ static int commit_quick_parse(git_revwalk *walk, git_commit_list_node *commit, g
 int git_commit_list_parse(git_revwalk *walk, git_commit_list_node *commit)
 {
 	git_odb_object *obj;
+	uint32_t pos;
 	int error;
 
 	if (commit->parsed)
 		return 0;
 
+	if (walk->graph && git_commit_graph_find(&pos, walk->graph, &commit->oid) == 0)
+		return commit_parse_from_graph(walk, commit, pos);
+
 	if ((error = git_odb_read(&obj, walk->odb, &commit->oid)) < 0)
 		return error;
 
@@ -192,3 +245,58 @@ int git_commit_list_parse(git_revwalk *walk, git_commit_list_node *commit)
 	return error;
 }
 
+/*
+ * Gives `commit` and its history a generation number. Those in the
+ * commit-graph have one already, so with an up to date graph this only
+ * walks the newest commits; without one it walks the whole history.
+ */
+int git_commit_list_generations(git_revwalk *walk, git_commit_list_node *commit)
+{
+	git_vector stack;
+	git_commit_list_node *top, *parent;
+	unsigned short i;
+	int error;
+
+	if ((error = git_commit_list_parse(walk, commit)) < 0)
+		return error;
+
+	if (commit->generation != GENERATION_INFINITY)
+		return 0;
+
+	if (git_vector_init(&stack, 32, NULL) < 0 ||
+		git_vector_insert(&stack, commit) < 0)
+		return -1;
+
+	while ((top = git_vector_last(&stack)) != NULL) {
+		uint32_t max = 0;
+		bool ready = true;
+
+		if (top->generation != GENERATION_INFINITY) {
+			git_vector_pop(&stack);
+			continue;
+		}
+
+		for (i = 0; i < top->out_degree; ++i) {
+			parent = top->parents[i];
+
+			if ((error = git_commit_list_parse(walk, parent)) < 0)
+				goto done;
+
+			if (parent->generation == GENERATION_INFINITY) {
+				ready = false;
+				if ((error = git_vector_insert(&stack, parent)) < 0)
+					goto done;
+			} else if (parent->generation > max)
+				max = parent->generation;
+		}
+
+		if (ready) {
+			top->generation = max + 1;
+			git_vector_pop(&stack);
+		}
+	}
+
+done:
+	git_vector_free(&stack);
+	return error;
+}
@@ -14,13 +14,17 @@
 #define RESULT   (1 << 2)
 #define STALE    (1 << 3)
 
+/* for commits that aren't in the commit-graph */
+#define GENERATION_INFINITY 0xFFFFFFFF
+
 #define PARENTS_PER_COMMIT	2
 #define COMMIT_ALLOC \
 	(sizeof(git_commit_list_node) + PARENTS_PER_COMMIT * sizeof(git_commit_list_node *))
 
 typedef struct git_commit_list_node {
 	git_oid oid;
-	uint32_t time;
+	git_time_t time;
+	uint32_t generation;
 	unsigned int seen:1,
 			 uninteresting:1,
 			 topo_delay:1,
@@ -40,10 +44,12 @@ typedef struct git_commit_list {
 
 git_commit_list_node *git_commit_list_alloc_node(git_revwalk *walk);
 int git_commit_list_time_cmp(void *a, void *b);
+int git_commit_list_generation_cmp(void *a, void *b);
 void git_commit_list_free(git_commit_list **list_p);
 git_commit_list *git_commit_list_insert(git_commit_list_node *item, git_commit_list **list_p);
 git_commit_list *git_commit_list_insert_by_date(git_commit_list_node *item, git_commit_list **list_p);
 int git_commit_list_parse(git_revwalk *walk, git_commit_list_node *commit);
+int git_commit_list_generations(git_revwalk *walk, git_commit_list_node *commit);
 git_commit_list_node *git_commit_list_pop(git_commit_list **stack);
 
 #endif
@@ -51,9 +51,21 @@ static git_cvar_map _cvar_map_autocrlf[] = {
 	{GIT_CVAR_STRING, "input", GIT_AUTO_CRLF_INPUT}
 };
 
+/*
+ *	core.untrackedCache
+ *		Whether what the directories of the working directory contain is
+ *	kept in the index, for the ones which didn't change not to be read
+ *	again.
+ */
+static git_cvar_map _cvar_map_untracked_cache[] = {
+	{GIT_CVAR_FALSE, NULL, GIT_UNTRACKED_CACHE_FALSE},
+	{GIT_CVAR_TRUE, NULL, GIT_UNTRACKED_CACHE_TRUE}
+};
+
 static struct map_data _cvar_maps[] = {
 	{"core.autocrlf", _cvar_map_autocrlf, ARRAY_SIZE(_cvar_map_autocrlf), GIT_AUTO_CRLF_DEFAULT},
-	{"core.eol", _cvar_map_eol, ARRAY_SIZE(_cvar_map_eol), GIT_EOL_DEFAULT}
+	{"core.eol", _cvar_map_eol, ARRAY_SIZE(_cvar_map_eol), GIT_EOL_DEFAULT},
+	{"core.untrackedcache", _cvar_map_untracked_cache, ARRAY_SIZE(_cvar_map_untracked_cache), GIT_UNTRACKED_CACHE_DEFAULT}
 };
 
 int git_repository__cvar(int *out, git_repository *repo, git_cvar_cached cvar)
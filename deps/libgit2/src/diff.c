@@ -11,6 +11,7 @@
 #include "attr_file.h"
 #include "filter.h"
 #include "pathspec.h"
+#include "threadpool.h"
 
 static git_diff_delta *diff_delta__alloc(
 	git_diff_list *diff,
@@ -400,6 +401,166 @@ cleanup:
 	return result;
 }
 
+/*
+ * With several workdir threads, the files whose stat data changed are
+ * hashed on them: their deltas are recorded as modified meanwhile and
+ * settled once the walk is over.
+ */
+typedef struct {
+	git_diff_delta *delta;
+	git_diff_file *file; /* the side of the delta from the workdir */
+	git_buf full_path;
+	size_t size;
+	git_vector filters;
+
+	git_oid oid;
+	int error;
+	int error_class;
+	char *error_message; /* errors are per-thread */
+} diff_hash_job;
+
+typedef struct {
+	unsigned int nr_threads;
+	git_threadpool *pool;
+	git_vector jobs;
+} diff_hasher;
+
+static void diff_hash_job_run(void *payload)
+{
+	diff_hash_job *job = payload;
+	const git_error *err;
+	int fd;
+
+	if ((fd = git_futils_open_ro(job->full_path.ptr)) < 0)
+		job->error = fd;
+	else {
+		job->error = git_odb__hashfd_filtered(
+			&job->oid, fd, job->size, GIT_OBJ_BLOB, &job->filters);
+		p_close(fd);
+	}
+
+	if (job->error < 0 && (err = giterr_last()) != NULL) {
+		job->error_class = err->klass;
+		job->error_message = git__strdup(err->message);
+		giterr_clear();
+	}
+}
+
+static void diff_hasher_free(diff_hasher *hasher)
+{
+	unsigned int i;
+	diff_hash_job *job;
+
+	/* runs whatever is left, so the jobs can go */
+	git_threadpool_free(hasher->pool);
+	hasher->pool = NULL;
+
+	git_vector_foreach(&hasher->jobs, i, job) {
+		git_buf_free(&job->full_path);
+		git_filters_free(&job->filters);
+		git__free(job->error_message);
+		git__free(job);
+	}
+
+	git_vector_free(&hasher->jobs);
+}
+
+/*
+ * Record `nitem` with the given status, and queue it to be hashed;
+ * returns 1 if it's a file which can't be hashed that way
+ */
+static int diff_hasher_defer(
+	diff_hasher *hasher,
+	git_diff_list *diff,
+	git_delta_t status,
+	const git_index_entry *oitem,
+	uint32_t omode,
+	const git_index_entry *nitem,
+	uint32_t nmode)
+{
+	diff_hash_job *job;
+
+	if (!S_ISREG(nitem->mode) || !git__is_sizet(nitem->file_size))
+		return 1;
+
+	if (hasher->pool == NULL &&
+		(git_vector_init(&hasher->jobs, 0, NULL) < 0 ||
+		 git_threadpool_new(&hasher->pool, hasher->nr_threads) < 0))
+		return -1;
+
+	if (diff_delta__from_two(
+			diff, status, oitem, omode, nitem, nmode, NULL) < 0)
+		return -1;
+
+	job = git__calloc(1, sizeof(diff_hash_job));
+	GITERR_CHECK_ALLOC(job);
+
+	job->delta = git_vector_last(&diff->deltas);
+	job->file = (diff->opts.flags & GIT_DIFF_REVERSE) != 0 ?
+		&job->delta->old_file : &job->delta->new_file;
+	job->size = (size_t)nitem->file_size;
+
+	/* attributes can only be looked up from here */
+	if (git_vector_insert(&hasher->jobs, job) < 0) {
+		git__free(job);
+		return -1;
+	}
+
+	if (git_buf_joinpath(&job->full_path,
+			git_repository_workdir(diff->repo), nitem->path) < 0 ||
+		git_filters_load(
+			&job->filters, diff->repo, nitem->path, GIT_FILTER_TO_ODB) < 0)
+		return -1;
+
+	return git_threadpool_submit(hasher->pool, diff_hash_job_run, job);
+}
+
+/* Wait for the files to be hashed, and drop those which didn't change */
+static int diff_hasher_settle(diff_hasher *hasher, git_diff_list *diff)
+{
+	unsigned int i, j;
+	diff_hash_job *job;
+	git_diff_delta *delta;
+
+	if (hasher->pool == NULL)
+		return 0;
+
+	git_threadpool_wait(hasher->pool);
+
+	git_vector_foreach(&hasher->jobs, i, job) {
+		git_diff_file *other = (job->file == &job->delta->new_file) ?
+			&job->delta->old_file : &job->delta->new_file;
+
+		if (job->error < 0) {
+			giterr_set(job->error_class ? job->error_class : GITERR_OS, "%s",
+				job->error_message ? job->error_message : "Failed to hash file");
+			return -1;
+		}
+
+		git_oid_cpy(&job->file->oid, &job->oid);
+		job->file->flags |= GIT_DIFF_FILE_VALID_OID;
+
+		if (job->delta->status == GIT_DELTA_MODIFIED &&
+			job->delta->old_file.mode == job->delta->new_file.mode &&
+			git_oid_equal(&other->oid, &job->oid))
+			job->delta->status =
+				(diff->opts.flags & GIT_DIFF_INCLUDE_UNMODIFIED) != 0 ?
+				GIT_DELTA_UNMODIFIED : GIT_DELTA__TO_DELETE;
+	}
+
+	for (i = 0, j = 0; j < diff->deltas.length; ++j) {
+		delta = diff->deltas.contents[j];
+
+		if (delta->status == GIT_DELTA__TO_DELETE)
+			git__free(delta);
+		else
+			diff->deltas.contents[i++] = delta;
+	}
+	diff->deltas.length = i;
+
+	return 0;
+}
+
 #define MODE_BITS_MASK 0000777
 
 static int maybe_modified(
@@ -407,7 +568,8 @@ static int maybe_modified(
 	const git_index_entry *oitem,
 	git_iterator *new_iter,
 	const git_index_entry *nitem,
-	git_diff_list *diff)
+	git_diff_list *diff,
+	diff_hasher *hasher)
 {
 	git_oid noid, *use_noid = NULL;
 	git_delta_t status = GIT_DELTA_MODIFIED;
@@ -510,6 +672,13 @@ static int maybe_modified(
 	 * haven't calculated the OID of the new item, then calculate it now
 	 */
 	if (status != GIT_DELTA_UNMODIFIED && git_oid_iszero(&nitem->oid)) {
+		if (!use_noid && hasher->nr_threads > 1 && new_is_workdir) {
+			int error = diff_hasher_defer(
+				hasher, diff, status, oitem, omode, nitem, nmode);
+			if (error <= 0)
+				return error;
+		}
+
 		if (!use_noid) {
 			if (git_diff__oid_for_file(diff->repo,
 					nitem->path, nitem->mode, nitem->file_size, &noid) < 0)
@@ -581,9 +750,14 @@ int git_diff__from_iterators(
 	const git_index_entry *oitem, *nitem;
 	git_buf ignore_prefix = GIT_BUF_INIT;
 	git_diff_list *diff = git_diff_list_alloc(repo, opts);
+	diff_hasher hasher;
 
 	*diff_ptr = NULL;
 
+	memset(&hasher, 0x0, sizeof(hasher));
+	if (new_iter->type == GIT_ITERATOR_WORKDIR)
+		hasher.nr_threads = git_iterator__workdir_threads();
+
 	if (!diff ||
 		diff_list_init_from_iterators(diff, old_iter, new_iter) < 0)
 		goto fail;
@@ -731,16 +905,22 @@ int git_diff__from_iterators(
 		else {
 			assert(oitem && nitem && cmp == 0);
 
-			if (maybe_modified(old_iter, oitem, new_iter, nitem, diff) < 0 ||
+			if (maybe_modified(
+					old_iter, oitem, new_iter, nitem, diff, &hasher) < 0 ||
 				git_iterator_advance(old_iter, &oitem) < 0 ||
 				git_iterator_advance(new_iter, &nitem) < 0)
 				goto fail;
 		}
 	}
 
+	if (diff_hasher_settle(&hasher, diff) < 0)
+		goto fail;
+
 	*diff_ptr = diff;
 
 fail:
+	diff_hasher_free(&hasher);
+
 	if (!*diff_ptr) {
 		git_diff_list_free(diff);
 		error = -1;
@@ -6,7 +6,13 @@
  */
 #include "common.h"
 #include "diff.h"
+#include "hashsig.h"
+#include "oidmap.h"
+#include "fileops.h"
 #include "git2/config.h"
+#include "git2/blob.h"
+
+GIT__USE_OIDMAP;
 
 static git_diff_delta *diff_delta__dup(
 	const git_diff_delta *d, git_pool *pool)
@@ -284,21 +290,493 @@ static int apply_splits_and_deletes(git_diff_list *diff, size_t expected_size)
 	return 0;
 }
 
-static unsigned int calc_similarity(
-	void *cache, git_diff_file *old_file, git_diff_file *new_file)
+/*
+ * Content signatures, computed at most once per blob while looking
+ * for renames. Files read from the working directory have no OID to
+ * key on, so theirs are kept aside.
+ */
+typedef struct {
+	git_diff_list *diff;
+	git_oidmap *sigs;
+	git_vector uncached;
+} diff_sig_cache;
+
+static int diff_sig_cache_init(diff_sig_cache *cache, git_diff_list *diff)
+{
+	cache->diff = diff;
+	cache->sigs = git_oidmap_alloc();
+	GITERR_CHECK_ALLOC(cache->sigs);
+
+	return git_vector_init(&cache->uncached, 0, NULL);
+}
+
+static void diff_sig_cache_free(diff_sig_cache *cache)
+{
+	git_hashsig *sig;
+	size_t i;
+
+	kh_foreach_value(cache->sigs, sig, git_hashsig_free(sig));
+	git_oidmap_free(cache->sigs);
+
+	git_vector_foreach(&cache->uncached, i, sig)
+		git_hashsig_free(sig);
+	git_vector_free(&cache->uncached);
+}
+
+GIT_INLINE(bool) diff_file_has_oid(const git_diff_file *file)
 {
-	GIT_UNUSED(cache);
+	return (file->flags & GIT_DIFF_FILE_VALID_OID) != 0 &&
+		!git_oid_iszero(&file->oid);
+}
+
+static int diff_sig_from_blob(
+	git_hashsig **out, diff_sig_cache *cache, const git_diff_file *file)
+{
+	git_blob *blob;
+	khiter_t pos;
+	int error;
+
+	pos = kh_get(oid, cache->sigs, &file->oid);
+	if (pos != kh_end(cache->sigs)) {
+		*out = kh_val(cache->sigs, pos);
+		return 0;
+	}
+
+	if ((error = git_blob_lookup(&blob, cache->diff->repo, &file->oid)) < 0)
+		return error;
+
+	error = git_hashsig_create(out,
+		git_blob_rawcontent(blob), (size_t)git_blob_rawsize(blob));
+	git_blob_free(blob);
+
+	if (error < 0)
+		return error;
+
+	git_oid_cpy(&(*out)->oid, &file->oid);
+	pos = kh_put(oid, cache->sigs, &(*out)->oid, &error);
+	if (error < 0) {
+		git_hashsig_free(*out);
+		*out = NULL;
+		return -1;
+	}
+	kh_val(cache->sigs, pos) = *out;
+
+	return 0;
+}
+
+static int diff_sig_from_workdir(
+	git_hashsig **out, diff_sig_cache *cache, const git_diff_file *file)
+{
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	int error;
+
+	if ((error = git_buf_joinpath(&path,
+			git_repository_workdir(cache->diff->repo), file->path)) < 0 ||
+		(error = git_futils_readbuffer(&content, path.ptr)) < 0)
+		goto cleanup;
+
+	if ((error = git_hashsig_create(out, content.ptr, content.size)) < 0)
+		goto cleanup;
+
+	if ((error = git_vector_insert(&cache->uncached, *out)) < 0) {
+		git_hashsig_free(*out);
+		*out = NULL;
+	}
+
+cleanup:
+	git_buf_free(&path);
+	git_buf_free(&content);
+	return error;
+}
+
+/*
+ * Get the signature of one side of a delta. Files we can't read
+ * (submodules, links, missing objects) get no signature and are
+ * simply never similar to anything.
+ */
+static int diff_sig_for_file(
+	git_hashsig **out,
+	diff_sig_cache *cache,
+	const git_diff_file *file,
+	git_iterator_type_t src)
+{
+	int error = 0;
+
+	*out = NULL;
+
+	if (GIT_MODE_TYPE(file->mode) != GIT_MODE_TYPE(GIT_FILEMODE_BLOB))
+		return 0;
+
+	if (diff_file_has_oid(file))
+		error = diff_sig_from_blob(out, cache, file);
+	else if (src == GIT_ITERATOR_WORKDIR)
+		error = diff_sig_from_workdir(out, cache, file);
+
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+	}
+
+	return error;
+}
+
+static int calc_similarity(
+	unsigned int *out,
+	diff_sig_cache *cache,
+	git_diff_file *old_file,
+	git_diff_file *new_file)
+{
+	git_hashsig *old_sig, *new_sig;
+
+	*out = 0;
 
-	if (git_oid_cmp(&old_file->oid, &new_file->oid) == 0)
-		return 100;
+	if (diff_file_has_oid(old_file) && diff_file_has_oid(new_file) &&
+		git_oid_cmp(&old_file->oid, &new_file->oid) == 0) {
+		*out = 100;
+		return 0;
+	}
+
+	if (diff_sig_for_file(&old_sig, cache, old_file, cache->diff->old_src) < 0 ||
+		diff_sig_for_file(&new_sig, cache, new_file, cache->diff->new_src) < 0)
+		return -1;
 
-	/* TODO: insert actual similarity algo here */
+	if (old_sig && new_sig)
+		*out = git_hashsig_compare(old_sig, new_sig);
 
 	return 0;
 }
 
 #define FLAG_SET(opts,flag_name) ((opts.flags & flag_name) != 0)
 
+static bool is_rename_source(const git_diff_find_options *opts, const git_diff_delta *delta)
+{
+	switch (delta->status) {
+	case GIT_DELTA_DELETED:
+		return true;
+	case GIT_DELTA_ADDED:
+	case GIT_DELTA_UNTRACKED:
+	case GIT_DELTA_IGNORED:
+		/* nothing on the old side to copy from */
+		return false;
+	case GIT_DELTA_UNMODIFIED:
+		return FLAG_SET((*opts), GIT_DIFF_FIND_COPIES_FROM_UNMODIFIED);
+	default:
+		return FLAG_SET((*opts), GIT_DIFF_FIND_COPIES);
+	}
+}
+
+static bool is_rename_target(const git_diff_delta *delta)
+{
+	switch (delta->status) {
+	case GIT_DELTA_ADDED:
+	case GIT_DELTA_UNTRACKED:
+	case GIT_DELTA_RENAMED:
+	case GIT_DELTA_COPIED:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Every chunk of every source, sorted by hash, so the sources that
+ * share content with a target can be found without comparing the
+ * target against each of them.
+ */
+typedef struct {
+	uint32_t hash;
+	uint32_t bytes;
+	size_t source;
+} similarity_posting;
+
+static int similarity_posting_cmp(const void *a_, const void *b_)
+{
+	const similarity_posting *a = a_, *b = b_;
+
+	if (a->hash != b->hash)
+		return (a->hash < b->hash) ? -1 : 1;
+	return (a->source < b->source) ? -1 : (a->source > b->source);
+}
+
+typedef struct {
+	size_t shared;
+	size_t source;
+} similarity_candidate;
+
+/* chunks shared by more sources than this don't select candidates */
+#define SIMILARITY_COMMON_CHUNK(nsources) ((nsources) / 8 > 16 ? (nsources) / 8 : 16)
+
+typedef struct {
+	git_diff_list *diff;
+	git_diff_find_options *opts;
+	diff_sig_cache *cache;
+	git_vector *matches;
+
+	size_t *sources;          /* delta index of each source */
+	git_hashsig **source_sigs;
+	size_t nsources;
+
+	similarity_posting *postings;
+	size_t npostings;
+
+	size_t *shared;           /* bytes each source shares with the target */
+	similarity_candidate *candidates;
+} similarity_search;
+
+static int record_match(
+	similarity_search *s, size_t target, size_t source, unsigned int similarity)
+{
+	git_diff_delta *to = GIT_VECTOR_GET(&s->diff->deltas, target);
+	git_diff_delta *from = GIT_VECTOR_GET(&s->diff->deltas, source);
+
+	if (to->similarity >= similarity)
+		return 0;
+
+	to->similarity = similarity;
+	return git_vector_set(NULL, s->matches, target, from);
+}
+
+/* pair identical blobs first; this needs no content at all */
+static int find_exact_matches(similarity_search *s)
+{
+	git_oidmap *by_oid;
+	git_diff_delta *delta;
+	khiter_t pos;
+	size_t i;
+	int error = 0;
+
+	by_oid = git_oidmap_alloc();
+	GITERR_CHECK_ALLOC(by_oid);
+
+	for (i = 0; i < s->nsources && !error; ++i) {
+		delta = GIT_VECTOR_GET(&s->diff->deltas, s->sources[i]);
+		if (!diff_file_has_oid(&delta->old_file))
+			continue;
+
+		pos = kh_put(oid, by_oid, &delta->old_file.oid, &error);
+		if (error < 0)
+			break;
+
+		/* a rename beats a copy of the same content */
+		if (error > 0 || (delta->status == GIT_DELTA_DELETED &&
+			((git_diff_delta *)kh_val(by_oid, pos))->status != GIT_DELTA_DELETED))
+			kh_val(by_oid, pos) = delta;
+
+		error = 0;
+	}
+
+	git_vector_foreach(&s->diff->deltas, i, delta) {
+		git_diff_delta *from;
+
+		if (error < 0)
+			break;
+		if (!is_rename_target(delta) || !diff_file_has_oid(&delta->new_file))
+			continue;
+
+		pos = kh_get(oid, by_oid, &delta->new_file.oid);
+		if (pos == kh_end(by_oid) || (from = kh_val(by_oid, pos)) == delta)
+			continue;
+
+		if (delta->similarity < 100) {
+			delta->similarity = 100;
+			error = git_vector_set(NULL, s->matches, i, from);
+		}
+	}
+
+	git_oidmap_free(by_oid);
+	return error;
+}
+
+static int build_postings(similarity_search *s)
+{
+	size_t i, j, n = 0;
+
+	for (i = 0; i < s->nsources; ++i) {
+		git_diff_delta *delta = GIT_VECTOR_GET(&s->diff->deltas, s->sources[i]);
+
+		if (diff_sig_for_file(&s->source_sigs[i], s->cache,
+				&delta->old_file, s->diff->old_src) < 0)
+			return -1;
+
+		if (s->source_sigs[i])
+			n += s->source_sigs[i]->length;
+	}
+
+	s->postings = git__malloc((n + 1) * sizeof(similarity_posting));
+	GITERR_CHECK_ALLOC(s->postings);
+
+	for (i = 0; i < s->nsources; ++i) {
+		git_hashsig *sig = s->source_sigs[i];
+
+		for (j = 0; sig && j < sig->length; ++j) {
+			similarity_posting *p = &s->postings[s->npostings++];
+			p->hash = sig->chunks[j].hash;
+			p->bytes = sig->chunks[j].bytes;
+			p->source = i;
+		}
+	}
+
+	qsort(s->postings, s->npostings, sizeof(similarity_posting), similarity_posting_cmp);
+	return 0;
+}
+
+static size_t postings_find(similarity_search *s, uint32_t hash)
+{
+	size_t lo = 0, hi = s->npostings;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (s->postings[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int similarity_candidate_cmp(const void *a_, const void *b_)
+{
+	const similarity_candidate *a = a_, *b = b_;
+
+	if (a->shared != b->shared)
+		return (a->shared > b->shared) ? -1 : 1;
+	return (a->source < b->source) ? -1 : (a->source > b->source);
+}
+
+static int find_similar_content(similarity_search *s, size_t target)
+{
+	git_diff_delta *to = GIT_VECTOR_GET(&s->diff->deltas, target);
+	git_hashsig *sig;
+	size_t i, ntouched = 0, common_limit, tried = 0;
+	unsigned int min_score;
+	int error = 0;
+
+	if (diff_sig_for_file(&sig, s->cache, &to->new_file, s->diff->new_src) < 0)
+		return -1;
+	if (!sig || !sig->total)
+		return 0;
+
+	common_limit = SIMILARITY_COMMON_CHUNK(s->nsources);
+	min_score = min(s->opts->rename_threshold, s->opts->copy_threshold);
+
+	/* tally the bytes each source shares with the target */
+	for (i = 0; i < sig->length; ++i) {
+		size_t first = postings_find(s, sig->chunks[i].hash), last = first;
+
+		while (last < s->npostings && s->postings[last].hash == sig->chunks[i].hash)
+			last++;
+
+		if (last - first > common_limit)
+			continue;
+
+		for (; first < last; ++first) {
+			similarity_posting *p = &s->postings[first];
+
+			if (s->shared[p->source] == 0)
+				s->candidates[ntouched++].source = p->source;
+			s->shared[p->source] += min(p->bytes, sig->chunks[i].bytes);
+		}
+	}
+
+	/* score the most promising sources first, up to the limit */
+	for (i = 0; i < ntouched; ++i) {
+		similarity_candidate *c = &s->candidates[i];
+		c->shared = s->shared[c->source];
+		s->shared[c->source] = 0;
+	}
+
+	qsort(s->candidates, ntouched, sizeof(similarity_candidate), similarity_candidate_cmp);
+
+	for (i = 0; i < ntouched && !error; ++i) {
+		size_t source = s->candidates[i].source;
+		git_hashsig *src_sig = s->source_sigs[source];
+		size_t max_total, min_total;
+		unsigned int similarity;
+
+		if (s->sources[source] == target)
+			continue;
+
+		if (++tried > s->opts->target_limit)
+			break;
+
+		/* a size difference this large rules out the threshold */
+		max_total = src_sig->total > sig->total ? src_sig->total : sig->total;
+		min_total = min(src_sig->total, sig->total);
+		if ((max_total - min_total) * 100 > max_total * (100 - min_score))
+			continue;
+
+		similarity = git_hashsig_compare(src_sig, sig);
+		if (similarity > 0)
+			error = record_match(s, target, s->sources[source], similarity);
+	}
+
+	return error;
+}
+
+static int find_best_matches(
+	git_diff_list *diff,
+	git_diff_find_options *opts,
+	diff_sig_cache *cache,
+	git_vector *matches)
+{
+	similarity_search s;
+	git_diff_delta *delta;
+	size_t i;
+	int error = -1;
+
+	memset(&s, 0, sizeof(s));
+	s.diff = diff;
+	s.opts = opts;
+	s.cache = cache;
+	s.matches = matches;
+
+	s.sources = git__calloc(diff->deltas.length + 1, sizeof(size_t));
+	GITERR_CHECK_ALLOC(s.sources);
+
+	git_vector_foreach(&diff->deltas, i, delta) {
+		if (is_rename_source(opts, delta))
+			s.sources[s.nsources++] = i;
+	}
+
+	if (!s.nsources) {
+		git__free(s.sources);
+		return 0;
+	}
+
+	if (find_exact_matches(&s) < 0)
+		goto cleanup;
+
+	s.source_sigs = git__calloc(s.nsources, sizeof(git_hashsig *));
+	s.shared = git__calloc(s.nsources, sizeof(size_t));
+	s.candidates = git__calloc(s.nsources, sizeof(similarity_candidate));
+	if (!s.source_sigs || !s.shared || !s.candidates)
+		goto cleanup;
+
+	git_vector_foreach(&diff->deltas, i, delta) {
+		if (!is_rename_target(delta) || delta->similarity == 100)
+			continue;
+
+		/* only read the sources once some target actually needs them */
+		if (!s.postings && build_postings(&s) < 0)
+			goto cleanup;
+
+		if (find_similar_content(&s, i) < 0)
+			goto cleanup;
+	}
+
+	error = 0;
+
+cleanup:
+	git__free(s.sources);
+	git__free(s.source_sigs);
+	git__free(s.postings);
+	git__free(s.shared);
+	git__free(s.candidates);
+	return error;
+}
+
 int git_diff_find_similar(
 	git_diff_list *diff,
 	git_diff_find_options *given_opts)
@@ -306,12 +784,17 @@ int git_diff_find_similar(
 	unsigned int i, j, similarity;
 	git_diff_delta *from, *to;
 	git_diff_find_options opts;
-	unsigned int tried_targets, num_changes = 0;
+	unsigned int num_changes = 0;
 	git_vector matches = GIT_VECTOR_INIT;
+	diff_sig_cache cache;
+	int error = -1;
 
 	if (normalize_find_opts(diff, &opts, given_opts) < 0)
 		return -1;
 
+	if (diff_sig_cache_init(&cache, diff) < 0)
+		return -1;
+
 	/* first do splits if requested */
 
 	if (FLAG_SET(opts, GIT_DIFF_FIND_AND_BREAK_REWRITES)) {
@@ -319,11 +802,9 @@ int git_diff_find_similar(
 			if (from->status != GIT_DELTA_MODIFIED)
 				continue;
 
-			/* Right now, this doesn't work right because the similarity
-			 * algorithm isn't actually implemented...
-			 */
-			similarity = 100;
-			/* calc_similarity(NULL, &from->old_file, from->new_file); */
+			if (calc_similarity(
+					&similarity, &cache, &from->old_file, &from->new_file) < 0)
+				goto cleanup;
 
 			if (similarity < opts.break_rewrite_threshold) {
 				from->status = GIT_DELTA__TO_SPLIT;
@@ -335,58 +816,17 @@ int git_diff_find_similar(
 		if (num_changes > 0 &&
 			apply_splits_and_deletes(
 				diff, diff->deltas.length + num_changes) < 0)
-			return -1;
+			goto cleanup;
 	}
 
 	/* next find the most similar delta for each rename / copy candidate */
 
-	if (git_vector_init(&matches, diff->deltas.length, git_diff_delta__cmp) < 0)
-		return -1;
-
-	git_vector_foreach(&diff->deltas, i, from) {
-		tried_targets = 0;
-
-		git_vector_foreach(&diff->deltas, j, to) {
-			if (i == j)
-				continue;
-
-			switch (to->status) {
-			case GIT_DELTA_ADDED:
-			case GIT_DELTA_UNTRACKED:
-			case GIT_DELTA_RENAMED:
-			case GIT_DELTA_COPIED:
-				break;
-			default:
-				/* only the above status values should be checked */
-				continue;
-			}
+	if (git_vector_init(&matches, diff->deltas.length, git_diff_delta__cmp) < 0 ||
+		git_vector_resize_to(&matches, diff->deltas.length) < 0)
+		goto cleanup;
 
-			/* skip all but DELETED files unless copy detection is on */
-			if (from->status != GIT_DELTA_DELETED &&
-				!FLAG_SET(opts, GIT_DIFF_FIND_COPIES))
-				continue;
-
-			/* don't check UNMODIFIED files as source unless given option */
-			if (from->status == GIT_DELTA_UNMODIFIED &&
-				!FLAG_SET(opts, GIT_DIFF_FIND_COPIES_FROM_UNMODIFIED))
-				continue;
-
-			/* cap on maximum files we'll examine */
-			if (++tried_targets > opts.target_limit)
-				break;
-
-			/* calculate similarity and see if this pair beats the
-			 * similarity score of the current best pair.
-			 */
-			similarity = calc_similarity(NULL, &from->old_file, &to->new_file);
-
-			if (to->similarity < similarity) {
-				to->similarity = similarity;
-				if (git_vector_set(NULL, &matches, j, from) < 0)
-					return -1;
-			}
-		}
-	}
+	if (find_best_matches(diff, &opts, &cache, &matches) < 0)
+		goto cleanup;
 
 	/* next rewrite the diffs with renames / copies */
 
@@ -427,8 +867,9 @@ int git_diff_find_similar(
 			FLAG_SET(opts, GIT_DIFF_FIND_RENAMES_FROM_REWRITES) &&
 			to->similarity > opts.rename_threshold)
 		{
-			similarity = 100;
-			/* calc_similarity(NULL, &from->old_file, from->new_file); */
+			if (calc_similarity(
+					&similarity, &cache, &from->old_file, &from->new_file) < 0)
+				goto cleanup;
 
 			if (similarity < opts.rename_from_rewrite_threshold) {
 				to->status = GIT_DELTA_RENAMED;
@@ -453,17 +894,20 @@ int git_diff_find_similar(
 		memcpy(&to->old_file, &from->old_file, sizeof(to->old_file));
 	}
 
-	git_vector_free(&matches);
-
 	if (num_changes > 0) {
 		assert(num_changes < diff->deltas.length);
 
 		if (apply_splits_and_deletes(
 				diff, diff->deltas.length - num_changes) < 0)
-			return -1;
+			goto cleanup;
 	}
 
-	return 0;
+	error = 0;
+
+cleanup:
+	git_vector_free(&matches);
+	diff_sig_cache_free(&cache);
+	return error;
 }
 
 #undef FLAG_SET
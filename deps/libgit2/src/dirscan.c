@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "dirscan.h"
+#include "path.h"
+#include "strmap.h"
+#include "threadpool.h"
+#include "thread-utils.h"
+
+GIT__USE_STRMAP;
+
+typedef enum {
+	DIRSCAN_QUEUED,
+	DIRSCAN_RUNNING,
+	DIRSCAN_DONE,
+	DIRSCAN_DROPPED /* whoever sees it next frees it */
+} dirscan_state;
+
+typedef struct {
+	git_dirscan *scan;
+	dirscan_state state;
+	git_vector contents;
+	int error;
+	char path[GIT_FLEX_ARRAY];
+} dirscan_job;
+
+struct git_dirscan {
+	git_threadpool *pool;
+	git_mutex lock;
+	git_cond done;
+
+	/* the jobs queued and not taken yet, by path */
+	git_strmap *jobs;
+
+	size_t prefix_len;
+	bool ignore_case;
+	char *start_stat;
+	char *end_stat;
+};
+
+static void dirscan_contents_free(git_vector *contents)
+{
+	unsigned int i;
+	git_path_with_stat *ps;
+
+	git_vector_foreach(contents, i, ps)
+		git__free(ps);
+	git_vector_free(contents);
+}
+
+static void dirscan_job_free(dirscan_job *job)
+{
+	dirscan_contents_free(&job->contents);
+	git__free(job);
+}
+
+static int dirscan_load(
+	git_vector *contents, git_dirscan *scan, const char *path)
+{
+	return git_path_dirload_with_stat(
+		path, scan->prefix_len, scan->ignore_case,
+		scan->start_stat, scan->end_stat, contents);
+}
+
+static void dirscan_run(void *payload)
+{
+	dirscan_job *job = payload;
+	git_dirscan *scan = job->scan;
+
+	git_mutex_lock(&scan->lock);
+
+	if (job->state == DIRSCAN_DROPPED) {
+		git_mutex_unlock(&scan->lock);
+		dirscan_job_free(job);
+		return;
+	}
+
+	job->state = DIRSCAN_RUNNING;
+	git_mutex_unlock(&scan->lock);
+
+	job->error = dirscan_load(&job->contents, scan, job->path);
+
+	/* the walker only wants to know the directory couldn't be read */
+	if (job->error < 0)
+		giterr_clear();
+
+	git_mutex_lock(&scan->lock);
+
+	if (job->state == DIRSCAN_DROPPED) {
+		git_mutex_unlock(&scan->lock);
+		dirscan_job_free(job);
+		return;
+	}
+
+	job->state = DIRSCAN_DONE;
+	git_cond_broadcast(&scan->done);
+	git_mutex_unlock(&scan->lock);
+}
+
+int git_dirscan_new(
+	git_dirscan **out,
+	unsigned int nr_threads,
+	size_t prefix_len,
+	bool ignore_case,
+	const char *start_stat,
+	const char *end_stat)
+{
+	git_dirscan *scan = git__calloc(1, sizeof(git_dirscan));
+	GITERR_CHECK_ALLOC(scan);
+
+	git_mutex_init(&scan->lock);
+#ifdef GIT_THREADS
+	git_cond_init(&scan->done);
+#endif
+
+	scan->prefix_len = prefix_len;
+	scan->ignore_case = ignore_case;
+
+	if ((scan->jobs = git_strmap_alloc()) == NULL ||
+		(start_stat && (scan->start_stat = git__strdup(start_stat)) == NULL) ||
+		(end_stat && (scan->end_stat = git__strdup(end_stat)) == NULL) ||
+		git_threadpool_new(&scan->pool, nr_threads) < 0) {
+		git_dirscan_free(scan);
+		return -1;
+	}
+
+	*out = scan;
+	return 0;
+}
+
+/*
+ * Unlist the job for `path`, if there is one which the walker can
+ * use; must be called with the lock held
+ */
+static dirscan_job *dirscan_unlist(git_dirscan *scan, const char *path)
+{
+	khiter_t pos = git_strmap_lookup_index(scan->jobs, path);
+	dirscan_job *job;
+
+	if (!git_strmap_valid_index(scan->jobs, pos))
+		return NULL;
+
+	job = git_strmap_value_at(scan->jobs, pos);
+	git_strmap_delete_at(scan->jobs, pos);
+
+	return job;
+}
+
+int git_dirscan_queue(git_dirscan *scan, const char *path)
+{
+	size_t path_len = strlen(path);
+	dirscan_job *job;
+	int error;
+
+	job = git__calloc(1, sizeof(dirscan_job) + path_len + 1);
+	GITERR_CHECK_ALLOC(job);
+
+	job->scan = scan;
+	job->state = DIRSCAN_QUEUED;
+	memcpy(job->path, path, path_len);
+
+	if (git_vector_init(&job->contents, 0, scan->ignore_case ?
+			git_path_with_stat_cmp_icase : git_path_with_stat_cmp) < 0) {
+		git__free(job);
+		return -1;
+	}
+
+	git_mutex_lock(&scan->lock);
+
+	/* already there from an earlier queueing */
+	if (git_strmap_exists(scan->jobs, job->path))
+		error = 0;
+	else
+		git_strmap_insert(scan->jobs, job->path, job, error);
+
+	git_mutex_unlock(&scan->lock);
+
+	if (error <= 0) {
+		dirscan_job_free(job);
+		return error;
+	}
+
+	if (git_threadpool_submit(scan->pool, dirscan_run, job) < 0) {
+		git_mutex_lock(&scan->lock);
+		dirscan_unlist(scan, job->path);
+		git_mutex_unlock(&scan->lock);
+
+		dirscan_job_free(job);
+		return -1;
+	}
+
+	return 0;
+}
+
+int git_dirscan_take(
+	git_vector *contents, git_dirscan *scan, const char *path)
+{
+	dirscan_job *job;
+	int error;
+
+	git_mutex_lock(&scan->lock);
+
+	if ((job = dirscan_unlist(scan, path)) != NULL) {
+		/* not started yet: faster to read it than to wait for it */
+		if (job->state == DIRSCAN_QUEUED) {
+			job->state = DIRSCAN_DROPPED;
+			job = NULL;
+		}
+
+		while (job != NULL && job->state != DIRSCAN_DONE)
+			git_cond_wait(&scan->done, &scan->lock);
+	}
+
+	git_mutex_unlock(&scan->lock);
+
+	if (job == NULL)
+		return dirscan_load(contents, scan, path);
+
+	if ((error = job->error) == 0) {
+		git_vector_free(contents);
+		*contents = job->contents;
+		memset(&job->contents, 0x0, sizeof(git_vector));
+	} else {
+		giterr_set(GITERR_OS, "Failed to read directory '%s'", path);
+	}
+
+	dirscan_job_free(job);
+	return error;
+}
+
+void git_dirscan_drop(git_dirscan *scan, const char *path)
+{
+	dirscan_job *job;
+
+	git_mutex_lock(&scan->lock);
+
+	if ((job = dirscan_unlist(scan, path)) != NULL) {
+		if (job->state == DIRSCAN_DONE)
+			dirscan_job_free(job);
+		else
+			job->state = DIRSCAN_DROPPED;
+	}
+
+	git_mutex_unlock(&scan->lock);
+}
+
+void git_dirscan_free(git_dirscan *scan)
+{
+	dirscan_job *job;
+
+	if (scan == NULL)
+		return;
+
+	if (scan->jobs != NULL) {
+		git_mutex_lock(&scan->lock);
+
+		git_strmap_foreach_value(scan->jobs, job, {
+			if (job->state == DIRSCAN_DONE)
+				dirscan_job_free(job);
+			else
+				job->state = DIRSCAN_DROPPED;
+		});
+		git_strmap_clear(scan->jobs);
+
+		git_mutex_unlock(&scan->lock);
+	}
+
+	/* the dropped jobs get freed as the threads come to them */
+	git_threadpool_free(scan->pool);
+	git_strmap_free(scan->jobs);
+
+#ifdef GIT_THREADS
+	git_cond_free(&scan->done);
+#endif
+	git_mutex_free(&scan->lock);
+
+	git__free(scan->start_stat);
+	git__free(scan->end_stat);
+	git__free(scan);
+}
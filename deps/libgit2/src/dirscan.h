@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_dirscan_h__
+#define INCLUDE_dirscan_h__
+
+#include "common.h"
+#include "vector.h"
+
+/*
+ * Reads directories ahead of a walk, on a few threads.
+ *
+ * The walker queues the directories it's likely to enter next, and
+ * takes their contents when it gets there -- as they would have been
+ * loaded by `git_path_dirload_with_stat` with the scanner's settings.
+ * A directory which wasn't queued, or whose turn hasn't come yet, is
+ * just read on the spot.
+ */
+typedef struct git_dirscan git_dirscan;
+
+extern int git_dirscan_new(
+	git_dirscan **out,
+	unsigned int nr_threads,
+	size_t prefix_len,
+	bool ignore_case,
+	const char *start_stat,
+	const char *end_stat);
+
+/* Start reading the directory `path` in the background */
+extern int git_dirscan_queue(git_dirscan *scan, const char *path);
+
+/*
+ * Get the contents of the directory `path` into `contents`, which
+ * must be an empty vector of `git_path_with_stat`
+ */
+extern int git_dirscan_take(
+	git_vector *contents, git_dirscan *scan, const char *path);
+
+/* Say the directory `path` won't be taken after all */
+extern void git_dirscan_drop(git_dirscan *scan, const char *path);
+
+extern void git_dirscan_free(git_dirscan *scan);
+
+#endif
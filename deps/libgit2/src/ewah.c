@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "ewah.h"
+
+#define RLW_RUN_MAX 0xFFFFFFFFu
+#define RLW_LITERAL_MAX 0x7FFFFFFFu
+
+#define WORD_CLEAN(w) ((w) == 0 || (w) == ~(uint64_t)0)
+
+static int bitmap_grow(git_bitmap *bitmap, size_t length)
+{
+	if (length <= bitmap->length)
+		return 0;
+
+	if (length > bitmap->alloc) {
+		size_t alloc = bitmap->alloc ? bitmap->alloc : 16;
+		uint64_t *words;
+
+		while (alloc < length)
+			alloc = alloc * 3 / 2;
+
+		words = git__realloc(bitmap->words, alloc * sizeof(uint64_t));
+		GITERR_CHECK_ALLOC(words);
+
+		bitmap->words = words;
+		bitmap->alloc = alloc;
+	}
+
+	memset(bitmap->words + bitmap->length, 0x0,
+		(length - bitmap->length) * sizeof(uint64_t));
+	bitmap->length = length;
+	return 0;
+}
+
+int git_bitmap_set(git_bitmap *bitmap, size_t pos)
+{
+	if (bitmap_grow(bitmap, pos / 64 + 1) < 0)
+		return -1;
+
+	bitmap->words[pos / 64] |= (uint64_t)1 << (pos % 64);
+	return 0;
+}
+
+int git_bitmap_or(git_bitmap *bitmap, const git_bitmap *other)
+{
+	size_t i;
+
+	if (bitmap_grow(bitmap, other->length) < 0)
+		return -1;
+
+	for (i = 0; i < other->length; ++i)
+		bitmap->words[i] |= other->words[i];
+
+	return 0;
+}
+
+int git_bitmap_xor(git_bitmap *bitmap, const git_bitmap *other)
+{
+	size_t i;
+
+	if (bitmap_grow(bitmap, other->length) < 0)
+		return -1;
+
+	for (i = 0; i < other->length; ++i)
+		bitmap->words[i] ^= other->words[i];
+
+	return 0;
+}
+
+void git_bitmap_and_not(git_bitmap *bitmap, const git_bitmap *other)
+{
+	size_t i, length = min(bitmap->length, other->length);
+
+	for (i = 0; i < length; ++i)
+		bitmap->words[i] &= ~other->words[i];
+}
+
+size_t git_bitmap_count(const git_bitmap *bitmap)
+{
+	size_t i, count = 0;
+
+	for (i = 0; i < bitmap->length; ++i) {
+		uint64_t w = bitmap->words[i];
+		while (w) {
+			w &= w - 1;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void git_bitmap_clear(git_bitmap *bitmap)
+{
+	bitmap->length = 0;
+}
+
+void git_bitmap_free(git_bitmap *bitmap)
+{
+	git__free(bitmap->words);
+	bitmap->words = NULL;
+	bitmap->length = bitmap->alloc = 0;
+}
+
+GIT_INLINE(uint32_t) get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+GIT_INLINE(uint64_t) get_be64(const unsigned char *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+GIT_INLINE(void) put_be32(unsigned char *p, uint32_t n)
+{
+	p[0] = (unsigned char)(n >> 24);
+	p[1] = (unsigned char)(n >> 16);
+	p[2] = (unsigned char)(n >> 8);
+	p[3] = (unsigned char)n;
+}
+
+GIT_INLINE(void) put_be64(unsigned char *p, uint64_t n)
+{
+	put_be32(p, (uint32_t)(n >> 32));
+	put_be32(p + 4, (uint32_t)n);
+}
+
+static int ewah_error(const char *message)
+{
+	giterr_set(GITERR_ODB, "Invalid EWAH bitmap - %s", message);
+	return -1;
+}
+
+int git_ewah_read(
+	git_bitmap *out, size_t *read, const unsigned char *data, size_t len)
+{
+	const unsigned char *words;
+	size_t bits, length, count, pos = 0, i = 0;
+
+	if (len < 8)
+		return ewah_error("bitmap is truncated");
+
+	bits = get_be32(data);
+	count = get_be32(data + 4);
+	words = data + 8;
+
+	if (count > (len - 8 - 4) / 8)
+		return ewah_error("bitmap is truncated");
+
+	length = (bits + 63) / 64;
+
+	git_bitmap_clear(out);
+	if (bitmap_grow(out, length) < 0)
+		return -1;
+
+	while (i < count) {
+		uint64_t marker = get_be64(words + 8 * i++);
+		size_t run = (size_t)((marker >> 1) & RLW_RUN_MAX);
+		size_t literals = (size_t)(marker >> 33);
+
+		if (run > length - pos || literals > length - pos - run ||
+			literals > count - i)
+			return ewah_error("bitmap overflows its size");
+
+		if (marker & 1)
+			memset(out->words + pos, 0xFF, run * sizeof(uint64_t));
+		pos += run;
+
+		while (literals--)
+			out->words[pos++] = get_be64(words + 8 * i++);
+	}
+
+	*read = 8 + count * 8 + 4;
+	return 0;
+}
+
+int git_ewah_write(git_buf *out, const git_bitmap *bitmap, size_t bits)
+{
+	size_t start = out->size, length = (bits + 63) / 64, count = 0, i = 0, last = 0;
+	unsigned char word[8];
+
+#define WORD_AT(n) ((n) < bitmap->length ? bitmap->words[n] : 0)
+
+	memset(word, 0x0, sizeof(word));
+	if (git_buf_put(out, (const char *)word, 8) < 0)
+		return -1;
+
+	/* at least one marker, even for an empty bitmap */
+	do {
+		uint64_t clean = (i < length && WORD_AT(i) == ~(uint64_t)0) ? ~(uint64_t)0 : 0;
+		size_t run = 0, literals = 0, first;
+
+		while (i < length && WORD_AT(i) == clean && run < RLW_RUN_MAX) {
+			run++;
+			i++;
+		}
+
+		first = i;
+		while (i < length && !WORD_CLEAN(WORD_AT(i)) && literals < RLW_LITERAL_MAX) {
+			literals++;
+			i++;
+		}
+
+		last = count;
+		put_be64(word, (clean & 1) | ((uint64_t)run << 1) | ((uint64_t)literals << 33));
+		if (git_buf_put(out, (const char *)word, 8) < 0)
+			return -1;
+		count++;
+
+		for (; first < i; ++first, ++count) {
+			put_be64(word, WORD_AT(first));
+			if (git_buf_put(out, (const char *)word, 8) < 0)
+				return -1;
+		}
+	} while (i < length);
+
+#undef WORD_AT
+
+	put_be32(word, (uint32_t)last);
+	if (git_buf_put(out, (const char *)word, 4) < 0)
+		return -1;
+
+	put_be32((unsigned char *)out->ptr + start, (uint32_t)bits);
+	put_be32((unsigned char *)out->ptr + start + 4, (uint32_t)count);
+	return 0;
+}
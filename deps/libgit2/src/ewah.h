@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_ewah_h__
+#define INCLUDE_ewah_h__
+
+#include "common.h"
+#include "buffer.h"
+
+/*
+ * Uncompressed, growable bitmaps, and their EWAH-compressed on-disk
+ * form as core Git serializes it: a 32-bit size in bits, a 32-bit count
+ * of 64-bit words, the words themselves and the 32-bit position of the
+ * last marker word, all big-endian.
+ *
+ * A compressed stream is a sequence of marker words, each followed by
+ * its literal words: bit 0 of a marker is the value of a run of clean
+ * (all 0 or all 1) words, bits 1-32 the length of that run and bits
+ * 33-63 the number of literal words coming after it.
+ */
+
+typedef struct {
+	uint64_t *words;
+	size_t length; /* in words; bits past it are clear */
+	size_t alloc;
+} git_bitmap;
+
+#define GIT_BITMAP_INIT {NULL, 0, 0}
+
+extern int git_bitmap_set(git_bitmap *bitmap, size_t pos);
+
+GIT_INLINE(bool) git_bitmap_get(const git_bitmap *bitmap, size_t pos)
+{
+	size_t word = pos / 64;
+	return word < bitmap->length &&
+		(bitmap->words[word] & ((uint64_t)1 << (pos % 64))) != 0;
+}
+
+/* `bitmap` |= `other` */
+extern int git_bitmap_or(git_bitmap *bitmap, const git_bitmap *other);
+
+/* `bitmap` ^= `other` */
+extern int git_bitmap_xor(git_bitmap *bitmap, const git_bitmap *other);
+
+/* `bitmap` &= ~`other` */
+extern void git_bitmap_and_not(git_bitmap *bitmap, const git_bitmap *other);
+
+extern size_t git_bitmap_count(const git_bitmap *bitmap);
+
+extern void git_bitmap_clear(git_bitmap *bitmap);
+extern void git_bitmap_free(git_bitmap *bitmap);
+
+/*
+ * Decode the compressed bitmap at the start of `data` into `out`;
+ * `read` gets the number of bytes it took.
+ */
+extern int git_ewah_read(
+	git_bitmap *out, size_t *read, const unsigned char *data, size_t len);
+
+/* Append `bitmap`, compressed, to `out`; `bits` is its size in bits */
+extern int git_ewah_write(git_buf *out, const git_bitmap *bitmap, size_t bits);
+
+#endif
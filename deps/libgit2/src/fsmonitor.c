@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "fsmonitor.h"
+#include "path.h"
+#include "buffer.h"
+#include "fileops.h"
+#include "posix.h"
+
+#ifdef GIT_FSMONITOR
+#	include <sys/inotify.h>
+#endif
+
+GIT__USE_STRMAP;
+
+struct fsmonitor_dir {
+	int wd;
+	bool known;   /* `contents` are up to date */
+	bool pending; /* being read, since it started to be watched */
+	bool changed; /* something happened in it since then */
+	git_vector contents;
+	char path[GIT_FLEX_ARRAY];
+};
+
+static void fsmonitor_contents_free(git_vector *contents)
+{
+	unsigned int i;
+	git_path_with_stat *ps;
+
+	git_vector_foreach(contents, i, ps)
+		git__free(ps);
+	git_vector_free(contents);
+}
+
+static int fsmonitor_contents_copy(
+	git_vector *out, const git_vector *contents)
+{
+	unsigned int i;
+	size_t size;
+	git_path_with_stat *ps, *copy;
+
+	git_vector_foreach(contents, i, ps) {
+		/* room for the slash `git_path_dirload_with_stat` may add */
+		size = sizeof(git_path_with_stat) + ps->path_len + 2;
+
+		copy = git__malloc(size);
+		GITERR_CHECK_ALLOC(copy);
+		memcpy(copy, ps, sizeof(git_path_with_stat) + ps->path_len + 1);
+
+		if (git_vector_insert(out, copy) < 0) {
+			git__free(copy);
+			return -1;
+		}
+	}
+
+	git_vector_sort(out);
+	return 0;
+}
+
+static void fsmonitor_dir_free(fsmonitor_dir *dir)
+{
+	fsmonitor_contents_free(&dir->contents);
+	git__free(dir);
+}
+
+/* Forget everything, and start over with a new set of watches */
+static int fsmonitor_reset(git_fsmonitor *mon, bool watch)
+{
+	fsmonitor_dir *dir;
+
+	git_strmap_foreach_value(mon->dirs, dir, {
+		fsmonitor_dir_free(dir);
+	});
+	git_strmap_clear(mon->dirs);
+
+	if (mon->by_wd != NULL)
+		memset(mon->by_wd, 0x0, mon->by_wd_size * sizeof(fsmonitor_dir *));
+
+	if (mon->fd >= 0) {
+		p_close(mon->fd);
+		mon->fd = -1;
+	}
+
+	if (!watch)
+		return 0;
+
+#ifdef GIT_FSMONITOR
+	if ((mon->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0)
+		return 0;
+
+	giterr_set(GITERR_OS, "Failed to watch the working directory");
+#else
+	giterr_set(GITERR_OS,
+		"Watching the working directory is not supported on this platform");
+#endif
+	return -1;
+}
+
+int git_fsmonitor_init(git_fsmonitor *mon)
+{
+	memset(mon, 0x0, sizeof(git_fsmonitor));
+	mon->fd = -1;
+
+	mon->dirs = git_strmap_alloc();
+	GITERR_CHECK_ALLOC(mon->dirs);
+
+	git_mutex_init(&mon->lock);
+	return 0;
+}
+
+void git_fsmonitor_free(git_fsmonitor *mon)
+{
+	if (mon->dirs == NULL)
+		return;
+
+	fsmonitor_reset(mon, false);
+
+	git_strmap_free(mon->dirs);
+	git__free(mon->by_wd);
+	git_mutex_free(&mon->lock);
+}
+
+int git_fsmonitor_enable(git_fsmonitor *mon, bool enable)
+{
+	int error = 0;
+
+	if (git_mutex_lock(&mon->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock the working directory monitor");
+		return -1;
+	}
+
+	if (enable != (mon->fd >= 0))
+		error = fsmonitor_reset(mon, enable);
+
+	git_mutex_unlock(&mon->lock);
+	return error;
+}
+
+#ifdef GIT_FSMONITOR
+
+#define FSMONITOR_EVENTS \
+	(IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | \
+	 IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | \
+	 IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+static void fsmonitor_forget(git_fsmonitor *mon, fsmonitor_dir *dir)
+{
+	khiter_t pos = git_strmap_lookup_index(mon->dirs, dir->path);
+
+	if (git_strmap_valid_index(mon->dirs, pos))
+		git_strmap_delete_at(mon->dirs, pos);
+
+	mon->by_wd[dir->wd] = NULL;
+	fsmonitor_dir_free(dir);
+}
+
+static void fsmonitor_drop_contents(fsmonitor_dir *dir)
+{
+	fsmonitor_contents_free(&dir->contents);
+	dir->known = false;
+}
+
+static int fsmonitor_entry_cmp(const void *key, const void *entry)
+{
+	return strcmp(key, ((const git_path_with_stat *)entry)->path);
+}
+
+static int fsmonitor_entry_cmp_icase(const void *key, const void *entry)
+{
+	return strcasecmp(key, ((const git_path_with_stat *)entry)->path);
+}
+
+/* Refresh the stat data of a file which was written to */
+static void fsmonitor_restat(
+	git_fsmonitor *mon, fsmonitor_dir *dir, const char *name)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_path_with_stat *ps;
+	struct stat st;
+	int pos;
+
+	if (git_buf_sets(&path, dir->path) < 0 || git_buf_puts(&path, name) < 0) {
+		giterr_clear();
+		fsmonitor_drop_contents(dir);
+		return;
+	}
+
+	pos = git_vector_bsearch2(&dir->contents,
+		mon->ignore_case ? fsmonitor_entry_cmp_icase : fsmonitor_entry_cmp,
+		path.ptr + mon->prefix_len);
+
+	if (pos < 0 || p_lstat(path.ptr, &st) < 0 ||
+		S_ISDIR(st.st_mode) ||
+		(ps = git_vector_get(&dir->contents, pos)) == NULL ||
+		GIT_MODE_TYPE(st.st_mode) != GIT_MODE_TYPE(ps->st.st_mode))
+		fsmonitor_drop_contents(dir);
+	else {
+		ps->st = st;
+		mon->updates++;
+	}
+
+	git_buf_free(&path);
+}
+
+static void fsmonitor_event(git_fsmonitor *mon, struct inotify_event *ev)
+{
+	fsmonitor_dir *dir;
+
+	if (ev->wd < 0 || (size_t)ev->wd >= mon->by_wd_size ||
+		(dir = mon->by_wd[ev->wd]) == NULL)
+		return;
+
+	/* its path doesn't lead to it anymore */
+	if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+		if (!(ev->mask & IN_IGNORED))
+			inotify_rm_watch(mon->fd, ev->wd);
+		fsmonitor_forget(mon, dir);
+		return;
+	}
+
+	dir->changed = true;
+
+	if (!dir->known)
+		return;
+
+	if ((ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) ||
+		(ev->mask & IN_ISDIR) || ev->len == 0)
+		fsmonitor_drop_contents(dir);
+	else
+		fsmonitor_restat(mon, dir, ev->name);
+}
+
+/* Go through what the kernel reported since the last time */
+static int fsmonitor_drain(git_fsmonitor *mon)
+{
+	uint64_t buf[4096 / sizeof(uint64_t)];
+	struct inotify_event *ev, *last = NULL;
+	char *pos, *end;
+	ssize_t len;
+
+	while (mon->fd >= 0) {
+		if ((len = read(mon->fd, buf, sizeof(buf))) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+
+			giterr_set(GITERR_OS, "Failed to read the working directory events");
+			return -1;
+		}
+
+		for (pos = (char *)buf, end = pos + len; pos < end;
+			pos += sizeof(struct inotify_event) + ev->len) {
+			ev = (struct inotify_event *)pos;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				mon->overflows++;
+				return fsmonitor_reset(mon, true);
+			}
+
+			/* a file being written says so at every write */
+			if (last != NULL && last->wd == ev->wd && last->mask == ev->mask &&
+				last->len == ev->len && !memcmp(last->name, ev->name, ev->len))
+				continue;
+
+			fsmonitor_event(mon, ev);
+			last = ev;
+		}
+
+		last = NULL;
+	}
+
+	return 0;
+}
+
+static int fsmonitor_watch(
+	fsmonitor_dir **out, git_fsmonitor *mon, const char *path)
+{
+	fsmonitor_dir *dir, **by_wd;
+	size_t path_len, new_size;
+	int wd, error;
+
+	*out = NULL;
+
+	if ((wd = inotify_add_watch(mon->fd, path, FSMONITOR_EVENTS)) < 0)
+		return 0; /* out of watches, or can't be watched: it'll be read */
+
+	if ((size_t)wd >= mon->by_wd_size) {
+		new_size = mon->by_wd_size ? mon->by_wd_size * 2 : 64;
+		if (new_size <= (size_t)wd)
+			new_size = (size_t)wd + 1;
+
+		by_wd = git__realloc(mon->by_wd, new_size * sizeof(fsmonitor_dir *));
+		GITERR_CHECK_ALLOC(by_wd);
+		memset(by_wd + mon->by_wd_size, 0x0,
+			(new_size - mon->by_wd_size) * sizeof(fsmonitor_dir *));
+
+		mon->by_wd = by_wd;
+		mon->by_wd_size = new_size;
+	}
+
+	/* the same directory, known under another path */
+	if (mon->by_wd[wd] != NULL)
+		fsmonitor_forget(mon, mon->by_wd[wd]);
+
+	path_len = strlen(path);
+	dir = git__calloc(1, sizeof(fsmonitor_dir) + path_len + 1);
+	GITERR_CHECK_ALLOC(dir);
+
+	dir->wd = wd;
+	dir->pending = true;
+	memcpy(dir->path, path, path_len);
+
+	if (git_vector_init(&dir->contents, 0, mon->ignore_case ?
+			git_path_with_stat_cmp_icase : git_path_with_stat_cmp) < 0) {
+		git__free(dir);
+		return -1;
+	}
+
+	git_strmap_insert(mon->dirs, dir->path, dir, error);
+	if (error < 0) {
+		fsmonitor_dir_free(dir);
+		return -1;
+	}
+
+	mon->by_wd[wd] = dir;
+	*out = dir;
+	return 0;
+}
+
+/*
+ * Find what's known of `path`, or start watching it; returns 1 if its
+ * contents are known, 0 if it has to be read
+ */
+static int fsmonitor_lookup(
+	fsmonitor_dir **out, git_fsmonitor *mon, const char *path)
+{
+	khiter_t pos = git_strmap_lookup_index(mon->dirs, path);
+	fsmonitor_dir *dir;
+
+	if (!git_strmap_valid_index(mon->dirs, pos))
+		return fsmonitor_watch(out, mon, path);
+
+	dir = *out = git_strmap_value_at(mon->dirs, pos);
+
+	if (dir->known)
+		return 1;
+
+	if (!dir->pending) {
+		dir->pending = true;
+		dir->changed = false;
+	}
+
+	return 0;
+}
+
+int git_fsmonitor_update(
+	git_fsmonitor *mon, size_t prefix_len, bool ignore_case)
+{
+	int error;
+
+	if (git_mutex_lock(&mon->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock the working directory monitor");
+		return -1;
+	}
+
+	if (mon->fd < 0)
+		error = 0;
+	else if ((mon->prefix_len != prefix_len || mon->ignore_case != ignore_case) &&
+		git_strmap_num_entries(mon->dirs) > 0)
+		error = fsmonitor_reset(mon, true);
+	else
+		error = fsmonitor_drain(mon);
+
+	if (!error && mon->fd >= 0) {
+		mon->prefix_len = prefix_len;
+		mon->ignore_case = ignore_case;
+		error = 1;
+	}
+
+	git_mutex_unlock(&mon->lock);
+	return error;
+}
+
+int git_fsmonitor_take(
+	git_vector *contents, git_fsmonitor *mon, const char *path)
+{
+	fsmonitor_dir *dir;
+	int error;
+
+	if (git_mutex_lock(&mon->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock the working directory monitor");
+		return -1;
+	}
+
+	if (mon->fd < 0)
+		error = GIT_ENOTFOUND;
+	else if ((error = fsmonitor_lookup(&dir, mon, path)) == 0) {
+		mon->misses++;
+		error = GIT_ENOTFOUND;
+	} else if (error > 0) {
+		mon->hits++;
+		error = fsmonitor_contents_copy(contents, &dir->contents);
+	}
+
+	git_mutex_unlock(&mon->lock);
+	return error;
+}
+
+int git_fsmonitor_watch(git_fsmonitor *mon, const char *path)
+{
+	fsmonitor_dir *dir;
+	int error = 0;
+
+	if (git_mutex_lock(&mon->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock the working directory monitor");
+		return -1;
+	}
+
+	if (mon->fd >= 0)
+		error = fsmonitor_lookup(&dir, mon, path);
+
+	git_mutex_unlock(&mon->lock);
+	return error;
+}
+
+int git_fsmonitor_store(
+	git_fsmonitor *mon, const char *path, const git_vector *contents)
+{
+	khiter_t pos;
+	fsmonitor_dir *dir;
+	int error = 0;
+
+	if (git_mutex_lock(&mon->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock the working directory monitor");
+		return -1;
+	}
+
+	/* whatever happened while it was read has to be seen first */
+	if (mon->fd < 0 || (error = fsmonitor_drain(mon)) < 0)
+		goto done;
+
+	pos = git_strmap_lookup_index(mon->dirs, path);
+	if (!git_strmap_valid_index(mon->dirs, pos))
+		goto done;
+
+	dir = git_strmap_value_at(mon->dirs, pos);
+	if (!dir->pending)
+		goto done;
+
+	dir->pending = false;
+	if (dir->changed)
+		goto done;
+
+	fsmonitor_contents_free(&dir->contents);
+	if ((error = fsmonitor_contents_copy(&dir->contents, contents)) < 0)
+		fsmonitor_contents_free(&dir->contents);
+	else
+		dir->known = true;
+
+done:
+	git_mutex_unlock(&mon->lock);
+	return error;
+}
+
+#else
+
+int git_fsmonitor_update(
+	git_fsmonitor *mon, size_t prefix_len, bool ignore_case)
+{
+	GIT_UNUSED(mon); GIT_UNUSED(prefix_len); GIT_UNUSED(ignore_case);
+	return 0;
+}
+
+int git_fsmonitor_take(
+	git_vector *contents, git_fsmonitor *mon, const char *path)
+{
+	GIT_UNUSED(contents); GIT_UNUSED(mon); GIT_UNUSED(path);
+	return GIT_ENOTFOUND;
+}
+
+int git_fsmonitor_watch(git_fsmonitor *mon, const char *path)
+{
+	GIT_UNUSED(mon); GIT_UNUSED(path);
+	return 0;
+}
+
+int git_fsmonitor_store(
+	git_fsmonitor *mon, const char *path, const git_vector *contents)
+{
+	GIT_UNUSED(mon); GIT_UNUSED(path); GIT_UNUSED(contents);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_fsmonitor_h__
+#define INCLUDE_fsmonitor_h__
+
+#include "common.h"
+#include "vector.h"
+#include "strmap.h"
+#include "thread-utils.h"
+
+#if defined(__linux__)
+#	define GIT_FSMONITOR
+#endif
+
+/*
+ * Keeps what the directories of the working directory contained the
+ * last time they were read, and has the kernel (inotify) say when
+ * they change.
+ *
+ * A directory which didn't change since it was read doesn't need to
+ * be read again, nor its files lstat()ed: its contents are handed out
+ * as `git_path_dirload_with_stat` gave them, with the stat data of
+ * the files that were written to since then updated. Directories
+ * where files were added, removed or renamed are read again. When the
+ * kernel drops events, everything is.
+ */
+typedef struct fsmonitor_dir fsmonitor_dir;
+
+typedef struct {
+	git_mutex lock;
+	int fd; /* -1 when not watching */
+
+	/* what was kept, by absolute path (with a trailing slash) */
+	git_strmap *dirs;
+
+	/* the same, by watch descriptor */
+	fsmonitor_dir **by_wd;
+	size_t by_wd_size;
+
+	/* the settings what was kept was read with */
+	size_t prefix_len;
+	bool ignore_case;
+
+	size_t hits, misses, updates, overflows;
+} git_fsmonitor;
+
+extern int git_fsmonitor_init(git_fsmonitor *mon);
+extern void git_fsmonitor_free(git_fsmonitor *mon);
+
+/* Start or stop watching; stopping forgets everything that was kept */
+extern int git_fsmonitor_enable(git_fsmonitor *mon, bool enable);
+
+/*
+ * Apply the changes reported since the last call, before a walk;
+ * returns 1 if the monitor can be used for it, 0 if it's not watching
+ */
+extern int git_fsmonitor_update(
+	git_fsmonitor *mon, size_t prefix_len, bool ignore_case);
+
+/*
+ * Copy what `path` contains into `contents`, if it's known and didn't
+ * change. Otherwise, start watching it and return GIT_ENOTFOUND: it
+ * has to be read, then given to `git_fsmonitor_store`.
+ */
+extern int git_fsmonitor_take(
+	git_vector *contents, git_fsmonitor *mon, const char *path);
+
+/*
+ * Like `git_fsmonitor_take` without the copy: returns 1 if `path` is
+ * known, 0 if it has to be read
+ */
+extern int git_fsmonitor_watch(git_fsmonitor *mon, const char *path);
+
+/* Keep what `path` was just read to contain */
+extern int git_fsmonitor_store(
+	git_fsmonitor *mon, const char *path, const git_vector *contents);
+
+#endif
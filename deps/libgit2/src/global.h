@@ -26,6 +26,8 @@ typedef struct {
 git_global_st *git__global_state(void);
 
 extern git_mutex git__mwindow_mutex;
+extern git_mutex git__delta_cache_mutex;
+extern git_mutex git__pack_header_mutex;
 
 #define GIT_GLOBAL (git__global_state())
 
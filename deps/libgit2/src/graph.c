@@ -1,4 +1,3 @@
-
 /*
  * Copyright (C) 2009-2012 the libgit2 contributors
  *
@@ -8,91 +7,349 @@
 
 #include "revwalk.h"
 #include "merge.h"
+#include "commit_graph.h"
+#include "pack_bitmap.h"
+#include "repository.h"
 #include "git2/graph.h"
 
-static int ahead_behind(git_commit_list_node *one, git_commit_list_node *two,
-	size_t *ahead, size_t *behind)
+/*
+ * Ahead/behind counts for any number of tips against one base, in a
+ * single walk. Every commit reached carries a bitmap of the tips it can
+ * be reached from (bit 0 being the base). Commits are visited by
+ * generation (taken from the commit-graph, or computed for the commits
+ * it doesn't have), so all of a commit's descendants in the walk have
+ * been visited (and have painted it) before it is. Once every queued commit
+ * is reachable from all the tips, nothing below them can change the
+ * counts, so the walk stops there instead of going down to the roots.
+ */
+
+#define QUEUED	PARENT1
+#define VISITED	RESULT
+/* STALE: reachable from every tip */
+
+typedef struct {
+	git_revwalk *walk;
+	git_oidmap *bitmaps;
+	git_pool pool;
+	git_pqueue queue;
+	size_t words, tips, nonstale;
+} ahead_behind_walk;
+
+static uint32_t *bitmap_for(ahead_behind_walk *w, git_commit_list_node *commit)
+{
+	khiter_t pos;
+	uint32_t *bits;
+	int ret;
+
+	pos = kh_get(oid, w->bitmaps, &commit->oid);
+	if (pos != kh_end(w->bitmaps))
+		return kh_value(w->bitmaps, pos);
+
+	if ((bits = git_pool_mallocz(&w->pool, 1)) == NULL)
+		return NULL;
+
+	pos = kh_put(oid, w->bitmaps, &commit->oid, &ret);
+	if (ret < 0) {
+		giterr_set_oom();
+		return NULL;
+	}
+
+	kh_value(w->bitmaps, pos) = bits;
+	return bits;
+}
+
+static bool bitmap_full(ahead_behind_walk *w, const uint32_t *bits)
+{
+	size_t i, last = w->tips % 32;
+
+	for (i = 0; i < w->words; ++i) {
+		uint32_t full = (i == w->words - 1 && last) ? (1u << last) - 1 : 0xFFFFFFFF;
+		if (bits[i] != full)
+			return false;
+	}
+
+	return true;
+}
+
+#define BIT_SET(bits, n) ((bits)[(n) / 32] & (1u << ((n) % 32)))
+
+static int paint(ahead_behind_walk *w, git_commit_list_node *commit, const uint32_t *from)
+{
+	uint32_t *bits;
+	size_t i;
+	int error;
+
+	if (commit->flags & STALE)
+		return 0;
+
+	assert(!(commit->flags & VISITED));
+
+	if ((bits = bitmap_for(w, commit)) == NULL)
+		return -1;
+
+	for (i = 0; i < w->words; ++i)
+		bits[i] |= from[i];
+
+	if (bitmap_full(w, bits)) {
+		commit->flags |= STALE;
+		if (commit->flags & QUEUED)
+			w->nonstale--;
+	}
+
+	if (commit->flags & QUEUED)
+		return 0;
+
+	if ((error = git_commit_list_parse(w->walk, commit)) < 0)
+		return error;
+
+	if (git_pqueue_insert(&w->queue, commit) < 0)
+		return -1;
+
+	commit->flags |= QUEUED;
+	if (!(commit->flags & STALE))
+		w->nonstale++;
+
+	return 0;
+}
+
+static int ahead_behind(size_t *ahead, size_t *behind, bool *common,
+	ahead_behind_walk *w, const git_oid *base, const git_oid *targets, size_t count)
 {
 	git_commit_list_node *commit;
-	git_pqueue pq;
-	int i;
-	*ahead = 0;
-	*behind = 0;
+	uint32_t *from;
+	size_t i;
+	unsigned short p;
+	int error;
+
+	memset(ahead, 0x0, count * sizeof(size_t));
+	memset(behind, 0x0, count * sizeof(size_t));
+	if (common)
+		memset(common, 0x0, count * sizeof(bool));
 
-	if (git_pqueue_init(&pq, 2, git_commit_list_time_cmp) < 0)
+	/* the tips themselves are painted from a scratch bitmap */
+	if ((from = git_pool_mallocz(&w->pool, 1)) == NULL)
 		return -1;
-	if (git_pqueue_insert(&pq, one) < 0)
-		goto on_error;
-	if (git_pqueue_insert(&pq, two) < 0)
-		goto on_error;
-
-	while ((commit = git_pqueue_pop(&pq)) != NULL) {
-		if (commit->flags & RESULT ||
-			(commit->flags & (PARENT1 | PARENT2)) == (PARENT1 | PARENT2))
-			continue;
-		else if (commit->flags & PARENT1)
-			(*behind)++;
-		else if (commit->flags & PARENT2)
-			(*ahead)++;
-
-		for (i = 0; i < commit->out_degree; i++) {
-			git_commit_list_node *p = commit->parents[i];
-			if (git_pqueue_insert(&pq, p) < 0)
-				return -1;
+
+	for (i = 0; i <= count; ++i) {
+		const git_oid *oid = i ? &targets[i - 1] : base;
+
+		if ((commit = git_revwalk__commit_lookup(w->walk, oid)) == NULL)
+			return -1;
+
+		/* times alone can't order the walk if clocks were skewed */
+		if ((error = git_commit_list_generations(w->walk, commit)) < 0)
+			return error;
+
+		memset(from, 0x0, w->words * sizeof(uint32_t));
+		from[i / 32] = 1u << (i % 32);
+
+		if ((error = paint(w, commit, from)) < 0)
+			return error;
+	}
+
+	while (w->nonstale > 0 && (commit = git_pqueue_pop(&w->queue)) != NULL) {
+		uint32_t *bits = bitmap_for(w, commit);
+		if (bits == NULL)
+			return -1;
+
+		commit->flags &= ~QUEUED;
+		commit->flags |= VISITED;
+		if (!(commit->flags & STALE))
+			w->nonstale--;
+
+		for (i = 0; i < count; ++i) {
+			bool by_base = BIT_SET(bits, 0) != 0;
+			bool by_target = BIT_SET(bits, i + 1) != 0;
+
+			if (by_base && by_target) {
+				if (common)
+					common[i] = true;
+			} else if (by_base)
+				behind[i]++;
+			else if (by_target)
+				ahead[i]++;
+		}
+
+		for (p = 0; p < commit->out_degree; ++p) {
+			if ((error = paint(w, commit->parents[p], bits)) < 0)
+				return error;
+		}
+	}
+
+	/* whatever is left is reachable from everything */
+	if (common) {
+		while ((commit = git_pqueue_pop(&w->queue)) != NULL) {
+			if (commit->flags & STALE)
+				memset(common, 0x1, count * sizeof(bool));
 		}
-		commit->flags |= RESULT;
 	}
 
-	git_pqueue_free(&pq);
 	return 0;
+}
+
+static int ahead_behind_many(size_t *ahead, size_t *behind, bool *common,
+	git_repository *repo, const git_oid *base, const git_oid *targets, size_t count)
+{
+	ahead_behind_walk w;
+	int error = -1;
+
+	memset(&w, 0x0, sizeof(w));
+	w.tips = count + 1;
+	w.words = (w.tips + 31) / 32;
+
+	if (git_revwalk_new(&w.walk, repo) < 0)
+		return -1;
+
+	if ((w.bitmaps = git_oidmap_alloc()) == NULL) {
+		giterr_set_oom();
+		goto cleanup;
+	}
+
+	if (git_pool_init(&w.pool, (uint32_t)(w.words * sizeof(uint32_t)), 0) < 0 ||
+		git_pqueue_init(&w.queue, 2 * w.tips, git_commit_list_generation_cmp) < 0)
+		goto cleanup;
 
-on_error:
-	git_pqueue_free(&pq);
-	return -1;
+	error = ahead_behind(ahead, behind, common, &w, base, targets, count);
+
+cleanup:
+	git_pqueue_free(&w.queue);
+	git_pool_clear(&w.pool);
+	git_oidmap_free(w.bitmaps);
+	git_revwalk_free(w.walk);
+	return error;
 }
 
 int git_graph_ahead_behind(size_t *ahead, size_t *behind, git_repository *repo,
 	const git_oid *one, const git_oid *two)
+{
+	bool common;
+
+	assert(ahead && behind && repo && one && two);
+
+	if (ahead_behind_many(ahead, behind, &common, repo, one, two, 1) < 0)
+		return -1;
+
+	return common ? 0 : GIT_ENOTFOUND;
+}
+
+int git_graph_ahead_behind_many(size_t *ahead, size_t *behind, git_repository *repo,
+	const git_oid *base, const git_oid targets[], size_t count)
+{
+	assert(ahead && behind && repo && base && (targets || !count));
+
+	return ahead_behind_many(ahead, behind, NULL, repo, base, targets, count);
+}
+
+/*
+ * Whether a commit is an ancestor of (or one of) `from`. Commits whose
+ * generation is below the target's can't have it in their history, so
+ * the walk goes no deeper than that where generations are known.
+ */
+static int commit_reachable(git_repository *repo,
+	const git_oid *oid, const git_oid *from, size_t count)
 {
 	git_revwalk *walk;
-	git_vector list;
-	struct git_commit_list *result = NULL;
-	git_commit_list_node *commit1, *commit2;
-	void *contents[1];
+	git_commit_list_node *target, *commit;
+	git_vector todo = GIT_VECTOR_INIT;
+	size_t i;
+	unsigned short p;
+	int error;
 
 	if (git_revwalk_new(&walk, repo) < 0)
 		return -1;
 
-	commit2 = git_revwalk__commit_lookup(walk, two);
-	if (commit2 == NULL)
-		goto on_error;
+	if ((target = git_revwalk__commit_lookup(walk, oid)) == NULL) {
+		error = -1;
+		goto cleanup;
+	}
+
+	if ((error = git_commit_list_generations(walk, target)) < 0)
+		goto cleanup;
 
-	/* This is just one value, so we can do it on the stack */
-	memset(&list, 0x0, sizeof(git_vector));
-	contents[0] = commit2;
-	list.length = 1;
-	list.contents = contents;
+	for (i = 0; i < count; ++i) {
+		if ((commit = git_revwalk__commit_lookup(walk, &from[i])) == NULL) {
+			error = -1;
+			goto cleanup;
+		}
+
+		if (!(commit->flags & RESULT)) {
+			commit->flags |= RESULT;
+			if ((error = git_vector_insert(&todo, commit)) < 0)
+				goto cleanup;
+		}
+	}
+
+	error = 0;
+
+	while ((commit = git_vector_last(&todo)) != NULL) {
+		git_vector_pop(&todo);
+
+		if (commit == target) {
+			error = 1;
+			break;
+		}
+
+		if ((error = git_commit_list_parse(walk, commit)) < 0)
+			break;
+
+		if (commit->generation != GENERATION_INFINITY &&
+			commit->generation <= target->generation)
+			continue;
 
-	commit1 = git_revwalk__commit_lookup(walk, one);
-	if (commit1 == NULL)
-		goto on_error;
+		for (p = 0; p < commit->out_degree; ++p) {
+			git_commit_list_node *parent = commit->parents[p];
 
-	if (git_merge__bases_many(&result, walk, commit1, &list) < 0)
-		goto on_error;
-	if (ahead_behind(commit1, commit2, ahead, behind) < 0)
-		goto on_error;
+			if (parent->flags & RESULT)
+				continue;
 
-	if (!result) {
-		git_revwalk_free(walk);
-		return GIT_ENOTFOUND;
+			parent->flags |= RESULT;
+			if ((error = git_vector_insert(&todo, parent)) < 0)
+				goto cleanup;
+		}
 	}
 
-	git_commit_list_free(&result);
+cleanup:
+	git_vector_free(&todo);
 	git_revwalk_free(walk);
+	return error;
+}
 
-	return 0;
+int git_graph_reachable_from_any(git_repository *repo,
+	const git_oid *oid, const git_oid from[], size_t count)
+{
+	git_reachable r;
+	git_bitmap reachable = GIT_BITMAP_INIT;
+	git_odb *odb;
+	git_otype type;
+	size_t size, pos;
+	int error;
 
-on_error:
-	git_revwalk_free(walk);
-	return -1;
+	assert(repo && oid && (from || !count));
+
+	if (git_repository_odb__weakptr(&odb, repo) < 0)
+		return -1;
+
+	if ((error = git_odb_read_header(&size, &type, odb, oid)) < 0)
+		return error;
+
+	if (type == GIT_OBJ_COMMIT)
+		return commit_reachable(repo, oid, from, count);
+
+	if (git_reachable_init(&r, repo, NULL) < 0)
+		return -1;
+
+	if ((error = git_reachable_fill(&reachable, &r, from, count, NULL)) == 0)
+		error = git_reachable_position(&pos, &r, oid) == 0 &&
+			git_bitmap_get(&reachable, pos);
+
+	git_bitmap_free(&reachable);
+	git_reachable_free(&r);
+	return error;
+}
+
+int git_graph_write(size_t *count, git_repository *repo,
+	const git_oid tips[], size_t length)
+{
+	assert(repo);
+	return git_commit_graph_write(count, repo, tips, length);
 }
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#include "hashsig.h"
+
+static int hashsig_chunk_cmp(const void *a_, const void *b_)
+{
+	const git_hashsig_chunk *a = a_, *b = b_;
+	return (a->hash < b->hash) ? -1 : (a->hash > b->hash);
+}
+
+int git_hashsig_create(git_hashsig **out, const char *buf, size_t len)
+{
+	git_hashsig *sig;
+	git_hashsig_chunk *chunks;
+	size_t n = 0, i, j;
+
+	sig = git__calloc(1, sizeof(git_hashsig));
+	GITERR_CHECK_ALLOC(sig);
+
+	/* every chunk ends at a newline, at a chunk boundary or at EOF */
+	for (i = 0; i < len; ++i)
+		if (buf[i] == '\n')
+			n++;
+	n += len / HASHSIG_CHUNK + 1;
+
+	chunks = git__malloc(n * sizeof(git_hashsig_chunk));
+	if (!chunks) {
+		git__free(sig);
+		return -1;
+	}
+
+	n = i = 0;
+	while (i < len) {
+		uint32_t hash = 0x811c9dc5;
+		size_t start = i, bytes;
+
+		while (i < len && i - start < HASHSIG_CHUNK) {
+			unsigned char c = (unsigned char)buf[i++];
+
+			/* ignore CR in CRLF, like git does */
+			if (c == '\r' && i < len && buf[i] == '\n')
+				continue;
+
+			hash = (hash ^ c) * 0x01000193;
+			if (c == '\n')
+				break;
+		}
+
+		bytes = i - start;
+		chunks[n].hash = hash;
+		chunks[n].bytes = (uint32_t)bytes;
+		n++;
+		sig->total += bytes;
+	}
+
+	qsort(chunks, n, sizeof(git_hashsig_chunk), hashsig_chunk_cmp);
+
+	/* fold repeated chunks together */
+	for (i = 0, j = 0; i < n; ++i) {
+		if (j > 0 && chunks[j - 1].hash == chunks[i].hash)
+			chunks[j - 1].bytes += chunks[i].bytes;
+		else
+			chunks[j++] = chunks[i];
+	}
+
+	sig->chunks = chunks;
+	sig->length = j;
+
+	*out = sig;
+	return 0;
+}
+
+size_t git_hashsig_common(const git_hashsig *a, const git_hashsig *b)
+{
+	size_t i = 0, j = 0, common = 0;
+
+	while (i < a->length && j < b->length) {
+		uint32_t ha = a->chunks[i].hash, hb = b->chunks[j].hash;
+
+		if (ha < hb)
+			i++;
+		else if (ha > hb)
+			j++;
+		else {
+			common += min(a->chunks[i].bytes, b->chunks[j].bytes);
+			i++;
+			j++;
+		}
+	}
+
+	return common;
+}
+
+unsigned int git_hashsig_compare(const git_hashsig *a, const git_hashsig *b)
+{
+	size_t max_total = a->total > b->total ? a->total : b->total;
+
+	/* empty files are never considered similar to anything */
+	if (a->total == 0 || b->total == 0)
+		return 0;
+
+	return (unsigned int)(git_hashsig_common(a, b) * 100 / max_total);
+}
+
+void git_hashsig_free(git_hashsig *sig)
+{
+	if (!sig)
+		return;
+
+	git__free(sig->chunks);
+	git__free(sig);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_hashsig_h__
+#define INCLUDE_hashsig_h__
+
+#include "common.h"
+#include "git2/oid.h"
+
+/*
+ * Content signature used for rename and copy detection.
+ *
+ * The content is cut into chunks that end at a newline or after
+ * HASHSIG_CHUNK bytes, whichever comes first, and the signature
+ * records how many bytes of content fall into chunks of each hash.
+ * Two signatures are compared by summing the bytes they have in
+ * common, the same estimate that core git uses.
+ */
+
+#define HASHSIG_CHUNK 64
+
+typedef struct {
+	uint32_t hash;
+	uint32_t bytes;
+} git_hashsig_chunk;
+
+typedef struct {
+	git_oid oid;               /* key when cached by blob OID */
+	git_hashsig_chunk *chunks; /* sorted by hash */
+	size_t length;
+	size_t total;              /* bytes of content covered */
+} git_hashsig;
+
+extern int git_hashsig_create(
+	git_hashsig **out, const char *buf, size_t len);
+
+/* Similarity of two signatures, from 0 to 100 */
+extern unsigned int git_hashsig_compare(
+	const git_hashsig *a, const git_hashsig *b);
+
+/* Bytes of content two signatures have in common */
+extern size_t git_hashsig_common(
+	const git_hashsig *a, const git_hashsig *b);
+
+extern void git_hashsig_free(git_hashsig *sig);
+
+#endif
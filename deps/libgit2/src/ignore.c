@@ -2,6 +2,7 @@
 #include "ignore.h"
 #include "path.h"
 #include "config.h"
+#include "hash.h"
 
 #define GIT_IGNORE_INTERNAL		"[internal]exclude"
 #define GIT_IGNORE_FILE_INREPO	"info/exclude"
@@ -359,3 +360,56 @@ cleanup:
 	return error;
 }
 
+static int hash_rules(git_hash_ctx *ctx, git_attr_file *file)
+{
+	unsigned int i;
+	git_attr_rule *rule;
+	uint32_t flags;
+
+	git_vector_foreach(&file->rules, i, rule) {
+		flags = htonl(rule->match.flags);
+
+		if (git_hash_update(ctx, rule->match.pattern, rule->match.length + 1) < 0 ||
+			git_hash_update(ctx, &flags, sizeof(flags)) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int hash_files(
+	git_oid *out, git_attr_file *first, git_vector *files, size_t from)
+{
+	git_hash_ctx ctx;
+	size_t i;
+	int error;
+
+	if (git_hash_ctx_init(&ctx) < 0)
+		return -1;
+
+	error = first ? hash_rules(&ctx, first) : 0;
+
+	for (i = from; !error && i < files->length; ++i)
+		error = hash_rules(&ctx, git_vector_get(files, i));
+
+	if (!error)
+		error = git_hash_final(out, &ctx);
+
+	git_hash_ctx_cleanup(&ctx);
+	return error;
+}
+
+int git_ignore__hash_path(git_oid *out, git_ignores *ign, size_t from)
+{
+	if (from >= ign->ign_path.length) {
+		memset(out, 0x0, sizeof(git_oid));
+		return 0;
+	}
+
+	return hash_files(out, NULL, &ign->ign_path, from);
+}
+
+int git_ignore__hash_global(git_oid *out, git_ignores *ign)
+{
+	return hash_files(out, ign->ign_internal, &ign->ign_global, 0);
+}
@@ -36,4 +36,13 @@ extern void git_ignore__free(git_ignores *ign);
 
 extern int git_ignore__lookup(git_ignores *ign, const char *path, int *ignored);
 
+/*
+ * Digest of the rules of the per directory ignore files past the first
+ * `from` ones (zero when there are none), or of the internal and global
+ * ignores: what is looked up can be kept as long as they don't change
+ */
+extern int git_ignore__hash_path(git_oid *out, git_ignores *ign, size_t from);
+
+extern int git_ignore__hash_global(git_oid *out, git_ignores *ign);
+
 #endif
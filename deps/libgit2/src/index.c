@@ -12,6 +12,7 @@
 #include "index.h"
 #include "tree.h"
 #include "tree-cache.h"
+#include "untracked.h"
 #include "hash.h"
 #include "iterator.h"
 #include "pathspec.h"
@@ -35,6 +36,8 @@ static const unsigned int INDEX_VERSION_NUMBER_EXT = 3;
 static const unsigned int INDEX_HEADER_SIG = 0x44495243;
 static const char INDEX_EXT_TREECACHE_SIG[] = {'T', 'R', 'E', 'E'};
 static const char INDEX_EXT_UNMERGED_SIG[] = {'R', 'E', 'U', 'C'};
+/* not git's "UNTR": see untracked.h */
+static const char INDEX_EXT_UNTRACKED_SIG[] = {'U', 'N', 'T', 'C'};
 
 #define INDEX_OWNER(idx) ((git_repository *)(GIT_REFCOUNT_OWNER(idx)))
 
@@ -309,6 +312,7 @@ static void index_free(git_index *index)
 		index_entry_reuc_free(reuc);
 	}
 	git_vector_free(&index->reuc);
+	git_untracked_cache_free(index->untracked);
 
 	git__free(index->index_file_path);
 	git__free(index);
@@ -463,10 +467,56 @@ int git_index_write(git_index *index)
 	if (error < 0)
 		return error;
 
+	if (index->untracked != NULL)
+		index->untracked->dirty = false;
+
 	index->on_disk = 1;
 	return 0;
 }
 
+int git_index__write_untracked_cache(git_index *index)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_futils_filestamp stamp;
+	git_index *on_disk = NULL;
+	int error;
+
+	if (index->untracked == NULL || !index->untracked->dirty ||
+		!index->index_file_path || !index->on_disk)
+		return 0;
+
+	/* whoever holds the lock is about to write the index anyway */
+	if (git_filebuf_open(
+			&file, index->index_file_path, GIT_FILEBUF_HASH_CONTENTS) < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	/* the entries in memory may differ from the file; so may the file */
+	memcpy(&stamp, &index->stamp, sizeof(stamp));
+	if ((error = git_futils_filestamp_check(&stamp, index->index_file_path)) != 0 ||
+		(error = git_index_open(&on_disk, index->index_file_path)) < 0)
+		goto cleanup;
+
+	git_untracked_cache_free(on_disk->untracked);
+	on_disk->untracked = index->untracked;
+
+	error = write_index(on_disk, &file);
+
+	on_disk->untracked = NULL;
+
+	if (!error && !(error = git_filebuf_commit(&file, GIT_INDEX_FILE_MODE))) {
+		index->untracked->dirty = false;
+		error = git_futils_filestamp_check(
+			&index->stamp, index->index_file_path);
+	}
+
+cleanup:
+	git_filebuf_cleanup(&file);
+	git_index_free(on_disk);
+	return (error < 0) ? error : 0;
+}
+
 int git_index_write_tree(git_oid *oid, git_index *index)
 {
 	git_repository *repo;
@@ -1272,6 +1322,11 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 		} else if (memcmp(dest.signature, INDEX_EXT_UNMERGED_SIG, 4) == 0) {
 			if (read_reuc(index, buffer + 8, dest.extension_size) < 0)
 				return 0;
+		} else if (memcmp(dest.signature, INDEX_EXT_UNTRACKED_SIG, 4) == 0) {
+			/* a cache: one that can't be read is just not used */
+			if (index->untracked == NULL && git_untracked_cache_read(
+					&index->untracked, buffer + 8, dest.extension_size) < 0)
+				giterr_clear();
 		}
 		/* else, unsupported extension. We cannot parse this, but we can skip
 		 * it by returning `total_size */
@@ -1532,6 +1587,26 @@ done:
 	return error;
 }
 
+static int write_untracked_extension(git_index *index, git_filebuf *file)
+{
+	git_buf untracked_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	int error;
+
+	if ((error = git_untracked_cache_write(&untracked_buf, index->untracked)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_UNTRACKED_SIG, 4);
+	extension.extension_size = (uint32_t)untracked_buf.size;
+
+	error = write_extension(file, &extension, &untracked_buf);
+
+done:
+	git_buf_free(&untracked_buf);
+	return error;
+}
+
 static int write_index(git_index *index, git_filebuf *file)
 {
 	git_oid hash_final;
@@ -1558,6 +1633,9 @@ static int write_index(git_index *index, git_filebuf *file)
 	if (index->reuc.length > 0 && write_reuc_extension(index, file) < 0)
 		return -1;
 
+	if (index->untracked != NULL && write_untracked_extension(index, file) < 0)
+		return -1;
+
 	/* get out the hash for all the contents we've appended to the file */
 	git_filebuf_hash(&hash_final, file);
 
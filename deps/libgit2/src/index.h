@@ -11,6 +11,7 @@
 #include "filebuf.h"
 #include "vector.h"
 #include "tree-cache.h"
+#include "untracked.h"
 #include "git2/odb.h"
 #include "git2/index.h"
 
@@ -35,6 +36,9 @@ struct git_index {
 
 	git_vector reuc;
 
+	/* survives the index being read again: it's checked against the disk */
+	git_untracked_cache *untracked;
+
 	git_vector_cmp entries_cmp_path;
 	git_vector_cmp entries_search;
 	git_vector_cmp entries_search_path;
@@ -51,4 +55,10 @@ extern int git_index_entry__cmp_icase(const void *a, const void *b);
 extern int git_index_read_tree_match(
 	git_index *index, git_tree *tree, git_strarray *strspec);
 
+/*
+ * Save the untracked cache if it changed since it was read, provided
+ * the index file itself didn't; nothing else of the index is written
+ */
+extern int git_index__write_untracked_cache(git_index *index);
+
 #endif
@@ -17,9 +17,14 @@
 #include "posix.h"
 #include "pack.h"
 #include "filebuf.h"
+#include "indexer.h"
+#include "thread-utils.h"
 
 #define UINT31_MAX (0x7FFFFFFF)
 
+/* 0 means one thread per CPU; see git_indexer__set_default_threads */
+static unsigned int default_threads = 1;
+
 struct entry {
 	git_oid oid;
 	uint32_t crc;
@@ -55,11 +60,15 @@ struct git_indexer_stream {
 	git_oid hash;
 	git_transfer_progress_callback progress_cb;
 	void *progress_payload;
+	unsigned int nr_threads;
 	char objbuf[8*1024];
 };
 
 struct delta_info {
 	git_off_t delta_off;
+	git_otype type;
+	git_oid oid;
+	uint32_t crc;
 };
 
 const git_oid *git_indexer_hash(const git_indexer *idx)
@@ -160,6 +169,7 @@ int git_indexer_stream_new(
 	GITERR_CHECK_ALLOC(idx);
 	idx->progress_cb = progress_cb;
 	idx->progress_payload = progress_payload;
+	idx->nr_threads = default_threads;
 
 	error = git_buf_joinpath(&path, prefix, suff);
 	if (error < 0)
@@ -181,14 +191,33 @@ cleanup:
 	return -1;
 }
 
+unsigned int git_indexer_stream_set_threads(git_indexer_stream *idx, unsigned int n)
+{
+	assert(idx);
+
+	idx->nr_threads = n;
+	return n;
+}
+
+void git_indexer__set_default_threads(unsigned int n)
+{
+	default_threads = n;
+}
+
+unsigned int git_indexer__default_threads(void)
+{
+	return default_threads;
+}
+
 /* Try to store the delta so we can try to resolve it later */
-static int store_delta(git_indexer_stream *idx)
+static int store_delta(git_indexer_stream *idx, git_otype type)
 {
 	struct delta_info *delta;
 
 	delta = git__calloc(1, sizeof(struct delta_info));
 	GITERR_CHECK_ALLOC(delta);
 	delta->delta_off = idx->entry_start;
+	delta->type = type;
 
 	if (git_vector_insert(&idx->deltas, delta) < 0)
 		return -1;
@@ -337,52 +366,67 @@ on_error:
 	return -1;
 }
 
-static int hash_and_save(git_indexer_stream *idx, git_rawobj *obj, git_off_t entry_start)
+/*
+ * Inflate a delta and work out the name and CRC of the object it
+ * produces. This only reads from the pack, so it's safe to run on
+ * several deltas at once.
+ */
+static int resolve_delta(git_indexer_stream *idx, struct delta_info *delta)
+{
+	git_rawobj obj;
+	git_off_t off = delta->delta_off;
+	int error;
+
+	if (git_packfile_unpack(&obj, idx->pack, &off) < 0)
+		return -1;
+
+	/* FIXME: Parse the object instead of hashing it */
+	error = git_odb__hashobj(&delta->oid, &obj);
+	git__free(obj.data);
+
+	if (error < 0) {
+		giterr_set(GITERR_INDEXER, "Failed to hash object");
+		return -1;
+	}
+
+	return crc_object(&delta->crc, &idx->pack->mwf,
+		delta->delta_off, off - delta->delta_off);
+}
+
+static int save_entry(git_indexer_stream *idx, struct delta_info *delta)
 {
 	int i;
-	git_oid oid;
-	size_t entry_size;
 	struct entry *entry;
 	struct git_pack_entry *pentry;
 
 	entry = git__calloc(1, sizeof(*entry));
 	GITERR_CHECK_ALLOC(entry);
 
-	if (entry_start > UINT31_MAX) {
+	if (delta->delta_off > UINT31_MAX) {
 		entry->offset = UINT32_MAX;
-		entry->offset_long = entry_start;
+		entry->offset_long = delta->delta_off;
 	} else {
-		entry->offset = (uint32_t)entry_start;
-	}
-
-	/* FIXME: Parse the object instead of hashing it */
-	if (git_odb__hashobj(&oid, obj) < 0) {
-		giterr_set(GITERR_INDEXER, "Failed to hash object");
-		return -1;
+		entry->offset = (uint32_t)delta->delta_off;
 	}
 
 	pentry = git__malloc(sizeof(struct git_pack_entry));
 	GITERR_CHECK_ALLOC(pentry);
 
-	git_oid_cpy(&pentry->sha1, &oid);
-	pentry->offset = entry_start;
+	git_oid_cpy(&pentry->sha1, &delta->oid);
+	pentry->offset = delta->delta_off;
 	if (git_vector_insert(&idx->pack->cache, pentry) < 0) {
 		git__free(pentry);
 		goto on_error;
 	}
 
-	git_oid_cpy(&entry->oid, &oid);
-	entry->crc = crc32(0L, Z_NULL, 0);
-
-	entry_size = (size_t)(idx->off - entry_start);
-	if (crc_object(&entry->crc, &idx->pack->mwf, entry_start, entry_size) < 0)
-		goto on_error;
+	git_oid_cpy(&entry->oid, &delta->oid);
+	entry->crc = delta->crc;
 
 	/* Add the object to the list */
 	if (git_vector_insert(&idx->objects, entry) < 0)
 		goto on_error;
 
-	for (i = oid.id[0]; i < 256; ++i) {
+	for (i = delta->oid.id[0]; i < 256; ++i) {
 		idx->fanout[i]++;
 	}
 
@@ -390,14 +434,17 @@ static int hash_and_save(git_indexer_stream *idx, git_rawobj *obj, git_off_t ent
 
 on_error:
 	git__free(entry);
-	git__free(obj->data);
 	return -1;
 }
 
-static void do_progress_callback(git_indexer_stream *idx, git_transfer_progress *stats)
+static int do_progress_callback(git_indexer_stream *idx, git_transfer_progress *stats)
 {
-	if (!idx->progress_cb) return;
-	idx->progress_cb(stats, idx->progress_payload);
+	if (idx->progress_cb && idx->progress_cb(stats, idx->progress_payload)) {
+		giterr_clear();
+		return GIT_EUSER;
+	}
+
+	return 0;
 }
 
 int git_indexer_stream_add(git_indexer_stream *idx, const void *data, size_t size, git_transfer_progress *stats)
@@ -454,7 +501,8 @@ int git_indexer_stream_add(git_indexer_stream *idx, const void *data, size_t siz
 		stats->received_objects = 0;
 		stats->indexed_objects = 0;
 		stats->total_objects = (unsigned int)idx->nr_objects;
-		do_progress_callback(idx, stats);
+		if ((error = do_progress_callback(idx, stats)) < 0)
+			return error;
 	}
 
 	/* Now that we have data in the pack, let's try to parse it */
@@ -523,7 +571,7 @@ int git_indexer_stream_add(git_indexer_stream *idx, const void *data, size_t siz
 			goto on_error;
 
 		if (idx->have_delta) {
-			error = store_delta(idx);
+			error = store_delta(idx, type);
 		} else {
 			error = store_object(idx);
 		}
@@ -536,7 +584,8 @@ int git_indexer_stream_add(git_indexer_stream *idx, const void *data, size_t siz
 		}
 		stats->received_objects++;
 
-		do_progress_callback(idx, stats);
+		if ((error = do_progress_callback(idx, stats)) < 0)
+			return error;
 	}
 
 	return 0;
@@ -568,27 +617,242 @@ static int index_path_stream(git_buf *path, git_indexer_stream *idx, const char
 	return git_buf_oom(path) ? -1 : 0;
 }
 
-static int resolve_deltas(git_indexer_stream *idx, git_transfer_progress *stats)
+static int resolve_deltas_serial(
+	git_indexer_stream *idx, git_vector *deltas, git_transfer_progress *stats)
+{
+	unsigned int i;
+	int error;
+	struct delta_info *delta;
+
+	git_vector_foreach(deltas, i, delta) {
+		if (resolve_delta(idx, delta) < 0 || save_entry(idx, delta) < 0)
+			return -1;
+
+		stats->indexed_objects++;
+		if ((error = do_progress_callback(idx, stats)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+#ifdef GIT_THREADS
+
+/* deltas handed to a worker at a time */
+#define RESOLVE_BATCH 64
+
+struct resolve_work {
+	git_indexer_stream *idx;
+	git_vector *deltas;
+
+	git_mutex mutex;
+	git_cond cond;
+	size_t next;
+	size_t resolved;
+	unsigned int running;
+
+	/* errors are per-thread, so the first one is carried over */
+	int failed;
+	int error_class;
+	char *error_message;
+};
+
+static void resolve_work_fail(struct resolve_work *work)
+{
+	const git_error *err = giterr_last();
+
+	if (work->failed++)
+		return;
+
+	work->error_class = err ? err->klass : GITERR_INDEXER;
+	work->error_message = git__strdup(err ? err->message : "Failed to resolve delta");
+}
+
+static void *resolve_deltas_thread(void *arg)
+{
+	struct resolve_work *work = arg;
+	size_t i, start, end;
+
+	git_mutex_lock(&work->mutex);
+
+	while (!work->failed && work->next < work->deltas->length) {
+		start = work->next;
+		end = min(start + RESOLVE_BATCH, work->deltas->length);
+		work->next = end;
+		git_mutex_unlock(&work->mutex);
+
+		for (i = start; i < end; ++i)
+			if (resolve_delta(work->idx, git_vector_get(work->deltas, i)) < 0)
+				break;
+
+		git_mutex_lock(&work->mutex);
+		if (i < end)
+			resolve_work_fail(work);
+		work->resolved += i - start;
+		git_cond_signal(&work->cond);
+	}
+
+	work->running--;
+	git_cond_signal(&work->cond);
+	git_mutex_unlock(&work->mutex);
+
+	return NULL;
+}
+
+/*
+ * Resolve the deltas on `nr_threads` threads, which take batches of
+ * consecutive deltas (and so, usually, whole chains sharing a base)
+ * off a common list. Progress is reported from the calling thread.
+ */
+static int resolve_deltas_threaded(
+	git_indexer_stream *idx,
+	git_vector *deltas,
+	unsigned int nr_threads,
+	git_transfer_progress *stats)
+{
+	struct resolve_work work;
+	git_thread *threads;
+	unsigned int i, started = 0, indexed = stats->indexed_objects;
+	struct delta_info *delta;
+	int error = 0, cancelled = 0;
+
+	threads = git__calloc(nr_threads, sizeof(git_thread));
+	GITERR_CHECK_ALLOC(threads);
+
+	memset(&work, 0, sizeof(work));
+	work.idx = idx;
+	work.deltas = deltas;
+	git_mutex_init(&work.mutex);
+	git_cond_init(&work.cond);
+
+	/* base lookups must not re-sort the cache under the workers */
+	git_vector_sort(&idx->pack->cache);
+
+	git_mutex_lock(&work.mutex);
+
+	for (i = 0; i < nr_threads; ++i) {
+		if (git_thread_create(&threads[i], NULL, resolve_deltas_thread, &work) != 0)
+			break;
+		work.running++;
+		started++;
+	}
+
+	while (work.running > 0) {
+		git_cond_wait(&work.cond, &work.mutex);
+
+		if (!cancelled && stats->indexed_objects != indexed + work.resolved) {
+			stats->indexed_objects = (unsigned int)(indexed + work.resolved);
+			git_mutex_unlock(&work.mutex);
+			cancelled = do_progress_callback(idx, stats) < 0;
+			git_mutex_lock(&work.mutex);
+
+			/* stops the workers at their next batch */
+			if (cancelled)
+				work.failed++;
+		}
+	}
+
+	git_mutex_unlock(&work.mutex);
+
+	for (i = 0; i < started; ++i)
+		git_thread_join(threads[i], NULL);
+
+	if (!started) {
+		giterr_set(GITERR_THREAD, "unable to create thread");
+		error = -1;
+	} else if (cancelled) {
+		error = GIT_EUSER;
+	} else if (work.failed) {
+		giterr_set(work.error_class, "%s",
+			work.error_message ? work.error_message : "Failed to resolve delta");
+		error = -1;
+	}
+
+	/* only now can the results go into the shared lists */
+	git_vector_foreach(deltas, i, delta) {
+		if (error < 0)
+			break;
+		error = save_entry(idx, delta);
+	}
+
+	git__free(work.error_message);
+	git_cond_free(&work.cond);
+	git_mutex_free(&work.mutex);
+	git__free(threads);
+
+	return error;
+}
+
+#endif
+
+#ifdef GIT_THREADS
+
+static int resolve_deltas_parallel(
+	git_indexer_stream *idx, unsigned int nr_threads, git_transfer_progress *stats)
 {
 	unsigned int i;
 	struct delta_info *delta;
+	git_vector ofs_deltas = GIT_VECTOR_INIT, deferred = GIT_VECTOR_INIT;
+	int error;
 
+	if ((error = git_vector_init(&ofs_deltas, idx->deltas.length, NULL)) < 0)
+		goto cleanup;
+
+	/*
+	 * A REF_DELTA finds its base through the pack's list of resolved
+	 * objects, which the workers can't add to, so those are done here
+	 * first. The ones whose base is itself a delta wait until after
+	 * the OFS_DELTAs, which only refer to offsets, have been spread
+	 * across the workers.
+	 */
 	git_vector_foreach(&idx->deltas, i, delta) {
-		git_rawobj obj;
+		if (delta->type != GIT_OBJ_REF_DELTA) {
+			if ((error = git_vector_insert(&ofs_deltas, delta)) < 0)
+				goto cleanup;
+			continue;
+		}
 
-		idx->off = delta->delta_off;
-		if (git_packfile_unpack(&obj, idx->pack, &idx->off) < 0)
-			return -1;
+		if (resolve_delta(idx, delta) < 0) {
+			giterr_clear();
+			if ((error = git_vector_insert(&deferred, delta)) < 0)
+				goto cleanup;
+			continue;
+		}
 
-		if (hash_and_save(idx, &obj, delta->delta_off) < 0)
-			return -1;
+		if ((error = save_entry(idx, delta)) < 0)
+			goto cleanup;
 
-		git__free(obj.data);
 		stats->indexed_objects++;
-		do_progress_callback(idx, stats);
+		if ((error = do_progress_callback(idx, stats)) < 0)
+			goto cleanup;
 	}
 
-	return 0;
+	if ((error = resolve_deltas_threaded(idx, &ofs_deltas, nr_threads, stats)) < 0)
+		goto cleanup;
+
+	error = resolve_deltas_serial(idx, &deferred, stats);
+
+cleanup:
+	git_vector_free(&ofs_deltas);
+	git_vector_free(&deferred);
+	return error;
+}
+
+#endif
+
+static int resolve_deltas(git_indexer_stream *idx, git_transfer_progress *stats)
+{
+	unsigned int nr_threads = idx->nr_threads;
+
+	if (!nr_threads)
+		nr_threads = git_online_cpus();
+
+#ifdef GIT_THREADS
+	if (nr_threads > 1 && idx->deltas.length > RESOLVE_BATCH)
+		return resolve_deltas_parallel(idx, nr_threads, stats);
+#endif
+
+	return resolve_deltas_serial(idx, &idx->deltas, stats);
 }
 
 int git_indexer_stream_finalize(git_indexer_stream *idx, git_transfer_progress *stats)
@@ -601,6 +865,7 @@ int git_indexer_stream_finalize(git_indexer_stream *idx, git_transfer_progress *
 	void *packfile_hash;
 	git_oid file_hash;
 	git_hash_ctx ctx;
+	int error;
 
 	if (git_hash_ctx_init(&ctx) < 0)
 		return -1;
@@ -612,8 +877,8 @@ int git_indexer_stream_finalize(git_indexer_stream *idx, git_transfer_progress *
 	}
 
 	if (idx->deltas.length > 0)
-		if (resolve_deltas(idx, stats) < 0)
-			return -1;
+		if ((error = resolve_deltas(idx, stats)) < 0)
+			return error;
 
 	if (stats->indexed_objects != stats->total_objects) {
 		giterr_set(GITERR_INDEXER, "Indexing error: early EOF");
@@ -707,6 +972,7 @@ int git_indexer_stream_finalize(git_indexer_stream *idx, git_transfer_progress *
 
 	git_mwindow_free_all(&idx->pack->mwf);
 	p_close(idx->pack->mwf.fd);
+	idx->pack->mwf.fd = -1;
 
 	if (index_path_stream(&filename, idx, ".pack") < 0)
 		goto on_error;
@@ -720,6 +986,7 @@ int git_indexer_stream_finalize(git_indexer_stream *idx, git_transfer_progress *
 on_error:
 	git_mwindow_free_all(&idx->pack->mwf);
 	p_close(idx->pack->mwf.fd);
+	idx->pack->mwf.fd = -1;
 	git_filebuf_cleanup(&idx->index_file);
 	git_buf_free(&filename);
 	git_hash_ctx_cleanup(&ctx);
@@ -743,10 +1010,19 @@ void git_indexer_stream_free(git_indexer_stream *idx)
 		git_vector_foreach(&idx->pack->cache, i, pe)
 			git__free(pe);
 		git_vector_free(&idx->pack->cache);
+		git_packfile__delta_cache_clear(idx->pack);
+		if (idx->opened_pack) {
+			git_mwindow_free_all(&idx->pack->mwf);
+			git_mwindow_file_deregister(&idx->pack->mwf);
+		}
+		if (idx->pack->mwf.fd >= 0)
+			p_close(idx->pack->mwf.fd);
 	}
 	git_vector_foreach(&idx->deltas, i, delta)
 		git__free(delta);
 	git_vector_free(&idx->deltas);
+	/* removes the temporary pack unless finalize moved it in place */
+	git_filebuf_cleanup(&idx->pack_file);
 	git__free(idx->pack);
 	git__free(idx);
 }
@@ -1059,6 +1335,7 @@ void git_indexer_free(git_indexer *idx)
 	git_vector_foreach(&idx->pack->cache, i, pe)
 		git__free(pe);
 	git_vector_free(&idx->pack->cache);
+	git_packfile__delta_cache_clear(idx->pack);
 	git__free(idx->pack);
 	git__free(idx);
 }
@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) 2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_indexer_h__
+#define INCLUDE_indexer_h__
+
+#include "common.h"
+#include "git2/indexer.h"
+
+/*
+ * Number of threads new streaming indexers resolve deltas with,
+ * 0 meaning one per CPU. Set through git_libgit2_opts().
+ */
+extern void git_indexer__set_default_threads(unsigned int n);
+extern unsigned int git_indexer__default_threads(void);
+
+#endif
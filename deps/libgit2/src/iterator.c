@@ -9,9 +9,35 @@
 #include "tree.h"
 #include "ignore.h"
 #include "buffer.h"
+#include "dirscan.h"
+#include "fsmonitor.h"
+#include "untracked.h"
+#include "thread-utils.h"
 #include "git2/submodule.h"
 #include <ctype.h>
 
+/* 0 means one thread per CPU; see git_iterator__set_workdir_threads */
+static unsigned int workdir_threads = 1;
+
+void git_iterator__set_workdir_threads(unsigned int n)
+{
+	workdir_threads = n;
+}
+
+unsigned int git_iterator__default_workdir_threads(void)
+{
+	return workdir_threads;
+}
+
+unsigned int git_iterator__workdir_threads(void)
+{
+#ifdef GIT_THREADS
+	return workdir_threads ? workdir_threads : (unsigned int)git_online_cpus();
+#else
+	return 1;
+#endif
+}
+
 #define ITERATOR_SET_CB(P,NAME_LC) do { \
 	(P)->cb.current = NAME_LC ## _iterator__current; \
 	(P)->cb.at_end  = NAME_LC ## _iterator__at_end; \
@@ -505,6 +531,7 @@ struct workdir_iterator_frame {
 	workdir_iterator_frame *next;
 	git_vector entries;
 	size_t index;
+	git_untracked_dir *untracked; /* what's kept of it, entry for entry */
 };
 
 typedef struct {
@@ -517,6 +544,10 @@ typedef struct {
 	git_buf path;
 	size_t root_len;
 	int is_ignored;
+	git_dirscan *scan; /* reads the next directories ahead, if threaded */
+	git_fsmonitor *monitor; /* knows the directories that didn't change */
+	git_index *index;
+	git_untracked_cache *untracked; /* the same, without a monitor */
 } workdir_iterator;
 
 GIT_INLINE(bool) path_is_dotgit(const git_path_with_stat *ps)
@@ -558,13 +589,19 @@ static workdir_iterator_frame *workdir_iterator__alloc_frame(
 	return wf;
 }
 
-static void workdir_iterator__free_frame(workdir_iterator_frame *wf)
+static void workdir_iterator__clear_frame(workdir_iterator_frame *wf)
 {
 	unsigned int i;
 	git_path_with_stat *path;
 
 	git_vector_foreach(&wf->entries, i, path)
 		git__free(path);
+	git_vector_clear(&wf->entries);
+}
+
+static void workdir_iterator__free_frame(workdir_iterator_frame *wf)
+{
+	workdir_iterator__clear_frame(wf);
 	git_vector_free(&wf->entries);
 	git__free(wf);
 }
@@ -599,15 +636,190 @@ static void workdir_iterator__seek_frame_start(
 		wf->index++;
 }
 
+/* Whether the directory at `wi->path` didn't change since it was kept */
+static bool workdir_iterator__is_kept(workdir_iterator *wi)
+{
+	struct stat st;
+	git_untracked_dir *dir = git_untracked_cache_lookup(
+		wi->untracked, wi->path.ptr + wi->root_len);
+
+	return (dir != NULL && p_lstat(wi->path.ptr, &st) == 0 &&
+		git_untracked_dir_is_fresh(dir, &st));
+}
+
+/*
+ * Stat again an entry of a directory that didn't change, if the index
+ * tracks it: the files themselves may have
+ */
+static int workdir_iterator__restat(
+	workdir_iterator *wi, git_path_with_stat *ps)
+{
+	size_t dir_size = wi->path.size;
+	bool is_dir = (ps->path[ps->path_len - 1] == '/');
+	int tracked, error = 0;
+
+	if (is_dir)
+		ps->path[ps->path_len - 1] = '\0';
+	tracked = (git_index_find(wi->index, ps->path) >= 0);
+	if (is_dir)
+		ps->path[ps->path_len - 1] = '/';
+
+	if (!tracked)
+		return 0;
+
+	if (git_buf_puts(&wi->path, ps->path + (dir_size - wi->root_len)) < 0)
+		return -1;
+
+	/* it can only have been replaced along with its directory */
+	if (p_lstat(wi->path.ptr, &ps->st) < 0 ||
+		S_ISDIR(ps->st.st_mode) != is_dir)
+		error = GIT_ENOTFOUND;
+
+	git_buf_truncate(&wi->path, dir_size);
+	return error;
+}
+
+/*
+ * Fill a frame with what the directory at `wi->path` was kept to
+ * contain, if it didn't change since; `st` is how it is now
+ */
+static int workdir_iterator__take_untracked(
+	workdir_iterator *wi, workdir_iterator_frame *wf, struct stat *st)
+{
+	const char *path = wi->path.ptr + wi->root_len;
+	size_t i, dir_len = wi->path.size - wi->root_len;
+	git_untracked_dir *dir;
+	git_untracked_entry *entry;
+	git_path_with_stat *ps;
+	int error;
+
+	if (p_lstat(wi->path.ptr, st) < 0) {
+		st->st_mode = 0;
+		return GIT_ENOTFOUND;
+	}
+
+	dir = git_untracked_cache_lookup(wi->untracked, path);
+	if (dir == NULL || !git_untracked_dir_is_fresh(dir, st))
+		goto miss;
+
+	git_vector_foreach(&dir->entries, i, entry) {
+		ps = git__calloc(1, sizeof(git_path_with_stat) + dir_len + entry->name_len + 2);
+		GITERR_CHECK_ALLOC(ps);
+
+		ps->path_len = dir_len + entry->name_len;
+		memcpy(ps->path, path, dir_len);
+		memcpy(ps->path + dir_len, entry->name, entry->name_len);
+		ps->st.st_mode = entry->mode;
+
+		if (git_vector_insert(&wf->entries, ps) < 0) {
+			git__free(ps);
+			return -1;
+		}
+
+		if ((error = workdir_iterator__restat(wi, ps)) < 0) {
+			workdir_iterator__clear_frame(wf);
+			if (error != GIT_ENOTFOUND)
+				return error;
+			goto miss;
+		}
+	}
+
+	git_vector_sort(&wf->entries);
+
+	wf->untracked = dir;
+	wi->untracked->hits++;
+	return 0;
+
+miss:
+	wi->untracked->misses++;
+	return GIT_ENOTFOUND;
+}
+
+/* Check what was kept about the ignored entries of a frame still holds */
+static int workdir_iterator__check_ignores(
+	workdir_iterator *wi, workdir_iterator_frame *wf, size_t ignores_from)
+{
+	git_oid oid;
+
+	if (git_ignore__hash_path(&oid, &wi->ignores, ignores_from) < 0)
+		return -1;
+
+	git_untracked_cache_set_ignore_oid(wi->untracked, wf->untracked, &oid);
+	return 0;
+}
+
+/*
+ * Have the subdirectories of a directory just entered read in the
+ * background, while the walk goes through its files
+ */
+static int workdir_iterator__scan_ahead(
+	workdir_iterator *wi, workdir_iterator_frame *wf)
+{
+	size_t i;
+	int error;
+	git_path_with_stat *ps;
+
+	for (i = wf->index; i < wf->entries.length; ++i) {
+		ps = git_vector_get(&wf->entries, i);
+
+		if (!S_ISDIR(ps->st.st_mode) || path_is_dotgit(ps))
+			continue;
+
+		git_buf_truncate(&wi->path, wi->root_len);
+		if (git_buf_put(&wi->path, ps->path, ps->path_len) < 0)
+			return -1;
+
+		/* nothing to read in the ones that didn't change */
+		if (wi->monitor != NULL &&
+			(error = git_fsmonitor_watch(wi->monitor, wi->path.ptr)) != 0) {
+			if (error < 0)
+				return -1;
+			continue;
+		}
+
+		if (wi->untracked != NULL && workdir_iterator__is_kept(wi))
+			continue;
+
+		if (git_dirscan_queue(wi->scan, wi->path.ptr) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 static int workdir_iterator__expand_dir(workdir_iterator *wi)
 {
 	int error;
+	struct stat st;
+	size_t ignores_from = 0;
 	workdir_iterator_frame *wf = workdir_iterator__alloc_frame(wi);
 	GITERR_CHECK_ALLOC(wf);
 
-	error = git_path_dirload_with_stat(
-		wi->path.ptr, wi->root_len, wi->base.ignore_case,
-		wi->base.start, wi->base.end, &wf->entries);
+	if (wi->monitor != NULL)
+		error = git_fsmonitor_take(&wf->entries, wi->monitor, wi->path.ptr);
+	else if (wi->untracked != NULL)
+		error = workdir_iterator__take_untracked(wi, wf, &st);
+	else
+		error = GIT_ENOTFOUND;
+
+	/* unless it didn't change since the last walk, read it */
+	if (error == GIT_ENOTFOUND) {
+		if (wi->scan != NULL)
+			error = git_dirscan_take(&wf->entries, wi->scan, wi->path.ptr);
+		else
+			error = git_path_dirload_with_stat(
+				wi->path.ptr, wi->root_len, wi->base.ignore_case,
+				wi->base.start, wi->base.end, &wf->entries);
+
+		if (!error && wi->monitor != NULL)
+			error = git_fsmonitor_store(
+				wi->monitor, wi->path.ptr, &wf->entries);
+		else if (!error && wi->untracked != NULL && st.st_mode != 0)
+			error = git_untracked_cache_store(&wf->untracked, wi->untracked,
+				wi->path.ptr + wi->root_len, &st, &wf->entries);
+	}
+	else if (!error && wi->scan != NULL)
+		git_dirscan_drop(wi->scan, wi->path.ptr);
 
 	if (error < 0 || wf->entries.length == 0) {
 		workdir_iterator__free_frame(wf);
@@ -619,12 +831,20 @@ static int workdir_iterator__expand_dir(workdir_iterator *wi)
 	/* only push new ignores if this is not top level directory */
 	if (wi->stack != NULL) {
 		ssize_t slash_pos = git_buf_rfind_next(&wi->path, '/');
+		ignores_from = wi->ignores.ign_path.length;
 		(void)git_ignore__push_dir(&wi->ignores, &wi->path.ptr[slash_pos + 1]);
 	}
 
 	wf->next  = wi->stack;
 	wi->stack = wf;
 
+	if (wf->untracked != NULL &&
+		workdir_iterator__check_ignores(wi, wf, ignores_from) < 0)
+		return -1;
+
+	if (wi->scan != NULL && workdir_iterator__scan_ahead(wi, wf) < 0)
+		return -1;
+
 	return workdir_iterator__update_entry(wi);
 }
 
@@ -655,6 +875,11 @@ static int workdir_iterator__advance(
 	if (wi->entry.path == NULL)
 		return 0;
 
+	/* a directory left without going in won't be read */
+	if (wi->scan != NULL &&
+		(S_ISDIR(wi->entry.mode) || S_ISGITLINK(wi->entry.mode)))
+		git_dirscan_drop(wi->scan, wi->path.ptr);
+
 	while (1) {
 		wf   = wi->stack;
 		next = git_vector_get(&wf->entries, ++wf->index);
@@ -696,6 +921,77 @@ static int workdir_iterator__seek(git_iterator *self, const char *prefix)
 	return 0;
 }
 
+static int workdir_iterator__new_scan(workdir_iterator *wi)
+{
+	unsigned int nr_threads = git_iterator__workdir_threads();
+
+	if (nr_threads < 2)
+		return 0;
+
+	return git_dirscan_new(&wi->scan, nr_threads, wi->root_len,
+		wi->base.ignore_case, wi->base.start, wi->base.end);
+}
+
+/* Directories which didn't change since the last walk needn't be read */
+static int workdir_iterator__update_monitor(workdir_iterator *wi)
+{
+	git_fsmonitor *mon = &wi->base.repo->workdir_monitor;
+	int error;
+
+	wi->monitor = NULL;
+
+	/* what it keeps is whole directories */
+	if (wi->base.start != NULL || wi->base.end != NULL)
+		return 0;
+
+	error = git_fsmonitor_update(mon, wi->root_len, wi->base.ignore_case);
+	if (error > 0)
+		wi->monitor = mon;
+
+	return (error < 0) ? -1 : 0;
+}
+
+/* What was kept about ignored entries holds as long as the global rules do */
+static int workdir_iterator__check_excludes(workdir_iterator *wi)
+{
+	git_oid oid;
+
+	if (git_ignore__hash_global(&oid, &wi->ignores) < 0)
+		return -1;
+
+	git_untracked_cache_update(wi->untracked, &oid, wi->base.ignore_case);
+	return 0;
+}
+
+/*
+ * Without a monitor, what the directories contained can be kept in the
+ * index instead, if core.untrackedCache says so
+ */
+static int workdir_iterator__update_untracked(workdir_iterator *wi)
+{
+	int enabled;
+
+	wi->untracked = NULL;
+
+	if (wi->monitor != NULL ||
+		wi->base.start != NULL || wi->base.end != NULL)
+		return 0;
+
+	if (git_repository__cvar(
+			&enabled, wi->base.repo, GIT_CVAR_UNTRACKED_CACHE) < 0)
+		return -1;
+
+	if (enabled != GIT_UNTRACKED_CACHE_TRUE)
+		return 0;
+
+	if (wi->index->untracked == NULL &&
+		git_untracked_cache_new(&wi->index->untracked) < 0)
+		return -1;
+
+	wi->untracked = wi->index->untracked;
+	return 0;
+}
+
 static int workdir_iterator__reset(
 	git_iterator *self, const char *start, const char *end)
 {
@@ -711,6 +1007,19 @@ static int workdir_iterator__reset(
 	if (iterator__reset_range(self, start, end) < 0)
 		return -1;
 
+	/* what was read ahead was read for the old range */
+	if (wi->scan != NULL) {
+		git_dirscan_free(wi->scan);
+		wi->scan = NULL;
+
+		if (workdir_iterator__new_scan(wi) < 0)
+			return -1;
+	}
+
+	if (workdir_iterator__update_monitor(wi) < 0 ||
+		workdir_iterator__update_untracked(wi) < 0)
+		return -1;
+
 	workdir_iterator__seek_frame_start(wi, wi->stack);
 
 	return workdir_iterator__update_entry(wi);
@@ -720,6 +1029,8 @@ static void workdir_iterator__free(git_iterator *self)
 {
 	workdir_iterator *wi = (workdir_iterator *)self;
 
+	git_dirscan_free(wi->scan);
+
 	while (wi->stack != NULL) {
 		workdir_iterator_frame *wf = wi->stack;
 		wi->stack = wf->next;
@@ -825,6 +1136,16 @@ int git_iterator_for_workdir_range(
 	wi->entrycmp = wi->base.ignore_case ?
 		workdir_iterator__entry_cmp_icase : workdir_iterator__entry_cmp_case;
 
+	wi->index = index;
+
+	if (workdir_iterator__new_scan(wi) < 0 ||
+		workdir_iterator__update_monitor(wi) < 0 ||
+		workdir_iterator__update_untracked(wi) < 0 ||
+		(wi->untracked != NULL && workdir_iterator__check_excludes(wi) < 0)) {
+		git_iterator_free((git_iterator *)wi);
+		return -1;
+	}
+
 	if ((error = workdir_iterator__expand_dir(wi)) < 0) {
 		if (error == GIT_ENOTFOUND)
 			error = 0;
@@ -1035,9 +1356,33 @@ notfound:
 	return 0;
 }
 
+/* What's kept of the current entry, if its directory is kept */
+static git_untracked_entry *workdir_iterator__kept_entry(workdir_iterator *wi)
+{
+	workdir_iterator_frame *wf = wi->stack;
+	git_path_with_stat *ps;
+	git_untracked_entry *entry;
+
+	if (wi->untracked == NULL || wf->untracked == NULL)
+		return NULL;
+
+	ps    = git_vector_get(&wf->entries, wf->index);
+	entry = git_vector_get(&wf->untracked->entries, wf->index);
+
+	/* only trust it while it lines up with what was read */
+	if (ps == NULL || entry == NULL ||
+		entry->name_len > ps->path_len ||
+		memcmp(ps->path + ps->path_len - entry->name_len,
+			entry->name, entry->name_len) != 0)
+		return NULL;
+
+	return entry;
+}
+
 int git_iterator_current_is_ignored(git_iterator *iter)
 {
 	workdir_iterator *wi = (workdir_iterator *)iter;
+	git_untracked_entry *entry;
 
 	if (iter->type != GIT_ITERATOR_WORKDIR)
 		return 0;
@@ -1045,8 +1390,15 @@ int git_iterator_current_is_ignored(git_iterator *iter)
 	if (wi->is_ignored != -1)
 		return wi->is_ignored;
 
+	entry = workdir_iterator__kept_entry(wi);
+	if (entry != NULL && entry->ignored != -1)
+		return (wi->is_ignored = entry->ignored);
+
 	if (git_ignore__lookup(&wi->ignores, wi->entry.path, &wi->is_ignored) < 0)
-		wi->is_ignored = 1;
+		return (wi->is_ignored = 1);
+
+	if (entry != NULL)
+		git_untracked_cache_set_ignored(wi->untracked, entry, wi->is_ignored);
 
 	return wi->is_ignored;
 }
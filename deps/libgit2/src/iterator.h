@@ -46,6 +46,16 @@ struct git_iterator {
 
 extern int git_iterator_for_nothing(git_iterator **iter);
 
+/*
+ * The number of threads workdir iterators read directories with, and
+ * diffs against the workdir hash files with; 0 means one per CPU
+ */
+extern void git_iterator__set_workdir_threads(unsigned int n);
+extern unsigned int git_iterator__default_workdir_threads(void);
+
+/* The same, resolved to an actual number of threads */
+extern unsigned int git_iterator__workdir_threads(void);
+
 extern int git_iterator_for_tree_range(
 	git_iterator **iter, git_tree *tree,
 	const char *start, const char *end);
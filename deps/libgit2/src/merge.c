@@ -146,13 +146,31 @@ on_error:
 	return -1;
 }
 
+/*
+ * Whether the walk can still find a merge base. Commits from the
+ * commit-graph are popped by generation, after all their descendants in
+ * the walk; a base is final once it's popped, so the walk stops as soon
+ * as either side has no unstale commits left, instead of going on until
+ * the STALE marks reach the roots. Cutting at the inputs' generation,
+ * as ancestry checks do, would stop above every proper base.
+ */
 static int interesting(git_pqueue *list)
 {
-	unsigned int i;
+	git_commit_list_node *top = git_pqueue_peek(list);
+	unsigned int i, sides = 0;
+
 	/* element 0 isn't used - we need to start at 1 */
 	for (i = 1; i < list->size; i++) {
 		git_commit_list_node *commit = list->d[i];
-		if ((commit->flags & STALE) == 0)
+		if (commit->flags & STALE)
+			continue;
+
+		/* commits outside the graph only come in date order */
+		if (top->generation == GENERATION_INFINITY)
+			return 1;
+
+		sides |= commit->flags & (PARENT1 | PARENT2);
+		if (sides == (PARENT1 | PARENT2))
 			return 1;
 	}
 
@@ -173,7 +191,7 @@ int git_merge__bases_many(git_commit_list **out, git_revwalk *walk, git_commit_l
 			return git_commit_list_insert(one, out) ? 0 : -1;
 	}
 
-	if (git_pqueue_init(&list, twos->length * 2, git_commit_list_time_cmp) < 0)
+	if (git_pqueue_init(&list, twos->length * 2, git_commit_list_generation_cmp) < 0)
 		return -1;
 
 	if (git_commit_list_parse(walk, one) < 0)
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "midx.h"
+#include "odb.h"
+
+#define MIDX_NO_PACK ((uint32_t)-1)
+
+static int midx_entry_cmp(const void *a_, const void *b_)
+{
+	const git_midx_entry *a = a_, *b = b_;
+	int cmp = git_oid_cmp(a->oid, b->oid);
+
+	if (cmp)
+		return cmp;
+
+	return (a->pack < b->pack) ? -1 : (a->pack > b->pack);
+}
+
+static void midx_fill_fanout(git_midx *midx)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < 256; ++i) {
+		while (n < midx->length && midx->entries[n].oid->id[0] == i)
+			n++;
+		midx->fanout[i] = n;
+	}
+}
+
+static void midx_dealloc(git_midx *midx)
+{
+	struct git_pack_file *p;
+	size_t i;
+
+	git_vector_foreach(&midx->packs, i, p)
+		git_packfile__decref(p);
+
+	git_vector_free(&midx->packs);
+	git__free(midx->entries);
+	git__free(midx);
+}
+
+int git_midx_new(git_midx **out, git_midx *base, const git_vector *packs)
+{
+	git_midx *midx;
+	git_midx_entry *added = NULL;
+	uint32_t *remap = NULL;
+	char *covered = NULL;
+	size_t nadded = 0, i, j, k;
+	struct git_pack_file *p;
+
+	assert(out && packs);
+
+	midx = git__calloc(1, sizeof(git_midx));
+	GITERR_CHECK_ALLOC(midx);
+
+	if (git_vector_dup(&midx->packs, packs, NULL) < 0)
+		goto on_error;
+
+	/* entries point into the indexes, so the packs must outlive them */
+	git_vector_foreach(&midx->packs, i, p)
+		git_packfile__incref(p);
+
+	covered = git__calloc(packs->length + 1, sizeof(char));
+	if (covered == NULL)
+		goto on_error;
+
+	/* where each pack of the base ended up, if it is still around */
+	if (base != NULL) {
+		remap = git__calloc(base->packs.length + 1, sizeof(uint32_t));
+		if (remap == NULL)
+		goto on_error;
+
+		for (i = 0; i < base->packs.length; ++i) {
+			remap[i] = MIDX_NO_PACK;
+
+			for (j = 0; j < packs->length; ++j) {
+				if (base->packs.contents[i] == packs->contents[j]) {
+					remap[i] = (uint32_t)j;
+					covered[j] = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	/* read the packs the base doesn't know about */
+	git_vector_foreach(&midx->packs, i, p) {
+		if (covered[i])
+			continue;
+
+		if (git_pack__index_load(p) < 0) {
+			/* leave it out, like a pack without a valid index */
+			giterr_clear();
+			covered[i] = 1;
+			continue;
+		}
+
+		nadded += p->num_objects;
+	}
+
+	added = git__malloc((nadded + 1) * sizeof(git_midx_entry));
+	if (added == NULL)
+		goto on_error;
+
+	k = 0;
+	git_vector_foreach(&midx->packs, i, p) {
+		uint32_t n;
+
+		if (covered[i])
+			continue;
+
+		for (n = 0; n < p->num_objects; ++n) {
+			added[k].oid = git_pack__nth_oid(p, n);
+			added[k].pack = (uint32_t)i;
+			added[k].nth = n;
+			k++;
+		}
+	}
+
+	qsort(added, nadded, sizeof(git_midx_entry), midx_entry_cmp);
+
+	/* merge the surviving entries of the base with the new ones */
+	midx->entries = git__malloc(
+		((base ? base->length : 0) + nadded + 1) * sizeof(git_midx_entry));
+	if (midx->entries == NULL)
+		goto on_error;
+
+	i = j = k = 0;
+	while (base != NULL && i < base->length) {
+		git_midx_entry entry = base->entries[i++];
+
+		if ((entry.pack = remap[entry.pack]) == MIDX_NO_PACK)
+			continue;
+
+		while (j < nadded && midx_entry_cmp(&added[j], &entry) < 0)
+			midx->entries[k++] = added[j++];
+
+		midx->entries[k++] = entry;
+	}
+
+	while (j < nadded)
+		midx->entries[k++] = added[j++];
+
+	midx->length = k;
+	midx_fill_fanout(midx);
+	git_atomic_set(&midx->refcount, 1);
+
+	git__free(added);
+	git__free(remap);
+	git__free(covered);
+
+	*out = midx;
+	return 0;
+
+on_error:
+	git__free(added);
+	git__free(remap);
+	git__free(covered);
+	midx_dealloc(midx);
+	return -1;
+}
+
+static int midx_entry_open(
+	struct git_pack_entry *e, git_midx *midx, size_t pos)
+{
+	return git_pack__nth_entry(e,
+		git_vector_get(&midx->packs, midx->entries[pos].pack),
+		midx->entries[pos].nth);
+}
+
+int git_midx_find(
+	struct git_pack_entry *e,
+	git_midx *midx,
+	const git_oid *short_oid,
+	size_t len)
+{
+	size_t lo, hi, pos, best, next, i;
+	unsigned char first = short_oid->id[0];
+
+	lo = first ? midx->fanout[first - 1] : 0;
+	hi = midx->fanout[first];
+
+	/* first entry not smaller than the (zero padded) prefix */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (git_oid_cmp(midx->entries[mid].oid, short_oid) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	pos = lo;
+	if (pos >= midx->length ||
+		git_oid_ncmp(short_oid, midx->entries[pos].oid, len) != 0)
+		return git_odb__error_notfound("failed to find pack entry", short_oid);
+
+	/* the same object may live in several packs; take the preferred one */
+	best = pos;
+	for (next = pos + 1; next < midx->length; ++next) {
+		if (git_oid_cmp(midx->entries[next].oid, midx->entries[pos].oid) != 0)
+			break;
+		if (midx->entries[next].pack < midx->entries[best].pack)
+			best = next;
+	}
+
+	if (len < GIT_OID_HEXSZ && next < midx->length &&
+		git_oid_ncmp(short_oid, midx->entries[next].oid, len) == 0)
+		return git_odb__error_ambiguous("found multiple pack entries");
+
+	if (!midx_entry_open(e, midx, best))
+		return 0;
+
+	for (i = pos; i < next; ++i) {
+		if (i != best && !midx_entry_open(e, midx, i))
+			return 0;
+	}
+
+	/* the packs may be gone (i.e. repacked away) since it was made */
+	giterr_clear();
+	return git_odb__error_notfound("failed to open pack entry", short_oid);
+}
+
+void git_midx_free(git_midx *midx)
+{
+	if (midx == NULL)
+		return;
+
+	if (git_atomic_dec(&midx->refcount) == 0)
+		midx_dealloc(midx);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_midx_h__
+#define INCLUDE_midx_h__
+
+#include "common.h"
+#include "pack.h"
+#include "vector.h"
+#include "thread-utils.h"
+
+/*
+ * In-memory index of every object in a set of packfiles, sorted by
+ * OID, so a lookup costs a single search instead of one per pack.
+ *
+ * Entries point straight into the mapped .idx files; nothing is
+ * copied. An OID stored in several packs gets one entry per pack,
+ * and lookups prefer the pack that comes first in `packs`.
+ *
+ * A midx is immutable once built and reference counted, so readers
+ * can keep using one while a newer one is built for a changed set of
+ * packs. It holds a reference on each of its packs, so a pack dropped
+ * from the backend stays allocated until the last midx using it goes.
+ */
+
+typedef struct {
+	const git_oid *oid;
+	uint32_t pack;
+	uint32_t nth;
+} git_midx_entry;
+
+typedef struct {
+	git_atomic refcount;
+	git_vector packs;
+	git_midx_entry *entries;
+	size_t length;
+	size_t fanout[256];
+} git_midx;
+
+/*
+ * Build an index for `packs`, taken in order of preference. When
+ * `base` is given, the entries of packs it already covers are reused
+ * and only packs new to it are read.
+ */
+extern int git_midx_new(git_midx **out, git_midx *base, const git_vector *packs);
+
+/*
+ * Find the object matching the first `len` hex digits of `short_oid`.
+ * Returns GIT_ENOTFOUND or GIT_EAMBIGUOUS when there is no single
+ * match. None of the packs holding it opening (they may have been
+ * repacked away since) is GIT_ENOTFOUND as well: the packs have to be
+ * looked at again, and a new index made.
+ */
+extern int git_midx_find(
+	struct git_pack_entry *e,
+	git_midx *midx,
+	const git_oid *short_oid,
+	size_t len);
+
+GIT_INLINE(void) git_midx_incref(git_midx *midx)
+{
+	git_atomic_inc(&midx->refcount);
+}
+
+extern void git_midx_free(git_midx *midx);
+
+#endif
@@ -20,21 +20,75 @@
 #define DEFAULT_MAPPED_LIMIT \
 	((1024 * 1024) * (sizeof(void*) >= 8 ? 8192ULL : 256UL))
 
+#define MWINDOW_ALIGN (128 * 1024)
+
 /*
- * These are the global options for mmmap limits.
- * TODO: allow the user to change these
+ * These are the global options for mmmap limits. Per-database ones
+ * live in the git_mwindow_group of the files.
  */
 static struct {
 	size_t window_size;
 	size_t mapped_limit;
+	unsigned int file_limit;
 } _mw_options = {
 	DEFAULT_WINDOW_SIZE,
 	DEFAULT_MAPPED_LIMIT,
+	0,
 };
 
 /* Whenever you want to read or modify this, grab git__mwindow_mutex */
 static git_mwindow_ctl mem_ctl;
 
+/* The following are called under lock to keep the counters straight */
+
+static void stats_window_mapped(git_mwindow_stats *stats)
+{
+	stats->mmap_calls++;
+	stats->open_windows++;
+
+	if (stats->mapped > stats->peak_mapped)
+		stats->peak_mapped = stats->mapped;
+
+	if (stats->open_windows > stats->peak_open_windows)
+		stats->peak_open_windows = stats->open_windows;
+}
+
+static void stats_file_opened(git_mwindow_stats *stats)
+{
+	stats->open_files++;
+
+	if (stats->open_files > stats->peak_open_files)
+		stats->peak_open_files = stats->open_files;
+}
+
+static void window_free(git_mwindow_file *mwf, git_mwindow *w)
+{
+	git_mwindow_ctl *ctl = &mem_ctl;
+
+	ctl->stats.mapped -= w->window_map.len;
+	ctl->stats.open_windows--;
+
+	if (mwf->group) {
+		mwf->group->stats.mapped -= w->window_map.len;
+		mwf->group->stats.open_windows--;
+	}
+
+	git_futils_mmap_free(&w->window_map);
+	git__free(w);
+}
+
+static void windowfiles_remove(unsigned int i)
+{
+	git_mwindow_ctl *ctl = &mem_ctl;
+	git_mwindow_file *mwf = git_vector_get(&ctl->windowfiles, i);
+
+	git_vector_remove(&ctl->windowfiles, i);
+
+	ctl->stats.open_files--;
+	if (mwf->group)
+		mwf->group->stats.open_files--;
+}
+
 /*
  * Free all the windows in a sequence, typically because we're done
  * with the file
@@ -54,7 +108,7 @@ void git_mwindow_free_all(git_mwindow_file *mwf)
 	 */
 	for (i = 0; i < ctl->windowfiles.length; ++i){
 		if (git_vector_get(&ctl->windowfiles, i) == mwf) {
-			git_vector_remove(&ctl->windowfiles, i);
+			windowfiles_remove(i);
 			break;
 		}
 	}
@@ -68,13 +122,8 @@ void git_mwindow_free_all(git_mwindow_file *mwf)
 		git_mwindow *w = mwf->windows;
 		assert(w->inuse_cnt == 0);
 
-		ctl->mapped -= w->window_map.len;
-		ctl->open_windows--;
-
-		git_futils_mmap_free(&w->window_map);
-
 		mwf->windows = w->next;
-		git__free(w);
+		window_free(mwf, w);
 	}
 
 	git_mutex_unlock(&git__mwindow_mutex);
@@ -117,26 +166,33 @@ static void git_mwindow_scan_lru(
 }
 
 /*
- * Close the least recently used window. You should check to see if
- * the file descriptors need closing from time to time. Called under
- * lock from new_window.
+ * Close the least recently used window, among the files of 'group'
+ * or among all of them when it's NULL. Called under lock from
+ * new_window.
  */
-static int git_mwindow_close_lru(git_mwindow_file *mwf)
+static int git_mwindow_close_lru(git_mwindow_file *mwf, git_mwindow_group *group)
 {
 	git_mwindow_ctl *ctl = &mem_ctl;
 	unsigned int i;
 	git_mwindow *lru_w = NULL, *lru_l = NULL, **list = &mwf->windows;
+	git_mwindow_file *lru_f = mwf;
 
-	/* FIXME: Does this give us any advantage? */
-	if(mwf->windows)
+	/* mwf may have been dropped from the list, but still be mapping */
+	if (mwf->windows && (!group || mwf->group == group))
 		git_mwindow_scan_lru(mwf, &lru_w, &lru_l);
 
 	for (i = 0; i < ctl->windowfiles.length; ++i) {
 		git_mwindow *last = lru_w;
 		git_mwindow_file *cur = git_vector_get(&ctl->windowfiles, i);
+
+		if (group && cur->group != group)
+			continue;
+
 		git_mwindow_scan_lru(cur, &lru_w, &lru_l);
-		if (lru_w != last)
+		if (lru_w != last) {
 			list = &cur->windows;
+			lru_f = cur;
+		}
 	}
 
 	if (!lru_w) {
@@ -144,20 +200,102 @@ static int git_mwindow_close_lru(git_mwindow_file *mwf)
 		return -1;
 	}
 
-	ctl->mapped -= lru_w->window_map.len;
-	git_futils_mmap_free(&lru_w->window_map);
-
 	if (lru_l)
 		lru_l->next = lru_w->next;
 	else
 		*list = lru_w->next;
 
-	git__free(lru_w);
-	ctl->open_windows--;
+	window_free(lru_f, lru_w);
+	return 0;
+}
+
+/* Unmap all the windows of the i-th file and close it. Called under lock. */
+static void file_close(unsigned int i)
+{
+	git_mwindow_ctl *ctl = &mem_ctl;
+	git_mwindow_file *mwf = git_vector_get(&ctl->windowfiles, i);
+	git_mwindow *w;
+
+	windowfiles_remove(i);
+
+	while (mwf->windows) {
+		w = mwf->windows;
+		mwf->windows = w->next;
+		window_free(mwf, w);
+	}
+
+	p_close(mwf->fd);
+	mwf->fd = -1;
 
+	ctl->stats.file_closes++;
+	if (mwf->group)
+		mwf->group->stats.file_closes++;
+}
+
+/*
+ * Close the least recently used file that has no window in use, among
+ * the files of 'group' or among all of them when it's NULL. Only the
+ * files whose owner knows how to reopen them are considered. Called
+ * under lock from git_mwindow_file_register.
+ */
+static int git_mwindow_close_lru_file(git_mwindow_file *keep, git_mwindow_group *group)
+{
+	git_mwindow_ctl *ctl = &mem_ctl;
+	git_mwindow_file *cur, *lru = NULL;
+	git_mwindow *w;
+	unsigned int i, lru_i = 0;
+
+	git_vector_foreach(&ctl->windowfiles, i, cur) {
+		if (cur == keep || !cur->closable || (group && cur->group != group))
+			continue;
+
+		for (w = cur->windows; w && !w->inuse_cnt; w = w->next)
+			/* nop */;
+
+		if (w == NULL && (!lru || cur->last_used < lru->last_used)) {
+			lru = cur;
+			lru_i = i;
+		}
+	}
+
+	if (!lru)
+		return -1;
+
+	file_close(lru_i);
 	return 0;
 }
 
+int git_mwindow_file_close(git_mwindow_file *mwf)
+{
+	git_mwindow_ctl *ctl = &mem_ctl;
+	git_mwindow_file *cur;
+	git_mwindow *w;
+	unsigned int i;
+	int error = 0;
+
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		giterr_set(GITERR_THREAD, "unable to lock mwindow mutex");
+		return -1;
+	}
+
+	git_vector_foreach(&ctl->windowfiles, i, cur) {
+		if (cur != mwf)
+			continue;
+
+		for (w = cur->windows; w && !w->inuse_cnt; w = w->next)
+			/* nop */;
+
+		if (w != NULL)
+			error = 1;
+		else
+			file_close(i);
+		break;
+	}
+
+	git_mutex_unlock(&git__mwindow_mutex);
+	return error;
+}
+
 /* This gets called under lock from git_mwindow_open */
 static git_mwindow *new_window(
 	git_mwindow_file *mwf,
@@ -166,12 +304,18 @@ static git_mwindow *new_window(
 	git_off_t offset)
 {
 	git_mwindow_ctl *ctl = &mem_ctl;
-	size_t walign = _mw_options.window_size / 2;
+	git_mwindow_group *group = mwf->group;
+	size_t window_size = _mw_options.window_size;
+	size_t walign;
 	git_off_t len;
 	git_mwindow *w;
 
+	if (group && group->window_size)
+		window_size = group->window_size;
+	walign = window_size / 2;
+
 	w = git__malloc(sizeof(*w));
-	
+
 	if (w == NULL)
 		return NULL;
 
@@ -179,33 +323,37 @@ static git_mwindow *new_window(
 	w->offset = (offset / walign) * walign;
 
 	len = size - w->offset;
-	if (len > (git_off_t)_mw_options.window_size)
-		len = (git_off_t)_mw_options.window_size;
+	if (len > (git_off_t)window_size)
+		len = (git_off_t)window_size;
+
+	ctl->stats.mapped += (size_t)len;
+	if (group)
+		group->stats.mapped += (size_t)len;
 
-	ctl->mapped += (size_t)len;
+	while (_mw_options.mapped_limit < ctl->stats.mapped &&
+			git_mwindow_close_lru(mwf, NULL) == 0) /* nop */;
 
-	while (_mw_options.mapped_limit < ctl->mapped &&
-			git_mwindow_close_lru(mwf) == 0) /* nop */;
+	while (group && group->mapped_limit &&
+			group->mapped_limit < group->stats.mapped &&
+			git_mwindow_close_lru(mwf, group) == 0) /* nop */;
 
 	/*
-	 * We treat _mw_options.mapped_limit as a soft limit. If we can't find a
-	 * window to close and are above the limit, we still mmap the new
+	 * We treat the mapped limits as soft limits. If we can't find a
+	 * window to close and are above them, we still mmap the new
 	 * window.
 	 */
 
 	if (git_futils_mmap_ro(&w->window_map, fd, w->offset, (size_t)len) < 0) {
+		ctl->stats.mapped -= (size_t)len;
+		if (group)
+			group->stats.mapped -= (size_t)len;
 		git__free(w);
 		return NULL;
 	}
 
-	ctl->mmap_calls++;
-	ctl->open_windows++;
-
-	if (ctl->mapped > ctl->peak_mapped)
-		ctl->peak_mapped = ctl->mapped;
-
-	if (ctl->open_windows > ctl->peak_open_windows)
-		ctl->peak_open_windows = ctl->open_windows;
+	stats_window_mapped(&ctl->stats);
+	if (group)
+		stats_window_mapped(&group->stats);
 
 	return w;
 }
@@ -230,16 +378,24 @@ unsigned char *git_mwindow_open(
 	}
 
 	if (!w || !(git_mwindow_contains(w, offset) && git_mwindow_contains(w, offset + extra))) {
-		if (w) {
-			w->inuse_cnt--;
-		}
-
 		for (w = mwf->windows; w; w = w->next) {
 			if (git_mwindow_contains(w, offset) &&
 				git_mwindow_contains(w, offset + extra))
 				break;
 		}
 
+		/* Closed to honor the file limit; the owner has to reopen it */
+		if (!w && mwf->fd == -1) {
+			giterr_set(GITERR_OS, "Failed to map window. The file is closed");
+			git_mutex_unlock(&git__mwindow_mutex);
+			return NULL;
+		}
+
+		if (*cursor) {
+			(*cursor)->inuse_cnt--;
+			*cursor = NULL;
+		}
+
 		/*
 		 * If there isn't a suitable window, we need to create a new
 		 * one.
@@ -260,6 +416,7 @@ unsigned char *git_mwindow_open(
 		w->last_used = ctl->used_ctr++;
 		w->inuse_cnt++;
 		*cursor = w;
+		mwf->last_used = w->last_used;
 	}
 
 	offset -= w->offset;
@@ -274,6 +431,7 @@ unsigned char *git_mwindow_open(
 int git_mwindow_file_register(git_mwindow_file *mwf)
 {
 	git_mwindow_ctl *ctl = &mem_ctl;
+	git_mwindow_group *group = mwf->group;
 	int ret;
 
 	if (git_mutex_lock(&git__mwindow_mutex)) {
@@ -287,10 +445,27 @@ int git_mwindow_file_register(git_mwindow_file *mwf)
 		return -1;
 	}
 
-	ret = git_vector_insert(&ctl->windowfiles, mwf);
-	git_mutex_unlock(&git__mwindow_mutex);
+	if ((ret = git_vector_insert(&ctl->windowfiles, mwf)) < 0) {
+		git_mutex_unlock(&git__mwindow_mutex);
+		return ret;
+	}
+
+	mwf->last_used = ctl->used_ctr++;
+	stats_file_opened(&ctl->stats);
+	if (group)
+		stats_file_opened(&group->stats);
+
+	/* Like the mapped limits, these are soft */
+	while (_mw_options.file_limit &&
+			ctl->stats.open_files > _mw_options.file_limit &&
+			git_mwindow_close_lru_file(mwf, NULL) == 0) /* nop */;
 
-	return ret;
+	while (group && group->file_limit &&
+			group->stats.open_files > group->file_limit &&
+			git_mwindow_close_lru_file(mwf, group) == 0) /* nop */;
+
+	git_mutex_unlock(&git__mwindow_mutex);
+	return 0;
 }
 
 int git_mwindow_file_deregister(git_mwindow_file *mwf)
@@ -306,7 +481,7 @@ int git_mwindow_file_deregister(git_mwindow_file *mwf)
 
 	git_vector_foreach(&ctl->windowfiles, i, cur) {
 		if (cur == mwf) {
-			git_vector_remove(&ctl->windowfiles, i);
+			windowfiles_remove(i);
 			git_mutex_unlock(&git__mwindow_mutex);
 			return 0;
 		}
@@ -331,3 +506,118 @@ void git_mwindow_close(git_mwindow **window)
 		*window = NULL;
 	}
 }
+
+static int check_window_size(size_t size, int allow_zero)
+{
+	if ((!size && !allow_zero) || size % MWINDOW_ALIGN != 0) {
+		giterr_set(GITERR_INVALID,
+			"Invalid window size %"PRIuZ"; must be a multiple of %d",
+			size, MWINDOW_ALIGN);
+		return -1;
+	}
+
+	return 0;
+}
+
+size_t git_mwindow__window_size(void)
+{
+	return _mw_options.window_size;
+}
+
+int git_mwindow__set_window_size(size_t size)
+{
+	if (check_window_size(size, 0) < 0)
+		return -1;
+
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		giterr_set(GITERR_THREAD, "unable to lock mwindow mutex");
+		return -1;
+	}
+
+	_mw_options.window_size = size;
+	git_mutex_unlock(&git__mwindow_mutex);
+	return 0;
+}
+
+size_t git_mwindow__mapped_limit(void)
+{
+	return _mw_options.mapped_limit;
+}
+
+void git_mwindow__set_mapped_limit(size_t limit)
+{
+	if (git_mutex_lock(&git__mwindow_mutex))
+		return;
+
+	_mw_options.mapped_limit = limit;
+	git_mutex_unlock(&git__mwindow_mutex);
+}
+
+unsigned int git_mwindow__file_limit(void)
+{
+	return _mw_options.file_limit;
+}
+
+void git_mwindow__set_file_limit(unsigned int limit)
+{
+	if (git_mutex_lock(&git__mwindow_mutex))
+		return;
+
+	_mw_options.file_limit = limit;
+	git_mutex_unlock(&git__mwindow_mutex);
+}
+
+int git_mwindow__stats(git_mwindow_stats *out)
+{
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		giterr_set(GITERR_THREAD, "unable to lock mwindow mutex");
+		return -1;
+	}
+
+	*out = mem_ctl.stats;
+	out->window_size = _mw_options.window_size;
+	out->mapped_limit = _mw_options.mapped_limit;
+	out->file_limit = _mw_options.file_limit;
+
+	git_mutex_unlock(&git__mwindow_mutex);
+	return 0;
+}
+
+int git_mwindow_group_set_limits(
+	git_mwindow_group *group, size_t window_size,
+	size_t mapped_limit, unsigned int file_limit)
+{
+	if (check_window_size(window_size, 1) < 0)
+		return -1;
+
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		giterr_set(GITERR_THREAD, "unable to lock mwindow mutex");
+		return -1;
+	}
+
+	group->window_size = window_size;
+	group->mapped_limit = mapped_limit;
+	group->file_limit = file_limit;
+
+	git_mutex_unlock(&git__mwindow_mutex);
+	return 0;
+}
+
+int git_mwindow_group_stats(git_mwindow_stats *out, git_mwindow_group *group)
+{
+	if (git_mutex_lock(&git__mwindow_mutex)) {
+		giterr_set(GITERR_THREAD, "unable to lock mwindow mutex");
+		return -1;
+	}
+
+	*out = group->stats;
+	out->window_size = group->window_size ?
+		group->window_size : _mw_options.window_size;
+	out->mapped_limit = group->mapped_limit ?
+		group->mapped_limit : _mw_options.mapped_limit;
+	out->file_limit = group->file_limit ?
+		group->file_limit : _mw_options.file_limit;
+
+	git_mutex_unlock(&git__mwindow_mutex);
+	return 0;
+}
@@ -19,18 +19,29 @@ typedef struct git_mwindow {
 	size_t inuse_cnt;
 } git_mwindow;
 
+/*
+ * Limits and counters shared by the files of one object database, on
+ * top of the process-wide ones. A zero limit defers to the global one.
+ */
+typedef struct git_mwindow_group {
+	size_t window_size;
+	size_t mapped_limit;
+	unsigned int file_limit;
+	git_mwindow_stats stats;
+} git_mwindow_group;
+
 typedef struct git_mwindow_file {
 	git_mwindow *windows;
 	int fd;
 	git_off_t size;
+	size_t last_used;
+	git_mwindow_group *group;
+	/* the owner reopens the file on demand, so its fd may be closed */
+	unsigned closable:1;
 } git_mwindow_file;
 
 typedef struct git_mwindow_ctl {
-	size_t mapped;
-	unsigned int open_windows;
-	unsigned int mmap_calls;
-	unsigned int peak_open_windows;
-	size_t peak_mapped;
+	git_mwindow_stats stats;
 	size_t used_ctr;
 	git_vector windowfiles;
 } git_mwindow_ctl;
@@ -40,6 +51,24 @@ void git_mwindow_free_all(git_mwindow_file *mwf);
 unsigned char *git_mwindow_open(git_mwindow_file *mwf, git_mwindow **cursor, git_off_t offset, size_t extra, unsigned int *left);
 int git_mwindow_file_register(git_mwindow_file *mwf);
 int git_mwindow_file_deregister(git_mwindow_file *mwf);
+/*
+ * Unmap the windows of a file and close it. Returns 1, leaving it
+ * alone, when one of its windows is in use.
+ */
+int git_mwindow_file_close(git_mwindow_file *mwf);
 void git_mwindow_close(git_mwindow **w_cursor);
 
+size_t git_mwindow__window_size(void);
+int git_mwindow__set_window_size(size_t size);
+size_t git_mwindow__mapped_limit(void);
+void git_mwindow__set_mapped_limit(size_t limit);
+unsigned int git_mwindow__file_limit(void);
+void git_mwindow__set_file_limit(unsigned int limit);
+int git_mwindow__stats(git_mwindow_stats *out);
+
+int git_mwindow_group_set_limits(
+	git_mwindow_group *group, size_t window_size,
+	size_t mapped_limit, unsigned int file_limit);
+int git_mwindow_group_stats(git_mwindow_stats *out, git_mwindow_group *group);
+
 #endif
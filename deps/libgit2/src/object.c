@@ -100,6 +100,10 @@ int git_object__from_odb_object(
 	git_oid_cpy(&object->cached.oid, &odb_obj->cached.oid);
 	object->repo = repo;
 
+	/* parsed objects take roughly as much as their raw data */
+	object->cached.size = git_object__size(type) + odb_obj->raw.len;
+	object->cached.type = (signed char)type;
+
 	switch (type) {
 	case GIT_OBJ_COMMIT:
 		error = git_commit__parse((git_commit *)object, odb_obj);
@@ -76,6 +76,9 @@ static git_odb_object *new_odb_object(const git_oid *oid, git_rawobj *source)
 	git_oid_cpy(&object->cached.oid, oid);
 	memcpy(&object->raw, source, sizeof(git_rawobj));
 
+	object->cached.size = sizeof(git_odb_object) + source->len;
+	object->cached.type = (signed char)source->type;
+
 	return object;
 }
 
@@ -327,6 +330,63 @@ static int init_fake_wstream(git_odb_stream **stream_p, git_odb_backend *backend
 	return 0;
 }
 
+/**
+ * FAKE RSTREAM
+ *
+ * Hands out an object read in one go, for the objects no backend can
+ * stream (e.g. deltas, which need their whole base).
+ */
+
+typedef struct {
+	git_odb_stream stream;
+	git_odb_object *object;
+	size_t read;
+} fake_rstream;
+
+static int fake_rstream__read(git_odb_stream *_stream, char *buffer, size_t len)
+{
+	fake_rstream *stream = (fake_rstream *)_stream;
+	size_t left = stream->object->raw.len - stream->read;
+
+	if (len > left)
+		len = left;
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	memcpy(buffer, (char *)stream->object->raw.data + stream->read, len);
+	stream->read += len;
+	return (int)len;
+}
+
+static void fake_rstream__free(git_odb_stream *_stream)
+{
+	fake_rstream *stream = (fake_rstream *)_stream;
+
+	git_odb_object_free(stream->object);
+	git__free(stream);
+}
+
+static int init_fake_rstream(git_odb_stream **stream_p, git_odb *db, const git_oid *oid)
+{
+	fake_rstream *stream;
+	int error;
+
+	stream = git__calloc(1, sizeof(fake_rstream));
+	GITERR_CHECK_ALLOC(stream);
+
+	if ((error = git_odb_read(&stream->object, db, oid)) < 0) {
+		git__free(stream);
+		return error;
+	}
+
+	stream->stream.read = &fake_rstream__read;
+	stream->stream.free = &fake_rstream__free;
+	stream->stream.mode = GIT_STREAM_RDONLY;
+
+	*stream_p = (git_odb_stream *)stream;
+	return 0;
+}
+
 /***********************************************************
  *
  * OBJECT DATABASE PUBLIC API
@@ -354,6 +414,7 @@ int git_odb_new(git_odb **out)
 	if (git_cache_init(&db->cache, GIT_DEFAULT_CACHE_SIZE, &free_odb_object) < 0 ||
 		git_vector_init(&db->backends, 4, backend_sort_cmp) < 0)
 	{
+		git_cache_free(&db->cache);
 		git__free(db);
 		return -1;
 	}
@@ -524,6 +585,32 @@ void git_odb_free(git_odb *db)
 	GIT_REFCOUNT_DEC(db, odb_free);
 }
 
+int git_odb_set_cache_limit(git_odb *db, git_otype type, size_t max_bytes)
+{
+	assert(db);
+	return git_cache_set_limit(&db->cache, type, max_bytes);
+}
+
+void git_odb_cache_stats(git_cache_stats *out, git_odb *db)
+{
+	assert(out && db);
+	git_cache_get_stats(out, &db->cache);
+}
+
+int git_odb_set_mwindow_limits(
+	git_odb *db, size_t window_size, size_t mapped_limit, unsigned int file_limit)
+{
+	assert(db);
+	return git_mwindow_group_set_limits(
+		&db->mwindows, window_size, mapped_limit, file_limit);
+}
+
+int git_odb_mwindow_stats(git_mwindow_stats *out, git_odb *db)
+{
+	assert(out && db);
+	return git_mwindow_group_stats(out, &db->mwindows);
+}
+
 int git_odb_exists(git_odb *db, const git_oid *id)
 {
 	git_odb_object *object;
@@ -789,8 +876,11 @@ int git_odb_open_rstream(git_odb_stream **stream, git_odb *db, const git_oid *oi
 			error = b->readstream(stream, b, oid);
 	}
 
-	if (error == GIT_PASSTHROUGH)
-		error = 0;
+	/* no backend streamed it; this also reports missing objects */
+	if (error < 0) {
+		giterr_clear();
+		error = init_fake_rstream(stream, db, oid);
+	}
 
 	return error;
 }
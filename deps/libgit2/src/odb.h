@@ -14,6 +14,7 @@
 #include "vector.h"
 #include "cache.h"
 #include "posix.h"
+#include "mwindow.h"
 
 #define GIT_OBJECTS_DIR "objects/"
 #define GIT_OBJECT_DIR_MODE 0777
@@ -37,6 +38,7 @@ struct git_odb {
 	git_refcount rc;
 	git_vector backends;
 	git_cache cache;
+	git_mwindow_group mwindows;
 };
 
 /*
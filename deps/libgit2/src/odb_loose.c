@@ -26,8 +26,22 @@ typedef struct { /* object header data */
 typedef struct {
 	git_odb_stream stream;
 	git_filebuf fbuf;
+	size_t size, written; /* of the content, not counting the header */
 } loose_writestream;
 
+#define LOOSE_READSTREAM_BUFSIZE (16 * 1024)
+
+typedef struct {
+	git_odb_stream stream;
+	git_file fd;
+	z_stream zs;
+	int done;
+	/* content inflated along with the header, handed out first */
+	unsigned char head[64];
+	size_t head_pos, head_len;
+	unsigned char in[LOOSE_READSTREAM_BUFSIZE];
+} loose_readstream;
+
 typedef struct loose_backend {
 	git_odb_backend parent;
 
@@ -761,6 +775,121 @@ static int loose_backend__foreach(git_odb_backend *_backend, git_odb_foreach_cb
 	return state.cb_error ? state.cb_error : error;
 }
 
+static int loose_backend__readstream_read(
+	git_odb_stream *_stream, char *buffer, size_t len)
+{
+	loose_readstream *stream = (loose_readstream *)_stream;
+	size_t written = 0;
+	ssize_t read_bytes;
+	int status;
+
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	if (stream->head_pos < stream->head_len) {
+		written = min(len, stream->head_len - stream->head_pos);
+		memcpy(buffer, stream->head + stream->head_pos, written);
+		stream->head_pos += written;
+	}
+
+	while (written < len && !stream->done) {
+		if (stream->zs.avail_in == 0) {
+			if ((read_bytes = p_read(stream->fd, stream->in, sizeof(stream->in))) < 0) {
+				giterr_set(GITERR_OS, "Failed to read loose object");
+				return -1;
+			}
+			set_stream_input(&stream->zs, stream->in, (size_t)read_bytes);
+		}
+
+		set_stream_output(&stream->zs, buffer + written, len - written);
+		status = inflate(&stream->zs, Z_NO_FLUSH);
+		written = len - stream->zs.avail_out;
+
+		/* a truncated file shows up as Z_BUF_ERROR */
+		if (status == Z_STREAM_END)
+			stream->done = 1;
+		else if (status != Z_OK) {
+			giterr_set(GITERR_ZLIB, "Failed to inflate loose object");
+			return -1;
+		}
+	}
+
+	return (int)written;
+}
+
+static void loose_backend__readstream_free(git_odb_stream *_stream)
+{
+	loose_readstream *stream = (loose_readstream *)_stream;
+
+	inflateEnd(&stream->zs);
+	p_close(stream->fd);
+	git__free(stream);
+}
+
+/*
+ * Objects are inflated a buffer at a time as they are read. The legacy
+ * pack-like format is left to the caller to read in one go.
+ */
+static int loose_backend__readstream(
+	git_odb_stream **stream_out, git_odb_backend *backend, const git_oid *oid)
+{
+	git_buf object_path = GIT_BUF_INIT;
+	loose_readstream *stream;
+	ssize_t read_bytes;
+	obj_hdr hdr;
+	size_t used = 0;
+	int status = Z_ERRNO;
+
+	assert(backend && oid);
+
+	if (locate_object(&object_path, (loose_backend *)backend, oid) < 0) {
+		git_buf_free(&object_path);
+		return git_odb__error_notfound("no matching loose object", oid);
+	}
+
+	stream = git__calloc(1, sizeof(loose_readstream));
+	GITERR_CHECK_ALLOC(stream);
+
+	if ((stream->fd = git_futils_open_ro(object_path.ptr)) < 0) {
+		git_buf_free(&object_path);
+		git__free(stream);
+		return -1;
+	}
+	git_buf_free(&object_path);
+
+	if ((read_bytes = p_read(stream->fd, stream->in, sizeof(stream->in))) < 2 ||
+		!is_zlib_compressed_data(stream->in)) {
+		p_close(stream->fd);
+		git__free(stream);
+		return GIT_PASSTHROUGH;
+	}
+
+	init_stream(&stream->zs, stream->head, sizeof(stream->head));
+	set_stream_input(&stream->zs, stream->in, (size_t)read_bytes);
+
+	if (inflateInit(&stream->zs) < Z_OK ||
+		(status = inflate(&stream->zs, 0)) < Z_OK ||
+		(used = get_object_header(&hdr, stream->head)) == 0 ||
+		!git_object_typeisloose(hdr.type))
+	{
+		giterr_set(GITERR_ODB, "Failed to inflate disk object.");
+		loose_backend__readstream_free((git_odb_stream *)stream);
+		return -1;
+	}
+
+	stream->head_pos = used;
+	stream->head_len = sizeof(stream->head) - stream->zs.avail_out;
+	stream->done = (status == Z_STREAM_END);
+
+	stream->stream.backend = backend;
+	stream->stream.read = &loose_backend__readstream_read;
+	stream->stream.free = &loose_backend__readstream_free;
+	stream->stream.mode = GIT_STREAM_RDONLY;
+
+	*stream_out = (git_odb_stream *)stream;
+	return 0;
+}
+
 static int loose_backend__stream_fwrite(git_oid *oid, git_odb_stream *_stream)
 {
 	loose_writestream *stream = (loose_writestream *)_stream;
@@ -768,6 +897,13 @@ static int loose_backend__stream_fwrite(git_oid *oid, git_odb_stream *_stream)
 	git_buf final_path = GIT_BUF_INIT;
 	int error = 0;
 
+	/* the header promised this much content */
+	if (stream->written != stream->size) {
+		giterr_set(GITERR_ODB, "Failed to write object. "
+			"Expected %"PRIuZ" bytes but got %"PRIuZ, stream->size, stream->written);
+		return -1;
+	}
+
 	if (git_filebuf_hash(oid, &stream->fbuf) < 0 ||
 		object_file_name(&final_path, backend->objects_dir, oid) < 0 ||
 		git_futils_mkpath2file(final_path.ptr, GIT_OBJECT_DIR_MODE) < 0)
@@ -791,6 +927,14 @@ static int loose_backend__stream_fwrite(git_oid *oid, git_odb_stream *_stream)
 static int loose_backend__stream_write(git_odb_stream *_stream, const char *data, size_t len)
 {
 	loose_writestream *stream = (loose_writestream *)_stream;
+
+	if (len > stream->size - stream->written) {
+		giterr_set(GITERR_ODB, "Failed to write object. "
+			"Got more than the expected %"PRIuZ" bytes", stream->size);
+		return -1;
+	}
+
+	stream->written += len;
 	return git_filebuf_write(&stream->fbuf, data, len);
 }
 
@@ -843,13 +987,16 @@ static int loose_backend__stream(git_odb_stream **stream_out, git_odb_backend *_
 			GIT_FILEBUF_HASH_CONTENTS |
 			GIT_FILEBUF_TEMPORARY |
 			(backend->object_zlib_level << GIT_FILEBUF_DEFLATE_SHIFT)) < 0 ||
-		stream->stream.write((git_odb_stream *)stream, hdr, hdrlen) < 0)
+		git_filebuf_write(&stream->fbuf, hdr, hdrlen) < 0)
 	{
 		git_filebuf_cleanup(&stream->fbuf);
 		git__free(stream);
 		stream = NULL;
 	}
 	git_buf_free(&tmp_path);
+
+	if (stream)
+		stream->size = length;
 	*stream_out = (git_odb_stream *)stream;
 
 	return !stream ? -1 : 0;
@@ -928,6 +1075,7 @@ int git_odb_backend_loose(
 	backend->parent.read_prefix = &loose_backend__read_prefix;
 	backend->parent.read_header = &loose_backend__read_header;
 	backend->parent.writestream = &loose_backend__stream;
+	backend->parent.readstream = &loose_backend__readstream;
 	backend->parent.exists = &loose_backend__exists;
 	backend->parent.foreach = &loose_backend__foreach;
 	backend->parent.free = &loose_backend__free;
@@ -16,13 +16,16 @@
 #include "sha1_lookup.h"
 #include "mwindow.h"
 #include "pack.h"
+#include "midx.h"
 
 #include "git2/odb_backend.h"
 
 struct pack_backend {
 	git_odb_backend parent;
 	git_vector packs;
-	struct git_pack_file *last_found;
+	git_midx *midx;
+	unsigned midx_dirty:1;
+	git_mutex lock;
 	char *pack_folder;
 };
 
@@ -85,23 +88,22 @@ struct pack_writepack {
  * | that have been loaded for our ODB.
  * |
  * |-# pack_entry_find
- *	| Iterate through all the packs that have been preloaded
- *	| (starting by the pack where the latest object was found)
- *	| to try to find the OID in one of them.
+ *	| Search the multi-pack index, which covers every pack that
+ *	| has been preloaded, for the OID. If it's not there, reload
+ *	| the pack folder and search again.
  *	|
- *	|-# pack_entry_find1
- *		| Check the index of an individual pack to see if the SHA1
- *		| OID can be found. If we can find the offset to that SHA1
- *		| inside of the index, that means the object is contained
- *		| inside of the packfile and we can stop searching.
- *		| Before returning, we verify that the packfile behing the
- *		| index we are searching still exists on disk.
+ *	|-# pack_backend__midx
+ *		| Grab a reference to the current multi-pack index, bringing
+ *		| it up to date first if packs were added or removed: the
+ *		| entries of packs it already knew about are kept, and only
+ *		| the new packs are read. If we find the OID, we verify that
+ *		| the packfile behind it still exists on disk.
  *		|
- *		|-# pack_entry_find_offset
- *		| | Mmap the actual index file to disk if it hasn't been opened
- *		| | yet, and run a binary search through it to find the OID.
+ *		|-# git_midx_new
+ *		| | Mmap the index file of each new pack if it hasn't been
+ *		| | opened yet, and merge its OIDs into the sorted list.
  *		| | See <http://book.git-scm.com/7_the_packfile.html> for specifics
- *		| | on the Packfile Index format and how do we find entries in it.
+ *		| | on the Packfile Index format.
  *		| |
  *		| |-# pack_index_open
  *		|	| Guess the name of the index based on the full path to the
@@ -234,13 +236,45 @@ static int packfile_load__cb(void *_data, git_buf *path)
 	else if (error < 0)
 		return error;
 
+	if (backend->parent.odb)
+		pack->mwf.group = &backend->parent.odb->mwindows;
+
 	return git_vector_insert(&backend->packs, pack);
 }
 
+/*
+ * Forget about packs whose file went away (e.g. after a repack). Their
+ * mappings and descriptor are released right away, unless an object
+ * is being read from them; the rest goes with the last reference,
+ * once no multi-pack index or reader holds them.
+ */
+static int packfile_drop_missing(struct pack_backend *backend, int *dropped)
+{
+	unsigned int i = 0;
+
+	while (i < backend->packs.length) {
+		struct git_pack_file *p = git_vector_get(&backend->packs, i);
+
+		if (git_path_exists(p->pack_name) == true) {
+			i++;
+			continue;
+		}
+
+		git_vector_remove(&backend->packs, i);
+		if (git_mwindow_file_close(&p->mwf) < 0)
+			giterr_clear();
+		git_packfile__decref(p);
+		*dropped = 1;
+	}
+
+	return 0;
+}
+
 static int packfile_refresh_all(struct pack_backend *backend)
 {
-	int error;
+	int error, dropped = 0;
 	struct stat st;
+	size_t known;
 	git_buf path = GIT_BUF_INIT;
 
 	if (backend->pack_folder == NULL)
@@ -249,6 +283,13 @@ static int packfile_refresh_all(struct pack_backend *backend)
 	if (p_stat(backend->pack_folder, &st) < 0 || !S_ISDIR(st.st_mode))
 		return git_odb__error_notfound("failed to refresh packfiles", NULL);
 
+	if (git_mutex_lock(&backend->lock) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock pack backend");
+		return -1;
+	}
+
+	known = backend->packs.length;
+
 	git_buf_sets(&path, backend->pack_folder);
 
 	/* reload all packs */
@@ -256,98 +297,75 @@ static int packfile_refresh_all(struct pack_backend *backend)
 
 	git_buf_free(&path);
 
-	if (error < 0)
-		return error;
+	if (!error)
+		error = packfile_drop_missing(backend, &dropped);
 
-	git_vector_sort(&backend->packs);
+	if (dropped || backend->packs.length != known) {
+		git_vector_sort(&backend->packs);
+		backend->midx_dirty = 1;
+	}
 
-	return 0;
+	git_mutex_unlock(&backend->lock);
+	return error;
 }
 
-static int pack_entry_find_inner(
-	struct git_pack_entry *e,
-	struct pack_backend *backend,
-	const git_oid *oid,
-	struct git_pack_file *last_found)
+static int pack_backend__midx(git_midx **out, struct pack_backend *backend)
 {
-	unsigned int i;
-
-	if (last_found &&
-		git_pack_entry_find(e, last_found, oid, GIT_OID_HEXSZ) == 0)
-		return 0;
-
-	for (i = 0; i < backend->packs.length; ++i) {
-		struct git_pack_file *p;
+	git_midx *midx;
 
-		p = git_vector_get(&backend->packs, i);
-		if (p == last_found)
-			continue;
+	if (git_mutex_lock(&backend->lock) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock pack backend");
+		return -1;
+	}
 
-		if (git_pack_entry_find(e, p, oid, GIT_OID_HEXSZ) == 0) {
-			backend->last_found = p;
-			return 0;
+	if (backend->midx == NULL || backend->midx_dirty) {
+		if (git_midx_new(&midx, backend->midx, &backend->packs) < 0) {
+			git_mutex_unlock(&backend->lock);
+			return -1;
 		}
+
+		git_midx_free(backend->midx);
+		backend->midx = midx;
+		backend->midx_dirty = 0;
 	}
 
-	return -1;
+	git_midx_incref(backend->midx);
+	*out = backend->midx;
+
+	git_mutex_unlock(&backend->lock);
+	return 0;
 }
 
-static int pack_entry_find(struct git_pack_entry *e, struct pack_backend *backend, const git_oid *oid)
+static int pack_entry_find_inner(
+	struct git_pack_entry *e,
+	struct pack_backend *backend,
+	const git_oid *short_oid,
+	size_t len)
 {
+	git_midx *midx;
 	int error;
-	struct git_pack_file *last_found = backend->last_found;
-
-	if (backend->last_found &&
-		git_pack_entry_find(e, backend->last_found, oid, GIT_OID_HEXSZ) == 0)
-		return 0;
 
-	if (!pack_entry_find_inner(e, backend, oid, last_found))
-		return 0;
-	if ((error = packfile_refresh_all(backend)) < 0)
+	if ((error = pack_backend__midx(&midx, backend)) < 0)
 		return error;
-	if (!pack_entry_find_inner(e, backend, oid, last_found))
-		return 0;
 
-	return git_odb__error_notfound("failed to find pack entry", oid);
+	/* the caller reads from the pack after the midx is let go */
+	if ((error = git_midx_find(e, midx, short_oid, len)) == 0)
+		git_packfile__incref(e->p);
+	git_midx_free(midx);
+
+	return error;
 }
 
-static unsigned pack_entry_find_prefix_inner(
-		struct git_pack_entry *e,
-		struct pack_backend *backend,
-		const git_oid *short_oid,
-		size_t len,
-		struct git_pack_file *last_found)
+static int pack_entry_find(struct git_pack_entry *e, struct pack_backend *backend, const git_oid *oid)
 {
 	int error;
-	unsigned int i;
-	unsigned found = 0;
-
-	if (last_found) {
-		error = git_pack_entry_find(e, last_found, short_oid, len);
-		if (error == GIT_EAMBIGUOUS)
-			return error;
-		if (!error)
-			found = 1;
-	}
-
-	for (i = 0; i < backend->packs.length; ++i) {
-		struct git_pack_file *p;
-
-		p = git_vector_get(&backend->packs, i);
-		if (p == last_found)
-			continue;
 
-		error = git_pack_entry_find(e, p, short_oid, len);
-		if (error == GIT_EAMBIGUOUS)
-			return error;
-		if (!error) {
-			if (++found > 1)
-				break;
-			backend->last_found = p;
-		}
-	}
+	if ((error = pack_entry_find_inner(e, backend, oid, GIT_OID_HEXSZ)) != GIT_ENOTFOUND)
+		return error;
+	if ((error = packfile_refresh_all(backend)) < 0)
+		return error;
 
-	return found;
+	return pack_entry_find_inner(e, backend, oid, GIT_OID_HEXSZ);
 }
 
 static int pack_entry_find_prefix(
@@ -356,23 +374,14 @@ static int pack_entry_find_prefix(
 	const git_oid *short_oid,
 	size_t len)
 {
-	unsigned found = 0;
 	int error;
-	struct git_pack_file *last_found = backend->last_found;
 
-	if ((found = pack_entry_find_prefix_inner(e, backend, short_oid, len, last_found)) > 0)
-		goto cleanup;
+	if ((error = pack_entry_find_inner(e, backend, short_oid, len)) != GIT_ENOTFOUND)
+		return error;
 	if ((error = packfile_refresh_all(backend)) < 0)
 		return error;
-	found = pack_entry_find_prefix_inner(e, backend, short_oid, len, last_found);
-
-cleanup:
-	if (!found)
-		return git_odb__error_notfound("no matching pack entry for prefix", short_oid);
-	else if (found > 1)
-		return git_odb__error_ambiguous("found multiple pack entries");
-	else
-		return 0;
+
+	return pack_entry_find_inner(e, backend, short_oid, len);
 }
 
 
@@ -394,7 +403,100 @@ static int pack_backend__read_header(size_t *len_p, git_otype *type_p, struct gi
 	if ((error = pack_entry_find(&e, (struct pack_backend *)backend, oid)) < 0)
 		return error;
 
-	return git_packfile_resolve_header(len_p, type_p, e.p, e.offset);
+	error = git_packfile_resolve_header(len_p, type_p, e.p, e.offset);
+	git_packfile__decref(e.p);
+	return error;
+}
+
+struct pack_readstream {
+	git_odb_stream parent;
+	git_packfile_stream inner;
+};
+
+static int pack_backend__readstream_read(git_odb_stream *_stream, char *buffer, size_t len)
+{
+	struct pack_readstream *stream = (struct pack_readstream *)_stream;
+	size_t written = 0;
+	git_off_t pos;
+	ssize_t bytes;
+
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	while (written < len && !stream->inner.done) {
+		pos = stream->inner.curpos;
+		bytes = git_packfile_stream_read(&stream->inner, buffer + written, len - written);
+
+		/* inflate may stop at the end of a window without output */
+		if (bytes == GIT_EBUFS && stream->inner.curpos != pos)
+			continue;
+
+		if (bytes == GIT_EBUFS) {
+			giterr_set(GITERR_ODB, "Truncated packed object");
+			return -1;
+		} else if (bytes < 0)
+			return (int)bytes;
+
+		written += bytes;
+	}
+
+	return (int)written;
+}
+
+static void pack_backend__readstream_free(git_odb_stream *_stream)
+{
+	struct pack_readstream *stream = (struct pack_readstream *)_stream;
+
+	git_packfile_stream_free(&stream->inner);
+	git_packfile__decref(stream->inner.p);
+	git__free(stream);
+}
+
+/*
+ * Whole objects are inflated straight from the pack windows; deltas
+ * need their whole base, so they are left to be read in one go.
+ */
+static int pack_backend__readstream(git_odb_stream **stream_out, git_odb_backend *backend, const git_oid *oid)
+{
+	struct git_pack_entry e;
+	struct pack_readstream *stream = NULL;
+	git_mwindow *w_curs = NULL;
+	git_off_t curpos;
+	size_t size;
+	git_otype type;
+	int error;
+
+	assert(stream_out && backend && oid);
+
+	if ((error = pack_entry_find(&e, (struct pack_backend *)backend, oid)) < 0)
+		return error;
+
+	curpos = e.offset;
+	error = git_packfile_unpack_header(&size, &type, &e.p->mwf, &w_curs, &curpos);
+	git_mwindow_close(&w_curs);
+
+	if (!error && (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA))
+		error = GIT_PASSTHROUGH;
+
+	if (!error && (stream = git__calloc(1, sizeof(struct pack_readstream))) == NULL)
+		error = -1;
+
+	if (!error && (error = git_packfile_stream_open(&stream->inner, e.p, curpos)) < 0)
+		git__free(stream);
+
+	/* on success, the stream keeps the reference until it's freed */
+	if (error < 0) {
+		git_packfile__decref(e.p);
+		return error;
+	}
+
+	stream->parent.backend = backend;
+	stream->parent.read = &pack_backend__readstream_read;
+	stream->parent.free = &pack_backend__readstream_free;
+	stream->parent.mode = GIT_STREAM_RDONLY;
+
+	*stream_out = (git_odb_stream *)stream;
+	return 0;
 }
 
 static int pack_backend__read(void **buffer_p, size_t *len_p, git_otype *type_p, git_odb_backend *backend, const git_oid *oid)
@@ -403,8 +505,12 @@ static int pack_backend__read(void **buffer_p, size_t *len_p, git_otype *type_p,
 	git_rawobj raw;
 	int error;
 
-	if ((error = pack_entry_find(&e, (struct pack_backend *)backend, oid)) < 0 ||
-		(error = git_packfile_unpack(&raw, e.p, &e.offset)) < 0)
+	if ((error = pack_entry_find(&e, (struct pack_backend *)backend, oid)) < 0)
+		return error;
+
+	error = git_packfile_unpack(&raw, e.p, &e.offset);
+	git_packfile__decref(e.p);
+	if (error < 0)
 		return error;
 
 	*buffer_p = raw.data;
@@ -438,9 +544,12 @@ static int pack_backend__read_prefix(
 		git_rawobj raw;
 
 		if ((error = pack_entry_find_prefix(
-				&e, (struct pack_backend *)backend, short_oid, len)) == 0 &&
-			(error = git_packfile_unpack(&raw, e.p, &e.offset)) == 0)
-		{
+				&e, (struct pack_backend *)backend, short_oid, len)) == 0) {
+			error = git_packfile_unpack(&raw, e.p, &e.offset);
+			git_packfile__decref(e.p);
+		}
+
+		if (!error) {
 			*buffer_p = raw.data;
 			*len_p = raw.len;
 			*type_p = raw.type;
@@ -454,7 +563,12 @@ static int pack_backend__read_prefix(
 static int pack_backend__exists(git_odb_backend *backend, const git_oid *oid)
 {
 	struct git_pack_entry e;
-	return pack_entry_find(&e, (struct pack_backend *)backend, oid) == 0;
+
+	if (pack_entry_find(&e, (struct pack_backend *)backend, oid) < 0)
+		return 0;
+
+	git_packfile__decref(e.p);
+	return 1;
 }
 
 static int pack_backend__foreach(git_odb_backend *_backend, git_odb_foreach_cb cb, void *data)
@@ -462,6 +576,7 @@ static int pack_backend__foreach(git_odb_backend *_backend, git_odb_foreach_cb c
 	int error;
 	struct git_pack_file *p;
 	struct pack_backend *backend;
+	git_vector packs = GIT_VECTOR_INIT;
 	unsigned int i;
 
 	assert(_backend && cb);
@@ -471,12 +586,27 @@ static int pack_backend__foreach(git_odb_backend *_backend, git_odb_foreach_cb c
 	if ((error = packfile_refresh_all(backend)) < 0)
 		return error;
 
-	git_vector_foreach(&backend->packs, i, p) {
-		if ((error = git_pack_foreach_entry(p, cb, data)) < 0)
-			return error;
+	/* a refresh from another thread may drop some while we go */
+	if (git_mutex_lock(&backend->lock) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock pack backend");
+		return -1;
 	}
 
-	return 0;
+	if ((error = git_vector_dup(&packs, &backend->packs, NULL)) == 0) {
+		git_vector_foreach(&packs, i, p)
+			git_packfile__incref(p);
+	}
+
+	git_mutex_unlock(&backend->lock);
+
+	git_vector_foreach(&packs, i, p) {
+		if (!error)
+			error = git_pack_foreach_entry(p, cb, data);
+		git_packfile__decref(p);
+	}
+
+	git_vector_free(&packs);
+	return error;
 }
 
 static int pack_backend__writepack_add(struct git_odb_writepack *_writepack, const void *data, size_t size, git_transfer_progress *stats)
@@ -549,12 +679,15 @@ static void pack_backend__free(git_odb_backend *_backend)
 
 	backend = (struct pack_backend *)_backend;
 
+	git_midx_free(backend->midx);
+
 	for (i = 0; i < backend->packs.length; ++i) {
 		struct git_pack_file *p = git_vector_get(&backend->packs, i);
-		packfile_free(p);
+		git_packfile__decref(p);
 	}
 
 	git_vector_free(&backend->packs);
+	git_mutex_free(&backend->lock);
 	git__free(backend->pack_folder);
 	git__free(backend);
 }
@@ -580,10 +713,12 @@ int git_odb_backend_one_pack(git_odb_backend **backend_out, const char *idx)
 	backend->parent.read = &pack_backend__read;
 	backend->parent.read_prefix = &pack_backend__read_prefix;
 	backend->parent.read_header = &pack_backend__read_header;
+	backend->parent.readstream = &pack_backend__readstream;
 	backend->parent.exists = &pack_backend__exists;
 	backend->parent.foreach = &pack_backend__foreach;
 	backend->parent.free = &pack_backend__free;
 
+	git_mutex_init(&backend->lock);
 	*backend_out = (git_odb_backend *)backend;
 
 	return 0;
@@ -607,6 +742,7 @@ int git_odb_backend_pack(git_odb_backend **backend_out, const char *objects_dir)
 	if (git_vector_init(&backend->packs, 8, packfile_sort__cb) < 0 ||
 		git_buf_joinpath(&path, objects_dir, "pack") < 0)
 	{
+		git_vector_free(&backend->packs);
 		git__free(backend);
 		return -1;
 	}
@@ -618,11 +754,13 @@ int git_odb_backend_pack(git_odb_backend **backend_out, const char *objects_dir)
 	backend->parent.read = &pack_backend__read;
 	backend->parent.read_prefix = &pack_backend__read_prefix;
 	backend->parent.read_header = &pack_backend__read_header;
+	backend->parent.readstream = &pack_backend__readstream;
 	backend->parent.exists = &pack_backend__exists;
 	backend->parent.foreach = &pack_backend__foreach;
 	backend->parent.writepack = &pack_backend__writepack;
 	backend->parent.free = &pack_backend__free;
 
+	git_mutex_init(&backend->lock);
 	*backend_out = (git_odb_backend *)backend;
 
 	git_buf_free(&path);
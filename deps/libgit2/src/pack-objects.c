@@ -12,6 +12,7 @@
 #include "iterator.h"
 #include "netops.h"
 #include "pack.h"
+#include "pack_bitmap.h"
 #include "thread-utils.h"
 #include "tree.h"
 
@@ -1296,6 +1297,79 @@ int git_packbuilder_insert_tree(git_packbuilder *pb, const git_oid *oid)
 	return 0;
 }
 
+static int insert_reachable(git_packbuilder *pb,
+	git_reachable *r, const git_bitmap *objects)
+{
+	/* commits first, then what they point to */
+	static const git_otype order[] = {
+		GIT_OBJ_COMMIT, GIT_OBJ_TAG, GIT_OBJ_TREE, GIT_OBJ_BLOB
+	};
+	size_t i, word, bit;
+
+	for (i = 0; i < ARRAY_SIZE(order); ++i) {
+		for (word = 0; word < objects->length; ++word) {
+			if (!objects->words[word])
+				continue;
+
+			for (bit = 0; bit < 64; ++bit) {
+				size_t pos = word * 64 + bit;
+
+				if (!(objects->words[word] & ((uint64_t)1 << bit)) ||
+					git_reachable_type(r, pos) != order[i])
+					continue;
+
+				if (git_packbuilder_insert(pb, git_reachable_oid(r, pos), NULL) < 0)
+					return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int git_packbuilder_insert_reachable(git_packbuilder *pb,
+	const git_oid wants[], size_t nwants, const git_oid haves[], size_t nhaves)
+{
+	git_reachable r;
+	git_bitmap objects = GIT_BITMAP_INIT, common = GIT_BITMAP_INIT;
+	git_oid *known = NULL;
+	size_t i, nknown = 0;
+	int error = -1;
+
+	assert(pb && (wants || !nwants) && (haves || !nhaves));
+
+	if (git_reachable_init(&r, pb->repo, NULL) < 0)
+		return -1;
+
+	/* haves we don't have can't leave anything out */
+	if (nhaves > 0) {
+		known = git__malloc(nhaves * sizeof(git_oid));
+		if (known == NULL) {
+			error = -1;
+			goto cleanup;
+		}
+
+		for (i = 0; i < nhaves; ++i) {
+			if (git_odb_exists(pb->odb, &haves[i]))
+				git_oid_cpy(&known[nknown++], &haves[i]);
+		}
+	}
+
+	if ((error = git_reachable_fill(&common, &r, known, nknown, NULL)) < 0 ||
+		(error = git_reachable_fill(&objects, &r, wants, nwants, &common)) < 0)
+		goto cleanup;
+
+	git_bitmap_and_not(&objects, &common);
+	error = insert_reachable(pb, &r, &objects);
+
+cleanup:
+	git__free(known);
+	git_bitmap_free(&objects);
+	git_bitmap_free(&common);
+	git_reachable_free(&r);
+	return error;
+}
+
 uint32_t git_packbuilder_object_count(git_packbuilder *pb)
 {
 	return pb->nr_objects;
@@ -12,6 +12,7 @@
 #include "sha1_lookup.h"
 #include "mwindow.h"
 #include "fileops.h"
+#include "global.h"
 
 #include "git2/oid.h"
 #include <zlib.h>
@@ -40,6 +41,342 @@ static int pack_entry_find_offset(
 		const git_oid *short_oid,
 		size_t len);
 
+/***********************************************************
+ *
+ * DELTA HEADER CACHE
+ *
+ * The size of a deltified object is in the header of its (compressed)
+ * delta and its type is the one of the base at the end of the chain.
+ * Answers are kept in a direct-mapped table keyed by (pack, offset),
+ * shared by all packs and threads; grab git__pack_header_mutex to
+ * read or modify it.
+ *
+ ***********************************************************/
+
+#define DELTA_HEADER_CACHE_SLOTS 4096
+
+typedef struct {
+	struct git_pack_file *p;
+	git_off_t offset;
+	size_t size;
+	git_otype type;
+} delta_header_entry;
+
+static delta_header_entry delta_headers[DELTA_HEADER_CACHE_SLOTS];
+
+GIT_INLINE(delta_header_entry *) delta_header_slot(
+	struct git_pack_file *p, git_off_t offset)
+{
+	size_t hash = (size_t)offset + ((size_t)p >> 4);
+	hash += hash >> 12;
+	return &delta_headers[hash % DELTA_HEADER_CACHE_SLOTS];
+}
+
+static int delta_header_get(
+	size_t *size_p, git_otype *type_p, struct git_pack_file *p, git_off_t offset)
+{
+	delta_header_entry *e;
+	int found = 0;
+
+	if (git_mutex_lock(&git__pack_header_mutex) < 0)
+		return 0;
+
+	e = delta_header_slot(p, offset);
+	if (e->p == p && e->offset == offset) {
+		if (size_p)
+			*size_p = e->size;
+		*type_p = e->type;
+		found = 1;
+	}
+
+	git_mutex_unlock(&git__pack_header_mutex);
+	return found;
+}
+
+static void delta_header_put(
+	struct git_pack_file *p, git_off_t offset, size_t size, git_otype type)
+{
+	delta_header_entry *e;
+
+	if (git_mutex_lock(&git__pack_header_mutex) < 0)
+		return;
+
+	e = delta_header_slot(p, offset);
+	e->p = p;
+	e->offset = offset;
+	e->size = size;
+	e->type = type;
+
+	git_mutex_unlock(&git__pack_header_mutex);
+}
+
+static void delta_header_clear(struct git_pack_file *p)
+{
+	size_t i;
+
+	if (git_mutex_lock(&git__pack_header_mutex) < 0)
+		return;
+
+	for (i = 0; i < DELTA_HEADER_CACHE_SLOTS; ++i)
+		if (delta_headers[i].p == p)
+			delta_headers[i].p = NULL;
+
+	git_mutex_unlock(&git__pack_header_mutex);
+}
+
+/***********************************************************
+ *
+ * DELTA BASE CACHE
+ *
+ * Objects at the end of a delta chain would otherwise re-inflate
+ * the whole chain every time they are read. Inflated bases are kept
+ * in a small direct-mapped table keyed by (pack, offset), with an
+ * LRU list to stay under a byte budget. The table is shared by all
+ * packs and threads; whenever you want to read or modify it, grab
+ * git__delta_cache_mutex.
+ *
+ * Entries handed out by `delta_base_get` are pinned until they are
+ * released, so a base can be evicted while another thread is still
+ * applying a delta against it.
+ *
+ ***********************************************************/
+
+#define DELTA_BASE_CACHE_SLOTS 1024
+
+typedef struct delta_base_entry {
+	struct delta_base_entry *lru_prev, *lru_next;
+	struct git_pack_file *p;
+	git_off_t offset;
+	git_rawobj raw;
+	unsigned int refcount;
+	unsigned int evicted:1;
+} delta_base_entry;
+
+static struct {
+	delta_base_entry *slots[DELTA_BASE_CACHE_SLOTS];
+	delta_base_entry *lru_head, *lru_tail;
+	size_t limit;
+	size_t used;
+	size_t count;
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+} delta_cache = { {NULL}, NULL, NULL, GIT_DELTA_BASE_CACHE_SIZE, 0, 0, 0, 0, 0 };
+
+GIT_INLINE(size_t) delta_base_slot(struct git_pack_file *p, git_off_t offset)
+{
+	size_t hash = (size_t)offset + ((size_t)p >> 4);
+	hash += hash >> 8;
+	return hash % DELTA_BASE_CACHE_SLOTS;
+}
+
+static void delta_base_entry_free(delta_base_entry *e)
+{
+	git__free(e->raw.data);
+	git__free(e);
+}
+
+/* must be called with the cache lock held */
+static void delta_base_evict(delta_base_entry *e)
+{
+	size_t slot = delta_base_slot(e->p, e->offset);
+
+	if (delta_cache.slots[slot] == e)
+		delta_cache.slots[slot] = NULL;
+
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		delta_cache.lru_head = e->lru_next;
+
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		delta_cache.lru_tail = e->lru_prev;
+
+	delta_cache.used -= e->raw.len;
+	delta_cache.count--;
+	delta_cache.evictions++;
+
+	if (e->refcount == 0)
+		delta_base_entry_free(e);
+	else
+		e->evicted = 1;
+}
+
+/* must be called with the cache lock held */
+static void delta_base_shrink(size_t limit)
+{
+	while (delta_cache.lru_head != NULL && delta_cache.used > limit)
+		delta_base_evict(delta_cache.lru_head);
+}
+
+static delta_base_entry *delta_base_get(struct git_pack_file *p, git_off_t offset)
+{
+	delta_base_entry *e;
+
+	if (git_mutex_lock(&git__delta_cache_mutex) < 0)
+		return NULL;
+
+	e = delta_cache.slots[delta_base_slot(p, offset)];
+
+	if (e != NULL && e->p == p && e->offset == offset) {
+		e->refcount++;
+		delta_cache.hits++;
+
+		/* move to the most recently used end */
+		if (e != delta_cache.lru_tail) {
+			if (e->lru_prev)
+				e->lru_prev->lru_next = e->lru_next;
+			else
+				delta_cache.lru_head = e->lru_next;
+			e->lru_next->lru_prev = e->lru_prev;
+
+			e->lru_prev = delta_cache.lru_tail;
+			e->lru_next = NULL;
+			delta_cache.lru_tail->lru_next = e;
+			delta_cache.lru_tail = e;
+		}
+	} else {
+		e = NULL;
+		delta_cache.misses++;
+	}
+
+	git_mutex_unlock(&git__delta_cache_mutex);
+	return e;
+}
+
+static void delta_base_release(delta_base_entry *e)
+{
+	int dead;
+
+	if (git_mutex_lock(&git__delta_cache_mutex) < 0)
+		return;
+
+	dead = (--e->refcount == 0 && e->evicted);
+	git_mutex_unlock(&git__delta_cache_mutex);
+
+	if (dead)
+		delta_base_entry_free(e);
+}
+
+/*
+ * Hand an inflated base over to the cache. The cache takes ownership
+ * of `base->data` whether or not the object ends up being stored.
+ */
+static void delta_base_put(struct git_pack_file *p, git_off_t offset, git_rawobj *base)
+{
+	delta_base_entry *e, *old;
+	size_t slot;
+
+	if ((e = git__malloc(sizeof(delta_base_entry))) == NULL) {
+		giterr_clear();
+		git__free(base->data);
+		return;
+	}
+
+	e->p = p;
+	e->offset = offset;
+	e->raw = *base;
+	e->refcount = 0;
+	e->evicted = 0;
+	e->lru_next = NULL;
+
+	if (git_mutex_lock(&git__delta_cache_mutex) < 0) {
+		delta_base_entry_free(e);
+		return;
+	}
+
+	/* a single base may not take more than a quarter of the budget */
+	if (delta_cache.limit == 0 || e->raw.len > delta_cache.limit / 4) {
+		git_mutex_unlock(&git__delta_cache_mutex);
+		delta_base_entry_free(e);
+		return;
+	}
+
+	slot = delta_base_slot(p, offset);
+	if ((old = delta_cache.slots[slot]) != NULL) {
+		if (old->p == p && old->offset == offset) {
+			/* another thread got here first */
+			git_mutex_unlock(&git__delta_cache_mutex);
+			delta_base_entry_free(e);
+			return;
+		}
+
+		delta_base_evict(old);
+	}
+
+	delta_base_shrink(delta_cache.limit - e->raw.len);
+
+	e->lru_prev = delta_cache.lru_tail;
+	if (delta_cache.lru_tail)
+		delta_cache.lru_tail->lru_next = e;
+	else
+		delta_cache.lru_head = e;
+	delta_cache.lru_tail = e;
+
+	delta_cache.slots[slot] = e;
+	delta_cache.used += e->raw.len;
+	delta_cache.count++;
+
+	git_mutex_unlock(&git__delta_cache_mutex);
+}
+
+void git_packfile__delta_cache_clear(struct git_pack_file *p)
+{
+	delta_base_entry *e, *next;
+
+	delta_header_clear(p);
+
+	if (git_mutex_lock(&git__delta_cache_mutex) < 0)
+		return;
+
+	for (e = delta_cache.lru_head; e != NULL; e = next) {
+		next = e->lru_next;
+		if (e->p == p)
+			delta_base_evict(e);
+	}
+
+	git_mutex_unlock(&git__delta_cache_mutex);
+}
+
+int git_packfile__delta_cache_set_limit(size_t limit)
+{
+	if (git_mutex_lock(&git__delta_cache_mutex) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock delta base cache mutex");
+		return -1;
+	}
+
+	delta_cache.limit = limit;
+	delta_base_shrink(limit);
+
+	git_mutex_unlock(&git__delta_cache_mutex);
+	return 0;
+}
+
+size_t git_packfile__delta_cache_limit(void)
+{
+	return delta_cache.limit;
+}
+
+int git_packfile__delta_cache_stats(git_cache_stats *out)
+{
+	if (git_mutex_lock(&git__delta_cache_mutex) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock delta base cache mutex");
+		return -1;
+	}
+
+	out->count = delta_cache.count;
+	out->used = delta_cache.used;
+	out->limit = delta_cache.limit;
+	out->hits = delta_cache.hits;
+	out->misses = delta_cache.misses;
+	out->evictions = delta_cache.evictions;
+
+	git_mutex_unlock(&git__delta_cache_mutex);
+	return 0;
+}
+
 static int packfile_error(const char *message)
 {
 	giterr_set(GITERR_ODB, "Invalid pack file - %s", message);
@@ -189,14 +526,37 @@ static int pack_index_open(struct git_pack_file *p)
 	return error;
 }
 
+/*
+ * Packs are opened lazily, and may be closed again at any time to
+ * honor the limit on open files; see git_mwindow_file_register.
+ */
+static int packfile_ensure_open(struct git_pack_file *p)
+{
+	int error = 0;
+
+	if (p->mwf.fd != -1)
+		return 0;
+
+	if (git_mutex_lock(&p->lock) < 0) {
+		giterr_set(GITERR_THREAD, "unable to lock packfile mutex");
+		return -1;
+	}
+
+	if (p->mwf.fd == -1)
+		error = packfile_open(p);
+
+	git_mutex_unlock(&p->lock);
+	return error;
+}
+
 static unsigned char *pack_window_open(
 		struct git_pack_file *p,
 		git_mwindow **w_cursor,
 		git_off_t offset,
 		unsigned int *left)
 {
-	if (p->mwf.fd == -1 && packfile_open(p) < 0)
-		return NULL;
+	unsigned char *data;
+	int tries;
 
 	/* Since packfiles end in a hash of their content and it's
 	 * pointless to ask for an offset into the middle of that
@@ -206,8 +566,18 @@ static unsigned char *pack_window_open(
 	if (offset > (p->mwf.size - 20))
 		return NULL;
 
-	return git_mwindow_open(&p->mwf, w_cursor, offset, 20, left);
- }
+	/* the pack may get closed between opening it and mapping it */
+	for (tries = 0; tries < 3; ++tries) {
+		if (packfile_ensure_open(p) < 0)
+			return NULL;
+
+		data = git_mwindow_open(&p->mwf, w_cursor, offset, 20, left);
+		if (data != NULL || p->mwf.fd != -1)
+			return data;
+	}
+
+	return NULL;
+}
 
 static int packfile_unpack_header1(
 		unsigned long *usedp,
@@ -277,6 +647,69 @@ int git_packfile_unpack_header(
 	return 0;
 }
 
+static void *use_git_alloc(void *opaq, unsigned int count, unsigned int size)
+{
+	GIT_UNUSED(opaq);
+	return git__calloc(count, size);
+}
+
+static void use_git_free(void *opaq, void *ptr)
+{
+	GIT_UNUSED(opaq);
+	git__free(ptr);
+}
+
+/*
+ * Read the size of the object a delta produces. Its header holds two
+ * varints (base size, then result size) of up to 10 bytes each, so
+ * only that much of the delta is inflated.
+ */
+static int packfile_delta_result_size(
+	size_t *size_p,
+	struct git_pack_file *p,
+	git_off_t curpos,
+	size_t delta_size)
+{
+	unsigned char buffer[20], *in;
+	git_mwindow *w_curs = NULL;
+	size_t base_size;
+	z_stream stream;
+	int st;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.next_out = buffer;
+	stream.avail_out = (uInt)min(sizeof(buffer), delta_size);
+	stream.zalloc = use_git_alloc;
+	stream.zfree = use_git_free;
+
+	if (inflateInit(&stream) != Z_OK) {
+		giterr_set(GITERR_ZLIB, "Failed to inflate packfile");
+		return -1;
+	}
+
+	do {
+		in = pack_window_open(p, &w_curs, curpos, &stream.avail_in);
+		stream.next_in = in;
+		st = inflate(&stream, Z_NO_FLUSH);
+		git_mwindow_close(&w_curs);
+
+		if (in == NULL)
+			break;
+
+		curpos += stream.next_in - in;
+	} while (stream.avail_out > 0 && st == Z_OK);
+
+	inflateEnd(&stream);
+
+	if (in == NULL || (st != Z_OK && st != Z_STREAM_END) ||
+		git__delta_read_header(buffer, stream.total_out, &base_size, size_p) < 0) {
+		giterr_set(GITERR_ZLIB, "Failed to read delta header");
+		return -1;
+	}
+
+	return 0;
+}
+
 int git_packfile_resolve_header(
 		size_t *size_p,
 		git_otype *type_p,
@@ -295,23 +728,25 @@ int git_packfile_resolve_header(
 	if (error < 0)
 		return error;
 
-	if (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA) {
-		size_t base_size;
-		git_rawobj delta;
-		base_offset = get_delta_base(p, &w_curs, &curpos, type, offset);
-		git_mwindow_close(&w_curs);
-		error = packfile_unpack_compressed(&delta, p, &w_curs, &curpos, size, type);
-		git_mwindow_close(&w_curs);
-		if (error < 0)
-			return error;
-		error = git__delta_read_header(delta.data, delta.len, &base_size, size_p);
-		git__free(delta.data);
-		if (error < 0)
-			return error;
-	} else
+	if (type != GIT_OBJ_OFS_DELTA && type != GIT_OBJ_REF_DELTA) {
 		*size_p = size;
+		*type_p = type;
+		return 0;
+	}
+
+	if (delta_header_get(size_p, type_p, p, offset))
+		return 0;
+
+	base_offset = get_delta_base(p, &w_curs, &curpos, type, offset);
+	git_mwindow_close(&w_curs);
+	if (base_offset <= 0)
+		return packfile_error("delta offset out of bound");
+
+	if ((error = packfile_delta_result_size(size_p, p, curpos, size)) < 0)
+		return error;
 
-	while (type == GIT_OBJ_OFS_DELTA || type == GIT_OBJ_REF_DELTA) {
+	/* the type is the base's; stop early on a base we already know */
+	while (!delta_header_get(NULL, &type, p, base_offset)) {
 		curpos = base_offset;
 		error = git_packfile_unpack_header(&size, &type, &p->mwf, &w_curs, &curpos);
 		git_mwindow_close(&w_curs);
@@ -321,10 +756,14 @@ int git_packfile_resolve_header(
 			break;
 		base_offset = get_delta_base(p, &w_curs, &curpos, type, base_offset);
 		git_mwindow_close(&w_curs);
+		if (base_offset <= 0)
+			return packfile_error("delta offset out of bound");
 	}
+
+	delta_header_put(p, offset, *size_p, type);
 	*type_p = type;
 
-	return error;
+	return 0;
 }
 
 static int packfile_unpack_delta(
@@ -336,8 +775,9 @@ static int packfile_unpack_delta(
 		git_otype delta_type,
 		git_off_t obj_offset)
 {
-	git_off_t base_offset;
+	git_off_t base_offset, base_key;
 	git_rawobj base, delta;
+	delta_base_entry *cached;
 	int error;
 
 	base_offset = get_delta_base(p, w_curs, curpos, delta_type, obj_offset);
@@ -347,32 +787,38 @@ static int packfile_unpack_delta(
 	if (base_offset < 0) /* must actually be an error code */
 		return (int)base_offset;
 
-	error = git_packfile_unpack(&base, p, &base_offset);
+	base_key = base_offset;
 
-	/*
-	 * TODO: git.git tries to load the base from other packfiles
-	 * or loose objects.
-	 *
-	 * We'll need to do this in order to support thin packs.
-	 */
-	if (error < 0)
-		return error;
+	if ((cached = delta_base_get(p, base_key)) != NULL) {
+		base = cached->raw;
+	} else {
+		error = git_packfile_unpack(&base, p, &base_offset);
 
-	error = packfile_unpack_compressed(&delta, p, w_curs, curpos, delta_size, delta_type);
-	git_mwindow_close(w_curs);
-	if (error < 0) {
-		git__free(base.data);
-		return error;
+		/*
+		 * TODO: git.git tries to load the base from other packfiles
+		 * or loose objects.
+		 *
+		 * We'll need to do this in order to support thin packs.
+		 */
+		if (error < 0)
+			return error;
 	}
 
-	obj->type = base.type;
-	error = git__delta_apply(obj, base.data, base.len, delta.data, delta.len);
+	error = packfile_unpack_compressed(&delta, p, w_curs, curpos, delta_size, delta_type);
+	git_mwindow_close(w_curs);
 
-	git__free(base.data);
-	git__free(delta.data);
+	if (error == 0) {
+		obj->type = base.type;
+		error = git__delta_apply(obj, base.data, base.len, delta.data, delta.len);
+		git__free(delta.data);
+	}
 
-	/* TODO: we might want to cache this. eventually */
-	//add_delta_base_cache(p, base_offset, base, base_size, *type);
+	if (cached != NULL)
+		delta_base_release(cached);
+	else if (error == 0)
+		delta_base_put(p, base_key, &base);
+	else
+		git__free(base.data);
 
 	return error; /* error set by git__delta_apply */
 }
@@ -429,18 +875,6 @@ int git_packfile_unpack(
 	return error;
 }
 
-static void *use_git_alloc(void *opaq, unsigned int count, unsigned int size)
-{
-	GIT_UNUSED(opaq);
-	return git__calloc(count, size);
-}
-
-static void use_git_free(void *opaq, void *ptr)
-{
-	GIT_UNUSED(opaq);
-	git__free(ptr);
-}
-
 int git_packfile_stream_open(git_packfile_stream *obj, struct git_pack_file *p, git_off_t curpos)
 {
 	int st;
@@ -454,7 +888,6 @@ int git_packfile_stream_open(git_packfile_stream *obj, struct git_pack_file *p,
 	obj->zstream.next_out = Z_NULL;
 	st = inflateInit(&obj->zstream);
 	if (st != Z_OK) {
-		git__free(obj);
 		giterr_set(GITERR_ZLIB, "Failed to inflate packfile");
 		return -1;
 	}
@@ -643,8 +1076,11 @@ git_off_t get_delta_base(
 static struct git_pack_file *packfile_alloc(size_t extra)
 {
 	struct git_pack_file *p = git__calloc(1, sizeof(*p) + extra);
-	if (p != NULL)
+	if (p != NULL) {
 		p->mwf.fd = -1;
+		git_atomic_set(&p->refcount, 1);
+		git_mutex_init(&p->lock);
+	}
 	return p;
 }
 
@@ -653,7 +1089,7 @@ void packfile_free(struct git_pack_file *p)
 {
 	assert(p);
 
-	/* clear_delta_base_cache(); */
+	git_packfile__delta_cache_clear(p);
 	git_mwindow_free_all(&p->mwf);
 	git_mwindow_file_deregister(&p->mwf);
 
@@ -663,9 +1099,16 @@ void packfile_free(struct git_pack_file *p)
 	pack_index_free(p);
 
 	git__free(p->bad_object_sha1);
+	git_mutex_free(&p->lock);
 	git__free(p);
 }
 
+void git_packfile__decref(struct git_pack_file *p)
+{
+	if (p != NULL && git_atomic_dec(&p->refcount) == 0)
+		packfile_free(p);
+}
+
 static int packfile_open(struct git_pack_file *p)
 {
 	struct stat st;
@@ -685,8 +1128,7 @@ static int packfile_open(struct git_pack_file *p)
 		return -1;
 	}
 
-	if (p_fstat(p->mwf.fd, &st) < 0 ||
-		git_mwindow_file_register(&p->mwf) < 0)
+	if (p_fstat(p->mwf.fd, &st) < 0)
 		goto cleanup;
 
 	/* If we created the struct before we had the pack we lack size. */
@@ -724,7 +1166,10 @@ static int packfile_open(struct git_pack_file *p)
 
 	idx_sha1 = ((unsigned char *)p->index_map.data) + p->index_map.len - 40;
 
-	if (git_oid_cmp(&sha1, (git_oid *)idx_sha1) == 0)
+	/* Register last: from then on, it can be closed under us */
+	p->mwf.closable = 1;
+	if (git_oid_cmp(&sha1, (git_oid *)idx_sha1) == 0 &&
+		git_mwindow_file_register(&p->mwf) == 0)
 		return 0;
 
 cleanup:
@@ -751,6 +1196,7 @@ int git_packfile_check(struct git_pack_file **pack_out, const char *path)
 	 */
 	path_len -= strlen(".idx");
 	if (path_len < 1) {
+		git_mutex_free(&p->lock);
 		git__free(p);
 		return git_odb__error_notfound("invalid packfile path", NULL);
 	}
@@ -763,6 +1209,7 @@ int git_packfile_check(struct git_pack_file **pack_out, const char *path)
 
 	strcpy(p->pack_name + path_len, ".pack");
 	if (p_stat(p->pack_name, &st) < 0 || !S_ISREG(st.st_mode)) {
+		git_mutex_free(&p->lock);
 		git__free(p);
 		return git_odb__error_notfound("packfile not found", NULL);
 	}
@@ -872,6 +1319,91 @@ int git_pack_foreach_entry(
 	return 0;
 }
 
+int git_pack__index_load(struct git_pack_file *p)
+{
+	if (p->index_map.data != NULL)
+		return 0;
+
+	return pack_index_open(p);
+}
+
+const git_oid *git_pack__nth_oid(const struct git_pack_file *p, uint32_t n)
+{
+	const unsigned char *index = p->index_map.data;
+
+	assert(index && n < p->num_objects);
+
+	index += 4 * 256;
+	if (p->index_version > 1)
+		return (const git_oid *)(index + 8 + 20 * n);
+	else
+		return (const git_oid *)(index + 24 * n + 4);
+}
+
+int git_pack__find_nth(
+		uint32_t *n,
+		const struct git_pack_file *p,
+		const git_oid *oid)
+{
+	const uint32_t *level1_ofs = p->index_map.data;
+	const unsigned char *index = p->index_map.data;
+	unsigned hi, lo, stride;
+	int pos;
+
+	assert(index);
+
+	if (p->index_version > 1) {
+		level1_ofs += 2;
+		index += 8;
+		stride = 20;
+	} else {
+		index += 4;
+		stride = 24;
+	}
+
+	index += 4 * 256;
+	hi = ntohl(level1_ofs[(int)oid->id[0]]);
+	lo = ((oid->id[0] == 0x0) ? 0 : ntohl(level1_ofs[(int)oid->id[0] - 1]));
+
+	pos = sha1_entry_pos(index, stride, 0, lo, hi, p->num_objects, oid->id);
+	if (pos < 0)
+		return GIT_ENOTFOUND;
+
+	*n = (uint32_t)pos;
+	return 0;
+}
+
+git_off_t git_pack__nth_offset(const struct git_pack_file *p, uint32_t n)
+{
+	assert(p->index_map.data && n < p->num_objects);
+	return nth_packed_object_offset(p, n);
+}
+
+int git_pack__nth_entry(
+		struct git_pack_entry *e,
+		struct git_pack_file *p,
+		uint32_t n)
+{
+	const git_oid *oid = git_pack__nth_oid(p, n);
+	int error;
+
+	if (p->num_bad_objects) {
+		unsigned i;
+		for (i = 0; i < p->num_bad_objects; i++)
+			if (git_oid_cmp(oid, &p->bad_object_sha1[i]) == 0)
+				return packfile_error("bad object found in packfile");
+	}
+
+	if ((error = packfile_ensure_open(p)) < 0)
+		return error;
+
+	e->offset = nth_packed_object_offset(p, n);
+	e->p = p;
+
+	git_oid_cpy(&e->sha1, oid);
+	return 0;
+}
+
 static int pack_entry_find_offset(
 	git_off_t *offset_out,
 	git_oid *found_oid,
@@ -992,7 +1524,7 @@ int git_pack_entry_find(
 	/* we found a unique entry in the index;
 	 * make sure the packfile backing the index
 	 * still exists on disk */
-	if (p->mwf.fd == -1 && (error = packfile_open(p)) < 0)
+	if ((error = packfile_ensure_open(p)) < 0)
 		return error;
 
 	e->offset = offset;
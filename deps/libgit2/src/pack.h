@@ -19,6 +19,9 @@
 
 #define GIT_PACK_FILE_MODE 0444
 
+/* Default budget for inflated delta bases, shared by all packs */
+#define GIT_DELTA_BASE_CACHE_SIZE (32 * 1024 * 1024)
+
 #define PACK_SIGNATURE 0x5041434b	/* "PACK" */
 #define PACK_VERSION 2
 #define pack_version_ok(v) ((v) == htonl(2) || (v) == htonl(3))
@@ -55,7 +58,9 @@ struct git_pack_idx_header {
 
 struct git_pack_file {
 	git_mwindow_file mwf;
+	git_atomic refcount; /* see git_packfile__decref */
 	git_map index_map;
+	git_mutex lock; /* held while (re)opening the pack */
 
 	uint32_t num_objects;
 	uint32_t num_bad_objects;
@@ -117,12 +122,49 @@ git_off_t get_delta_base(struct git_pack_file *p, git_mwindow **w_curs,
 		git_off_t delta_obj_offset);
 
 void packfile_free(struct git_pack_file *p);
+
+/*
+ * A pack can be shared by the backend that found it, the multi-pack
+ * indexes built over it and the readers of its objects; each holds a
+ * reference, and the last one frees it. `packfile_free` is for packs
+ * that are never shared.
+ */
+GIT_INLINE(void) git_packfile__incref(struct git_pack_file *p)
+{
+	git_atomic_inc(&p->refcount);
+}
+
+void git_packfile__decref(struct git_pack_file *p);
+
+int git_packfile__delta_cache_set_limit(size_t limit);
+size_t git_packfile__delta_cache_limit(void);
+int git_packfile__delta_cache_stats(git_cache_stats *out);
+void git_packfile__delta_cache_clear(struct git_pack_file *p);
+
 int git_packfile_check(struct git_pack_file **pack_out, const char *path);
 int git_pack_entry_find(
 		struct git_pack_entry *e,
 		struct git_pack_file *p,
 		const git_oid *short_oid,
 		size_t len);
+
+/*
+ * Positional access to the entries of a pack index, in OID order.
+ * The index must have been loaded with `git_pack__index_load`.
+ */
+int git_pack__index_load(struct git_pack_file *p);
+const git_oid *git_pack__nth_oid(const struct git_pack_file *p, uint32_t n);
+/* Position of `oid` in the index; GIT_ENOTFOUND, without an error set, if it's not there */
+int git_pack__find_nth(
+		uint32_t *n,
+		const struct git_pack_file *p,
+		const git_oid *oid);
+git_off_t git_pack__nth_offset(const struct git_pack_file *p, uint32_t n);
+int git_pack__nth_entry(
+		struct git_pack_entry *e,
+		struct git_pack_file *p,
+		uint32_t n);
+
 int git_pack_foreach_entry(
 		struct git_pack_file *p,
 		git_odb_foreach_cb cb,
@@ -0,0 +1,1009 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "pack_bitmap.h"
+#include "fileops.h"
+#include "filebuf.h"
+#include "odb.h"
+#include "repository.h"
+
+#include "git2/commit.h"
+#include "git2/pack.h"
+#include "git2/refs.h"
+#include "git2/revwalk.h"
+#include "git2/tag.h"
+#include "git2/tree.h"
+
+GIT__USE_OIDMAP;
+
+#define BITMAP_SIGNATURE "BITM"
+#define BITMAP_VERSION 1
+#define BITMAP_OPT_FULL_DAG 1
+
+#define BITMAP_HEADER_SIZE (4 + 2 + 2 + 4 + GIT_OID_RAWSZ)
+#define BITMAP_ENTRY_HEADER_SIZE (4 + 1 + 1)
+#define BITMAP_MAX_XOR_OFFSET 160
+
+/* a commit out of every so many gets a bitmap, on top of the tips */
+#define BITMAP_SELECT_INTERVAL 100
+
+GIT_INLINE(uint32_t) get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+		((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+GIT_INLINE(void) put_be32(unsigned char *p, uint32_t n)
+{
+	p[0] = (unsigned char)(n >> 24);
+	p[1] = (unsigned char)(n >> 16);
+	p[2] = (unsigned char)(n >> 8);
+	p[3] = (unsigned char)n;
+}
+
+static int bitmap_error(const char *message)
+{
+	giterr_set(GITERR_ODB, "Invalid bitmap index - %s", message);
+	return -1;
+}
+
+/*
+ * Reading
+ */
+
+static int revindex_cmp(const void *a, const void *b)
+{
+	git_off_t a_off = ((const git_pack_bitmap_revindex *)a)->offset;
+	git_off_t b_off = ((const git_pack_bitmap_revindex *)b)->offset;
+
+	return a_off < b_off ? -1 : a_off > b_off;
+}
+
+/* Bit positions follow the order of the objects in the pack */
+static int bitmap_index_pack(git_pack_bitmap *bitmap)
+{
+	struct git_pack_file *pack = bitmap->pack;
+	uint32_t i;
+
+	bitmap->num_objects = pack->num_objects;
+	bitmap->revindex = git__malloc(
+		(pack->num_objects + 1) * sizeof(git_pack_bitmap_revindex));
+	GITERR_CHECK_ALLOC(bitmap->revindex);
+	bitmap->positions = git__malloc((pack->num_objects + 1) * sizeof(uint32_t));
+	GITERR_CHECK_ALLOC(bitmap->positions);
+
+	for (i = 0; i < pack->num_objects; ++i) {
+		bitmap->revindex[i].offset = git_pack__nth_offset(pack, i);
+		bitmap->revindex[i].nth = i;
+	}
+
+	qsort(bitmap->revindex, pack->num_objects,
+		sizeof(git_pack_bitmap_revindex), revindex_cmp);
+
+	for (i = 0; i < pack->num_objects; ++i)
+		bitmap->positions[bitmap->revindex[i].nth] = i;
+
+	bitmap->entry_map = git_oidmap_alloc();
+	GITERR_CHECK_ALLOC(bitmap->entry_map);
+
+	return 0;
+}
+
+static int bitmap_parse(git_pack_bitmap *bitmap)
+{
+	const unsigned char *data = bitmap->map.data, *pack_checksum;
+	size_t len = bitmap->map.len, pos, read;
+	git_bitmap *types[4];
+	uint32_t i;
+	int ret;
+
+	if (len < BITMAP_HEADER_SIZE + GIT_OID_RAWSZ)
+		return bitmap_error("file is too short");
+
+	/* the trailing checksum isn't part of the contents */
+	len -= GIT_OID_RAWSZ;
+
+	if (memcmp(data, BITMAP_SIGNATURE, 4) != 0 ||
+		((data[4] << 8) | data[5]) != BITMAP_VERSION)
+		return bitmap_error("unsupported format");
+
+	if (!(((data[6] << 8) | data[7]) & BITMAP_OPT_FULL_DAG))
+		return bitmap_error("bitmaps don't cover the full history");
+
+	pack_checksum = (const unsigned char *)bitmap->pack->index_map.data +
+		bitmap->pack->index_map.len - 2 * GIT_OID_RAWSZ;
+	if (memcmp(data + 12, pack_checksum, GIT_OID_RAWSZ) != 0)
+		return bitmap_error("the bitmap doesn't match the pack");
+
+	bitmap->num_entries = get_be32(data + 8);
+	pos = BITMAP_HEADER_SIZE;
+
+	types[0] = &bitmap->commits;
+	types[1] = &bitmap->trees;
+	types[2] = &bitmap->blobs;
+	types[3] = &bitmap->tags;
+
+	for (i = 0; i < 4; ++i) {
+		if (git_ewah_read(types[i], &read, data + pos, len - pos) < 0)
+			return -1;
+		pos += read;
+	}
+
+	if (bitmap->num_entries > (len - pos) / (BITMAP_ENTRY_HEADER_SIZE + 12))
+		return bitmap_error("entries are truncated");
+
+	bitmap->entries = git__calloc(bitmap->num_entries + 1, sizeof(git_pack_bitmap_entry));
+	GITERR_CHECK_ALLOC(bitmap->entries);
+
+	for (i = 0; i < bitmap->num_entries; ++i) {
+		git_pack_bitmap_entry *entry = &bitmap->entries[i];
+		uint32_t nth, words;
+		khiter_t k;
+
+		if (len - pos < BITMAP_ENTRY_HEADER_SIZE + 12)
+			return bitmap_error("entries are truncated");
+
+		nth = get_be32(data + pos);
+		entry->xor_offset = data[pos + 4];
+		pos += BITMAP_ENTRY_HEADER_SIZE;
+
+		if (nth >= bitmap->num_objects)
+			return bitmap_error("entry for an object outside the pack");
+
+		if (entry->xor_offset > BITMAP_MAX_XOR_OFFSET || entry->xor_offset > i)
+			return bitmap_error("entry is XORed with a missing one");
+
+		/* compressed bitmaps are only decoded when needed */
+		words = get_be32(data + pos + 4);
+		if (words > (len - pos - 8 - 4) / 8)
+			return bitmap_error("entries are truncated");
+
+		entry->data = data + pos;
+		entry->len = 8 + (size_t)words * 8 + 4;
+		pos += entry->len;
+
+		git_oid_cpy(&entry->oid, git_pack__nth_oid(bitmap->pack, nth));
+
+		k = kh_put(oid, bitmap->entry_map, &entry->oid, &ret);
+		if (ret < 0) {
+			giterr_set_oom();
+			return -1;
+		}
+		kh_value(bitmap->entry_map, k) = entry;
+	}
+
+	/* anything past the entries (e.g. a name-hash cache) is optional */
+	return 0;
+}
+
+int git_pack_bitmap_open(git_pack_bitmap **out, const char *path)
+{
+	git_pack_bitmap *bitmap;
+	git_buf idx = GIT_BUF_INIT;
+	git_file fd;
+	git_off_t len;
+	int error;
+
+	*out = NULL;
+
+	bitmap = git__calloc(1, sizeof(git_pack_bitmap));
+	GITERR_CHECK_ALLOC(bitmap);
+	git_atomic_set(&bitmap->refcount, 1);
+
+	if (git_buf_put(&idx, path, strlen(path) - strlen(GIT_PACK_BITMAP_SUFFIX)) < 0 ||
+		git_buf_puts(&idx, ".idx") < 0) {
+		git_pack_bitmap_free(bitmap);
+		return -1;
+	}
+
+	error = git_packfile_check(&bitmap->pack, idx.ptr);
+	git_buf_free(&idx);
+
+	if (error < 0 || (error = git_pack__index_load(bitmap->pack)) < 0) {
+		git_pack_bitmap_free(bitmap);
+		return error;
+	}
+
+	if ((fd = git_futils_open_ro(path)) < 0) {
+		git_pack_bitmap_free(bitmap);
+		return fd;
+	}
+
+	len = git_futils_filesize(fd);
+	if (len < BITMAP_HEADER_SIZE + GIT_OID_RAWSZ || !git__is_sizet(len)) {
+		p_close(fd);
+		git_pack_bitmap_free(bitmap);
+		return bitmap_error("file is too short or too large");
+	}
+
+	error = git_futils_mmap_ro(&bitmap->map, fd, 0, (size_t)len);
+	p_close(fd);
+
+	if (error < 0 ||
+		(error = bitmap_index_pack(bitmap)) < 0 ||
+		(error = bitmap_parse(bitmap)) < 0) {
+		git_pack_bitmap_free(bitmap);
+		return error;
+	}
+
+	*out = bitmap;
+	return 0;
+}
+
+void git_pack_bitmap_free(git_pack_bitmap *bitmap)
+{
+	if (bitmap == NULL || git_atomic_dec(&bitmap->refcount) > 0)
+		return;
+
+	if (bitmap->map.data)
+		git_futils_mmap_free(&bitmap->map);
+	if (bitmap->pack)
+		packfile_free(bitmap->pack);
+
+	git_bitmap_free(&bitmap->commits);
+	git_bitmap_free(&bitmap->trees);
+	git_bitmap_free(&bitmap->blobs);
+	git_bitmap_free(&bitmap->tags);
+
+	git_oidmap_free(bitmap->entry_map);
+	git__free(bitmap->entries);
+	git__free(bitmap->revindex);
+	git__free(bitmap->positions);
+	git__free(bitmap);
+}
+
+/* Decodes the bitmap of an entry, undoing the XORs with the earlier ones */
+static int entry_bitmap(git_bitmap *out, const git_pack_bitmap_entry *entry)
+{
+	git_bitmap delta = GIT_BITMAP_INIT;
+	const git_pack_bitmap_entry *e;
+	size_t depth = 0, n, read;
+	int error = 0;
+
+	for (e = entry; e->xor_offset; e -= e->xor_offset)
+		depth++;
+
+	if (git_ewah_read(out, &read, e->data, e->len) < 0)
+		return -1;
+
+	while (depth-- > 0) {
+		for (e = entry, n = 0; n < depth; ++n)
+			e -= e->xor_offset;
+
+		if ((error = git_ewah_read(&delta, &read, e->data, e->len)) < 0 ||
+			(error = git_bitmap_xor(out, &delta)) < 0)
+			break;
+	}
+
+	git_bitmap_free(&delta);
+	return error;
+}
+
+/*
+ * Reachability
+ */
+
+typedef struct {
+	git_oid oid;
+	git_otype type;
+	size_t pos;
+} reachable_object;
+
+int git_reachable_init(
+	git_reachable *r, git_repository *repo, git_pack_bitmap *bitmap)
+{
+	memset(r, 0x0, sizeof(*r));
+	r->repo = repo;
+
+	if ((r->extended = git_oidmap_alloc()) == NULL) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	if (bitmap != NULL) {
+		git_atomic_inc(&bitmap->refcount);
+		r->bitmap = bitmap;
+	} else if (git_repository__pack_bitmap(&r->bitmap, repo) < 0) {
+		/* a broken bitmap only means doing without it */
+		giterr_clear();
+	}
+
+	if (r->bitmap)
+		r->num_objects = r->bitmap->num_objects;
+
+	if (git_vector_init(&r->extended_objects, 0, NULL) < 0 ||
+		git_pool_init(&r->pool, sizeof(reachable_object), 0) < 0) {
+		git_reachable_free(r);
+		return -1;
+	}
+
+	return 0;
+}
+
+void git_reachable_free(git_reachable *r)
+{
+	git_pack_bitmap_free(r->bitmap);
+	git_oidmap_free(r->extended);
+	git_vector_free(&r->extended_objects);
+	git_pool_clear(&r->pool);
+	memset(r, 0x0, sizeof(*r));
+}
+
+int git_reachable_position(size_t *pos, git_reachable *r, const git_oid *oid)
+{
+	khiter_t k;
+	uint32_t nth;
+
+	if (r->bitmap && git_pack__find_nth(&nth, r->bitmap->pack, oid) == 0) {
+		*pos = r->bitmap->positions[nth];
+		return 0;
+	}
+
+	k = kh_get(oid, r->extended, oid);
+	if (k == kh_end(r->extended))
+		return GIT_ENOTFOUND;
+
+	*pos = ((reachable_object *)kh_value(r->extended, k))->pos;
+	return 0;
+}
+
+static int add_extended(size_t *pos, git_reachable *r, const git_oid *oid, git_otype type)
+{
+	reachable_object *obj;
+	khiter_t k;
+	int ret;
+
+	if ((obj = git_pool_malloc(&r->pool, 1)) == NULL)
+		return -1;
+
+	git_oid_cpy(&obj->oid, oid);
+	obj->type = type;
+	obj->pos = r->num_objects + r->extended_objects.length;
+
+	if (git_vector_insert(&r->extended_objects, obj) < 0)
+		return -1;
+
+	k = kh_put(oid, r->extended, &obj->oid, &ret);
+	if (ret < 0) {
+		giterr_set_oom();
+		return -1;
+	}
+	kh_value(r->extended, k) = obj;
+
+	*pos = obj->pos;
+	return 0;
+}
+
+const git_oid *git_reachable_oid(git_reachable *r, size_t pos)
+{
+	reachable_object *obj;
+
+	if (pos < r->num_objects)
+		return git_pack__nth_oid(r->bitmap->pack, r->bitmap->revindex[pos].nth);
+
+	obj = git_vector_get(&r->extended_objects, pos - r->num_objects);
+	return obj ? &obj->oid : NULL;
+}
+
+git_otype git_reachable_type(git_reachable *r, size_t pos)
+{
+	reachable_object *obj;
+
+	if (pos < r->num_objects) {
+		if (git_bitmap_get(&r->bitmap->commits, pos))
+			return GIT_OBJ_COMMIT;
+		if (git_bitmap_get(&r->bitmap->trees, pos))
+			return GIT_OBJ_TREE;
+		if (git_bitmap_get(&r->bitmap->blobs, pos))
+			return GIT_OBJ_BLOB;
+		if (git_bitmap_get(&r->bitmap->tags, pos))
+			return GIT_OBJ_TAG;
+		return GIT_OBJ_BAD;
+	}
+
+	obj = git_vector_get(&r->extended_objects, pos - r->num_objects);
+	return obj ? obj->type : GIT_OBJ_BAD;
+}
+
+static int stored_bitmap(git_bitmap *out, git_reachable *r, const git_oid *oid)
+{
+	khiter_t k;
+	size_t read;
+
+	if (r->computed != NULL) {
+		k = kh_get(oid, r->computed, oid);
+		if (k != kh_end(r->computed)) {
+			git_buf *ewah = kh_value(r->computed, k);
+			return git_ewah_read(out, &read,
+				(const unsigned char *)ewah->ptr, ewah->size);
+		}
+	}
+
+	if (r->bitmap != NULL) {
+		k = kh_get(oid, r->bitmap->entry_map, oid);
+		if (k != kh_end(r->bitmap->entry_map))
+			return entry_bitmap(out, kh_value(r->bitmap->entry_map, k));
+	}
+
+	return GIT_ENOTFOUND;
+}
+
+typedef struct {
+	git_reachable *r;
+	git_bitmap *out;
+	const git_bitmap *seen;
+	git_pool oids;
+	git_vector todo;
+	git_vector trees;
+} reachable_fill;
+
+static int push_oid(reachable_fill *f, git_vector *list, const git_oid *oid)
+{
+	git_oid *copy = git_pool_malloc(&f->oids, 1);
+
+	if (copy == NULL)
+		return -1;
+
+	git_oid_cpy(copy, oid);
+	return git_vector_insert(list, copy);
+}
+
+/* The position of `oid` if it still has to be walked, GIT_EEXISTS if not */
+static int fill_position(size_t *pos, reachable_fill *f, const git_oid *oid, git_otype type)
+{
+	if (git_reachable_position(pos, f->r, oid) == 0) {
+		if (git_bitmap_get(f->out, *pos) ||
+			(f->seen && git_bitmap_get(f->seen, *pos)))
+			return GIT_EEXISTS;
+		return 0;
+	}
+
+	if (type == GIT_OBJ_ANY)
+		return GIT_ENOTFOUND;
+
+	return add_extended(pos, f->r, oid, type);
+}
+
+/*
+ * Commits (and tags) come first, so that the bitmaps of the commits we
+ * stop at are all in before any tree is walked.
+ */
+static int fill_commits(reachable_fill *f)
+{
+	git_bitmap stored = GIT_BITMAP_INIT;
+	git_object *obj;
+	git_oid *oid;
+	size_t pos;
+	unsigned int n;
+	int error = 0;
+
+	while ((oid = git_vector_last(&f->todo)) != NULL) {
+		git_vector_pop(&f->todo);
+
+		if (fill_position(&pos, f, oid, GIT_OBJ_ANY) == GIT_EEXISTS)
+			continue;
+
+		if ((error = stored_bitmap(&stored, f->r, oid)) != GIT_ENOTFOUND) {
+			if (error < 0 || (error = git_bitmap_or(f->out, &stored)) < 0)
+				break;
+			continue;
+		}
+
+		if ((error = git_object_lookup(&obj, f->r->repo, oid, GIT_OBJ_ANY)) < 0)
+			break;
+
+		if (git_object_type(obj) == GIT_OBJ_TREE) {
+			error = push_oid(f, &f->trees, oid);
+			git_object_free(obj);
+			if (error < 0)
+				break;
+			continue;
+		}
+
+		if ((error = fill_position(&pos, f, oid, git_object_type(obj))) < 0 ||
+			(error = git_bitmap_set(f->out, pos)) < 0) {
+			git_object_free(obj);
+			break;
+		}
+
+		switch (git_object_type(obj)) {
+		case GIT_OBJ_COMMIT: {
+			git_commit *commit = (git_commit *)obj;
+
+			error = push_oid(f, &f->trees, git_commit_tree_id(commit));
+			for (n = 0; !error && n < git_commit_parentcount(commit); ++n)
+				error = push_oid(f, &f->todo, git_commit_parent_id(commit, n));
+			break;
+		}
+
+		case GIT_OBJ_TAG:
+			error = push_oid(f, &f->todo, git_tag_target_id((git_tag *)obj));
+			break;
+
+		default:
+			break;
+		}
+
+		git_object_free(obj);
+		if (error < 0)
+			break;
+	}
+
+	git_bitmap_free(&stored);
+	return error;
+}
+
+static int fill_trees(reachable_fill *f)
+{
+	git_tree *tree;
+	git_oid *oid;
+	size_t pos, n;
+	int error;
+
+	while ((oid = git_vector_last(&f->trees)) != NULL) {
+		git_vector_pop(&f->trees);
+
+		if ((error = fill_position(&pos, f, oid, GIT_OBJ_TREE)) == GIT_EEXISTS)
+			continue;
+
+		if (error < 0 ||
+			(error = git_bitmap_set(f->out, pos)) < 0 ||
+			(error = git_tree_lookup(&tree, f->r->repo, oid)) < 0)
+			return error;
+
+		for (n = 0; n < git_tree_entrycount(tree); ++n) {
+			const git_tree_entry *entry = git_tree_entry_byindex(tree, n);
+			const git_oid *id = git_tree_entry_id(entry);
+
+			switch (git_tree_entry_type(entry)) {
+			case GIT_OBJ_TREE:
+				error = push_oid(f, &f->trees, id);
+				break;
+
+			case GIT_OBJ_BLOB:
+				error = fill_position(&pos, f, id, GIT_OBJ_BLOB);
+				if (error == GIT_EEXISTS)
+					error = 0;
+				else if (!error)
+					error = git_bitmap_set(f->out, pos);
+				break;
+
+			default:
+				/* submodule commits aren't part of the repository */
+				break;
+			}
+
+			if (error < 0) {
+				git_tree_free(tree);
+				return error;
+			}
+		}
+
+		git_tree_free(tree);
+	}
+
+	return 0;
+}
+
+int git_reachable_fill(
+	git_bitmap *out, git_reachable *r,
+	const git_oid *tips, size_t count, const git_bitmap *seen)
+{
+	reachable_fill f;
+	size_t i;
+	int error = -1;
+
+	memset(&f, 0x0, sizeof(f));
+	f.r = r;
+	f.out = out;
+	f.seen = seen;
+
+	if (git_pool_init(&f.oids, sizeof(git_oid), 0) < 0 ||
+		git_vector_init(&f.todo, 0, NULL) < 0 ||
+		git_vector_init(&f.trees, 0, NULL) < 0)
+		goto cleanup;
+
+	for (i = 0; i < count; ++i) {
+		if (push_oid(&f, &f.todo, &tips[i]) < 0)
+			goto cleanup;
+	}
+
+	if ((error = fill_commits(&f)) == 0)
+		error = fill_trees(&f);
+
+cleanup:
+	git_vector_free(&f.todo);
+	git_vector_free(&f.trees);
+	git_pool_clear(&f.oids);
+	return error;
+}
+
+/*
+ * Writing
+ */
+
+typedef struct {
+	git_repository *repo;
+	struct git_pack_file *pack;
+	git_vector tips;
+	git_pool oids;
+} bitmap_writer;
+
+static int find_biggest_pack(void *payload, git_buf *path)
+{
+	bitmap_writer *w = payload;
+	struct git_pack_file *pack;
+	int error;
+
+	if (git__suffixcmp(path->ptr, ".idx") != 0)
+		return 0;
+
+	if ((error = git_packfile_check(&pack, path->ptr)) == GIT_ENOTFOUND) {
+		giterr_clear();
+		return 0;
+	}
+
+	if (error < 0 || (error = git_pack__index_load(pack)) < 0) {
+		if (pack)
+			packfile_free(pack);
+		return error;
+	}
+
+	if (w->pack == NULL || pack->num_objects > w->pack->num_objects) {
+		if (w->pack)
+			packfile_free(w->pack);
+		w->pack = pack;
+	} else
+		packfile_free(pack);
+
+	return 0;
+}
+
+static int add_reference_tip(const char *name, void *payload)
+{
+	bitmap_writer *w = payload;
+	git_reference *ref;
+	git_object *peeled;
+	git_oid *oid;
+	int error;
+
+	if (git_reference_lookup(&ref, w->repo, name) < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	error = git_reference_peel(&peeled, ref, GIT_OBJ_COMMIT);
+	git_reference_free(ref);
+
+	if (error < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	if ((oid = git_pool_malloc(&w->oids, 1)) != NULL)
+		git_oid_cpy(oid, git_object_id(peeled));
+	git_object_free(peeled);
+
+	return (oid == NULL || git_vector_insert(&w->tips, oid) < 0) ? -1 : 0;
+}
+
+static int tip_cmp(const void *a, const void *b)
+{
+	return git_oid_cmp((const git_oid *)a, (const git_oid *)b);
+}
+
+static int fill_type_bitmaps(git_pack_bitmap *bitmap)
+{
+	struct git_pack_entry e;
+	git_otype type;
+	size_t size;
+	uint32_t i;
+	int error;
+
+	for (i = 0; i < bitmap->num_objects; ++i) {
+		git_bitmap *types;
+
+		if ((error = git_pack__nth_entry(&e, bitmap->pack, bitmap->revindex[i].nth)) < 0 ||
+			(error = git_packfile_resolve_header(&size, &type, bitmap->pack, e.offset)) < 0)
+			return error;
+
+		switch (type) {
+		case GIT_OBJ_COMMIT: types = &bitmap->commits; break;
+		case GIT_OBJ_TREE: types = &bitmap->trees; break;
+		case GIT_OBJ_BLOB: types = &bitmap->blobs; break;
+		case GIT_OBJ_TAG: types = &bitmap->tags; break;
+		default:
+			return bitmap_error("object of unknown type in the pack");
+		}
+
+		if (git_bitmap_set(types, i) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Commits with bitmaps: the tips, and some of the history below them */
+static int select_commits(git_vector *selected, bitmap_writer *w)
+{
+	git_revwalk *walk;
+	git_oid oid, *copy;
+	uint32_t nth;
+	size_t i, n = 0;
+	int error;
+
+	if (git_revwalk_new(&walk, w->repo) < 0)
+		return -1;
+
+	git_revwalk_sorting(walk, GIT_SORT_TIME);
+	git_vector_sort(&w->tips);
+
+	for (i = 0; i < w->tips.length; ++i) {
+		if ((error = git_revwalk_push(walk, git_vector_get(&w->tips, i))) < 0)
+			goto cleanup;
+	}
+
+	while ((error = git_revwalk_next(&oid, walk)) == 0) {
+		if (git_pack__find_nth(&nth, w->pack, &oid) < 0)
+			continue;
+
+		if (n++ % BITMAP_SELECT_INTERVAL != 0 &&
+			git_vector_bsearch(&w->tips, &oid) < 0)
+			continue;
+
+		if ((copy = git_pool_malloc(&w->oids, 1)) == NULL ||
+			git_vector_insert(selected, copy) < 0) {
+			error = -1;
+			goto cleanup;
+		}
+		git_oid_cpy(copy, &oid);
+	}
+
+	if (error == GIT_ITEROVER)
+		error = 0;
+
+cleanup:
+	git_revwalk_free(walk);
+	return error;
+}
+
+static bool has_extended(const git_bitmap *bitmap, uint32_t num_objects)
+{
+	size_t i = num_objects / 64;
+
+	if (i < bitmap->length && (num_objects % 64) &&
+		(bitmap->words[i] >> (num_objects % 64)) != 0)
+		return true;
+
+	for (i = (num_objects + 63) / 64; i < bitmap->length; ++i) {
+		if (bitmap->words[i] != 0)
+			return true;
+	}
+
+	return false;
+}
+
+static int write_bitmap_file(
+	git_pack_bitmap *bitmap, git_vector *written, git_oidmap *computed)
+{
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT, types = GIT_BUF_INIT;
+	const char *pack_name = bitmap->pack->pack_name;
+	unsigned char header[BITMAP_HEADER_SIZE], entry[BITMAP_ENTRY_HEADER_SIZE];
+	git_oid checksum, *oid;
+	unsigned int i;
+	int error = -1;
+
+	memcpy(header, BITMAP_SIGNATURE, 4);
+	header[4] = 0;
+	header[5] = BITMAP_VERSION;
+	header[6] = 0;
+	header[7] = BITMAP_OPT_FULL_DAG;
+	put_be32(header + 8, (uint32_t)written->length);
+	memcpy(header + 12, (const unsigned char *)bitmap->pack->index_map.data +
+		bitmap->pack->index_map.len - 2 * GIT_OID_RAWSZ, GIT_OID_RAWSZ);
+
+	if (git_ewah_write(&types, &bitmap->commits, bitmap->num_objects) < 0 ||
+		git_ewah_write(&types, &bitmap->trees, bitmap->num_objects) < 0 ||
+		git_ewah_write(&types, &bitmap->blobs, bitmap->num_objects) < 0 ||
+		git_ewah_write(&types, &bitmap->tags, bitmap->num_objects) < 0)
+		goto cleanup;
+
+	if (git_buf_put(&path, pack_name, strlen(pack_name) - strlen(".pack")) < 0 ||
+		git_buf_puts(&path, GIT_PACK_BITMAP_SUFFIX) < 0 ||
+		git_filebuf_open(&file, path.ptr, GIT_FILEBUF_HASH_CONTENTS) < 0)
+		goto cleanup;
+
+	if (git_filebuf_write(&file, header, sizeof(header)) < 0 ||
+		git_filebuf_write(&file, types.ptr, types.size) < 0)
+		goto cleanup;
+
+	/* stored as is: no entry is XORed with another */
+	git_vector_foreach(written, i, oid) {
+		git_buf *ewah = kh_value(computed, kh_get(oid, computed, oid));
+		uint32_t nth;
+
+		if (git_pack__find_nth(&nth, bitmap->pack, oid) < 0)
+			goto cleanup;
+
+		put_be32(entry, nth);
+		entry[4] = 0;
+		entry[5] = 0;
+
+		if (git_filebuf_write(&file, entry, sizeof(entry)) < 0 ||
+			git_filebuf_write(&file, ewah->ptr, ewah->size) < 0)
+			goto cleanup;
+	}
+
+	if (git_filebuf_hash(&checksum, &file) < 0 ||
+		git_filebuf_write(&file, checksum.id, GIT_OID_RAWSZ) < 0 ||
+		git_filebuf_commit(&file, GIT_PACK_FILE_MODE) < 0)
+		goto cleanup;
+
+	error = 0;
+
+cleanup:
+	git_filebuf_cleanup(&file);
+	git_buf_free(&path);
+	git_buf_free(&types);
+	return error;
+}
+
+int git_pack_bitmap_write(size_t *count, git_repository *repo, const char *pack)
+{
+	bitmap_writer w;
+	git_pack_bitmap *bitmap = NULL;
+	git_reachable r;
+	git_bitmap reachable = GIT_BITMAP_INIT;
+	git_vector selected = GIT_VECTOR_INIT, written = GIT_VECTOR_INIT;
+	git_oidmap *computed = NULL;
+	git_buf dir = GIT_BUF_INIT, *ewah;
+	git_oid *oid;
+	size_t i;
+	int error = -1;
+
+	memset(&w, 0x0, sizeof(w));
+	memset(&r, 0x0, sizeof(r));
+	w.repo = repo;
+
+	if (git_pool_init(&w.oids, sizeof(git_oid), 0) < 0 ||
+		git_vector_init(&w.tips, 0, tip_cmp) < 0)
+		goto cleanup;
+
+	if (pack != NULL) {
+		size_t len = strlen(pack);
+
+		if (git__suffixcmp(pack, ".pack") == 0)
+			len -= strlen(".pack");
+		else if (git__suffixcmp(pack, ".idx") == 0)
+			len -= strlen(".idx");
+
+		if (git_buf_put(&dir, pack, len) < 0 ||
+			git_buf_puts(&dir, ".idx") < 0)
+			goto cleanup;
+
+		if ((error = git_packfile_check(&w.pack, dir.ptr)) < 0 ||
+			(error = git_pack__index_load(w.pack)) < 0)
+			goto cleanup;
+	} else {
+		if (git_buf_joinpath(&dir, repo->path_repository, GIT_OBJECTS_DIR "pack") < 0)
+			goto cleanup;
+
+		if ((error = git_path_direach(&dir, find_biggest_pack, &w)) < 0)
+			goto cleanup;
+	}
+
+	error = -1;
+
+	if (w.pack == NULL) {
+		giterr_set(GITERR_ODB, "Failed to write bitmaps - the repository has no packs");
+		error = GIT_ENOTFOUND;
+		goto cleanup;
+	}
+
+	if ((bitmap = git__calloc(1, sizeof(git_pack_bitmap))) == NULL)
+		goto cleanup;
+
+	/* the pack belongs to the bitmap from now on */
+	git_atomic_set(&bitmap->refcount, 1);
+	bitmap->pack = w.pack;
+
+	if (bitmap_index_pack(bitmap) < 0 ||
+		(error = fill_type_bitmaps(bitmap)) < 0)
+		goto cleanup;
+
+	if ((error = git_reference_foreach(
+			repo, GIT_REF_LISTALL, add_reference_tip, &w)) < 0 ||
+		(error = select_commits(&selected, &w)) < 0)
+		goto cleanup;
+
+	error = -1;
+
+	if ((computed = git_oidmap_alloc()) == NULL) {
+		giterr_set_oom();
+		goto cleanup;
+	}
+
+	if (git_reachable_init(&r, repo, bitmap) < 0)
+		goto cleanup;
+	r.computed = computed;
+
+	/* oldest first, so every bitmap can build on the ones below it */
+	for (i = selected.length; i > 0; --i) {
+		int ret;
+		khiter_t k;
+
+		oid = git_vector_get(&selected, i - 1);
+		git_bitmap_clear(&reachable);
+
+		if ((error = git_reachable_fill(&reachable, &r, oid, 1, NULL)) < 0)
+			goto cleanup;
+
+		error = -1;
+
+		/* a bitmap can only describe objects of the pack */
+		if (has_extended(&reachable, bitmap->num_objects))
+			continue;
+
+		if ((ewah = git__calloc(1, sizeof(git_buf))) == NULL)
+			goto cleanup;
+		git_buf_init(ewah, 0);
+
+		k = kh_put(oid, computed, oid, &ret);
+		if (ret < 0) {
+			git_buf_free(ewah);
+			git__free(ewah);
+			giterr_set_oom();
+			goto cleanup;
+		}
+		kh_value(computed, k) = ewah;
+
+		if (git_ewah_write(ewah, &reachable, bitmap->num_objects) < 0 ||
+			git_vector_insert(&written, oid) < 0)
+			goto cleanup;
+	}
+
+	if (write_bitmap_file(bitmap, &written, computed) < 0)
+		goto cleanup;
+
+	git_repository__pack_bitmap_reset(repo);
+
+	if (count)
+		*count = written.length;
+	error = 0;
+
+cleanup:
+	if (r.repo)
+		git_reachable_free(&r);
+
+	if (computed) {
+		kh_foreach_value(computed, ewah, {
+			git_buf_free(ewah);
+			git__free(ewah);
+		});
+		git_oidmap_free(computed);
+	}
+
+	if (bitmap != NULL)
+		git_pack_bitmap_free(bitmap);
+	else if (w.pack != NULL)
+		packfile_free(w.pack);
+	git_bitmap_free(&reachable);
+	git_vector_free(&selected);
+	git_vector_free(&written);
+	git_vector_free(&w.tips);
+	git_pool_clear(&w.oids);
+	git_buf_free(&dir);
+	return error;
+}
+
+int git_pack_write_bitmaps(size_t *count, git_repository *repo, const char *pack)
+{
+	assert(repo);
+	return git_pack_bitmap_write(count, repo, pack);
+}
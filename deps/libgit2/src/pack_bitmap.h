@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_pack_bitmap_h__
+#define INCLUDE_pack_bitmap_h__
+
+#include "common.h"
+#include "ewah.h"
+#include "map.h"
+#include "oidmap.h"
+#include "pack.h"
+#include "pool.h"
+#include "vector.h"
+#include "thread-utils.h"
+#include "git2/types.h"
+
+/*
+ * Reachability bitmaps (pack-*.bitmap), in the format core Git writes
+ * with `git repack -b`: for some of the commits of a pack, the set of
+ * objects reachable from them, with one bit per object of the pack in
+ * the order they are stored in it. The objects reachable from any tip
+ * can then be found by walking only down to the nearest commits that
+ * have a bitmap.
+ */
+
+#define GIT_PACK_BITMAP_SUFFIX ".bitmap"
+
+typedef struct {
+	git_oid oid;
+	uint32_t xor_offset; /* the bitmap is XORed with this many entries back */
+	const unsigned char *data;
+	size_t len;
+} git_pack_bitmap_entry;
+
+typedef struct {
+	git_off_t offset;
+	uint32_t nth;
+} git_pack_bitmap_revindex;
+
+typedef struct {
+	git_atomic refcount;
+	struct git_pack_file *pack;
+	git_map map;
+
+	/* index positions by pack position, and the other way round */
+	git_pack_bitmap_revindex *revindex;
+	uint32_t *positions;
+	uint32_t num_objects;
+
+	git_bitmap commits, trees, blobs, tags;
+
+	git_pack_bitmap_entry *entries;
+	uint32_t num_entries;
+	git_oidmap *entry_map;
+} git_pack_bitmap;
+
+/* Opens the bitmap at `path` and the pack it goes with */
+extern int git_pack_bitmap_open(git_pack_bitmap **out, const char *path);
+extern void git_pack_bitmap_free(git_pack_bitmap *bitmap);
+
+/*
+ * Writes a bitmap for `pack` (the biggest pack of the repository when
+ * NULL), with a selection of the commits reachable from its references
+ * whose closure is entirely in that pack.
+ */
+extern int git_pack_bitmap_write(
+	size_t *count, git_repository *repo, const char *pack);
+
+/*
+ * Sets of reachable objects. Objects of the bitmapped pack (if the
+ * repository has one) keep their position in it; anything else gets a
+ * position past its end when it is first seen.
+ */
+typedef struct {
+	git_repository *repo;
+	git_pack_bitmap *bitmap;
+	uint32_t num_objects; /* in the bitmapped pack */
+
+	git_oidmap *extended;
+	git_vector extended_objects;
+	git_pool pool;
+
+	/* bitmaps known in memory, checked before the pack's */
+	git_oidmap *computed;
+} git_reachable;
+
+/* `bitmap` may be NULL, to use the one of the repository */
+extern int git_reachable_init(
+	git_reachable *r, git_repository *repo, git_pack_bitmap *bitmap);
+extern void git_reachable_free(git_reachable *r);
+
+/*
+ * Adds every object reachable from `tips` to `out`, without walking
+ * past the objects already in `seen` (which may be NULL).
+ */
+extern int git_reachable_fill(
+	git_bitmap *out, git_reachable *r,
+	const git_oid *tips, size_t count, const git_bitmap *seen);
+
+/* The position of an object; GIT_ENOTFOUND if it was never seen */
+extern int git_reachable_position(
+	size_t *pos, git_reachable *r, const git_oid *oid);
+
+extern const git_oid *git_reachable_oid(git_reachable *r, size_t pos);
+extern git_otype git_reachable_type(git_reachable *r, size_t pos);
+
+#endif
@@ -11,6 +11,7 @@
 #include "fileops.h"
 #include "pack.h"
 #include "reflog.h"
+#include "pool.h"
 
 #include <git2/tag.h>
 #include <git2/object.h>
@@ -24,7 +25,16 @@ GIT__USE_STRMAP;
 
 enum {
 	GIT_PACKREF_HAS_PEEL = 1,
-	GIT_PACKREF_WAS_LOOSE = 2
+	GIT_PACKREF_WAS_LOOSE = 2,
+	GIT_PACKREF_CANNOT_PEEL = 4 /* the file says it isn't a tag object */
+};
+
+#define PACKEDREFS_TRAITS "# pack-refs with:"
+
+enum {
+	PEELING_NONE = 0,
+	PEELING_STANDARD, /* peeled for the annotated tags in refs/tags/ */
+	PEELING_FULL /* peeled for every annotated tag */
 };
 
 struct packref {
@@ -50,10 +60,6 @@ static int loose_lookup_to_packfile(struct packref **ref_out,
 static int loose_write(git_reference *ref);
 
 /* packed refs */
-static int packed_parse_peel(struct packref *tag_ref,
-	const char **buffer_out, const char *buffer_end);
-static int packed_parse_oid(struct packref **ref_out,
-	const char **buffer_out, const char *buffer_end);
 static int packed_load(git_repository *repo);
 static int packed_loadloose(git_repository *repository);
 static int packed_write_ref(struct packref *ref, git_filebuf *file);
@@ -62,6 +68,7 @@ static int packed_remove_loose(git_repository *repo, git_vector *packing_list);
 static int packed_sort(const void *a, const void *b);
 static int packed_lookup(git_reference *ref);
 static int packed_write(git_repository *repo);
+static int packed_write_without(git_repository *repo, const char *name);
 
 /* internal helpers */
 static int reference_path_available(git_repository *repo,
@@ -311,38 +318,104 @@ static int loose_write(git_reference *ref)
 	return git_filebuf_commit(&file, GIT_REFS_FILE_MODE);
 }
 
-static int packed_parse_peel(
-		struct packref *tag_ref,
+/*
+ * A packed-refs file which says it is sorted doesn't get loaded in
+ * the `packfile` table: it stays mapped, and its records are found
+ * by bisection and only parsed when asked for. Iterations hold a
+ * reference on the mapping, so it can be replaced under them.
+ */
+struct git_packed_map {
+	git_refcount rc;
+	git_map map;
+	const char *records; /* past the header */
+	const char *end;
+	int peeling;
+};
+
+/* A packed ref as read from the file; `name` isn't NUL-terminated */
+typedef struct {
+	const char *name;
+	size_t name_len;
+	git_oid oid;
+	git_oid peel;
+	char flags;
+} packed_record;
+
+static void packed_map_free(git_packed_map *map)
+{
+	if (map->map.data != NULL)
+		git_futils_mmap_free(&map->map);
+
+	git__free(map);
+}
+
+static void packed_clear(git_refcache *ref_cache)
+{
+	if (ref_cache->packfile) {
+		struct packref *reference;
+
+		git_strmap_foreach_value(ref_cache->packfile, reference, {
+			git__free(reference);
+		});
+
+		git_strmap_clear(ref_cache->packfile);
+	}
+
+	if (ref_cache->packfile_map) {
+		GIT_REFCOUNT_DEC(ref_cache->packfile_map, packed_map_free);
+		ref_cache->packfile_map = NULL;
+	}
+
+	ref_cache->packfile_time = 0;
+	ref_cache->packfile_size = 0;
+}
+
+static int packed_parse_header(
+		int *peeling,
+		bool *sorted,
 		const char **buffer_out,
 		const char *buffer_end)
 {
-	const char *buffer = *buffer_out + 1;
+	const char *buffer = *buffer_out;
+	size_t traits_len = strlen(PACKEDREFS_TRAITS);
 
-	assert(buffer[-1] == '^');
+	*peeling = PEELING_NONE;
+	*sorted = false;
 
-	/* Ensure it's not the first entry of the file */
-	if (tag_ref == NULL)
-		goto corrupt;
+	while (buffer < buffer_end && buffer[0] == '#') {
+		const char *eol = memchr(buffer, '\n', buffer_end - buffer);
+		if (eol == NULL)
+			goto corrupt;
 
-	/* Ensure reference is a tag */
-	if (git__prefixcmp(tag_ref->name, GIT_REFS_TAGS_DIR) != 0)
-		goto corrupt;
+		/* the traits of the file tell which refs got peeled */
+		if ((size_t)(eol - buffer) >= traits_len &&
+			!memcmp(buffer, PACKEDREFS_TRAITS, traits_len)) {
+			git_buf traits = GIT_BUF_INIT;
+			const char *start = buffer + traits_len;
 
-	if (buffer + GIT_OID_HEXSZ >= buffer_end)
-		goto corrupt;
+			git_buf_putc(&traits, ' ');
+			git_buf_put(&traits, start, eol - start);
+			git_buf_rtrim(&traits);
+			git_buf_putc(&traits, ' ');
 
-	/* Is this a valid object id? */
-	if (git_oid_fromstr(&tag_ref->peel, buffer) < 0)
-		goto corrupt;
+			if (git_buf_oom(&traits))
+				return -1;
 
-	buffer = buffer + GIT_OID_HEXSZ;
-	if (*buffer == '\r')
-		buffer++;
+			if (strstr(git_buf_cstr(&traits), " fully-peeled ") != NULL)
+				*peeling = PEELING_FULL;
+			else if (strstr(git_buf_cstr(&traits), " peeled ") != NULL)
+				*peeling = PEELING_STANDARD;
 
-	if (*buffer != '\n')
-		goto corrupt;
+			if (strstr(git_buf_cstr(&traits), " sorted ") != NULL)
+				*sorted = true;
+
+			git_buf_free(&traits);
+		}
 
-	*buffer_out = buffer + 1;
+		buffer = eol + 1;
+	}
+
+	*buffer_out = buffer;
 	return 0;
 
 corrupt:
@@ -350,63 +423,296 @@ corrupt:
 	return -1;
 }
 
-static int packed_parse_oid(
-		struct packref **ref_out,
+/*
+ * Parse the record at `*buffer_out`, i.e. the line of a ref and the
+ * peel line which may follow it, and move past it
+ */
+static int packed_parse_record(
+		packed_record *record,
 		const char **buffer_out,
-		const char *buffer_end)
+		const char *buffer_end,
+		int peeling)
 {
-	struct packref *ref = NULL;
-
 	const char *buffer = *buffer_out;
-	const char *refname_begin, *refname_end;
-
-	size_t refname_len;
-	git_oid id;
+	const char *refname_end;
+	bool is_tag;
 
-	refname_begin = (buffer + GIT_OID_HEXSZ + 1);
-	if (refname_begin >= buffer_end || refname_begin[-1] != ' ')
+	record->name = buffer + GIT_OID_HEXSZ + 1;
+	if (record->name >= buffer_end || record->name[-1] != ' ')
 		goto corrupt;
 
 	/* Is this a valid object id? */
-	if (git_oid_fromstr(&id, buffer) < 0)
+	if (git_oid_fromstr(&record->oid, buffer) < 0)
 		goto corrupt;
 
-	refname_end = memchr(refname_begin, '\n', buffer_end - refname_begin);
+	refname_end = memchr(record->name, '\n', buffer_end - record->name);
 	if (refname_end == NULL)
 		goto corrupt;
 
+	buffer = refname_end + 1;
+
 	if (refname_end[-1] == '\r')
 		refname_end--;
 
-	refname_len = refname_end - refname_begin;
+	record->name_len = refname_end - record->name;
+	record->flags = 0;
+	memset(&record->peel, 0x0, sizeof(git_oid));
 
-	ref = git__malloc(sizeof(struct packref) + refname_len + 1);
-	GITERR_CHECK_ALLOC(ref);
+	is_tag = record->name_len >= strlen(GIT_REFS_TAGS_DIR) &&
+		!memcmp(record->name, GIT_REFS_TAGS_DIR, strlen(GIT_REFS_TAGS_DIR));
 
-	memcpy(ref->name, refname_begin, refname_len);
-	ref->name[refname_len] = 0;
+	if (buffer < buffer_end && buffer[0] == '^') {
+		/* Ensure reference is a tag */
+		if (!is_tag)
+			goto corrupt;
 
-	git_oid_cpy(&ref->oid, &id);
+		buffer++;
+		if (buffer + GIT_OID_HEXSZ >= buffer_end ||
+			git_oid_fromstr(&record->peel, buffer) < 0)
+			goto corrupt;
 
-	ref->flags = 0;
+		buffer = buffer + GIT_OID_HEXSZ;
+		if (*buffer == '\r')
+			buffer++;
 
-	*ref_out = ref;
-	*buffer_out = refname_end + 1;
+		if (buffer >= buffer_end || *buffer != '\n')
+			goto corrupt;
 
+		buffer++;
+		record->flags |= GIT_PACKREF_HAS_PEEL;
+	} else if (peeling == PEELING_FULL ||
+		(peeling == PEELING_STANDARD && is_tag)) {
+		record->flags |= GIT_PACKREF_CANNOT_PEEL;
+	}
+
+	*buffer_out = buffer;
 	return 0;
 
 corrupt:
-	git__free(ref);
 	giterr_set(GITERR_REFERENCE, "The packed references file is corrupted");
 	return -1;
 }
 
+static void packed_record_from_ref(packed_record *record, struct packref *ref)
+{
+	record->name = ref->name;
+	record->name_len = strlen(ref->name);
+	git_oid_cpy(&record->oid, &ref->oid);
+	git_oid_cpy(&record->peel, &ref->peel);
+	record->flags = ref->flags;
+}
+
+static int packed_insert(git_strmap *packfile, const packed_record *record)
+{
+	struct packref *ref;
+	void *old_ref = NULL;
+	int err;
+
+	ref = git__malloc(sizeof(struct packref) + record->name_len + 1);
+	GITERR_CHECK_ALLOC(ref);
+
+	memcpy(ref->name, record->name, record->name_len);
+	ref->name[record->name_len] = 0;
+
+	git_oid_cpy(&ref->oid, &record->oid);
+	git_oid_cpy(&ref->peel, &record->peel);
+	ref->flags = record->flags;
+
+	git_strmap_insert2(packfile, ref->name, ref, old_ref, err);
+	if (err < 0) {
+		git__free(ref);
+		return -1;
+	}
+
+	git__free(old_ref);
+	return 0;
+}
+
+static int packed_name_cmp(
+	const packed_record *record, const char *name, size_t name_len)
+{
+	int cmp = memcmp(record->name, name,
+		record->name_len < name_len ? record->name_len : name_len);
+
+	if (cmp == 0 && record->name_len != name_len)
+		cmp = record->name_len < name_len ? -1 : 1;
+
+	return cmp;
+}
+
+/*
+ * The start of the record around `pos`; `start` must be the
+ * start of a record itself
+ */
+static const char *packed_record_start(const char *start, const char *pos)
+{
+	while (pos > start && pos[-1] != '\n')
+		pos--;
+
+	/* a peel line belongs to the ref above it */
+	if (pos > start && pos[0] == '^') {
+		pos--;
+		while (pos > start && pos[-1] != '\n')
+			pos--;
+	}
+
+	return pos;
+}
+
+/*
+ * Find the first record of a mapped file which doesn't sort
+ * before `name`
+ */
+static int packed_bisect(
+	const char **out, git_packed_map *map, const char *name)
+{
+	const char *lo = map->records, *hi = map->end;
+	size_t name_len = strlen(name);
+
+	while (lo < hi) {
+		const char *start = packed_record_start(lo, lo + (hi - lo) / 2);
+		const char *next = start;
+		packed_record record;
+
+		if (packed_parse_record(&record, &next, map->end, map->peeling) < 0)
+			return -1;
+
+		if (packed_name_cmp(&record, name, name_len) < 0)
+			lo = next;
+		else
+			hi = start;
+	}
+
+	*out = lo;
+	return 0;
+}
+
+/*
+ * Find the packed ref `name`, whether the file is mapped or loaded;
+ * `out` may be NULL to only know whether it exists
+ */
+static int packed_find(
+	packed_record *out, git_refcache *ref_cache, const char *name)
+{
+	packed_record record;
+
+	if (ref_cache->packfile_map != NULL) {
+		git_packed_map *map = ref_cache->packfile_map;
+		const char *pos;
+
+		if (packed_bisect(&pos, map, name) < 0)
+			return -1;
+
+		if (pos == map->end)
+			return GIT_ENOTFOUND;
+
+		if (packed_parse_record(&record, &pos, map->end, map->peeling) < 0)
+			return -1;
+
+		if (packed_name_cmp(&record, name, strlen(name)) != 0)
+			return GIT_ENOTFOUND;
+	} else {
+		khiter_t pos;
+
+		if (ref_cache->packfile == NULL)
+			return GIT_ENOTFOUND;
+
+		pos = git_strmap_lookup_index(ref_cache->packfile, name);
+		if (!git_strmap_valid_index(ref_cache->packfile, pos))
+			return GIT_ENOTFOUND;
+
+		packed_record_from_ref(
+			&record, git_strmap_value_at(ref_cache->packfile, pos));
+	}
+
+	if (out != NULL)
+		*out = record;
+
+	return 0;
+}
+
+typedef int (*packed_foreach_cb)(
+	const char *name, const packed_record *record, void *payload);
+
+/*
+ * Call `callback` for every packed ref starting with `prefix`, or for
+ * all of them when it's NULL; a mapped file is only read from the
+ * first matching record on, and in order
+ */
+static int packed_foreach(
+	git_refcache *ref_cache,
+	const char *prefix,
+	packed_foreach_cb callback,
+	void *payload)
+{
+	git_packed_map *map = ref_cache->packfile_map;
+	git_buf name = GIT_BUF_INIT;
+	packed_record record;
+	const char *buffer;
+	size_t prefix_len = prefix ? strlen(prefix) : 0;
+	int error = 0;
+
+	if (map == NULL) {
+		const char *ref_name;
+		struct packref *ref;
+
+		if (ref_cache->packfile == NULL)
+			return 0;
+
+		git_strmap_foreach(ref_cache->packfile, ref_name, ref, {
+			if (prefix && git__prefixcmp(ref_name, prefix) != 0)
+				continue;
+
+			packed_record_from_ref(&record, ref);
+			if ((error = callback(ref_name, &record, payload)) != 0)
+				return error;
+		});
+
+		return 0;
+	}
+
+	buffer = map->records;
+	if (prefix && packed_bisect(&buffer, map, prefix) < 0)
+		return -1;
+
+	/* keep it mapped even if the callback gets it replaced */
+	GIT_REFCOUNT_INC(map);
+
+	while (buffer < map->end) {
+		if (packed_parse_record(&record, &buffer, map->end, map->peeling) < 0) {
+			error = -1;
+			break;
+		}
+
+		if (record.name_len < prefix_len ||
+			memcmp(record.name, prefix, prefix_len) != 0)
+			break;
+
+		git_buf_clear(&name);
+		if (git_buf_put(&name, record.name, record.name_len) < 0) {
+			error = -1;
+			break;
+		}
+
+		if ((error = callback(name.ptr, &record, payload)) != 0)
+			break;
+	}
+
+	GIT_REFCOUNT_DEC(map, packed_map_free);
+	git_buf_free(&name);
+
+	return error;
+}
+
 static int packed_load(git_repository *repo)
 {
-	int result, updated;
-	git_buf packfile = GIT_BUF_INIT;
-	const char *buffer_start, *buffer_end;
+	bool sorted;
+	git_buf path = GIT_BUF_INIT;
+	git_packed_map *map = NULL;
+	const char *buffer;
 	git_refcache *ref_cache = &repo->references;
+	struct stat st;
+	git_file fd;
 
 	/* First we make sure we have allocated the hash table */
 	if (ref_cache->packfile == NULL) {
@@ -414,71 +720,118 @@ static int packed_load(git_repository *repo)
 		GITERR_CHECK_ALLOC(ref_cache->packfile);
 	}
 
-	result = reference_read(&packfile, &ref_cache->packfile_time,
-		repo->path_repository, GIT_PACKEDREFS_FILE, &updated);
+	if (git_buf_joinpath(&path, repo->path_repository, GIT_PACKEDREFS_FILE) < 0)
+		return -1;
 
 	/*
 	 * If we couldn't find the file, we need to clear the table and
-	 * return. On any other error, we return that error. If everything
-	 * went fine and the file wasn't updated, then there's nothing new
-	 * for us here, so just return. Anything else means we need to
-	 * refresh the packed refs.
+	 * return. If it's still the file we have, there's nothing new
+	 * for us here. Anything else means we need to refresh the
+	 * packed refs.
 	 */
-	if (result == GIT_ENOTFOUND) {
-		git_strmap_clear(ref_cache->packfile);
+	if (p_stat(path.ptr, &st) < 0) {
+		if (errno != ENOENT && errno != ENOTDIR) {
+			giterr_set(GITERR_OS, "Failed to stat '%s'", path.ptr);
+			goto failed;
+		}
+
+		packed_clear(ref_cache);
+		git_buf_free(&path);
 		return 0;
 	}
 
-	if (result < 0)
-		return -1;
-
-	if (!updated)
+	if (st.st_mtime == ref_cache->packfile_time &&
+		(git_off_t)st.st_size == ref_cache->packfile_size) {
+		git_buf_free(&path);
 		return 0;
+	}
 
-	/*
-	 * At this point, we want to refresh the packed refs. We already
-	 * have the contents in our buffer.
-	 */
-	git_strmap_clear(ref_cache->packfile);
+	packed_clear(ref_cache);
 
-	buffer_start = (const char *)packfile.ptr;
-	buffer_end = (const char *)(buffer_start) + packfile.size;
+	if ((fd = git_futils_open_ro(path.ptr)) < 0)
+		goto failed;
 
-	while (buffer_start < buffer_end && buffer_start[0] == '#') {
-		buffer_start = strchr(buffer_start, '\n');
-		if (buffer_start == NULL)
-			goto parse_failed;
+	if (p_fstat(fd, &st) < 0 || S_ISDIR(st.st_mode) ||
+		!git__is_sizet(st.st_size)) {
+		giterr_set(GITERR_OS, "Invalid regular file stat for '%s'", path.ptr);
+		p_close(fd);
+		goto failed;
+	}
 
-		buffer_start++;
+	map = git__calloc(1, sizeof(git_packed_map));
+	if (map == NULL ||
+		(st.st_size > 0 &&
+		 git_futils_mmap_ro(&map->map, fd, 0, (size_t)st.st_size) < 0)) {
+		p_close(fd);
+		goto failed;
 	}
 
-	while (buffer_start < buffer_end) {
-		int err;
-		struct packref *ref = NULL;
+	p_close(fd);
+
+	map->records = map->map.data;
+	map->end = map->records + map->map.len;
+
+	if (packed_parse_header(&map->peeling, &sorted, &map->records, map->end) < 0)
+		goto failed;
 
-		if (packed_parse_oid(&ref, &buffer_start, buffer_end) < 0)
-			goto parse_failed;
+	if (sorted) {
+		GIT_REFCOUNT_INC(map);
+		ref_cache->packfile_map = map;
+	} else {
+		/* no telling where a ref is: load all of them */
+		packed_record record;
 
-		if (buffer_start[0] == '^') {
-			if (packed_parse_peel(ref, &buffer_start, buffer_end) < 0)
-				goto parse_failed;
+		for (buffer = map->records; buffer < map->end; ) {
+			if (packed_parse_record(&record, &buffer, map->end, map->peeling) < 0 ||
+				packed_insert(ref_cache->packfile, &record) < 0)
+				goto failed;
 		}
 
-		git_strmap_insert(ref_cache->packfile, ref->name, ref, err);
-		if (err < 0)
-			goto parse_failed;
+		packed_map_free(map);
 	}
 
-	git_buf_free(&packfile);
+	ref_cache->packfile_time = st.st_mtime;
+	ref_cache->packfile_size = st.st_size;
+
+	git_buf_free(&path);
 	return 0;
 
-parse_failed:
-	git_strmap_free(ref_cache->packfile);
-	ref_cache->packfile = NULL;
-	git_buf_free(&packfile);
+failed:
+	if (map != NULL)
+		packed_map_free(map);
+	packed_clear(ref_cache);
+	git_buf_free(&path);
 	return -1;
 }
 
+/*
+ * Load every record of a mapped packed-refs file in the `packfile`
+ * table, for the writers which need all of them in memory
+ */
+static int packed_materialize(git_repository *repo)
+{
+	git_refcache *ref_cache = &repo->references;
+	git_packed_map *map = ref_cache->packfile_map;
+	packed_record record;
+	const char *buffer;
+
+	if (map == NULL)
+		return 0;
+
+	for (buffer = map->records; buffer < map->end; ) {
+		if (packed_parse_record(&record, &buffer, map->end, map->peeling) < 0 ||
+			packed_insert(ref_cache->packfile, &record) < 0) {
+			packed_clear(ref_cache);
+			return -1;
+		}
+	}
+
+	ref_cache->packfile_map = NULL;
+	GIT_REFCOUNT_DEC(map, packed_map_free);
+
+	return 0;
+}
+
 
 struct dirent_list_data {
 	git_repository *repo;
@@ -499,9 +852,11 @@ static int _dirent_loose_listall(void *_data, git_buf *full_path)
 		return git_path_direach(full_path, _dirent_loose_listall, _data);
 
 	/* do not add twice a reference that exists already in the packfile */
-	if ((data->list_flags & GIT_REF_PACKED) != 0 &&
-		git_strmap_exists(data->repo->references.packfile, file_path))
-		return 0;
+	if ((data->list_flags & GIT_REF_PACKED) != 0) {
+		int error = packed_find(NULL, &data->repo->references, file_path);
+		if (error != GIT_ENOTFOUND)
+			return error < 0 ? error : 0;
+	}
 
 	if (data->list_flags != GIT_REF_LISTALL) {
 		if ((data->list_flags & loose_guess_rtype(full_path)) == 0)
@@ -620,7 +975,7 @@ static int packed_find_peel(git_repository *repo, struct packref *ref)
 {
 	git_object *object;
 
-	if (ref->flags & GIT_PACKREF_HAS_PEEL)
+	if (ref->flags & (GIT_PACKREF_HAS_PEEL | GIT_PACKREF_CANNOT_PEEL))
 		return 0;
 
 	/*
@@ -643,11 +998,19 @@ static int packed_find_peel(git_repository *repo, struct packref *ref)
 	 */
 	if (git_object_type(object) == GIT_OBJ_TAG) {
 		git_tag *tag = (git_tag *)object;
+		git_object *target;
 
 		/*
-		 * Find the object pointed at by this tag
+		 * Find the object pointed at by this tag, going
+		 * through tags of tags as git does
 		 */
-		git_oid_cpy(&ref->peel, git_tag_target_id(tag));
+		if (git_tag_peel(&target, tag) < 0) {
+			git_object_free(object);
+			return -1;
+		}
+
+		git_oid_cpy(&ref->peel, git_object_id(target));
+		git_object_free(target);
 		ref->flags |= GIT_PACKREF_HAS_PEEL;
 
 		/*
@@ -655,6 +1018,9 @@ static int packed_find_peel(git_repository *repo, struct packref *ref)
 		 * marked at such. When written to the packfile, it'll be
 		 * accompanied by this resolved oid
 		 */
+	} else {
+		/* and a "peeled" packfile says as much by having no peel line */
+		ref->flags |= GIT_PACKREF_CANNOT_PEEL;
 	}
 
 	git_object_free(object);
@@ -783,11 +1149,8 @@ static int packed_write(git_repository *repo)
 	 if (packed_remove_loose(repo, &packing_list) < 0)
 		 goto cleanup_memory;
 
-	 {
-		struct stat st;
-		if (p_stat(pack_file_path.ptr, &st) == 0)
-			repo->references.packfile_time = st.st_mtime;
-	 }
+	/* the file gets mapped when it's needed again */
+	packed_clear(&repo->references);
 
 	git_vector_free(&packing_list);
 	git_buf_free(&pack_file_path);
@@ -805,6 +1168,59 @@ cleanup_memory:
 	return -1;
 }
 
+/*
+ * Write a mapped packed-refs file back without the ref `name`:
+ * everything else is copied over as it is, without being parsed.
+ */
+static int packed_write_without(git_repository *repo, const char *name)
+{
+	git_packed_map *map = repo->references.packfile_map;
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+	git_buf pack_file_path = GIT_BUF_INIT;
+	const char *start, *end;
+	packed_record record;
+	int error;
+
+	assert(map);
+
+	if (packed_bisect(&start, map, name) < 0)
+		return -1;
+
+	end = start;
+	if (start < map->end &&
+		packed_parse_record(&record, &end, map->end, map->peeling) < 0)
+		return -1;
+
+	if (start == map->end || packed_name_cmp(&record, name, strlen(name)) != 0) {
+		giterr_set(GITERR_REFERENCE,
+			"Reference %s stopped existing in the packfile", name);
+		return -1;
+	}
+
+	if (git_buf_joinpath(&pack_file_path, repo->path_repository, GIT_PACKEDREFS_FILE) < 0)
+		return -1;
+
+	if ((error = git_filebuf_open(&pack_file, pack_file_path.ptr, 0)) < 0)
+		goto cleanup;
+
+	/* the header comes along with the records before the ref */
+	if ((error = git_filebuf_write(&pack_file,
+			map->map.data, start - (const char *)map->map.data)) < 0 ||
+		(error = git_filebuf_write(&pack_file, end, map->end - end)) < 0) {
+		git_filebuf_cleanup(&pack_file);
+		goto cleanup;
+	}
+
+	/* let go of the old file before it gets replaced */
+	packed_clear(&repo->references);
+
+	error = git_filebuf_commit(&pack_file, GIT_PACKEDREFS_FILE_MODE);
+
+cleanup:
+	git_buf_free(&pack_file_path);
+	return error;
+}
+
 struct reference_available_t {
 	const char *new_ref;
 	const char *old_ref;
@@ -869,15 +1285,17 @@ static int reference_exists(int *exists, git_repository *repo, const char *ref_n
 	if (git_buf_joinpath(&ref_path, repo->path_repository, ref_name) < 0)
 		return -1;
 
-	if (git_path_isfile(ref_path.ptr) == true ||
-		git_strmap_exists(repo->references.packfile, ref_path.ptr))
-	{
-		*exists = 1;
-	} else {
-		*exists = 0;
+	*exists = git_path_isfile(ref_path.ptr) == true;
+	git_buf_free(&ref_path);
+
+	if (!*exists) {
+		int error = packed_find(NULL, &repo->references, ref_name);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			return error;
+
+		*exists = (error == 0);
 	}
 
-	git_buf_free(&ref_path);
 	return 0;
 }
 
@@ -936,9 +1354,8 @@ static int reference_can_write(
 
 static int packed_lookup(git_reference *ref)
 {
-	struct packref *pack_ref = NULL;
-	git_strmap *packfile_refs;
-	khiter_t pos;
+	packed_record record;
+	int error;
 
 	if (packed_load(ref->owner) < 0)
 		return -1;
@@ -955,18 +1372,18 @@ static int packed_lookup(git_reference *ref)
 	}
 
 	/* Look up on the packfile */
-	packfile_refs = ref->owner->references.packfile;
-	pos = git_strmap_lookup_index(packfile_refs, ref->name);
-	if (!git_strmap_valid_index(packfile_refs, pos)) {
+	error = packed_find(&record, &ref->owner->references, ref->name);
+	if (error == GIT_ENOTFOUND) {
 		giterr_set(GITERR_REFERENCE, "Reference '%s' not found", ref->name);
 		return GIT_ENOTFOUND;
 	}
 
-	pack_ref = git_strmap_value_at(packfile_refs, pos);
+	if (error < 0)
+		return error;
 
 	ref->flags = GIT_REF_OID | GIT_REF_PACKED;
 	ref->mtime = ref->owner->references.packfile_time;
-	git_oid_cpy(&ref->target.oid, &pack_ref->oid);
+	git_oid_cpy(&ref->target.oid, &record.oid);
 
 	return 0;
 }
@@ -1016,6 +1433,10 @@ static int reference_delete(git_reference *ref)
 		if (packed_load(ref->owner) < 0)
 			return -1;
 
+		/* a mapped one can be copied over without the ref */
+		if (ref->owner->references.packfile_map != NULL)
+			return packed_write_without(ref->owner, ref->name);
+
 		packfile_refs = ref->owner->references.packfile;
 		pos = git_strmap_lookup_index(packfile_refs, ref->name);
 		if (!git_strmap_valid_index(packfile_refs, pos)) {
@@ -1469,6 +1890,7 @@ int git_reference_resolve(git_reference **ref_out, const git_reference *ref)
 int git_reference_packall(git_repository *repo)
 {
 	if (packed_load(repo) < 0 || /* load the existing packfile */
+		packed_materialize(repo) < 0 || /* with every ref in memory */
 		packed_loadloose(repo) < 0 || /* add all the loose refs */
 		packed_write(repo) < 0) /* write back to disk */
 		return -1;
@@ -1476,9 +1898,49 @@ int git_reference_packall(git_repository *repo)
 	return 0;
 }
 
-int git_reference_foreach(
+/*
+ * The directory under which are all the loose refs which can start
+ * with `prefix`; returns false when there are none
+ */
+static int loose_refs_path(
+	git_buf *out, git_repository *repo, const char *prefix)
+{
+	const char *dir = GIT_REFS_DIR;
+	size_t dir_len = strlen(GIT_REFS_DIR);
+
+	if (prefix && !git__prefixcmp(prefix, GIT_REFS_DIR)) {
+		dir = prefix;
+		dir_len = strrchr(prefix, '/') - prefix + 1;
+	}
+
+	git_buf_sets(out, repo->path_repository);
+	git_buf_put(out, dir, dir_len);
+
+	if (git_buf_oom(out))
+		return -1;
+
+	return dir == prefix ? git_path_isdir(out->ptr) : true;
+}
+
+/* The part of `glob` before its first wildcard */
+static int glob_prefix(git_buf *out, const char *glob)
+{
+	return git_buf_set(out, glob, strcspn(glob, "*?[\\"));
+}
+
+static int _packed_listall(
+	const char *name, const packed_record *record, void *payload)
+{
+	struct dirent_list_data *data = (struct dirent_list_data *)payload;
+	GIT_UNUSED(record);
+
+	return data->callback(name, data->callback_payload) ? GIT_EUSER : 0;
+}
+
+static int reference_foreach(
 	git_repository *repo,
 	unsigned int list_flags,
+	const char *prefix,
 	git_reference_foreach_cb callback,
 	void *payload)
 {
@@ -1486,41 +1948,42 @@ int git_reference_foreach(
 	struct dirent_list_data data;
 	git_buf refs_path = GIT_BUF_INIT;
 
+	data.repo_path_len = strlen(repo->path_repository);
+	data.list_flags = list_flags;
+	data.repo = repo;
+	data.callback = callback;
+	data.callback_payload = payload;
+	data.callback_error = 0;
+
 	/* list all the packed references first */
 	if (list_flags & GIT_REF_PACKED) {
-		const char *ref_name;
-		void *ref;
-		GIT_UNUSED(ref);
-
 		if (packed_load(repo) < 0)
 			return -1;
 
-		git_strmap_foreach(repo->references.packfile, ref_name, ref, {
-			if (callback(ref_name, payload))
-				return GIT_EUSER;
-		});
+		if ((result = packed_foreach(
+				&repo->references, prefix, _packed_listall, &data)) != 0)
+			return result;
 	}
 
 	/* now list the loose references, trying not to
 	 * duplicate the ref names already in the packed-refs file */
-
-	data.repo_path_len = strlen(repo->path_repository);
-	data.list_flags = list_flags;
-	data.repo = repo;
-	data.callback = callback;
-	data.callback_payload = payload;
-	data.callback_error = 0;
-
-	if (git_buf_joinpath(&refs_path, repo->path_repository, GIT_REFS_DIR) < 0)
-		return -1;
-
-	result = git_path_direach(&refs_path, _dirent_loose_listall, &data);
+	if ((result = loose_refs_path(&refs_path, repo, prefix)) > 0)
+		result = git_path_direach(&refs_path, _dirent_loose_listall, &data);
 
 	git_buf_free(&refs_path);
 
 	return data.callback_error ? GIT_EUSER : result;
 }
 
+int git_reference_foreach(
+	git_repository *repo,
+	unsigned int list_flags,
+	git_reference_foreach_cb callback,
+	void *payload)
+{
+	return reference_foreach(repo, list_flags, NULL, callback, payload);
+}
+
 static int cb__reflist_add(const char *ref, void *data)
 {
 	return git_vector_insert((git_vector *)data, git__strdup(ref));
@@ -1561,15 +2024,8 @@ void git_repository__refcache_free(git_refcache *refs)
 {
 	assert(refs);
 
-	if (refs->packfile) {
-		struct packref *reference;
-
-		git_strmap_foreach_value(refs->packfile, reference, {
-			git__free(reference);
-		});
-
-		git_strmap_free(refs->packfile);
-	}
+	packed_clear(refs);
+	git_strmap_free(refs->packfile);
 }
 
 static int is_valid_ref_char(char ch)
@@ -1877,6 +2333,8 @@ int git_reference_foreach_glob(
 	void *payload)
 {
 	struct glob_cb_data data;
+	git_buf prefix = GIT_BUF_INIT;
+	int error;
 
 	assert(repo && glob && callback);
 
@@ -1884,8 +2342,178 @@ int git_reference_foreach_glob(
 	data.callback = callback;
 	data.payload = payload;
 
-	return git_reference_foreach(
-			repo, list_flags, fromglob_cb, &data);
+	/* only the refs starting like the glob need to be listed */
+	if (glob_prefix(&prefix, glob) < 0)
+		return -1;
+
+	error = reference_foreach(
+			repo, list_flags, git_buf_cstr(&prefix), fromglob_cb, &data);
+
+	git_buf_free(&prefix);
+	return error;
+}
+
+struct target_list_data {
+	git_repository *repo;
+	size_t repo_path_len;
+	const char *glob;
+	int resolve;
+
+	/* loose refs hiding packed ones */
+	git_strmap *shadowed;
+	git_pool names;
+
+	git_reference_target_cb callback;
+	void *callback_payload;
+	int callback_error;
+};
+
+static int target_emit(
+	struct target_list_data *data, git_reference_target_entry *entry)
+{
+	if (data->callback(entry, data->callback_payload))
+		data->callback_error = GIT_EUSER;
+
+	return data->callback_error;
+}
+
+static int _dirent_loose_target(void *_data, git_buf *full_path)
+{
+	struct target_list_data *data = (struct target_list_data *)_data;
+	const char *file_path = full_path->ptr + data->repo_path_len;
+	git_reference_target_entry entry;
+	git_buf ref_file = GIT_BUF_INIT;
+	int error;
+
+	if (git_path_isdir(full_path->ptr) == true)
+		return git_path_direach(full_path, _dirent_loose_target, _data);
+
+	/* Locked references aren't returned */
+	if (!git__suffixcmp(file_path, GIT_FILELOCK_EXTENSION))
+		return 0;
+
+	error = packed_find(NULL, &data->repo->references, file_path);
+	if (error < 0 && error != GIT_ENOTFOUND)
+		return error;
+
+	if (error == 0) {
+		char *name = git_pool_strdup(&data->names, file_path);
+		GITERR_CHECK_ALLOC(name);
+
+		git_strmap_insert(data->shadowed, name, name, error);
+		if (error < 0)
+			return -1;
+	}
+
+	if (data->glob && p_fnmatch(data->glob, file_path, 0) != 0)
+		return 0;
+
+	if (git_futils_readbuffer(&ref_file, full_path->ptr) < 0)
+		return -1;
+
+	memset(&entry, 0x0, sizeof(entry));
+	entry.name = file_path;
+
+	if (git__prefixcmp(git_buf_cstr(&ref_file), GIT_SYMREF) == 0) {
+		git_buf_rtrim(&ref_file);
+		entry.symbolic = git_buf_cstr(&ref_file) + strlen(GIT_SYMREF);
+
+		if (data->resolve &&
+			(error = git_reference_name_to_id(
+				&entry.target, data->repo, entry.symbolic)) < 0) {
+			/* a dangling symbolic ref is still listed */
+			if (error != GIT_ENOTFOUND) {
+				git_buf_free(&ref_file);
+				return error;
+			}
+			giterr_clear();
+		}
+	} else if (loose_parse_oid(&entry.target, &ref_file) < 0) {
+		git_buf_free(&ref_file);
+		return -1;
+	}
+
+	error = target_emit(data, &entry);
+	git_buf_free(&ref_file);
+	return error;
+}
+
+static int _packed_target(
+	const char *name, const packed_record *record, void *payload)
+{
+	struct target_list_data *data = (struct target_list_data *)payload;
+	git_reference_target_entry entry;
+
+	if (git_strmap_exists(data->shadowed, name))
+		return 0;
+
+	if (data->glob && p_fnmatch(data->glob, name, 0) != 0)
+		return 0;
+
+	memset(&entry, 0x0, sizeof(entry));
+	entry.name = name;
+	git_oid_cpy(&entry.target, &record->oid);
+
+	if (record->flags & GIT_PACKREF_HAS_PEEL)
+		git_oid_cpy(&entry.peeled, &record->peel);
+	else if (record->flags & GIT_PACKREF_CANNOT_PEEL)
+		git_oid_cpy(&entry.peeled, &record->oid);
+
+	return target_emit(data, &entry);
+}
+
+int git_reference_foreach_target(
+	git_repository *repo,
+	const char *glob,
+	int resolve,
+	git_reference_target_cb callback,
+	void *payload)
+{
+	struct target_list_data data;
+	git_buf refs_path = GIT_BUF_INIT, prefix = GIT_BUF_INIT;
+	int error;
+
+	assert(repo && callback);
+
+	if (packed_load(repo) < 0)
+		return -1;
+
+	memset(&data, 0x0, sizeof(data));
+	data.repo = repo;
+	data.repo_path_len = strlen(repo->path_repository);
+	data.glob = glob;
+	data.resolve = resolve;
+	data.callback = callback;
+	data.callback_payload = payload;
+
+	data.shadowed = git_strmap_alloc();
+	GITERR_CHECK_ALLOC(data.shadowed);
+
+	/* only the refs starting like the glob need to be listed */
+	if (git_pool_init(&data.names, 1, 0) < 0 ||
+		(glob && glob_prefix(&prefix, glob) < 0) ||
+		(error = loose_refs_path(
+			&refs_path, repo, glob ? git_buf_cstr(&prefix) : NULL)) < 0) {
+		error = -1;
+		goto cleanup;
+	}
+
+	/* the loose refs first, to know which packed ones they hide */
+	if (error > 0)
+		error = git_path_direach(&refs_path, _dirent_loose_target, &data);
+	if (error < 0 || data.callback_error)
+		goto cleanup;
+
+	error = packed_foreach(&repo->references,
+		glob ? git_buf_cstr(&prefix) : NULL, _packed_target, &data);
+
+cleanup:
+	git_buf_free(&refs_path);
+	git_buf_free(&prefix);
+	git_strmap_free(data.shadowed);
+	git_pool_clear(&data.names);
+
+	return data.callback_error ? GIT_EUSER : error;
 }
 
 int git_reference_has_log(
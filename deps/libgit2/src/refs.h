@@ -24,7 +24,7 @@
 
 #define GIT_SYMREF "ref: "
 #define GIT_PACKEDREFS_FILE "packed-refs"
-#define GIT_PACKEDREFS_HEADER "# pack-refs with: peeled "
+#define GIT_PACKEDREFS_HEADER "# pack-refs with: peeled sorted "
 #define GIT_PACKEDREFS_FILE_MODE 0666
 
 #define GIT_HEAD_FILE "HEAD"
@@ -58,9 +58,15 @@ struct git_reference {
 	} target;
 };
 
+typedef struct git_packed_map git_packed_map;
+
 typedef struct {
+	/* all the packed refs, unless the file is mapped */
 	git_strmap *packfile;
+	/* a sorted packed-refs file, looked up in place */
+	git_packed_map *packfile_map;
 	time_t packfile_time;
+	git_off_t packfile_size;
 } git_refcache;
 
 void git_repository__refcache_free(git_refcache *refs);
@@ -39,6 +39,20 @@ static void drop_odb(git_repository *repo)
 	}
 }
 
+static void drop_graph(git_repository *repo)
+{
+	git_commit_graph_free(repo->_graph);
+	repo->_graph = NULL;
+	git_futils_filestamp_set(&repo->graph_stamp, NULL);
+}
+
+static void drop_bitmap(git_repository *repo)
+{
+	git_pack_bitmap_free(repo->_bitmap);
+	repo->_bitmap = NULL;
+	git_futils_filestamp_set(&repo->bitmap_stamp, NULL);
+}
+
 static void drop_config(git_repository *repo)
 {
 	if (repo->_config != NULL) {
@@ -68,6 +82,7 @@ void git_repository_free(git_repository *repo)
 	git_repository__refcache_free(&repo->references);
 	git_attr_cache_flush(repo);
 	git_submodule_config_free(repo);
+	git_fsmonitor_free(&repo->workdir_monitor);
 
 	git__free(repo->path_repository);
 	git__free(repo->workdir);
@@ -75,7 +90,11 @@ void git_repository_free(git_repository *repo)
 	drop_config(repo);
 	drop_index(repo);
 	drop_odb(repo);
+	drop_graph(repo);
+	drop_bitmap(repo);
 
+	git_mutex_free(&repo->graph_lock);
+	git_mutex_free(&repo->bitmap_lock);
 	git__free(repo);
 }
 
@@ -109,6 +128,14 @@ static git_repository *repository_alloc(void)
 	memset(repo, 0x0, sizeof(git_repository));
 
 	if (git_cache_init(&repo->objects, GIT_DEFAULT_CACHE_SIZE, &git_object__free) < 0) {
+		git_cache_free(&repo->objects);
+		git__free(repo);
+		return NULL;
+	}
+
+	if (git_fsmonitor_init(&repo->workdir_monitor) < 0) {
+		git_cache_free(&repo->objects);
+		git_fsmonitor_free(&repo->workdir_monitor);
 		git__free(repo);
 		return NULL;
 	}
@@ -116,6 +143,9 @@ static git_repository *repository_alloc(void)
 	/* set all the entries in the cvar cache to `unset` */
 	git_repository__cvar_cache_clear(repo);
 
+	git_mutex_init(&repo->graph_lock);
+	git_mutex_init(&repo->bitmap_lock);
+
 	return repo;
 }
 
@@ -588,6 +618,133 @@ int git_repository_odb(git_odb **out, git_repository *repo)
 	return 0;
 }
 
+int git_repository__commit_graph(git_commit_graph **out, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT;
+	int error = 0;
+
+	assert(out && repo);
+	*out = NULL;
+
+	if (git_buf_joinpath(&path, repo->path_repository, GIT_OBJECTS_DIR) < 0 ||
+		git_buf_puts(&path, GIT_COMMIT_GRAPH_FILE) < 0)
+		return -1;
+
+	if (git_mutex_lock(&repo->graph_lock) < 0) {
+		giterr_set(GITERR_OS, "Failed to lock the commit-graph");
+		git_buf_free(&path);
+		return -1;
+	}
+
+	switch (git_futils_filestamp_check(&repo->graph_stamp, path.ptr)) {
+	case 0:
+		break;
+
+	case GIT_ENOTFOUND:
+		drop_graph(repo);
+		break;
+
+	default:
+		/* a broken file is only retried once it changes */
+		git_commit_graph_free(repo->_graph);
+		repo->_graph = NULL;
+
+		if ((error = git_commit_graph_open(&repo->_graph, path.ptr)) == GIT_ENOTFOUND) {
+			git_futils_filestamp_set(&repo->graph_stamp, NULL);
+			giterr_clear();
+			error = 0;
+		}
+		break;
+	}
+
+	if (repo->_graph != NULL) {
+		git_atomic_inc(&repo->_graph->refcount);
+		*out = repo->_graph;
+	}
+
+	git_mutex_unlock(&repo->graph_lock);
+	git_buf_free(&path);
+	return error;
+}
+
+void git_repository__commit_graph_reset(git_repository *repo)
+{
+	if (git_mutex_lock(&repo->graph_lock) < 0)
+		return;
+
+	drop_graph(repo);
+	git_mutex_unlock(&repo->graph_lock);
+}
+
+static int load_pack_bitmap(void *payload, git_buf *path)
+{
+	git_repository *repo = payload;
+
+	/* core Git only uses one bitmap too */
+	if (repo->_bitmap != NULL ||
+		git__suffixcmp(path->ptr, GIT_PACK_BITMAP_SUFFIX) != 0)
+		return 0;
+
+	return git_pack_bitmap_open(&repo->_bitmap, path->ptr);
+}
+
+int git_repository__pack_bitmap(git_pack_bitmap **out, git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT;
+	int error = 0;
+
+	assert(out && repo);
+	*out = NULL;
+
+	if (git_buf_joinpath(&path, repo->path_repository, GIT_OBJECTS_DIR "pack") < 0)
+		return -1;
+
+	if (git_mutex_lock(&repo->bitmap_lock) < 0) {
+		giterr_set(GITERR_OS, "Failed to lock the pack bitmap");
+		git_buf_free(&path);
+		return -1;
+	}
+
+	switch (git_futils_filestamp_check(&repo->bitmap_stamp, path.ptr)) {
+	case 0:
+		break;
+
+	case GIT_ENOTFOUND:
+		drop_bitmap(repo);
+		break;
+
+	default:
+		/* a broken file is only retried once the packs change */
+		git_pack_bitmap_free(repo->_bitmap);
+		repo->_bitmap = NULL;
+
+		if (git_path_direach(&path, load_pack_bitmap, repo) < 0) {
+			git_pack_bitmap_free(repo->_bitmap);
+			repo->_bitmap = NULL;
+			error = -1;
+		}
+		break;
+	}
+
+	if (repo->_bitmap != NULL) {
+		git_atomic_inc(&repo->_bitmap->refcount);
+		*out = repo->_bitmap;
+	}
+
+	git_mutex_unlock(&repo->bitmap_lock);
+	git_buf_free(&path);
+	return error;
+}
+
+void git_repository__pack_bitmap_reset(git_repository *repo)
+{
+	if (git_mutex_lock(&repo->bitmap_lock) < 0)
+		return;
+
+	drop_bitmap(repo);
+	git_mutex_unlock(&repo->bitmap_lock);
+}
+
 void git_repository_set_odb(git_repository *repo, git_odb *odb)
 {
 	assert(repo && odb);
@@ -1630,3 +1787,47 @@ int git_repository_state(git_repository *repo)
 	git_buf_free(&repo_path);
 	return state;
 }
+
+int git_repository_set_cache_limit(
+	git_repository *repo, git_otype type, size_t max_bytes)
+{
+	assert(repo);
+	return git_cache_set_limit(&repo->objects, type, max_bytes);
+}
+
+void git_repository_cache_stats(git_cache_stats *out, git_repository *repo)
+{
+	assert(out && repo);
+	git_cache_get_stats(out, &repo->objects);
+}
+
+int git_repository_set_workdir_monitor(git_repository *repo, int enabled)
+{
+	int error;
+
+	assert(repo);
+
+	if (enabled &&
+		(error = git_repository__ensure_not_bare(repo, "watch the workdir")) < 0)
+		return error;
+
+	return git_fsmonitor_enable(&repo->workdir_monitor, enabled != 0);
+}
+
+void git_repository_workdir_monitor_stats(
+	git_workdir_monitor_stats *out, git_repository *repo)
+{
+	git_fsmonitor *mon;
+
+	assert(out && repo);
+	mon = &repo->workdir_monitor;
+
+	git_mutex_lock(&mon->lock);
+	out->enabled = (mon->fd >= 0);
+	out->directories = git_strmap_num_entries(mon->dirs);
+	out->hits = mon->hits;
+	out->misses = mon->misses;
+	out->updates = mon->updates;
+	out->overflows = mon->overflows;
+	git_mutex_unlock(&mon->lock);
+}
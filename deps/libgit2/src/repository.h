@@ -21,6 +21,10 @@
 #include "object.h"
 #include "attr.h"
 #include "strmap.h"
+#include "commit_graph.h"
+#include "pack_bitmap.h"
+#include "thread-utils.h"
+#include "fsmonitor.h"
 
 #define DOT_GIT ".git"
 #define GIT_DIR DOT_GIT "/"
@@ -31,6 +35,7 @@
 typedef enum {
 	GIT_CVAR_AUTO_CRLF = 0, /* core.autocrlf */
 	GIT_CVAR_EOL, /* core.eol */
+	GIT_CVAR_UNTRACKED_CACHE, /* core.untrackedCache */
 	GIT_CVAR_CACHE_MAX
 } git_cvar_cached;
 
@@ -66,7 +71,12 @@ typedef enum {
 #else
 	GIT_EOL_NATIVE = GIT_EOL_LF,
 #endif
-	GIT_EOL_DEFAULT = GIT_EOL_NATIVE
+	GIT_EOL_DEFAULT = GIT_EOL_NATIVE,
+
+	/* core.untrackedCache: false, true */
+	GIT_UNTRACKED_CACHE_FALSE = 0,
+	GIT_UNTRACKED_CACHE_TRUE = 1,
+	GIT_UNTRACKED_CACHE_DEFAULT = GIT_UNTRACKED_CACHE_FALSE
 } git_cvar_value;
 
 /* internal repository init flags */
@@ -86,6 +96,15 @@ struct git_repository {
 	git_refcache references;
 	git_attr_cache attrcache;
 	git_strmap *submodules;
+	git_fsmonitor workdir_monitor;
+
+	git_commit_graph *_graph;
+	git_futils_filestamp graph_stamp;
+	git_mutex graph_lock;
+
+	git_pack_bitmap *_bitmap;
+	git_futils_filestamp bitmap_stamp; /* of the pack directory */
+	git_mutex bitmap_lock;
 
 	char *path_repository;
 	char *workdir;
@@ -103,6 +122,26 @@ GIT_INLINE(git_attr_cache *) git_repository_attr_cache(git_repository *repo)
 
 int git_repository_head_tree(git_tree **tree, git_repository *repo);
 
+/*
+ * The commit-graph of the repository, if it has one (NULL otherwise), and
+ * reloaded if the file has changed since it was last loaded. The caller
+ * gets its own reference, to be released with git_commit_graph_free.
+ */
+int git_repository__commit_graph(git_commit_graph **out, git_repository *repo);
+
+/* Forgets the loaded commit-graph, so the next use reloads it */
+void git_repository__commit_graph_reset(git_repository *repo);
+
+/*
+ * The reachability bitmap of the repository's packs, if one of them has
+ * one, looked up again whenever the set of packs changes. The caller
+ * gets its own reference, to be released with git_pack_bitmap_free.
+ */
+int git_repository__pack_bitmap(git_pack_bitmap **out, git_repository *repo);
+
+/* Forgets the loaded bitmap, so the next use looks for one again */
+void git_repository__pack_bitmap_reset(git_repository *repo);
+
 /*
  * Weak pointers to repository internals.
  *
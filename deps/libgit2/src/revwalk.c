@@ -9,6 +9,7 @@
 #include "commit.h"
 #include "odb.h"
 #include "pool.h"
+#include "repository.h"
 
 #include "revwalk.h"
 #include "merge.h"
@@ -414,6 +415,10 @@ int git_revwalk_new(git_revwalk **revwalk_out, git_repository *repo)
 		return -1;
 	}
 
+	/* the graph is only a cache; without a usable one, commits are parsed */
+	if (git_repository__commit_graph(&walk->graph, repo) < 0)
+		giterr_clear();
+
 	*revwalk_out = walk;
 	return 0;
 }
@@ -425,6 +430,7 @@ void git_revwalk_free(git_revwalk *walk)
 
 	git_revwalk_reset(walk);
 	git_odb_free(walk->odb);
+	git_commit_graph_free(walk->graph);
 
 	git_oidmap_free(walk->commits);
 	git_pool_clear(&walk->commit_pool);
@@ -10,6 +10,7 @@
 #include "git2/revwalk.h"
 #include "oidmap.h"
 #include "commit_list.h"
+#include "commit_graph.h"
 #include "pqueue.h"
 #include "pool.h"
 #include "vector.h"
@@ -23,6 +24,9 @@ struct git_revwalk {
 	git_oidmap *commits;
 	git_pool commit_pool;
 
+	/* parents and times come from here when it has the commit */
+	git_commit_graph *graph;
+
 	git_commit_list *iterator_topo;
 	git_commit_list *iterator_rand;
 	git_commit_list *iterator_reverse;
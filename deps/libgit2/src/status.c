@@ -111,6 +111,7 @@ int git_status_foreach_ext(
 	git_diff_options diffopt = GIT_DIFF_OPTIONS_INIT;
 	git_diff_list *idx2head = NULL, *wd2idx = NULL;
 	git_tree *head = NULL;
+	git_index *index;
 	git_status_show_t show =
 		opts ? opts->show : GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
 	status_user_callback usercb;
@@ -148,9 +149,16 @@ int git_status_foreach_ext(
 		(err = git_diff_tree_to_index(&idx2head, repo, head, NULL, &diffopt)) < 0)
 		goto cleanup;
 
-	if (show != GIT_STATUS_SHOW_INDEX_ONLY &&
-		(err = git_diff_index_to_workdir(&wd2idx, repo, NULL, &diffopt)) < 0)
-		goto cleanup;
+	if (show != GIT_STATUS_SHOW_INDEX_ONLY) {
+		if ((err = git_diff_index_to_workdir(&wd2idx, repo, NULL, &diffopt)) < 0)
+			goto cleanup;
+
+		/* what the walk learned is worth keeping, but not failing for */
+		if ((opts->flags & GIT_STATUS_OPT_UPDATE_INDEX) != 0 &&
+			(git_repository_index__weakptr(&index, repo) < 0 ||
+			 git_index__write_untracked_cache(index) < 0))
+			giterr_clear();
+	}
 
 	usercb.cb = cb;
 	usercb.payload = payload;
@@ -18,6 +18,15 @@ typedef struct {
 #endif
 } git_atomic;
 
+/* A counter as wide as a pointer, for statistics that may overflow an int */
+typedef struct {
+#if defined(GIT_WIN32)
+	volatile LONG_PTR val;
+#else
+	volatile ssize_t val;
+#endif
+} git_atomic_ssize;
+
 GIT_INLINE(void) git_atomic_set(git_atomic *a, int val)
 {
 	a->val = val;
@@ -68,6 +77,46 @@ GIT_INLINE(int) git_atomic_dec(git_atomic *a)
 #endif
 }
 
+/* Read with the same ordering guarantees as the other operations */
+GIT_INLINE(int) git_atomic_get(git_atomic *a)
+{
+#if defined(GIT_WIN32)
+	return InterlockedCompareExchange(&a->val, 0, 0);
+#elif defined(__GNUC__)
+	return __sync_val_compare_and_swap(&a->val, 0, 0);
+#else
+#	error "Unsupported architecture for atomic operations"
+#endif
+}
+
+GIT_INLINE(ssize_t) git_atomic_ssize_add(git_atomic_ssize *a, ssize_t addend)
+{
+#if defined(GIT_WIN32) && defined(_WIN64)
+	return InterlockedExchangeAdd64(&a->val, addend) + addend;
+#elif defined(GIT_WIN32)
+	return InterlockedExchangeAdd(&a->val, addend) + addend;
+#elif defined(__GNUC__)
+	return __sync_add_and_fetch(&a->val, addend);
+#else
+#	error "Unsupported architecture for atomic operations"
+#endif
+}
+
+/*
+ * Full memory barrier: no load or store is moved across it, by the
+ * compiler or the CPU. Needed to publish data to lock-free readers.
+ */
+GIT_INLINE(void) git_memory_barrier(void)
+{
+#if defined(GIT_WIN32)
+	MemoryBarrier();
+#elif defined(__GNUC__)
+	__sync_synchronize();
+#else
+#	error "Unsupported architecture for atomic operations"
+#endif
+}
+
 #else
 
 #define git_thread unsigned int
@@ -101,6 +150,20 @@ GIT_INLINE(int) git_atomic_dec(git_atomic *a)
 	return --a->val;
 }
 
+GIT_INLINE(int) git_atomic_get(git_atomic *a)
+{
+	return a->val;
+}
+
+GIT_INLINE(ssize_t) git_atomic_ssize_add(git_atomic_ssize *a, ssize_t addend)
+{
+	return a->val += addend;
+}
+
+GIT_INLINE(void) git_memory_barrier(void)
+{
+}
+
 #endif
 
 extern int git_online_cpus(void);
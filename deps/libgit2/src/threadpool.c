@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "threadpool.h"
+#include "thread-utils.h"
+
+typedef struct threadpool_item threadpool_item;
+struct threadpool_item {
+	threadpool_item *next;
+	git_threadpool_job job;
+	void *payload;
+};
+
+struct git_threadpool {
+	git_thread *threads;
+	unsigned int nr_threads;
+
+#ifdef GIT_THREADS
+	git_mutex lock;
+	git_cond work; /* a job got queued, or the pool is closing */
+	git_cond idle; /* the last pending job ran */
+#endif
+
+	threadpool_item *head, *tail;
+	size_t pending; /* queued or running */
+	bool closing;
+};
+
+#ifdef GIT_THREADS
+
+static void *threadpool_thread(void *arg)
+{
+	git_threadpool *pool = arg;
+	threadpool_item *item;
+
+	git_mutex_lock(&pool->lock);
+
+	while (1) {
+		while (pool->head == NULL && !pool->closing)
+			git_cond_wait(&pool->work, &pool->lock);
+
+		if ((item = pool->head) == NULL)
+			break;
+
+		if ((pool->head = item->next) == NULL)
+			pool->tail = NULL;
+
+		git_mutex_unlock(&pool->lock);
+
+		item->job(item->payload);
+		git__free(item);
+
+		git_mutex_lock(&pool->lock);
+
+		if (--pool->pending == 0)
+			git_cond_broadcast(&pool->idle);
+	}
+
+	git_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+#endif
+
+int git_threadpool_new(git_threadpool **out, unsigned int nr_threads)
+{
+	git_threadpool *pool = git__calloc(1, sizeof(git_threadpool));
+	GITERR_CHECK_ALLOC(pool);
+
+#ifdef GIT_THREADS
+	git_mutex_init(&pool->lock);
+	git_cond_init(&pool->work);
+	git_cond_init(&pool->idle);
+
+	if (nr_threads > 0) {
+		pool->threads = git__calloc(nr_threads, sizeof(git_thread));
+		if (pool->threads == NULL) {
+			git_threadpool_free(pool);
+			return -1;
+		}
+	}
+
+	for (; pool->nr_threads < nr_threads; pool->nr_threads++) {
+		if (git_thread_create(&pool->threads[pool->nr_threads],
+				NULL, threadpool_thread, pool) != 0)
+			break;
+	}
+
+	/* fewer threads only make it slower */
+	if (pool->nr_threads == 0 && nr_threads > 0) {
+		git_threadpool_free(pool);
+		giterr_set(GITERR_THREAD, "unable to create thread");
+		return -1;
+	}
+#else
+	GIT_UNUSED(nr_threads);
+#endif
+
+	*out = pool;
+	return 0;
+}
+
+int git_threadpool_submit(
+	git_threadpool *pool, git_threadpool_job job, void *payload)
+{
+	threadpool_item *item;
+
+	if (pool->nr_threads == 0) {
+		job(payload);
+		return 0;
+	}
+
+	item = git__malloc(sizeof(threadpool_item));
+	GITERR_CHECK_ALLOC(item);
+
+	item->next = NULL;
+	item->job = job;
+	item->payload = payload;
+
+#ifdef GIT_THREADS
+	git_mutex_lock(&pool->lock);
+
+	if (pool->tail != NULL)
+		pool->tail->next = item;
+	else
+		pool->head = item;
+	pool->tail = item;
+	pool->pending++;
+
+	git_cond_signal(&pool->work);
+	git_mutex_unlock(&pool->lock);
+#endif
+
+	return 0;
+}
+
+void git_threadpool_wait(git_threadpool *pool)
+{
+#ifdef GIT_THREADS
+	git_mutex_lock(&pool->lock);
+
+	while (pool->pending > 0)
+		git_cond_wait(&pool->idle, &pool->lock);
+
+	git_mutex_unlock(&pool->lock);
+#else
+	GIT_UNUSED(pool);
+#endif
+}
+
+void git_threadpool_free(git_threadpool *pool)
+{
+	if (pool == NULL)
+		return;
+
+#ifdef GIT_THREADS
+	{
+		unsigned int i;
+
+		git_mutex_lock(&pool->lock);
+		pool->closing = true;
+		git_cond_broadcast(&pool->work);
+		git_mutex_unlock(&pool->lock);
+
+		for (i = 0; i < pool->nr_threads; ++i)
+			git_thread_join(pool->threads[i], NULL);
+	}
+
+	git_cond_free(&pool->idle);
+	git_cond_free(&pool->work);
+	git_mutex_free(&pool->lock);
+#endif
+
+	git__free(pool->threads);
+	git__free(pool);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_threadpool_h__
+#define INCLUDE_threadpool_h__
+
+#include "common.h"
+
+/*
+ * A fixed set of threads running the jobs they are handed, in the
+ * order they were submitted. A pool without threads (which is all
+ * there is without GIT_THREADS) runs every job right away, on the
+ * thread submitting it.
+ *
+ * Errors are per-thread: a job has to keep its own.
+ */
+typedef struct git_threadpool git_threadpool;
+
+typedef void (*git_threadpool_job)(void *payload);
+
+extern int git_threadpool_new(git_threadpool **out, unsigned int nr_threads);
+
+extern int git_threadpool_submit(
+	git_threadpool *pool, git_threadpool_job job, void *payload);
+
+/* Wait until every job submitted so far has run */
+extern void git_threadpool_wait(git_threadpool *pool);
+
+/* Run the jobs which are left, then stop the threads */
+extern void git_threadpool_free(git_threadpool *pool);
+
+#endif
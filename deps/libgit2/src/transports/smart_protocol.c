@@ -385,6 +385,7 @@ static int no_sideband(transport_smart *t, struct git_odb_writepack *writepack,
 
 struct network_packetsize_payload
 {
+	transport_smart *transport;
 	git_transfer_progress_callback callback;
 	void *payload;
 	git_transfer_progress *stats;
@@ -401,7 +402,10 @@ static void network_packetsize(size_t received, void *payload)
 	/* Fire notification if the threshold is reached */
 	if ((npp->stats->received_bytes - npp->last_fired_bytes) > NETWORK_XFER_THRESHOLD) {
 		npp->last_fired_bytes = npp->stats->received_bytes;
-		npp->callback(npp->stats, npp->payload);
+
+		/* A non-zero return stops the download like git_remote_stop() */
+		if (npp->callback(npp->stats, npp->payload))
+			git_atomic_set(&npp->transport->cancelled, 1);
 	}
 }
 
@@ -422,6 +426,7 @@ int git_smart__download_pack(
 	memset(stats, 0, sizeof(git_transfer_progress));
 
 	if (progress_cb) {
+		npp.transport = t;
 		npp.callback = progress_cb;
 		npp.payload = progress_payload;
 		npp.stats = stats;
@@ -469,7 +474,7 @@ int git_smart__download_pack(
 			git__free(pkt);
 		} else if (pkt->type == GIT_PKT_DATA) {
 			git_pkt_data *p = (git_pkt_data *) pkt;
-			if (writepack->add(writepack, p->data, p->len, stats) < 0)
+			if ((error = writepack->add(writepack, p->data, p->len, stats)) < 0)
 				goto on_error;
 
 			git__free(pkt);
@@ -480,7 +485,7 @@ int git_smart__download_pack(
 		}
 	} while (1);
 
-	if (writepack->commit(writepack, stats) < 0)
+	if ((error = writepack->commit(writepack, stats)) < 0)
 		goto on_error;
 
 on_success:
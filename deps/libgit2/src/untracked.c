@@ -0,0 +1,481 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "untracked.h"
+#include "path.h"
+
+GIT__USE_STRMAP;
+
+#define UNTRACKED_CACHE_VERSION 1
+#define UNTRACKED_CACHE_IGNORE_CASE (1u << 0)
+
+static void untracked_dir_free(git_untracked_dir *dir)
+{
+	size_t i;
+	git_untracked_entry *entry;
+
+	git_vector_foreach(&dir->entries, i, entry)
+		git__free(entry);
+	git_vector_free(&dir->entries);
+	git__free(dir);
+}
+
+static git_untracked_dir *untracked_dir_alloc(const char *path)
+{
+	size_t path_len = strlen(path);
+	git_untracked_dir *dir;
+
+	dir = git__calloc(1, sizeof(git_untracked_dir) + path_len + 1);
+	if (dir == NULL)
+		return NULL;
+
+	if (git_vector_init(&dir->entries, 0, NULL) < 0) {
+		git__free(dir);
+		return NULL;
+	}
+
+	memcpy(dir->path, path, path_len);
+	return dir;
+}
+
+static git_untracked_entry *untracked_entry_alloc(
+	const char *name, size_t name_len, uint32_t mode)
+{
+	git_untracked_entry *entry;
+
+	entry = git__calloc(1, sizeof(git_untracked_entry) + name_len + 1);
+	if (entry == NULL)
+		return NULL;
+
+	entry->mode = mode;
+	entry->ignored = -1;
+	entry->name_len = name_len;
+	memcpy(entry->name, name, name_len);
+
+	return entry;
+}
+
+static int untracked_cache_insert(git_untracked_cache *uc, git_untracked_dir *dir)
+{
+	git_untracked_dir *old;
+	int error;
+
+	git_strmap_insert2(uc->dirs, dir->path, dir, old, error);
+	if (error < 0) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	if (old != NULL)
+		untracked_dir_free(old);
+
+	return 0;
+}
+
+static void untracked_cache_clear(git_untracked_cache *uc)
+{
+	git_untracked_dir *dir;
+
+	git_strmap_foreach_value(uc->dirs, dir, {
+		untracked_dir_free(dir);
+	});
+	git_strmap_clear(uc->dirs);
+}
+
+int git_untracked_cache_new(git_untracked_cache **out)
+{
+	git_untracked_cache *uc = git__calloc(1, sizeof(git_untracked_cache));
+	GITERR_CHECK_ALLOC(uc);
+
+	uc->dirs = git_strmap_alloc();
+	if (uc->dirs == NULL) {
+		git__free(uc);
+		giterr_set_oom();
+		return -1;
+	}
+
+	*out = uc;
+	return 0;
+}
+
+void git_untracked_cache_free(git_untracked_cache *uc)
+{
+	if (uc == NULL)
+		return;
+
+	untracked_cache_clear(uc);
+	git_strmap_free(uc->dirs);
+	git__free(uc);
+}
+
+static void untracked_dir_forget_ignored(git_untracked_dir *dir)
+{
+	size_t i;
+	git_untracked_entry *entry;
+
+	git_vector_foreach(&dir->entries, i, entry)
+		entry->ignored = -1;
+}
+
+void git_untracked_cache_update(
+	git_untracked_cache *uc, const git_oid *exclude_oid, bool ignore_case)
+{
+	git_untracked_dir *dir;
+	bool case_changed = (uc->ignore_case != ignore_case);
+
+	if (!case_changed && git_oid_cmp(&uc->exclude_oid, exclude_oid) == 0)
+		return;
+
+	/* walks may still point at the directories: they're kept, but reset */
+	git_strmap_foreach_value(uc->dirs, dir, {
+		untracked_dir_forget_ignored(dir);
+		if (case_changed)
+			dir->mtime.seconds = 0;
+	});
+
+	git_oid_cpy(&uc->exclude_oid, exclude_oid);
+	uc->ignore_case = ignore_case;
+	uc->dirty = true;
+}
+
+git_untracked_dir *git_untracked_cache_lookup(
+	git_untracked_cache *uc, const char *path)
+{
+	khiter_t pos = git_strmap_lookup_index(uc->dirs, path);
+
+	if (!git_strmap_valid_index(uc->dirs, pos))
+		return NULL;
+
+	return git_strmap_value_at(uc->dirs, pos);
+}
+
+bool git_untracked_dir_is_fresh(
+	const git_untracked_dir *dir, const struct stat *st)
+{
+	/* see git_untracked_cache_store */
+	if (dir->mtime.seconds == 0)
+		return false;
+
+	return (dir->mtime.seconds == (git_time_t)st->st_mtime &&
+		dir->ctime.seconds == (git_time_t)st->st_ctime &&
+		dir->ino == (unsigned int)st->st_ino);
+}
+
+int git_untracked_cache_store(
+	git_untracked_dir **out,
+	git_untracked_cache *uc,
+	const char *path,
+	const struct stat *st,
+	const git_vector *contents)
+{
+	git_untracked_dir *dir;
+	git_untracked_entry *entry;
+	const git_path_with_stat *ps;
+	git_vector entries = GIT_VECTOR_INIT;
+	size_t i, skip = strlen(path);
+
+	if (git_vector_init(&entries, contents->length, NULL) < 0)
+		return -1;
+
+	git_vector_foreach(contents, i, ps) {
+		assert(ps->path_len > skip);
+
+		entry = untracked_entry_alloc(
+			ps->path + skip, ps->path_len - skip, (uint32_t)ps->st.st_mode);
+		if (entry == NULL || git_vector_insert(&entries, entry) < 0) {
+			git__free(entry);
+			goto fail;
+		}
+	}
+
+	/* kept where it was: walks may still point at it */
+	if ((dir = git_untracked_cache_lookup(uc, path)) == NULL) {
+		if ((dir = untracked_dir_alloc(path)) == NULL)
+			goto fail;
+
+		if (untracked_cache_insert(uc, dir) < 0) {
+			untracked_dir_free(dir);
+			goto fail;
+		}
+	}
+
+	git_vector_foreach(&dir->entries, i, entry)
+		git__free(entry);
+	git_vector_free(&dir->entries);
+	dir->entries = entries;
+
+	/*
+	 * What changes in the second a directory was read in may not show
+	 * in its mtime: such contents are kept, but never trusted
+	 */
+	if ((git_time_t)st->st_mtime < (git_time_t)time(NULL)) {
+		dir->ctime.seconds = (git_time_t)st->st_ctime;
+		dir->mtime.seconds = (git_time_t)st->st_mtime;
+		dir->ino = (unsigned int)st->st_ino;
+	} else
+		dir->mtime.seconds = 0;
+
+	uc->dirty = true;
+	*out = dir;
+	return 0;
+
+fail:
+	git_vector_foreach(&entries, i, entry)
+		git__free(entry);
+	git_vector_free(&entries);
+	return -1;
+}
+
+void git_untracked_cache_set_ignore_oid(
+	git_untracked_cache *uc, git_untracked_dir *dir, const git_oid *oid)
+{
+	size_t path_len = strlen(dir->path);
+	git_untracked_dir *other;
+
+	if (git_oid_cmp(&dir->ignore_oid, oid) == 0)
+		return;
+
+	git_strmap_foreach_value(uc->dirs, other, {
+		if (strncmp(other->path, dir->path, path_len) == 0)
+			untracked_dir_forget_ignored(other);
+	});
+
+	git_oid_cpy(&dir->ignore_oid, oid);
+	uc->dirty = true;
+}
+
+void git_untracked_cache_set_ignored(
+	git_untracked_cache *uc, git_untracked_entry *entry, int ignored)
+{
+	if (entry->ignored == ignored)
+		return;
+
+	entry->ignored = ignored;
+	uc->dirty = true;
+}
+
+/*
+ * On disk, all numbers in network byte order:
+ *
+ *   uint32 version, uint32 flags, 20 bytes digest of the global rules,
+ *   uint32 number of directories, and for each of them:
+ *
+ *     path (NUL-terminated), uint32 ctime, uint32 mtime, uint32 ino,
+ *     20 bytes digest of its rules, uint32 number of entries,
+ *     and for each entry:
+ *
+ *       uint32 mode, uint8 ignored (0, 1 or 0xff), name (NUL-terminated)
+ */
+typedef struct {
+	const char *ptr;
+	size_t left;
+} untracked_reader;
+
+static int read_uint32(uint32_t *out, untracked_reader *r)
+{
+	uint32_t value;
+
+	if (r->left < sizeof(uint32_t))
+		return -1;
+
+	memcpy(&value, r->ptr, sizeof(uint32_t));
+	*out = ntohl(value);
+
+	r->ptr += sizeof(uint32_t);
+	r->left -= sizeof(uint32_t);
+	return 0;
+}
+
+static int read_oid(git_oid *out, untracked_reader *r)
+{
+	if (r->left < GIT_OID_RAWSZ)
+		return -1;
+
+	git_oid_fromraw(out, (const unsigned char *)r->ptr);
+
+	r->ptr += GIT_OID_RAWSZ;
+	r->left -= GIT_OID_RAWSZ;
+	return 0;
+}
+
+static int read_string(const char **out, size_t *len, untracked_reader *r)
+{
+	const char *end = memchr(r->ptr, '\0', r->left);
+
+	if (end == NULL)
+		return -1;
+
+	*out = r->ptr;
+	*len = end - r->ptr;
+
+	r->left -= (end + 1) - r->ptr;
+	r->ptr = end + 1;
+	return 0;
+}
+
+static int read_dir(git_untracked_dir **out, untracked_reader *r)
+{
+	git_untracked_dir *dir;
+	git_untracked_entry *entry;
+	const char *str;
+	size_t len;
+	uint32_t value, count, mode, i;
+
+	if (read_string(&str, &len, r) < 0 ||
+		(dir = untracked_dir_alloc(str)) == NULL)
+		return -1;
+
+	if (read_uint32(&value, r) < 0)
+		goto fail;
+	dir->ctime.seconds = value;
+
+	if (read_uint32(&value, r) < 0)
+		goto fail;
+	dir->mtime.seconds = value;
+
+	if (read_uint32(&value, r) < 0)
+		goto fail;
+	dir->ino = value;
+
+	if (read_oid(&dir->ignore_oid, r) < 0 ||
+		read_uint32(&count, r) < 0)
+		goto fail;
+
+	for (i = 0; i < count; ++i) {
+		if (read_uint32(&mode, r) < 0 || r->left < 1)
+			goto fail;
+
+		value = (unsigned char)*r->ptr;
+		r->ptr++;
+		r->left--;
+
+		if (read_string(&str, &len, r) < 0 || !len ||
+			(entry = untracked_entry_alloc(str, len, mode)) == NULL)
+			goto fail;
+
+		entry->ignored = (value == 0xff) ? -1 : (value != 0);
+
+		if (git_vector_insert(&dir->entries, entry) < 0) {
+			git__free(entry);
+			goto fail;
+		}
+	}
+
+	*out = dir;
+	return 0;
+
+fail:
+	untracked_dir_free(dir);
+	return -1;
+}
+
+int git_untracked_cache_read(
+	git_untracked_cache **out, const char *buffer, size_t buffer_size)
+{
+	untracked_reader r = { buffer, buffer_size };
+	git_untracked_cache *uc = NULL;
+	git_untracked_dir *dir;
+	uint32_t version, flags, count, i;
+
+	if (read_uint32(&version, &r) < 0 ||
+		version != UNTRACKED_CACHE_VERSION ||
+		read_uint32(&flags, &r) < 0)
+		goto corrupt;
+
+	if (git_untracked_cache_new(&uc) < 0)
+		return -1;
+
+	uc->ignore_case = ((flags & UNTRACKED_CACHE_IGNORE_CASE) != 0);
+
+	if (read_oid(&uc->exclude_oid, &r) < 0 ||
+		read_uint32(&count, &r) < 0)
+		goto corrupt;
+
+	for (i = 0; i < count; ++i) {
+		if (read_dir(&dir, &r) < 0)
+			goto corrupt;
+
+		if (untracked_cache_insert(uc, dir) < 0) {
+			untracked_dir_free(dir);
+			goto fail;
+		}
+	}
+
+	if (r.left != 0)
+		goto corrupt;
+
+	*out = uc;
+	return 0;
+
+corrupt:
+	giterr_set(GITERR_INDEX, "Corrupted untracked cache extension");
+fail:
+	git_untracked_cache_free(uc);
+	return -1;
+}
+
+static int put_uint32(git_buf *out, uint32_t value)
+{
+	value = htonl(value);
+	return git_buf_put(out, (const char *)&value, sizeof(uint32_t));
+}
+
+static int untracked_dir_cmp(const void *a, const void *b)
+{
+	const git_untracked_dir *dir_a = a, *dir_b = b;
+	return strcmp(dir_a->path, dir_b->path);
+}
+
+int git_untracked_cache_write(git_buf *out, const git_untracked_cache *uc)
+{
+	git_vector dirs = GIT_VECTOR_INIT;
+	git_untracked_dir *dir;
+	git_untracked_entry *entry;
+	size_t i, j;
+	unsigned char ignored;
+	int error;
+
+	if (git_vector_init(&dirs,
+			git_strmap_num_entries(uc->dirs), untracked_dir_cmp) < 0)
+		return -1;
+
+	/* sorted, for the same cache to be written the same way */
+	git_strmap_foreach_value(uc->dirs, dir, {
+		if (git_vector_insert(&dirs, dir) < 0) {
+			git_vector_free(&dirs);
+			return -1;
+		}
+	});
+	git_vector_sort(&dirs);
+
+	put_uint32(out, UNTRACKED_CACHE_VERSION);
+	put_uint32(out, uc->ignore_case ? UNTRACKED_CACHE_IGNORE_CASE : 0);
+	git_buf_put(out, (const char *)uc->exclude_oid.id, GIT_OID_RAWSZ);
+	put_uint32(out, (uint32_t)dirs.length);
+
+	git_vector_foreach(&dirs, i, dir) {
+		git_buf_put(out, dir->path, strlen(dir->path) + 1);
+		put_uint32(out, (uint32_t)dir->ctime.seconds);
+		put_uint32(out, (uint32_t)dir->mtime.seconds);
+		put_uint32(out, (uint32_t)dir->ino);
+		git_buf_put(out, (const char *)dir->ignore_oid.id, GIT_OID_RAWSZ);
+		put_uint32(out, (uint32_t)dir->entries.length);
+
+		git_vector_foreach(&dir->entries, j, entry) {
+			ignored = (entry->ignored < 0) ? 0xff : (unsigned char)entry->ignored;
+
+			put_uint32(out, entry->mode);
+			git_buf_putc(out, (char)ignored);
+			git_buf_put(out, entry->name, entry->name_len + 1);
+		}
+	}
+
+	error = git_buf_oom(out) ? -1 : 0;
+
+	git_vector_free(&dirs);
+	return error;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2009-2012 the libgit2 contributors
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_untracked_h__
+#define INCLUDE_untracked_h__
+
+#include "common.h"
+#include "vector.h"
+#include "strmap.h"
+#include "buffer.h"
+#include "git2/oid.h"
+#include "git2/index.h"
+
+/*
+ * Remembers what the directories of the working directory contained
+ * the last time they were read, so a walk can skip reading the ones
+ * whose stat data didn't change since (when core.untrackedCache is on).
+ *
+ * Every name is kept with its type, whether tracked or not: the files
+ * the index tracks are lstat()ed again by the walk, the others are
+ * handed out as they were. Whether an entry is ignored is kept once it
+ * was asked, along with a digest of the ignore rules of its directory
+ * and of the global ones, which forget it when they change.
+ *
+ * It's kept in the index, as an optional extension. It isn't locked:
+ * storing a directory frees what was kept of it, which a walk running
+ * at the same time may still be looking at, so the walks of a
+ * repository that use it must run one at a time (see
+ * git_status_foreach_ext).
+ */
+typedef struct {
+	uint32_t mode;
+	int ignored; /* -1 until asked */
+	size_t name_len;
+	char name[GIT_FLEX_ARRAY]; /* '/'-suffixed for directories */
+} git_untracked_entry;
+
+typedef struct {
+	git_index_time ctime;
+	git_index_time mtime;
+	unsigned int ino;
+
+	git_oid ignore_oid; /* of the rules its .gitignore holds */
+	git_vector entries; /* sorted as the walk sorts them */
+
+	char path[GIT_FLEX_ARRAY]; /* '/'-suffixed, "" for the root */
+} git_untracked_dir;
+
+typedef struct {
+	git_oid exclude_oid; /* of the internal and global ignore rules */
+	bool ignore_case;
+
+	git_strmap *dirs;
+
+	bool dirty; /* changed since it was read or written */
+	size_t hits, misses;
+} git_untracked_cache;
+
+extern int git_untracked_cache_new(git_untracked_cache **out);
+extern void git_untracked_cache_free(git_untracked_cache *uc);
+
+extern int git_untracked_cache_read(
+	git_untracked_cache **out, const char *buffer, size_t buffer_size);
+extern int git_untracked_cache_write(
+	git_buf *out, const git_untracked_cache *uc);
+
+/*
+ * Check the settings a walk is about to read with against the ones
+ * what is kept was read with; forget everything if they differ
+ */
+extern void git_untracked_cache_update(
+	git_untracked_cache *uc, const git_oid *exclude_oid, bool ignore_case);
+
+/* What was kept about `path` (relative to the working directory), if any */
+extern git_untracked_dir *git_untracked_cache_lookup(
+	git_untracked_cache *uc, const char *path);
+
+/* Whether `dir` didn't change since it was read, as far as `st` tells */
+extern bool git_untracked_dir_is_fresh(
+	const git_untracked_dir *dir, const struct stat *st);
+
+/*
+ * Keep what `path` was just read to contain, as `git_path_dirload_with_stat`
+ * gave it, after it was lstat()ed as `st`
+ */
+extern int git_untracked_cache_store(
+	git_untracked_dir **out,
+	git_untracked_cache *uc,
+	const char *path,
+	const struct stat *st,
+	const git_vector *contents);
+
+/*
+ * Record the digest of the ignore rules of `dir`; when it differs from
+ * the one kept, forget what was ignored in and below it
+ */
+extern void git_untracked_cache_set_ignore_oid(
+	git_untracked_cache *uc, git_untracked_dir *dir, const git_oid *oid);
+
+extern void git_untracked_cache_set_ignored(
+	git_untracked_cache *uc, git_untracked_entry *entry, int ignored);
+
+#endif
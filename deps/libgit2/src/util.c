@@ -10,6 +10,11 @@
 #include <stdio.h>
 #include <ctype.h>
 #include "posix.h"
+#include "pack.h"
+#include "indexer.h"
+#include "mwindow.h"
+#include "iterator.h"
+#include "checkout.h"
 
 #ifdef _MSC_VER
 # include <Shlwapi.h>
@@ -34,6 +39,87 @@ int git_libgit2_capabilities()
 	;
 }
 
+int git_libgit2_opts(int key, ...)
+{
+	int error = 0;
+	va_list ap;
+
+	va_start(ap, key);
+
+	switch (key) {
+	case GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT:
+		*(va_arg(ap, size_t *)) = git_packfile__delta_cache_limit();
+		break;
+
+	case GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT:
+		error = git_packfile__delta_cache_set_limit(va_arg(ap, size_t));
+		break;
+
+	case GIT_OPT_GET_DELTA_BASE_CACHE_STATS:
+		error = git_packfile__delta_cache_stats(va_arg(ap, git_cache_stats *));
+		break;
+
+	case GIT_OPT_GET_INDEXER_THREADS:
+		*(va_arg(ap, unsigned int *)) = git_indexer__default_threads();
+		break;
+
+	case GIT_OPT_SET_INDEXER_THREADS:
+		git_indexer__set_default_threads(va_arg(ap, unsigned int));
+		break;
+
+	case GIT_OPT_GET_MWINDOW_SIZE:
+		*(va_arg(ap, size_t *)) = git_mwindow__window_size();
+		break;
+
+	case GIT_OPT_SET_MWINDOW_SIZE:
+		error = git_mwindow__set_window_size(va_arg(ap, size_t));
+		break;
+
+	case GIT_OPT_GET_MWINDOW_MAPPED_LIMIT:
+		*(va_arg(ap, size_t *)) = git_mwindow__mapped_limit();
+		break;
+
+	case GIT_OPT_SET_MWINDOW_MAPPED_LIMIT:
+		git_mwindow__set_mapped_limit(va_arg(ap, size_t));
+		break;
+
+	case GIT_OPT_GET_MWINDOW_FILE_LIMIT:
+		*(va_arg(ap, unsigned int *)) = git_mwindow__file_limit();
+		break;
+
+	case GIT_OPT_SET_MWINDOW_FILE_LIMIT:
+		git_mwindow__set_file_limit(va_arg(ap, unsigned int));
+		break;
+
+	case GIT_OPT_GET_MWINDOW_STATS:
+		error = git_mwindow__stats(va_arg(ap, git_mwindow_stats *));
+		break;
+
+	case GIT_OPT_GET_WORKDIR_THREADS:
+		*(va_arg(ap, unsigned int *)) = git_iterator__default_workdir_threads();
+		break;
+
+	case GIT_OPT_SET_WORKDIR_THREADS:
+		git_iterator__set_workdir_threads(va_arg(ap, unsigned int));
+		break;
+
+	case GIT_OPT_GET_CHECKOUT_THREADS:
+		*(va_arg(ap, unsigned int *)) = git_checkout__default_threads();
+		break;
+
+	case GIT_OPT_SET_CHECKOUT_THREADS:
+		git_checkout__set_threads(va_arg(ap, unsigned int));
+		break;
+
+	default:
+		giterr_set(GITERR_INVALID, "Unknown library option %d", key);
+		error = -1;
+	}
+
+	va_end(ap);
+	return error;
+}
+
 void git_strarray_free(git_strarray *array)
 {
 	size_t i;
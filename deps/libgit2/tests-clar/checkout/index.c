@@ -369,11 +369,12 @@ void test_checkout_index__wont_notify_of_expected_line_ending_changes(void)
 	cl_git_pass(git_checkout_index(g_repo, NULL, &g_opts));
 }
 
-static void progress(const char *path, size_t cur, size_t tot, void *payload)
+static int progress(const char *path, size_t cur, size_t tot, void *payload)
 {
 	bool *was_called = (bool*)payload;
 	GIT_UNUSED(path); GIT_UNUSED(cur); GIT_UNUSED(tot);
 	*was_called = true;
+	return 0;
 }
 
 void test_checkout_index__calls_progress_callback(void)
@@ -386,6 +387,24 @@ void test_checkout_index__calls_progress_callback(void)
 	cl_assert_equal_i(was_called, true);
 }
 
+static int cancel_after(const char *path, size_t cur, size_t tot, void *payload)
+{
+	size_t *calls = (size_t *)payload;
+	GIT_UNUSED(path); GIT_UNUSED(cur); GIT_UNUSED(tot);
+	return ++(*calls) > 1;
+}
+
+void test_checkout_index__progress_callback_can_cancel(void)
+{
+	size_t calls = 0;
+	g_opts.progress_cb = cancel_after;
+	g_opts.progress_payload = &calls;
+
+	cl_assert_equal_i(GIT_EUSER, git_checkout_index(g_repo, NULL, &g_opts));
+	cl_assert_equal_i(2, calls);
+	cl_assert_equal_i(false, git_path_isfile("./testrepo/new.txt"));
+}
+
 void test_checkout_index__can_overcome_name_clashes(void)
 {
 	git_index *index;
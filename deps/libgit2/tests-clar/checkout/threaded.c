@@ -0,0 +1,142 @@
+#include "clar_libgit2.h"
+
+#include "git2/checkout.h"
+#include "repository.h"
+
+static git_repository *g_repo;
+static git_checkout_opts g_opts;
+static git_object *g_object;
+
+void test_checkout_threaded__initialize(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_CHECKOUT_THREADS, 4));
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	GIT_INIT_STRUCTURE(&g_opts, GIT_CHECKOUT_OPTS_VERSION);
+	g_opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+}
+
+void test_checkout_threaded__cleanup(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_CHECKOUT_THREADS, 1));
+
+	git_object_free(g_object);
+	g_object = NULL;
+
+	cl_git_sandbox_cleanup();
+}
+
+static void test_file_contents(const char *path, const char *expected)
+{
+	git_buf content = GIT_BUF_INIT;
+
+	cl_git_pass(git_futils_readbuffer(&content, path));
+	cl_assert_equal_s(expected, git_buf_cstr(&content));
+
+	git_buf_free(&content);
+}
+
+void test_checkout_threaded__option_can_be_read_back(void)
+{
+	unsigned int threads;
+
+	git_libgit2_opts(GIT_OPT_GET_CHECKOUT_THREADS, &threads);
+	cl_assert_equal_i(4, threads);
+}
+
+void test_checkout_threaded__creates_nested_directories(void)
+{
+	cl_git_pass(git_revparse_single(&g_object, g_repo, "subtrees"));
+	cl_git_pass(git_checkout_tree(g_repo, g_object, &g_opts));
+
+	test_file_contents("./testrepo/ab/4.txt", "4.txt\n");
+	test_file_contents("./testrepo/ab/c/3.txt", "3.txt\n");
+	test_file_contents("./testrepo/ab/de/2.txt", "2.txt\n");
+	test_file_contents("./testrepo/ab/de/fgh/1.txt", "1.txt\n");
+}
+
+void test_checkout_threaded__applies_filters(void)
+{
+	cl_git_rewritefile("./testrepo/.gitattributes",
+		"branch_file.txt text eol=crlf\n"
+		"new.txt text eol=lf\n");
+
+	cl_git_pass(git_revparse_single(&g_object, g_repo, "master"));
+	cl_git_pass(git_checkout_tree(g_repo, g_object, &g_opts));
+
+	test_file_contents("./testrepo/README", "hey there\n");
+	test_file_contents("./testrepo/branch_file.txt", "hi\r\nbye!\r\n");
+	test_file_contents("./testrepo/new.txt", "my new file\n");
+}
+
+void test_checkout_threaded__writes_links(void)
+{
+	git_config *cfg;
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_bool(cfg, "core.symlinks", false));
+	git_config_free(cfg);
+
+	cl_git_pass(git_revparse_single(&g_object, g_repo, "master"));
+	cl_git_pass(git_checkout_tree(g_repo, g_object, &g_opts));
+
+	test_file_contents("./testrepo/link_to_new.txt", "new.txt");
+}
+
+typedef struct {
+	size_t calls;
+	size_t last;
+	size_t total;
+	bool in_order;
+} progress_data;
+
+static int progress(const char *path, size_t cur, size_t tot, void *payload)
+{
+	progress_data *data = payload;
+
+	GIT_UNUSED(path);
+
+	if (cur != data->calls)
+		data->in_order = false;
+
+	data->calls++;
+	data->last = cur;
+	data->total = tot;
+	return 0;
+}
+
+void test_checkout_threaded__reports_progress_in_order(void)
+{
+	progress_data data = { 0, 0, 0, true };
+
+	g_opts.progress_cb = progress;
+	g_opts.progress_payload = &data;
+
+	cl_git_pass(git_revparse_single(&g_object, g_repo, "subtrees"));
+	cl_git_pass(git_checkout_tree(g_repo, g_object, &g_opts));
+
+	cl_assert(data.in_order);
+	cl_assert(data.total > 0);
+	cl_assert_equal_sz(data.total, data.last);
+	cl_assert_equal_sz(data.total + 1, data.calls);
+}
+
+static int cancel_after(const char *path, size_t cur, size_t tot, void *payload)
+{
+	size_t *calls = (size_t *)payload;
+	GIT_UNUSED(path); GIT_UNUSED(cur); GIT_UNUSED(tot);
+	return ++(*calls) > 1;
+}
+
+void test_checkout_threaded__progress_callback_can_cancel(void)
+{
+	size_t calls = 0;
+
+	g_opts.progress_cb = cancel_after;
+	g_opts.progress_payload = &calls;
+
+	cl_git_pass(git_revparse_single(&g_object, g_repo, "subtrees"));
+	cl_assert_equal_i(GIT_EUSER, git_checkout_tree(g_repo, g_object, &g_opts));
+	cl_assert_equal_i(2, calls);
+}
@@ -65,11 +65,12 @@ void test_checkout_tree__can_checkout_a_subdirectory_from_a_subtree(void)
 	cl_assert_equal_i(true, git_path_isfile("./testrepo/de/fgh/1.txt"));
 }
 
-static void progress(const char *path, size_t cur, size_t tot, void *payload)
+static int progress(const char *path, size_t cur, size_t tot, void *payload)
 {
 	bool *was_called = (bool*)payload;
 	GIT_UNUSED(path); GIT_UNUSED(cur); GIT_UNUSED(tot);
 	*was_called = true;
+	return 0;
 }
 
 void test_checkout_tree__calls_progress_callback(void)
@@ -106,18 +106,20 @@ void test_clone_network__can_prevent_the_checkout_of_a_standard_repo(void)
 	git_buf_free(&path);
 }
 
-static void checkout_progress(const char *path, size_t cur, size_t tot, void *payload)
+static int checkout_progress(const char *path, size_t cur, size_t tot, void *payload)
 {
 	bool *was_called = (bool*)payload;
 	GIT_UNUSED(path); GIT_UNUSED(cur); GIT_UNUSED(tot);
 	(*was_called) = true;
+	return 0;
 }
 
-static void fetch_progress(const git_transfer_progress *stats, void *payload)
+static int fetch_progress(const git_transfer_progress *stats, void *payload)
 {
 	bool *was_called = (bool*)payload;
 	GIT_UNUSED(stats);
 	(*was_called) = true;
+	return 0;
 }
 
 void test_clone_network__can_checkout_a_cloned_repo(void)
@@ -463,3 +463,61 @@ void test_diff_diffiter__checks_options_version(void)
 	cl_assert_equal_i(GITERR_INVALID, err->klass);
 }
 
+
+static git_tree *tree_with(git_repository *repo, const char *text, const char *bin, size_t bin_len)
+{
+	git_treebuilder *bld;
+	git_tree *tree;
+	git_oid oid;
+
+	cl_git_pass(git_treebuilder_create(&bld, NULL));
+
+	cl_git_pass(git_blob_create_frombuffer(&oid, repo, text, strlen(text)));
+	cl_git_pass(git_treebuilder_insert(NULL, bld, "file.txt", &oid, GIT_FILEMODE_BLOB));
+	cl_git_pass(git_blob_create_frombuffer(&oid, repo, bin, bin_len));
+	cl_git_pass(git_treebuilder_insert(NULL, bld, "file.bin", &oid, GIT_FILEMODE_BLOB));
+
+	cl_git_pass(git_treebuilder_write(&oid, repo, bld));
+	cl_git_pass(git_tree_lookup(&tree, repo, &oid));
+	git_treebuilder_free(bld);
+
+	return tree;
+}
+
+void test_diff_diffiter__skipped_binary_check_is_done_by_the_patch(void)
+{
+	git_repository *repo = cl_git_sandbox_init("empty_standard_repo");
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_diff_list *diff = NULL;
+	git_diff_patch *patch;
+	const git_diff_delta *delta;
+	git_tree *a, *b;
+	size_t d;
+
+	a = tree_with(repo, "one\n", "\0one\n", 5);
+	b = tree_with(repo, "two\n", "\0two\n", 5);
+
+	opts.flags = GIT_DIFF_SKIP_BINARY_CHECK;
+	cl_git_pass(git_diff_tree_to_tree(&diff, repo, a, b, &opts));
+	cl_assert_equal_i(2, (int)git_diff_num_deltas(diff));
+
+	/* with the check skipped, generating the patch has to make it */
+	for (d = 0; d < 2; ++d) {
+		cl_git_pass(git_diff_get_patch(&patch, &delta, diff, d));
+
+		if (!strcmp(delta->new_file.path, "file.bin")) {
+			cl_assert_equal_i(1, delta->binary);
+			cl_assert(patch == NULL || git_diff_patch_num_hunks(patch) == 0);
+		} else {
+			cl_assert_equal_i(0, delta->binary);
+			cl_assert(patch != NULL);
+			cl_assert_equal_i(1, (int)git_diff_patch_num_hunks(patch));
+		}
+
+		git_diff_patch_free(patch);
+	}
+
+	git_diff_list_free(diff);
+	git_tree_free(a);
+	git_tree_free(b);
+}
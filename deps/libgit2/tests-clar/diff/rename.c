@@ -24,7 +24,7 @@ void test_diff_rename__cleanup(void)
  *   sevencities.txt -> sevencities.txt (no change)
  *   sevencities.txt -> songofseven.txt (copy, no change, 100% match)
  *
- * TODO: add commits with various % changes of copy / rename
+ * The tests below build their own trees for partial matches.
  */
 
 void test_diff_rename__match_oid(void)
@@ -133,3 +133,239 @@ void test_diff_rename__checks_options_version(void)
 	git_tree_free(old_tree);
 	git_tree_free(new_tree);
 }
+
+static void make_lines(git_buf *out, const char *tag, int first, int count)
+{
+	int i;
+
+	git_buf_clear(out);
+	for (i = first; i < first + count; ++i)
+		git_buf_printf(out, "%s line %d of some file content\n", tag, i);
+	cl_assert(!git_buf_oom(out));
+}
+
+static void insert_blob(git_treebuilder *bld, const char *path, git_buf *content)
+{
+	git_oid oid;
+
+	cl_git_pass(git_blob_create_frombuffer(&oid, g_repo, content->ptr, content->size));
+	cl_git_pass(git_treebuilder_insert(NULL, bld, path, &oid, GIT_FILEMODE_BLOB));
+}
+
+static git_tree *write_tree(git_treebuilder *bld)
+{
+	git_oid oid;
+	git_tree *tree;
+
+	cl_git_pass(git_treebuilder_write(&oid, g_repo, bld));
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &oid));
+	git_treebuilder_free(bld);
+
+	return tree;
+}
+
+static const git_diff_delta *find_delta(git_diff_list *diff, const char *new_path)
+{
+	const git_diff_delta *delta;
+	size_t i;
+
+	for (i = 0; i < git_diff_num_deltas(diff); ++i) {
+		cl_git_pass(git_diff_get_patch(NULL, &delta, diff, i));
+		if (!strcmp(delta->new_file.path, new_path))
+			return delta;
+	}
+
+	return NULL;
+}
+
+void test_diff_rename__inexact_matches(void)
+{
+	git_treebuilder *bld;
+	git_tree *old_tree, *new_tree;
+	git_diff_list *diff;
+	git_buf content = GIT_BUF_INIT;
+	const git_diff_delta *delta;
+
+	cl_git_pass(git_treebuilder_create(&bld, NULL));
+	make_lines(&content, "moved", 0, 40);
+	insert_blob(bld, "before.txt", &content);
+	make_lines(&content, "gone", 0, 40);
+	insert_blob(bld, "deleted.txt", &content);
+	old_tree = write_tree(bld);
+
+	cl_git_pass(git_treebuilder_create(&bld, NULL));
+	make_lines(&content, "moved", 4, 40); /* 36 of 40 lines kept */
+	insert_blob(bld, "after.txt", &content);
+	make_lines(&content, "fresh", 0, 40);
+	insert_blob(bld, "added.txt", &content);
+	new_tree = write_tree(bld);
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, NULL));
+	cl_assert_equal_i(4, (int)git_diff_num_deltas(diff));
+
+	cl_git_pass(git_diff_find_similar(diff, NULL));
+	cl_assert_equal_i(3, (int)git_diff_num_deltas(diff));
+
+	cl_assert((delta = find_delta(diff, "after.txt")) != NULL);
+	cl_assert_equal_i(GIT_DELTA_RENAMED, delta->status);
+	cl_assert_equal_s("before.txt", delta->old_file.path);
+	cl_assert(delta->similarity >= 85 && delta->similarity < 100);
+
+	/* unrelated content is left alone */
+	cl_assert((delta = find_delta(diff, "added.txt")) != NULL);
+	cl_assert_equal_i(GIT_DELTA_ADDED, delta->status);
+	cl_assert((delta = find_delta(diff, "deleted.txt")) != NULL);
+	cl_assert_equal_i(GIT_DELTA_DELETED, delta->status);
+
+	git_diff_list_free(diff);
+	git_buf_free(&content);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+void test_diff_rename__inexact_copies_and_thresholds(void)
+{
+	git_treebuilder *bld;
+	git_tree *old_tree, *new_tree;
+	git_diff_list *diff;
+	git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	git_buf content = GIT_BUF_INIT;
+	const git_diff_delta *delta;
+
+	cl_git_pass(git_treebuilder_create(&bld, NULL));
+	make_lines(&content, "orig", 0, 20);
+	insert_blob(bld, "original.txt", &content);
+	old_tree = write_tree(bld);
+
+	cl_git_pass(git_treebuilder_create(&bld, NULL));
+	insert_blob(bld, "original.txt", &content);
+	make_lines(&content, "orig", 10, 20); /* half of it survives */
+	insert_blob(bld, "copy.txt", &content);
+	new_tree = write_tree(bld);
+
+	diffopts.flags |= GIT_DIFF_INCLUDE_UNMODIFIED;
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, &diffopts));
+	opts.flags = GIT_DIFF_FIND_COPIES_FROM_UNMODIFIED;
+	opts.copy_threshold = 40;
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+
+	cl_assert((delta = find_delta(diff, "copy.txt")) != NULL);
+	cl_assert_equal_i(GIT_DELTA_COPIED, delta->status);
+	cl_assert_equal_s("original.txt", delta->old_file.path);
+	cl_assert_equal_i(50, delta->similarity);
+	git_diff_list_free(diff);
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, &diffopts));
+	opts.copy_threshold = 60;
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+
+	cl_assert((delta = find_delta(diff, "copy.txt")) != NULL);
+	cl_assert_equal_i(GIT_DELTA_ADDED, delta->status);
+	git_diff_list_free(diff);
+
+	git_buf_free(&content);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+void test_diff_rename__break_rewrites(void)
+{
+	git_treebuilder *bld;
+	git_tree *old_tree, *new_tree;
+	git_diff_list *diff;
+	git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+	git_buf content = GIT_BUF_INIT;
+	diff_expects exp;
+
+	cl_git_pass(git_treebuilder_create(&bld, NULL));
+	make_lines(&content, "first", 0, 20);
+	insert_blob(bld, "rewritten.txt", &content);
+	make_lines(&content, "second", 0, 20);
+	insert_blob(bld, "tweaked.txt", &content);
+	old_tree = write_tree(bld);
+
+	cl_git_pass(git_treebuilder_create(&bld, NULL));
+	make_lines(&content, "other", 0, 20);
+	insert_blob(bld, "rewritten.txt", &content);
+	make_lines(&content, "second", 1, 20);
+	insert_blob(bld, "tweaked.txt", &content);
+	new_tree = write_tree(bld);
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, NULL));
+	opts.flags = GIT_DIFF_FIND_AND_BREAK_REWRITES;
+	cl_git_pass(git_diff_find_similar(diff, &opts));
+
+	memset(&exp, 0, sizeof(exp));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, &exp));
+
+	cl_assert_equal_i(3, exp.files);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_MODIFIED]);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_ADDED]);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_DELETED]);
+
+	git_diff_list_free(diff);
+	git_buf_free(&content);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
+
+void test_diff_rename__many_files(void)
+{
+	git_treebuilder *old_bld, *new_bld;
+	git_tree *old_tree, *new_tree;
+	git_diff_list *diff;
+	git_buf content = GIT_BUF_INIT, path = GIT_BUF_INIT, tag = GIT_BUF_INIT;
+	diff_expects exp;
+	int i;
+
+	cl_git_pass(git_treebuilder_create(&old_bld, NULL));
+	cl_git_pass(git_treebuilder_create(&new_bld, NULL));
+
+	/* every file moves and gets one line changed */
+	for (i = 0; i < 400; ++i) {
+		git_buf_clear(&tag);
+		git_buf_printf(&tag, "file %d", i);
+
+		make_lines(&content, tag.ptr, 0, 20);
+		git_buf_clear(&path);
+		git_buf_printf(&path, "old-%03d.txt", i);
+		insert_blob(old_bld, path.ptr, &content);
+
+		make_lines(&content, tag.ptr, 1, 20);
+		git_buf_clear(&path);
+		git_buf_printf(&path, "new-%03d.txt", i);
+		insert_blob(new_bld, path.ptr, &content);
+	}
+
+	old_tree = write_tree(old_bld);
+	new_tree = write_tree(new_bld);
+
+	cl_git_pass(git_diff_tree_to_tree(&diff, g_repo, old_tree, new_tree, NULL));
+	cl_git_pass(git_diff_find_similar(diff, NULL));
+
+	memset(&exp, 0, sizeof(exp));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, &exp));
+	cl_assert_equal_i(400, exp.files);
+	cl_assert_equal_i(400, exp.file_status[GIT_DELTA_RENAMED]);
+
+	for (i = 0; i < 400; i += 37) {
+		const git_diff_delta *delta;
+		char expected[32];
+
+		git_buf_clear(&path);
+		git_buf_printf(&path, "new-%03d.txt", i);
+		p_snprintf(expected, sizeof(expected), "old-%03d.txt", i);
+
+		cl_assert((delta = find_delta(diff, path.ptr)) != NULL);
+		cl_assert_equal_s(expected, delta->old_file.path);
+	}
+
+	git_diff_list_free(diff);
+	git_buf_free(&content);
+	git_buf_free(&path);
+	git_buf_free(&tag);
+	git_tree_free(old_tree);
+	git_tree_free(new_tree);
+}
@@ -27,10 +27,11 @@ static int update_tips(const char *refname, const git_oid *a, const git_oid *b,
 	return 0;
 }
 
-static void progress(const git_transfer_progress *stats, void *payload)
+static int progress(const git_transfer_progress *stats, void *payload)
 {
 	size_t *bytes_received = (size_t *)payload;
 	*bytes_received = stats->received_bytes;
+	return 0;
 }
 
 static void do_fetch(const char *url, git_remote_autotag_option_t flag, int n)
@@ -75,12 +76,13 @@ void test_network_fetch__no_tags_http(void)
 	do_fetch("http://github.com/libgit2/TestGitRepository.git", GIT_REMOTE_DOWNLOAD_TAGS_NONE, 3);
 }
 
-static void transferProgressCallback(const git_transfer_progress *stats, void *payload)
+static int transferProgressCallback(const git_transfer_progress *stats, void *payload)
 {
 	bool *invoked = (bool *)payload;
 
 	GIT_UNUSED(stats);
 	*invoked = true;
+	return 0;
 }
 
 void test_network_fetch__doesnt_retrieve_a_pack_when_the_repository_is_up_to_date(void)
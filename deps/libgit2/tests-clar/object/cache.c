@@ -0,0 +1,161 @@
+#include "clar_libgit2.h"
+
+#include "repository.h"
+
+static git_repository *g_repo;
+
+static const char *commit_id = "a65fedf39aefe402d3bb6e24df4d4f5fe4547750";
+static const char *blob_id = "a8233120f6ad708f843d861ce2b7228ec4e3dec6";
+
+void test_object_cache__initialize(void)
+{
+	cl_git_pass(git_repository_open(&g_repo, cl_fixture("testrepo.git")));
+}
+
+void test_object_cache__cleanup(void)
+{
+	git_repository_free(g_repo);
+	g_repo = NULL;
+}
+
+static git_object *lookup(const char *id, git_otype type)
+{
+	git_oid oid;
+	git_object *object;
+
+	cl_git_pass(git_oid_fromstr(&oid, id));
+	cl_git_pass(git_object_lookup(&object, g_repo, &oid, type));
+	return object;
+}
+
+/* Walk every commit and its tree, so plenty of objects go through */
+static void load_history(void)
+{
+	git_revwalk *walk;
+	git_oid oid;
+
+	cl_git_pass(git_revwalk_new(&walk, g_repo));
+	cl_git_pass(git_revwalk_push_glob(walk, "refs/heads/*"));
+
+	while (git_revwalk_next(&oid, walk) == 0) {
+		git_commit *commit;
+		git_tree *tree;
+
+		cl_git_pass(git_commit_lookup(&commit, g_repo, &oid));
+		cl_git_pass(git_commit_tree(&tree, commit));
+		git_tree_free(tree);
+		git_commit_free(commit);
+	}
+
+	git_revwalk_free(walk);
+}
+
+void test_object_cache__second_lookup_is_a_hit(void)
+{
+	git_object *one, *two;
+	git_cache_stats stats;
+
+	one = lookup(commit_id, GIT_OBJ_COMMIT);
+	git_repository_cache_stats(&stats, g_repo);
+	cl_assert_equal_i(0, stats.hits);
+	cl_assert_equal_i(1, stats.count);
+	cl_assert(stats.used > 0);
+
+	two = lookup(commit_id, GIT_OBJ_COMMIT);
+	git_repository_cache_stats(&stats, g_repo);
+	cl_assert_equal_i(1, stats.hits);
+	cl_assert(one == two);
+
+	git_object_free(one);
+	git_object_free(two);
+}
+
+void test_object_cache__zero_limit_disables_caching(void)
+{
+	git_object *one, *two;
+	git_cache_stats stats;
+
+	cl_git_pass(git_repository_set_cache_limit(g_repo, GIT_OBJ_ANY, 0));
+
+	one = lookup(commit_id, GIT_OBJ_COMMIT);
+	two = lookup(commit_id, GIT_OBJ_COMMIT);
+	cl_assert(one != two);
+	cl_assert(git_oid_cmp(git_object_id(one), git_object_id(two)) == 0);
+
+	git_repository_cache_stats(&stats, g_repo);
+	cl_assert_equal_i(0, stats.count);
+	cl_assert_equal_i(0, stats.hits);
+
+	git_object_free(one);
+	git_object_free(two);
+}
+
+void test_object_cache__stays_within_budget(void)
+{
+	git_cache_stats stats;
+
+	load_history();
+	git_repository_cache_stats(&stats, g_repo);
+	cl_assert(stats.count > 0);
+	cl_assert_equal_i(0, stats.evictions);
+
+	cl_git_pass(git_repository_set_cache_limit(g_repo, GIT_OBJ_ANY, 16 * 1024));
+	git_repository_cache_stats(&stats, g_repo);
+	cl_assert(stats.used <= 16 * 1024);
+	cl_assert(stats.evictions > 0);
+
+	load_history();
+	git_repository_cache_stats(&stats, g_repo);
+	cl_assert(stats.used <= 16 * 1024);
+	cl_assert_equal_sz(16 * 1024, stats.limit);
+}
+
+void test_object_cache__per_type_limit(void)
+{
+	git_object *blob, *commit;
+	git_cache_stats stats;
+
+	cl_git_pass(git_repository_set_cache_limit(g_repo, GIT_OBJ_BLOB, 0));
+
+	blob = lookup(blob_id, GIT_OBJ_BLOB);
+	git_repository_cache_stats(&stats, g_repo);
+	cl_assert_equal_i(0, stats.count);
+
+	commit = lookup(commit_id, GIT_OBJ_COMMIT);
+	git_repository_cache_stats(&stats, g_repo);
+	cl_assert_equal_i(1, stats.count);
+
+	git_object_free(blob);
+	git_object_free(commit);
+}
+
+void test_object_cache__invalid_type(void)
+{
+	cl_git_fail(git_repository_set_cache_limit(g_repo, GIT_OBJ_BAD, 0));
+}
+
+void test_object_cache__odb_cache(void)
+{
+	git_odb *odb;
+	git_odb_object *obj;
+	git_cache_stats stats;
+	git_oid oid;
+
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	cl_git_pass(git_oid_fromstr(&oid, blob_id));
+
+	cl_git_pass(git_odb_read(&obj, odb, &oid));
+	git_odb_object_free(obj);
+	cl_git_pass(git_odb_read(&obj, odb, &oid));
+	git_odb_object_free(obj);
+
+	git_odb_cache_stats(&stats, odb);
+	cl_assert_equal_i(1, stats.count);
+	cl_assert_equal_i(1, stats.hits);
+
+	cl_git_pass(git_odb_set_cache_limit(odb, GIT_OBJ_ANY, 0));
+	git_odb_cache_stats(&stats, odb);
+	cl_assert_equal_i(0, stats.count);
+
+	git_odb_free(odb);
+}
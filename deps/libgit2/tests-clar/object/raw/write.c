@@ -453,3 +453,38 @@ void test_object_raw_write__several_bytes(void)
 
    test_body(&some, &some_obj);
 }
+
+void test_object_raw_write__stream_in_chunks(void)
+{
+   git_odb *db;
+   git_odb_stream *stream;
+   git_oid id, expected;
+   const char *data = "streamed blob content\n";
+   size_t i, len = strlen(data);
+
+   make_odb_dir();
+   cl_git_pass(git_odb_open(&db, odb_dir));
+   cl_git_pass(git_odb_hash(&expected, data, len, GIT_OBJ_BLOB));
+
+   /* one byte at a time */
+   cl_git_pass(git_odb_open_wstream(&stream, db, len, GIT_OBJ_BLOB));
+   for (i = 0; i < len; ++i)
+      cl_git_pass(stream->write(stream, data + i, 1));
+   cl_git_pass(stream->finalize_write(&id, stream));
+   stream->free(stream);
+   cl_assert(git_oid_cmp(&expected, &id) == 0);
+
+   /* content must match the size given up front */
+   cl_git_pass(git_odb_open_wstream(&stream, db, len, GIT_OBJ_BLOB));
+   cl_git_pass(stream->write(stream, data, len - 1));
+   cl_git_fail(stream->finalize_write(&id, stream));
+   stream->free(stream);
+
+   cl_git_pass(git_odb_open_wstream(&stream, db, len, GIT_OBJ_BLOB));
+   cl_git_pass(stream->write(stream, data, len));
+   cl_git_fail(stream->write(stream, data, 1));
+   stream->free(stream);
+
+   git_odb_free(db);
+   cl_git_pass(git_futils_rmdir_r(odb_dir, NULL, GIT_RMDIR_REMOVE_FILES));
+}
@@ -0,0 +1,99 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+#include "pack_data.h"
+
+static git_odb *_odb;
+static size_t _limit;
+
+void test_odb_deltacache__initialize(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT, &_limit));
+	cl_git_pass(git_odb_open(&_odb, cl_fixture("testrepo.git/objects")));
+}
+
+void test_odb_deltacache__cleanup(void)
+{
+	git_odb_free(_odb);
+	_odb = NULL;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT, _limit));
+}
+
+static void read_packed_objects(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); ++i) {
+		git_oid id;
+		git_odb_object *obj;
+
+		cl_git_pass(git_oid_fromstr(&id, packed_objects[i]));
+		cl_git_pass(git_odb_read(&obj, _odb, &id));
+		git_odb_object_free(obj);
+	}
+}
+
+void test_odb_deltacache__bases_are_reused(void)
+{
+	git_cache_stats before, after;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_STATS, &before));
+	read_packed_objects();
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_STATS, &after));
+
+	cl_assert(after.count > 0);
+	cl_assert(after.used > 0);
+	cl_assert(after.used <= after.limit);
+	cl_assert(after.misses > before.misses);
+	cl_assert(after.hits > before.hits);
+}
+
+void test_odb_deltacache__freeing_the_pack_drops_its_bases(void)
+{
+	git_cache_stats stats;
+
+	/* start from an empty cache */
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT, (size_t)0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT, _limit));
+
+	read_packed_objects();
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_STATS, &stats));
+	cl_assert(stats.count > 0);
+
+	git_odb_free(_odb);
+	_odb = NULL;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_STATS, &stats));
+	cl_assert_equal_i(0, (int)stats.count);
+	cl_assert_equal_i(0, (int)stats.used);
+}
+
+void test_odb_deltacache__limit_is_honoured(void)
+{
+	git_cache_stats stats;
+	size_t limit;
+
+	read_packed_objects();
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT, (size_t)1024));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT, &limit));
+	cl_assert_equal_i(1024, (int)limit);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_STATS, &stats));
+	cl_assert(stats.used <= 1024);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT, (size_t)0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_STATS, &stats));
+	cl_assert_equal_i(0, (int)stats.count);
+
+	read_packed_objects();
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_STATS, &stats));
+	cl_assert_equal_i(0, (int)stats.count);
+}
+
+void test_odb_deltacache__unknown_option(void)
+{
+	cl_git_fail(git_libgit2_opts(-1));
+}
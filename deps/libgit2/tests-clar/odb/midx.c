@@ -0,0 +1,213 @@
+#include "clar_libgit2.h"
+#include "midx.h"
+#include "pack.h"
+#include "buffer.h"
+#include "posix.h"
+
+static const char *_idx[] = {
+	"testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695.idx",
+	"testrepo.git/objects/pack/pack-d7c6adf9f61318f041845b01440d09aa7a91e1b5.idx",
+	"testrepo.git/objects/pack/pack-d85f5d483273108c9d8dd0e4728ccf0b2982423a.idx",
+};
+
+static git_vector _packs;
+
+void test_odb_midx__initialize(void)
+{
+	size_t i;
+
+	cl_git_pass(git_vector_init(&_packs, 3, NULL));
+
+	for (i = 0; i < ARRAY_SIZE(_idx); ++i) {
+		struct git_pack_file *p;
+		cl_git_pass(git_packfile_check(&p, cl_fixture(_idx[i])));
+		cl_git_pass(git_vector_insert(&_packs, p));
+	}
+}
+
+void test_odb_midx__cleanup(void)
+{
+	size_t i;
+	struct git_pack_file *p;
+
+	git_vector_foreach(&_packs, i, p)
+		packfile_free(p);
+
+	git_vector_free(&_packs);
+}
+
+static void assert_covers(git_midx *midx, struct git_pack_file *p)
+{
+	uint32_t n;
+
+	cl_git_pass(git_pack__index_load(p));
+
+	for (n = 0; n < p->num_objects; ++n) {
+		struct git_pack_entry expected, found;
+		const git_oid *oid = git_pack__nth_oid(p, n);
+
+		cl_git_pass(git_midx_find(&found, midx, oid, GIT_OID_HEXSZ));
+		cl_assert(git_oid_cmp(&found.sha1, oid) == 0);
+
+		cl_git_pass(git_pack_entry_find(&expected, found.p, oid, GIT_OID_HEXSZ));
+		cl_assert(expected.offset == found.offset);
+	}
+}
+
+static size_t total_objects(void)
+{
+	size_t i, total = 0;
+	struct git_pack_file *p;
+
+	git_vector_foreach(&_packs, i, p) {
+		cl_git_pass(git_pack__index_load(p));
+		total += p->num_objects;
+	}
+
+	return total;
+}
+
+void test_odb_midx__finds_every_object(void)
+{
+	git_midx *midx;
+	size_t i;
+	struct git_pack_file *p;
+
+	cl_git_pass(git_midx_new(&midx, NULL, &_packs));
+	cl_assert_equal_i((int)total_objects(), (int)midx->length);
+
+	git_vector_foreach(&_packs, i, p)
+		assert_covers(midx, p);
+
+	git_midx_free(midx);
+}
+
+void test_odb_midx__prefers_earlier_packs(void)
+{
+	git_midx *midx;
+	size_t i, j;
+	struct git_pack_file *p;
+
+	cl_git_pass(git_midx_new(&midx, NULL, &_packs));
+
+	git_vector_foreach(&_packs, i, p) {
+		uint32_t n;
+
+		for (n = 0; n < p->num_objects; ++n) {
+			struct git_pack_entry found;
+			cl_git_pass(git_midx_find(&found, midx, git_pack__nth_oid(p, n), GIT_OID_HEXSZ));
+
+			/* the pack we got it from must come no later than this one */
+			for (j = 0; j < _packs.length; ++j)
+				if (_packs.contents[j] == found.p)
+					break;
+			cl_assert(j <= i);
+		}
+	}
+
+	git_midx_free(midx);
+}
+
+void test_odb_midx__prefix_lookups(void)
+{
+	git_midx *midx;
+	git_oid id;
+	struct git_pack_entry found;
+	size_t i;
+
+	cl_git_pass(git_midx_new(&midx, NULL, &_packs));
+
+	cl_git_pass(git_pack__index_load(_packs.contents[0]));
+	git_oid_cpy(&id, git_pack__nth_oid(_packs.contents[0], 0));
+	cl_git_pass(git_midx_find(&found, midx, &id, 7));
+	cl_assert(git_oid_cmp(&found.sha1, &id) == 0);
+
+	cl_git_pass(git_oid_fromstrn(&id, "0000000", 7));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_midx_find(&found, midx, &id, 7));
+
+	/* two different objects sharing their first byte */
+	for (i = 1; i < midx->length; ++i) {
+		if (midx->entries[i].oid->id[0] == midx->entries[i - 1].oid->id[0] &&
+			git_oid_cmp(midx->entries[i].oid, midx->entries[i - 1].oid) != 0)
+			break;
+	}
+	cl_assert(i < midx->length);
+
+	git_oid_cpy(&id, midx->entries[i].oid);
+	cl_assert_equal_i(GIT_EAMBIGUOUS, git_midx_find(&found, midx, &id, 2));
+
+	git_midx_free(midx);
+}
+
+void test_odb_midx__incremental_rebuilds(void)
+{
+	git_midx *base, *grown, *shrunk;
+	git_vector some;
+	struct git_pack_file *dropped;
+
+	/* start with the first two packs, then add the third */
+	cl_git_pass(git_vector_init(&some, 3, NULL));
+	cl_git_pass(git_vector_insert(&some, _packs.contents[0]));
+	cl_git_pass(git_vector_insert(&some, _packs.contents[1]));
+	cl_git_pass(git_midx_new(&base, NULL, &some));
+
+	cl_git_pass(git_midx_new(&grown, base, &_packs));
+	cl_assert_equal_i((int)total_objects(), (int)grown->length);
+	assert_covers(grown, _packs.contents[2]);
+	assert_covers(grown, _packs.contents[0]);
+
+	/* now forget about the first one */
+	dropped = _packs.contents[0];
+	git_vector_clear(&some);
+	cl_git_pass(git_vector_insert(&some, _packs.contents[1]));
+	cl_git_pass(git_vector_insert(&some, _packs.contents[2]));
+	cl_git_pass(git_midx_new(&shrunk, grown, &some));
+
+	cl_assert_equal_i((int)(grown->length - dropped->num_objects), (int)shrunk->length);
+	assert_covers(shrunk, _packs.contents[1]);
+	assert_covers(shrunk, _packs.contents[2]);
+
+	/* readers of the older indexes are not affected */
+	assert_covers(base, _packs.contents[0]);
+
+	git_midx_free(shrunk);
+	git_midx_free(grown);
+	git_midx_free(base);
+	git_vector_free(&some);
+}
+
+void test_odb_midx__packs_removed_since_are_looked_up_again(void)
+{
+	git_odb *odb;
+	git_odb_object *obj;
+	git_oid oid;
+	const char *pack = "testrepo.git/objects/pack/pack-d85f5d483273108c9d8dd0e4728ccf0b2982423a";
+	const char *repacked = "testrepo.git/objects/pack/pack-0000000000000000000000000000000000000000";
+	git_buf from = GIT_BUF_INIT, to = GIT_BUF_INIT;
+
+	cl_git_sandbox_init("testrepo.git");
+	cl_git_pass(git_odb_open(&odb, "testrepo.git/objects"));
+
+	/* builds the index, without opening any pack */
+	cl_git_pass(git_oid_fromstr(&oid, "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_odb_read(&obj, odb, &oid));
+
+	/* as `git repack` would leave it: the same objects, in another pack */
+	cl_git_pass(git_buf_printf(&from, "%s.pack", pack));
+	cl_git_pass(git_buf_printf(&to, "%s.pack", repacked));
+	cl_git_pass(p_rename(from.ptr, to.ptr));
+	git_buf_clear(&from);
+	git_buf_clear(&to);
+	cl_git_pass(git_buf_printf(&from, "%s.idx", pack));
+	cl_git_pass(git_buf_printf(&to, "%s.idx", repacked));
+	cl_git_pass(p_rename(from.ptr, to.ptr));
+
+	cl_git_pass(git_oid_fromstr(&oid, "0266163a49e280c4f5ed1e08facd36a2bd716bcf"));
+	cl_git_pass(git_odb_read(&obj, odb, &oid));
+	git_odb_object_free(obj);
+
+	git_buf_free(&from);
+	git_buf_free(&to);
+	git_odb_free(odb);
+	cl_git_sandbox_cleanup();
+}
@@ -0,0 +1,89 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+
+static git_odb *_odb;
+static size_t _window_size, _mapped_limit;
+static unsigned int _file_limit;
+
+void test_odb_mwindow__initialize(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_MWINDOW_SIZE, &_window_size));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_MWINDOW_MAPPED_LIMIT, &_mapped_limit));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_MWINDOW_FILE_LIMIT, &_file_limit));
+	cl_git_pass(git_odb_open(&_odb, cl_fixture("testrepo.git/objects")));
+}
+
+void test_odb_mwindow__cleanup(void)
+{
+	git_odb_free(_odb);
+	_odb = NULL;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, _window_size));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_MWINDOW_MAPPED_LIMIT, _mapped_limit));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_MWINDOW_FILE_LIMIT, _file_limit));
+}
+
+static int read_cb(const git_oid *oid, void *payload)
+{
+	git_odb_object *obj;
+
+	GIT_UNUSED(payload);
+	cl_git_pass(git_odb_read(&obj, _odb, oid));
+	git_odb_object_free(obj);
+	return 0;
+}
+
+void test_odb_mwindow__options(void)
+{
+	size_t size;
+	unsigned int files;
+
+	cl_git_fail(git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, (size_t)0));
+	cl_git_fail(git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, (size_t)1000));
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, (size_t)(256 * 1024)));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_MWINDOW_SIZE, &size));
+	cl_assert_equal_i(256 * 1024, size);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_MWINDOW_FILE_LIMIT, 4));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_MWINDOW_FILE_LIMIT, &files));
+	cl_assert_equal_i(4, files);
+
+	cl_git_fail(git_odb_set_mwindow_limits(_odb, 1000, 0, 0));
+}
+
+void test_odb_mwindow__database_limits(void)
+{
+	git_mwindow_stats stats;
+
+	cl_git_pass(git_odb_set_mwindow_limits(_odb, 128 * 1024, 128 * 1024, 0));
+	cl_git_pass(git_odb_foreach(_odb, read_cb, NULL));
+	cl_git_pass(git_odb_mwindow_stats(&stats, _odb));
+
+	cl_assert_equal_i(128 * 1024, stats.window_size);
+	cl_assert_equal_i(128 * 1024, stats.mapped_limit);
+	cl_assert(stats.mmap_calls > 1);
+	cl_assert(stats.mapped <= stats.mapped_limit);
+	cl_assert(stats.open_windows < stats.mmap_calls);
+	cl_assert(stats.open_files > 0);
+}
+
+void test_odb_mwindow__file_limit_closes_packs(void)
+{
+	git_mwindow_stats before, after, db;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_MWINDOW_FILE_LIMIT, 1));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_MWINDOW_STATS, &before));
+
+	/* twice, so closed packs have to be reopened */
+	cl_git_pass(git_odb_foreach(_odb, read_cb, NULL));
+	cl_git_pass(git_odb_foreach(_odb, read_cb, NULL));
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_MWINDOW_STATS, &after));
+	cl_git_pass(git_odb_mwindow_stats(&db, _odb));
+
+	cl_assert_equal_i(1, after.file_limit);
+	cl_assert(after.file_closes > before.file_closes);
+	cl_assert_equal_i(1, db.open_files);
+	cl_assert(db.file_closes > 0);
+}
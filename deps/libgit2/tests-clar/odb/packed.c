@@ -77,3 +77,27 @@ void test_odb_packed__read_header_1(void)
 	}
 }
 
+
+void test_odb_packed__read_header_is_cached(void)
+{
+	int i, pass;
+
+	/* headers first, walking backwards so bases are resolved late */
+	for (pass = 0; pass < 2; ++pass) {
+		for (i = (int)ARRAY_SIZE(packed_objects) - 1; i >= 0; --i) {
+			git_oid id;
+			git_odb_object *obj;
+			size_t len;
+			git_otype type;
+
+			cl_git_pass(git_oid_fromstr(&id, packed_objects[i]));
+			cl_git_pass(git_odb_read_header(&len, &type, _odb, &id));
+			cl_git_pass(git_odb_read(&obj, _odb, &id));
+
+			cl_assert_equal_i(obj->raw.len, len);
+			cl_assert_equal_i(obj->raw.type, type);
+
+			git_odb_object_free(obj);
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#include "clar_libgit2.h"
+#include "odb.h"
+#include "buffer.h"
+#include "pack_data.h"
+
+static git_odb *_odb;
+
+void test_odb_readstream__initialize(void)
+{
+	cl_git_pass(git_odb_open(&_odb, cl_fixture("testrepo.git/objects")));
+}
+
+void test_odb_readstream__cleanup(void)
+{
+	git_odb_free(_odb);
+	_odb = NULL;
+}
+
+/* reads with an odd chunk size, to cross windows and zlib blocks */
+static void check_stream(const char *sha)
+{
+	git_oid id;
+	git_odb_object *obj;
+	git_odb_stream *stream;
+	git_buf out = GIT_BUF_INIT;
+	char chunk[1021];
+	int bytes;
+
+	cl_git_pass(git_oid_fromstr(&id, sha));
+	cl_git_pass(git_odb_read(&obj, _odb, &id));
+	cl_git_pass(git_odb_open_rstream(&stream, _odb, &id));
+	cl_assert_equal_i(GIT_STREAM_RDONLY, stream->mode);
+
+	while ((bytes = stream->read(stream, chunk, sizeof(chunk))) > 0)
+		cl_git_pass(git_buf_put(&out, chunk, bytes));
+	cl_assert(bytes == 0);
+
+	cl_assert_equal_i(obj->raw.len, git_buf_len(&out));
+	cl_assert(memcmp(obj->raw.data, out.ptr, out.size) == 0);
+
+	stream->free(stream);
+	git_buf_free(&out);
+	git_odb_object_free(obj);
+}
+
+void test_odb_readstream__packed(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(packed_objects); ++i)
+		check_stream(packed_objects[i]);
+}
+
+void test_odb_readstream__loose(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(loose_objects); ++i)
+		check_stream(loose_objects[i]);
+}
+
+void test_odb_readstream__missing(void)
+{
+	git_oid id;
+	git_odb_stream *stream;
+
+	cl_git_pass(git_oid_fromstr(&id, "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_odb_open_rstream(&stream, _odb, &id));
+}
@@ -0,0 +1,149 @@
+#include "clar_libgit2.h"
+#include "pack_bitmap.h"
+#include "repository.h"
+
+static git_repository *_repo;
+static git_oid _tips[4];
+
+static const char *tip_names[] = {
+	"refs/heads/master",
+	"refs/heads/br2",
+	"refs/tags/test",
+	"refs/heads/subtrees",
+};
+
+void test_pack_bitmap__initialize(void)
+{
+	size_t i;
+
+	_repo = cl_git_sandbox_init("testrepo.git");
+
+	for (i = 0; i < ARRAY_SIZE(tip_names); ++i)
+		cl_git_pass(git_reference_name_to_id(&_tips[i], _repo, tip_names[i]));
+}
+
+void test_pack_bitmap__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+	_repo = NULL;
+}
+
+static unsigned int count_objects(
+	const git_oid *wants, size_t nwants, const git_oid *haves, size_t nhaves)
+{
+	git_packbuilder *pb;
+	unsigned int count;
+
+	cl_git_pass(git_packbuilder_new(&pb, _repo));
+	cl_git_pass(git_packbuilder_insert_reachable(pb, wants, nwants, haves, nhaves));
+	count = git_packbuilder_object_count(pb);
+	git_packbuilder_free(pb);
+
+	return count;
+}
+
+static git_transfer_progress stats;
+static int index_cb(void *buf, size_t len, void *payload)
+{
+	return git_indexer_stream_add(payload, buf, len, &stats);
+}
+
+/* puts everything reachable from the tips in a pack of its own */
+static void repack(git_buf *path)
+{
+	git_packbuilder *pb;
+	git_indexer_stream *idx;
+	char hash[GIT_OID_HEXSZ + 1];
+
+	cl_git_pass(git_packbuilder_new(&pb, _repo));
+	cl_git_pass(git_packbuilder_insert_reachable(pb, _tips, ARRAY_SIZE(_tips), NULL, 0));
+
+	cl_git_pass(git_indexer_stream_new(&idx, "testrepo.git/objects/pack", NULL, NULL));
+	cl_git_pass(git_packbuilder_foreach(pb, index_cb, idx));
+	cl_git_pass(git_indexer_stream_finalize(idx, &stats));
+
+	git_oid_tostr(hash, sizeof(hash), git_indexer_stream_hash(idx));
+	cl_git_pass(git_buf_printf(path, "testrepo.git/objects/pack/pack-%s.pack", hash));
+
+	git_indexer_stream_free(idx);
+	git_packbuilder_free(pb);
+}
+
+static void check_counts(void)
+{
+	cl_assert_equal_i(39, count_objects(_tips, ARRAY_SIZE(_tips), NULL, 0));
+	cl_assert_equal_i(10, count_objects(&_tips[3], 1, &_tips[0], 1));
+
+	/* the tree of br2 is also the one of a merge below master */
+	cl_assert_equal_i(4, count_objects(&_tips[0], 1, &_tips[1], 1));
+}
+
+void test_pack_bitmap__enumerate_with_bitmaps(void)
+{
+	git_pack_bitmap *bitmap;
+	git_buf path = GIT_BUF_INIT;
+	size_t count;
+
+	check_counts();
+
+	cl_git_pass(git_repository__pack_bitmap(&bitmap, _repo));
+	cl_assert(bitmap == NULL);
+
+	repack(&path);
+	cl_git_pass(git_pack_write_bitmaps(&count, _repo, path.ptr));
+	git_buf_free(&path);
+	cl_assert(count >= ARRAY_SIZE(_tips));
+
+	cl_git_pass(git_repository__pack_bitmap(&bitmap, _repo));
+	cl_assert(bitmap != NULL);
+	cl_assert_equal_i(count, bitmap->num_entries);
+	cl_assert_equal_i(39, git_bitmap_count(&bitmap->commits) +
+		git_bitmap_count(&bitmap->trees) + git_bitmap_count(&bitmap->blobs) +
+		git_bitmap_count(&bitmap->tags));
+	git_pack_bitmap_free(bitmap);
+
+	check_counts();
+}
+
+void test_pack_bitmap__haves_missing_from_the_repository(void)
+{
+	git_oid haves[2];
+
+	cl_git_pass(git_oid_fromstr(&haves[0], "deadbeefdeadbeefdeadbeefdeadbeefdeadbeef"));
+	git_oid_cpy(&haves[1], &_tips[1]);
+
+	cl_assert_equal_i(4, count_objects(&_tips[0], 1, haves, 2));
+}
+
+static void check_reachability(void)
+{
+	git_oid blob, parent;
+
+	cl_git_pass(git_oid_fromstr(&blob, "3697d64be941a53d4ae8f6a271e4e3fa56b022cc"));
+	cl_git_pass(git_oid_fromstr(&parent, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"));
+
+	cl_assert_equal_i(1, git_graph_reachable_from_any(_repo, &blob, &_tips[0], 1));
+	cl_assert_equal_i(0, git_graph_reachable_from_any(_repo, &blob, &_tips[1], 1));
+	cl_assert_equal_i(1, git_graph_reachable_from_any(_repo, &blob, _tips, 2));
+
+	cl_assert_equal_i(1, git_graph_reachable_from_any(_repo, &parent, &_tips[0], 1));
+	cl_assert_equal_i(1, git_graph_reachable_from_any(_repo, &_tips[0], &_tips[0], 1));
+	cl_assert_equal_i(0, git_graph_reachable_from_any(_repo, &_tips[0], &parent, 1));
+	cl_assert_equal_i(0, git_graph_reachable_from_any(_repo, &_tips[1], &_tips[0], 1));
+	cl_assert_equal_i(0, git_graph_reachable_from_any(_repo, &_tips[0], NULL, 0));
+}
+
+void test_pack_bitmap__reachable_from_any(void)
+{
+	git_buf path = GIT_BUF_INIT;
+
+	check_reachability();
+
+	repack(&path);
+	cl_git_pass(git_pack_write_bitmaps(NULL, _repo, path.ptr));
+	git_buf_free(&path);
+	check_reachability();
+
+	cl_git_pass(git_graph_write(NULL, _repo, NULL, 0));
+	check_reachability();
+}
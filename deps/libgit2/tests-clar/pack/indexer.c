@@ -0,0 +1,147 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+
+#define TEST_PACK "testrepo.git/objects/pack/pack-a81e489679b7d3418f9ab594bda8ceb37dd4c695"
+
+/* feed the pack as it would arrive from the network */
+#define CHUNK_SIZE 8192
+
+static int progress_calls;
+
+static int progress_cb(const git_transfer_progress *stats, void *payload)
+{
+	GIT_UNUSED(stats);
+	GIT_UNUSED(payload);
+	progress_calls++;
+	return 0;
+}
+
+/* cancels once all but `payload` objects are indexed */
+static int cancel_cb(const git_transfer_progress *stats, void *payload)
+{
+	unsigned int left = *(unsigned int *)payload;
+
+	progress_calls++;
+	return stats->total_objects > 0 &&
+		stats->indexed_objects + left >= stats->total_objects;
+}
+
+void test_pack_indexer__initialize(void)
+{
+	progress_calls = 0;
+	cl_git_pass(p_mkdir("indexed", 0777));
+}
+
+void test_pack_indexer__cleanup(void)
+{
+	cl_git_pass(git_futils_rmdir_r("indexed", NULL, GIT_RMDIR_REMOVE_FILES));
+}
+
+static void index_pack(git_oid *hash, git_buf *idx_data, unsigned int threads)
+{
+	git_indexer_stream *idx;
+	git_transfer_progress stats;
+	git_buf pack = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	char name[GIT_OID_HEXSZ + 1];
+	size_t off;
+
+	cl_git_pass(git_futils_readbuffer(&pack, cl_fixture(TEST_PACK ".pack")));
+
+	cl_git_pass(git_indexer_stream_new(&idx, "indexed", progress_cb, NULL));
+	cl_assert_equal_i(threads, git_indexer_stream_set_threads(idx, threads));
+	for (off = 0; off < pack.size; off += CHUNK_SIZE)
+		cl_git_pass(git_indexer_stream_add(idx, pack.ptr + off,
+			min(CHUNK_SIZE, pack.size - off), &stats));
+	cl_git_pass(git_indexer_stream_finalize(idx, &stats));
+	cl_assert_equal_i(stats.total_objects, stats.indexed_objects);
+
+	git_oid_cpy(hash, git_indexer_stream_hash(idx));
+	git_indexer_stream_free(idx);
+
+	git_oid_tostr(name, sizeof(name), hash);
+	cl_git_pass(git_buf_printf(&path, "indexed/pack-%s.idx", name));
+	cl_git_pass(git_futils_readbuffer(idx_data, path.ptr));
+
+	cl_git_pass(p_unlink(path.ptr));
+	git_buf_truncate(&path, path.size - strlen(".idx"));
+	cl_git_pass(git_buf_puts(&path, ".pack"));
+	cl_git_pass(p_unlink(path.ptr));
+
+	git_buf_free(&path);
+	git_buf_free(&pack);
+}
+
+void test_pack_indexer__threads_produce_same_index(void)
+{
+	git_oid serial_hash, threaded_hash;
+	git_buf serial = GIT_BUF_INIT, threaded = GIT_BUF_INIT, expected = GIT_BUF_INIT;
+
+	index_pack(&serial_hash, &serial, 1);
+	index_pack(&threaded_hash, &threaded, 4);
+
+	cl_git_pass(git_futils_readbuffer(&expected, cl_fixture(TEST_PACK ".idx")));
+
+	cl_assert(git_oid_cmp(&serial_hash, &threaded_hash) == 0);
+	cl_assert_equal_i(expected.size, serial.size);
+	cl_assert(memcmp(expected.ptr, serial.ptr, serial.size) == 0);
+	cl_assert_equal_i(serial.size, threaded.size);
+	cl_assert(memcmp(serial.ptr, threaded.ptr, serial.size) == 0);
+	cl_assert(progress_calls > 0);
+
+	git_buf_free(&expected);
+	git_buf_free(&threaded);
+	git_buf_free(&serial);
+}
+
+void test_pack_indexer__default_threads(void)
+{
+	unsigned int threads;
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_INDEXER_THREADS, &threads));
+	cl_assert_equal_i(1, threads);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEXER_THREADS, 0));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_INDEXER_THREADS, &threads));
+	cl_assert_equal_i(0, threads);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEXER_THREADS, 1));
+}
+
+static void cancel_indexing(unsigned int threads)
+{
+	git_indexer_stream *idx;
+	git_transfer_progress stats;
+	git_buf pack = GIT_BUF_INIT;
+	unsigned int left = 500;
+	size_t off;
+
+	cl_git_pass(git_futils_readbuffer(&pack, cl_fixture(TEST_PACK ".pack")));
+
+	/* cancelling while resolving deltas */
+	cl_git_pass(git_indexer_stream_new(&idx, "indexed", cancel_cb, &left));
+	git_indexer_stream_set_threads(idx, threads);
+	for (off = 0; off < pack.size; off += CHUNK_SIZE)
+		cl_git_pass(git_indexer_stream_add(idx, pack.ptr + off,
+			min(CHUNK_SIZE, pack.size - off), &stats));
+	cl_assert_equal_i(GIT_EUSER, git_indexer_stream_finalize(idx, &stats));
+	cl_assert(stats.indexed_objects < stats.total_objects);
+	git_indexer_stream_free(idx);
+	/* the temporary pack goes with the indexer */
+	cl_assert(git_path_is_empty_dir("indexed"));
+
+	/* and while receiving the pack */
+	left = (unsigned int)-1;
+	cl_git_pass(git_indexer_stream_new(&idx, "indexed", cancel_cb, &left));
+	cl_assert_equal_i(GIT_EUSER,
+		git_indexer_stream_add(idx, pack.ptr, pack.size, &stats));
+	git_indexer_stream_free(idx);
+	cl_assert(git_path_is_empty_dir("indexed"));
+
+	git_buf_free(&pack);
+}
+
+void test_pack_indexer__progress_callback_can_cancel(void)
+{
+	cancel_indexing(1);
+	cancel_indexing(4);
+}
@@ -0,0 +1,170 @@
+#include "clar_libgit2.h"
+#include "refs.h"
+
+static git_repository *repo;
+
+void test_refs_foreachtarget__initialize(void)
+{
+	cl_fixture_sandbox("testrepo.git");
+	cl_git_pass(git_repository_open(&repo, "testrepo.git"));
+}
+
+void test_refs_foreachtarget__cleanup(void)
+{
+	git_repository_free(repo);
+	repo = NULL;
+
+	cl_fixture_cleanup("testrepo.git");
+}
+
+static int count_cb(const char *reference_name, void *payload)
+{
+	GIT_UNUSED(reference_name);
+	(*(int *)payload)++;
+	return 0;
+}
+
+/* every direct ref must point where a lookup says it does */
+static int check_cb(const git_reference_target_entry *entry, void *payload)
+{
+	git_oid oid;
+
+	(*(int *)payload)++;
+
+	if (entry->symbolic == NULL) {
+		cl_git_pass(git_reference_name_to_id(&oid, repo, entry->name));
+		cl_assert(git_oid_cmp(&oid, &entry->target) == 0);
+	}
+
+	return 0;
+}
+
+static void assert_same_as_glob(const char *glob)
+{
+	int expected = 0, count = 0;
+
+	cl_git_pass(git_reference_foreach_glob(repo, glob, GIT_REF_LISTALL, count_cb, &expected));
+	cl_git_pass(git_reference_foreach_target(repo, glob, 1, check_cb, &count));
+
+	cl_assert_equal_i(expected, count);
+}
+
+void test_refs_foreachtarget__lists_the_same_refs_as_a_glob(void)
+{
+	int count = 0;
+
+	assert_same_as_glob("*");
+	assert_same_as_glob("refs/tags/*");
+	assert_same_as_glob("refs/heads/packed*");
+
+	cl_git_pass(git_reference_foreach_target(repo, NULL, 1, check_cb, &count));
+	cl_assert_equal_i(20, count);
+}
+
+struct found {
+	const char *name;
+	git_reference_target_entry entry;
+	char symbolic[GIT_REFNAME_MAX];
+	bool seen;
+};
+
+static int find_cb(const git_reference_target_entry *entry, void *payload)
+{
+	struct found *found = payload;
+
+	if (strcmp(entry->name, found->name) == 0) {
+		found->entry = *entry;
+		found->seen = true;
+		if (entry->symbolic)
+			strncpy(found->symbolic, entry->symbolic, GIT_REFNAME_MAX - 1);
+	}
+
+	return 0;
+}
+
+static void find(struct found *found, const char *name, int resolve)
+{
+	memset(found, 0x0, sizeof(*found));
+	found->name = name;
+	cl_git_pass(git_reference_foreach_target(repo, NULL, resolve, find_cb, found));
+	cl_assert(found->seen);
+}
+
+void test_refs_foreachtarget__resolves_symbolic_refs_when_asked(void)
+{
+	git_reference *ref;
+	git_oid master;
+	struct found found;
+
+	cl_git_pass(git_reference_name_to_id(&master, repo, "refs/heads/master"));
+	cl_git_pass(git_reference_symbolic_create(&ref, repo, "refs/heads/symbolic", "refs/heads/master", 0));
+	git_reference_free(ref);
+	cl_git_pass(git_reference_symbolic_create(&ref, repo, "refs/heads/dangling", "refs/heads/nowhere", 0));
+	git_reference_free(ref);
+
+	find(&found, "refs/heads/symbolic", 1);
+	cl_assert_equal_s("refs/heads/master", found.symbolic);
+	cl_assert(git_oid_cmp(&master, &found.entry.target) == 0);
+
+	find(&found, "refs/heads/symbolic", 0);
+	cl_assert_equal_s("refs/heads/master", found.symbolic);
+	cl_assert(git_oid_iszero(&found.entry.target));
+
+	find(&found, "refs/heads/dangling", 1);
+	cl_assert_equal_s("refs/heads/nowhere", found.symbolic);
+	cl_assert(git_oid_iszero(&found.entry.target));
+}
+
+void test_refs_foreachtarget__gives_the_peeled_targets_of_packed_refs(void)
+{
+	git_object *tag, *peeled;
+	struct found found;
+
+	find(&found, "refs/tags/test", 1);
+	cl_assert(git_oid_iszero(&found.entry.peeled));
+
+	cl_git_pass(git_reference_packall(repo));
+
+	cl_git_pass(git_object_lookup(&tag, repo, &found.entry.target, GIT_OBJ_TAG));
+	cl_git_pass(git_object_peel(&peeled, tag, GIT_OBJ_ANY));
+
+	find(&found, "refs/tags/test", 1);
+	cl_assert(git_oid_cmp(git_object_id(peeled), &found.entry.peeled) == 0);
+
+	git_object_free(peeled);
+	git_object_free(tag);
+
+	/* lightweight tags peel to themselves */
+	find(&found, "refs/tags/point_to_blob", 1);
+	cl_assert(git_oid_cmp(&found.entry.target, &found.entry.peeled) == 0);
+
+	/* outside of refs/tags/, "peeled" packed-refs files tell nothing */
+	find(&found, "refs/heads/master", 1);
+	cl_assert(git_oid_iszero(&found.entry.peeled));
+}
+
+void test_refs_foreachtarget__a_loose_ref_hides_the_packed_one(void)
+{
+	git_oid loose;
+	struct found found;
+
+	/* refs/heads/packed-test is both packed and loose */
+	cl_git_pass(git_reference_name_to_id(&loose, repo, "refs/heads/packed-test"));
+
+	find(&found, "refs/heads/packed-test", 1);
+	cl_assert(git_oid_cmp(&loose, &found.entry.target) == 0);
+}
+
+static int stop_cb(const git_reference_target_entry *entry, void *payload)
+{
+	GIT_UNUSED(entry);
+	return ++(*(int *)payload) == 3;
+}
+
+void test_refs_foreachtarget__can_be_interrupted(void)
+{
+	int count = 0;
+
+	cl_assert_equal_i(GIT_EUSER, git_reference_foreach_target(repo, NULL, 1, stop_cb, &count));
+	cl_assert_equal_i(3, count);
+}
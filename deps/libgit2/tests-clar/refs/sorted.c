@@ -0,0 +1,148 @@
+#include "clar_libgit2.h"
+
+#include "repository.h"
+#include "refs.h"
+
+#define REF_COUNT 500
+
+static const char *master_oid = "a65fedf39aefe402d3bb6e24df4d4f5fe4547750";
+
+static git_repository *g_repo;
+
+/*
+ * Write a sorted packed-refs file with refs/many/0000 up to
+ * refs/many/0499, every other one missing until REF_COUNT / 2
+ */
+static void write_sorted_packfile(void)
+{
+	git_buf contents = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	int i;
+
+	git_buf_puts(&contents, "# pack-refs with: peeled fully-peeled sorted \n");
+	for (i = 0; i < REF_COUNT; ++i) {
+		if (i < REF_COUNT / 2 && i % 2)
+			continue;
+		git_buf_printf(&contents, "%s refs/many/%04d\n", master_oid, i);
+	}
+	cl_assert(!git_buf_oom(&contents));
+
+	cl_git_pass(git_buf_joinpath(&path, g_repo->path_repository, GIT_PACKEDREFS_FILE));
+	cl_git_rewritefile(path.ptr, contents.ptr);
+
+	git_buf_free(&contents);
+	git_buf_free(&path);
+}
+
+void test_refs_sorted__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("testrepo.git");
+	write_sorted_packfile();
+}
+
+void test_refs_sorted__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+void test_refs_sorted__lookups_bisect_the_mapped_file(void)
+{
+	char name[GIT_REFNAME_MAX];
+	git_oid expected, oid;
+	int i;
+
+	cl_git_pass(git_oid_fromstr(&expected, master_oid));
+
+	for (i = 0; i < REF_COUNT; ++i) {
+		p_snprintf(name, sizeof(name), "refs/many/%04d", i);
+
+		if (i < REF_COUNT / 2 && i % 2) {
+			cl_assert_equal_i(GIT_ENOTFOUND, git_reference_name_to_id(&oid, g_repo, name));
+		} else {
+			cl_git_pass(git_reference_name_to_id(&oid, g_repo, name));
+			cl_assert(git_oid_cmp(&expected, &oid) == 0);
+		}
+	}
+
+	cl_assert_equal_i(GIT_ENOTFOUND, git_reference_name_to_id(&oid, g_repo, "refs/many/00"));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_reference_name_to_id(&oid, g_repo, "refs/many/9999"));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_reference_name_to_id(&oid, g_repo, "refs/a"));
+
+	/* nothing got loaded in memory for that */
+	cl_assert(g_repo->references.packfile_map != NULL);
+	cl_assert_equal_i(0, (int)git_strmap_num_entries(g_repo->references.packfile));
+}
+
+static int count_cb(const char *reference_name, void *payload)
+{
+	GIT_UNUSED(reference_name);
+	(*(int *)payload)++;
+	return 0;
+}
+
+void test_refs_sorted__globs_only_read_the_matching_records(void)
+{
+	int count = 0;
+
+	/* 0100, 0102... 0198 */
+	cl_git_pass(git_reference_foreach_glob(g_repo, "refs/many/01*", GIT_REF_LISTALL, count_cb, &count));
+	cl_assert_equal_i(50, count);
+
+	count = 0;
+	cl_git_pass(git_reference_foreach_glob(g_repo, "refs/many/04*", GIT_REF_LISTALL, count_cb, &count));
+	cl_assert_equal_i(100, count);
+
+	count = 0;
+	cl_git_pass(git_reference_foreach_glob(g_repo, "refs/many/*", GIT_REF_LISTALL, count_cb, &count));
+	cl_assert_equal_i(REF_COUNT * 3 / 4, count);
+}
+
+void test_refs_sorted__deleting_keeps_the_rest_of_the_file(void)
+{
+	git_buf path = GIT_BUF_INIT, contents = GIT_BUF_INIT;
+	git_reference *ref;
+	git_oid oid;
+	int count = 0;
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/many/0300"));
+	cl_assert(git_reference_is_packed(ref));
+	cl_git_pass(git_reference_delete(ref));
+
+	cl_assert_equal_i(GIT_ENOTFOUND, git_reference_name_to_id(&oid, g_repo, "refs/many/0300"));
+	cl_git_pass(git_reference_name_to_id(&oid, g_repo, "refs/many/0301"));
+	cl_git_pass(git_reference_name_to_id(&oid, g_repo, "refs/many/0298"));
+
+	cl_git_pass(git_reference_foreach_glob(g_repo, "refs/many/*", GIT_REF_LISTALL, count_cb, &count));
+	cl_assert_equal_i(REF_COUNT * 3 / 4 - 1, count);
+
+	/* the traits of the file were kept */
+	cl_git_pass(git_buf_joinpath(&path, g_repo->path_repository, GIT_PACKEDREFS_FILE));
+	cl_git_pass(git_futils_readbuffer(&contents, path.ptr));
+	cl_assert(git__prefixcmp(contents.ptr, "# pack-refs with: peeled fully-peeled sorted \n") == 0);
+	cl_assert(strstr(contents.ptr, "refs/many/0300") == NULL);
+
+	git_buf_free(&contents);
+	git_buf_free(&path);
+}
+
+void test_refs_sorted__packing_writes_a_sorted_file(void)
+{
+	git_oid oid;
+
+	cl_git_pass(git_reference_packall(g_repo));
+
+	cl_git_pass(git_reference_name_to_id(&oid, g_repo, "refs/heads/master"));
+	cl_git_pass(git_reference_name_to_id(&oid, g_repo, "refs/many/0499"));
+	cl_assert(g_repo->references.packfile_map != NULL);
+}
+
+void test_refs_sorted__unsorted_files_are_loaded_in_memory(void)
+{
+	git_oid oid;
+
+	cl_git_sandbox_cleanup();
+	g_repo = cl_git_sandbox_init("testrepo.git");
+
+	cl_git_pass(git_reference_name_to_id(&oid, g_repo, "refs/heads/packed"));
+	cl_assert(g_repo->references.packfile_map == NULL);
+	cl_assert(git_strmap_num_entries(g_repo->references.packfile) > 0);
+}
@@ -0,0 +1,307 @@
+#include "clar_libgit2.h"
+#include "commit_graph.h"
+#include "commit_list.h"
+#include "hash.h"
+#include "posix.h"
+#include "repository.h"
+#include "revwalk.h"
+
+static git_repository *_repo;
+
+static const char *commit_head = "a4a7dce85cf63874e984719f4fdd239f5145052f";
+
+void test_revwalk_commitgraph__initialize(void)
+{
+	_repo = cl_git_sandbox_init("testrepo.git");
+}
+
+void test_revwalk_commitgraph__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+	_repo = NULL;
+}
+
+static void check_graph_matches_odb(git_commit_graph *graph)
+{
+	git_commit_graph_entry entry;
+	git_commit *commit;
+	uint32_t i, parent, parent_entry;
+	size_t n;
+
+	for (i = 0; i < graph->num_commits; ++i) {
+		cl_git_pass(git_commit_graph_entry_read(&entry, graph, i));
+		cl_git_pass(git_commit_lookup(&commit, _repo, git_commit_graph_oid(graph, i)));
+
+		cl_assert(git_oid_cmp(&entry.tree, git_commit_tree_id(commit)) == 0);
+		cl_assert(entry.time == git_commit_time(commit));
+		cl_assert_equal_i(git_commit_parentcount(commit), entry.parent_count);
+
+		if (entry.parent_count == 0)
+			cl_assert_equal_i(1, entry.generation);
+
+		for (n = 0; n < entry.parent_count; ++n) {
+			git_commit_graph_entry p;
+
+			cl_git_pass(git_commit_graph_parent(&parent, graph, &entry, n));
+			cl_assert(git_oid_cmp(git_commit_graph_oid(graph, parent),
+				git_commit_parent_id(commit, (unsigned int)n)) == 0);
+
+			cl_git_pass(git_commit_graph_find(&parent_entry, graph,
+				git_commit_parent_id(commit, (unsigned int)n)));
+			cl_assert_equal_i(parent, parent_entry);
+
+			cl_git_pass(git_commit_graph_entry_read(&p, graph, parent));
+			cl_assert(entry.generation > p.generation);
+		}
+
+		git_commit_free(commit);
+	}
+}
+
+static void walk_from(char *out, size_t size, const git_oid *oid)
+{
+	git_revwalk *walk;
+	git_oid next;
+
+	out[0] = '\0';
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	git_revwalk_sorting(walk, GIT_SORT_TIME);
+	cl_git_pass(git_revwalk_push(walk, oid));
+
+	while (git_revwalk_next(&next, walk) == 0) {
+		char hex[8];
+		git_oid_tostr(hex, sizeof(hex), &next);
+		cl_assert(strlen(out) + sizeof(hex) < size);
+		strcat(out, hex);
+		strcat(out, " ");
+	}
+
+	git_revwalk_free(walk);
+}
+
+void test_revwalk_commitgraph__write_every_reference(void)
+{
+	git_commit_graph *graph;
+	size_t count;
+
+	cl_git_pass(git_repository__commit_graph(&graph, _repo));
+	cl_assert(graph == NULL);
+
+	cl_git_pass(git_graph_write(&count, _repo, NULL, 0));
+	cl_assert_equal_i(15, count);
+	cl_assert(git_path_isfile("testrepo.git/objects/info/commit-graph"));
+
+	cl_git_pass(git_repository__commit_graph(&graph, _repo));
+	cl_assert(graph != NULL);
+	cl_assert_equal_i(15, graph->num_commits);
+
+	check_graph_matches_odb(graph);
+	git_commit_graph_free(graph);
+}
+
+void test_revwalk_commitgraph__traversals_agree(void)
+{
+	git_oid head, one, two, base, graph_base;
+	size_t ahead, behind, graph_ahead, graph_behind;
+	char plain[256], cached[256];
+
+	cl_git_pass(git_oid_fromstr(&head, commit_head));
+	cl_git_pass(git_oid_fromstr(&one, "c47800c7266a2be04c571c04d5a6614691ea99bd"));
+	cl_git_pass(git_oid_fromstr(&two, "9fd738e8f7967c078dceed8190330fc8648ee56a"));
+
+	walk_from(plain, sizeof(plain), &head);
+	cl_git_pass(git_merge_base(&base, _repo, &one, &two));
+	cl_git_pass(git_graph_ahead_behind(&ahead, &behind, _repo, &one, &two));
+
+	cl_git_pass(git_graph_write(NULL, _repo, &head, 1));
+
+	walk_from(cached, sizeof(cached), &head);
+	cl_git_pass(git_merge_base(&graph_base, _repo, &one, &two));
+	cl_git_pass(git_graph_ahead_behind(&graph_ahead, &graph_behind, _repo, &one, &two));
+
+	cl_assert_equal_s(plain, cached);
+	cl_assert(git_oid_cmp(&base, &graph_base) == 0);
+	cl_assert_equal_i(ahead, graph_ahead);
+	cl_assert_equal_i(behind, graph_behind);
+
+	cl_git_pass(git_graph_ahead_behind_many(&graph_ahead, &graph_behind, _repo, &one, &two, 1));
+	cl_assert_equal_i(ahead, graph_ahead);
+	cl_assert_equal_i(behind, graph_behind);
+}
+
+void test_revwalk_commitgraph__refresh_keeps_existing_commits(void)
+{
+	git_commit_graph *graph;
+	git_commit_graph_entry entry;
+	git_commit *parents[3];
+	git_signature *sig;
+	git_tree *tree;
+	git_oid head, octopus;
+	uint32_t pos;
+	size_t count;
+	char walked[256];
+
+	cl_git_pass(git_oid_fromstr(&head, commit_head));
+	cl_git_pass(git_graph_write(&count, _repo, &head, 1));
+	cl_assert_equal_i(6, count);
+
+	/* an octopus on top of commits that are all in the graph already */
+	cl_git_pass(git_commit_lookup_prefix(&parents[0], _repo, &head, GIT_OID_HEXSZ));
+	cl_git_pass(git_commit_parent(&parents[1], parents[0], 0));
+	cl_git_pass(git_commit_parent(&parents[2], parents[0], 1));
+	cl_git_pass(git_commit_tree(&tree, parents[0]));
+	cl_git_pass(git_signature_new(&sig, "nulltoken", "emeric.fermas@gmail.com", 1323847743, 60));
+
+	cl_git_pass(git_commit_create(&octopus, _repo, NULL, sig, sig, NULL,
+		"octopus\n", tree, 3, (const git_commit **)parents));
+
+	cl_git_pass(git_graph_write(&count, _repo, &octopus, 1));
+	cl_assert_equal_i(7, count);
+
+	cl_git_pass(git_repository__commit_graph(&graph, _repo));
+	cl_git_pass(git_commit_graph_find(&pos, graph, &octopus));
+	cl_git_pass(git_commit_graph_entry_read(&entry, graph, pos));
+	cl_assert_equal_i(3, entry.parent_count);
+	check_graph_matches_odb(graph);
+	git_commit_graph_free(graph);
+
+	walk_from(walked, sizeof(walked), &octopus);
+	cl_assert_equal_i(7 * 8, strlen(walked));
+
+	git_signature_free(sig);
+	git_tree_free(tree);
+	git_commit_free(parents[0]);
+	git_commit_free(parents[1]);
+	git_commit_free(parents[2]);
+}
+
+/* Writes `data` back as the commit-graph, with a good trailer if `rehash` */
+static void rewrite_graph(git_buf *data, bool rehash)
+{
+	git_oid checksum;
+	int fd;
+
+	if (rehash) {
+		cl_git_pass(git_hash_buf(&checksum, data->ptr, data->size - GIT_OID_RAWSZ));
+		memcpy(data->ptr + data->size - GIT_OID_RAWSZ, checksum.id, GIT_OID_RAWSZ);
+	}
+
+	cl_assert((fd = git_futils_creat_withpath(
+		"testrepo.git/objects/info/commit-graph", 0777, 0644)) >= 0);
+	cl_git_pass(p_write(fd, data->ptr, data->size));
+	p_close(fd);
+
+	git_repository__commit_graph_reset(_repo);
+}
+
+/* Offset in the file of the commit data for `oid` */
+static size_t commit_data_offset(const git_oid *oid)
+{
+	git_commit_graph *graph;
+	uint32_t pos;
+	size_t offset;
+
+	cl_git_pass(git_repository__commit_graph(&graph, _repo));
+	cl_git_pass(git_commit_graph_find(&pos, graph, oid));
+	offset = (graph->commit_data - (const unsigned char *)graph->map.data) +
+		pos * (GIT_OID_RAWSZ + 16);
+	git_commit_graph_free(graph);
+
+	return offset;
+}
+
+void test_revwalk_commitgraph__corrupt_files_are_refused(void)
+{
+	git_commit_graph *graph;
+	git_buf data = GIT_BUF_INIT;
+	git_oid head;
+	size_t offset;
+	char plain[256], walked[256];
+
+	cl_git_pass(git_oid_fromstr(&head, commit_head));
+	walk_from(plain, sizeof(plain), &head);
+
+	cl_git_pass(git_graph_write(NULL, _repo, &head, 1));
+	offset = commit_data_offset(&head);
+
+	/* a flipped bit in a commit time still parses, only the trailer tells */
+	cl_git_pass(git_futils_readbuffer(&data, "testrepo.git/objects/info/commit-graph"));
+	data.ptr[offset + GIT_OID_RAWSZ + 15] ^= 0x40;
+	rewrite_graph(&data, false);
+
+	cl_git_fail(git_repository__commit_graph(&graph, _repo));
+
+	/* walks go on without it */
+	walk_from(walked, sizeof(walked), &head);
+	cl_assert_equal_s(plain, walked);
+
+	git_buf_free(&data);
+}
+
+void test_revwalk_commitgraph__times_past_32_bits_are_kept(void)
+{
+	git_commit *commit;
+	git_revwalk *walk;
+	git_commit_list_node *node;
+	git_buf data = GIT_BUF_INIT;
+	git_oid head;
+	size_t offset;
+
+	cl_git_pass(git_oid_fromstr(&head, commit_head));
+	cl_git_pass(git_commit_lookup(&commit, _repo, &head));
+
+	cl_git_pass(git_graph_write(NULL, _repo, &head, 1));
+	offset = commit_data_offset(&head);
+
+	/* the two low bits of the generation word are bits 32-33 of the time */
+	cl_git_pass(git_futils_readbuffer(&data, "testrepo.git/objects/info/commit-graph"));
+	data.ptr[offset + GIT_OID_RAWSZ + 11] |= 0x1;
+	rewrite_graph(&data, true);
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	cl_assert(walk->graph != NULL);
+	cl_assert((node = git_revwalk__commit_lookup(walk, &head)) != NULL);
+	cl_git_pass(git_commit_list_parse(walk, node));
+	cl_assert(node->time == git_commit_time(commit) + ((git_time_t)1 << 32));
+
+	git_revwalk_free(walk);
+	git_commit_free(commit);
+	git_buf_free(&data);
+}
+
+static void merge_bases_of_all_pairs(int *errors, git_oid *bases, const git_oid *commits, size_t count)
+{
+	size_t i, j;
+
+	for (i = 0; i < count; ++i) {
+		for (j = 0; j < count; ++j) {
+			size_t n = i * count + j;
+			errors[n] = git_merge_base(&bases[n], _repo, &commits[i], &commits[j]);
+			cl_assert(errors[n] == 0 || errors[n] == GIT_ENOTFOUND);
+		}
+	}
+}
+
+void test_revwalk_commitgraph__merge_bases_agree_for_every_pair(void)
+{
+	git_revwalk *walk;
+	git_oid commits[16], plain[16 * 16], cached[16 * 16];
+	int plain_errors[16 * 16], cached_errors[16 * 16];
+	size_t i, count = 0;
+
+	cl_git_pass(git_revwalk_new(&walk, _repo));
+	cl_git_pass(git_revwalk_push_glob(walk, "heads/*"));
+	while (git_revwalk_next(&commits[count], walk) == 0)
+		cl_assert(++count < 16);
+	git_revwalk_free(walk);
+
+	merge_bases_of_all_pairs(plain_errors, plain, commits, count);
+	cl_git_pass(git_graph_write(NULL, _repo, NULL, 0));
+	merge_bases_of_all_pairs(cached_errors, cached, commits, count);
+
+	for (i = 0; i < count * count; ++i) {
+		cl_assert_equal_i(plain_errors[i], cached_errors[i]);
+		if (!plain_errors[i])
+			cl_assert(git_oid_cmp(&plain[i], &cached[i]) == 0);
+	}
+}
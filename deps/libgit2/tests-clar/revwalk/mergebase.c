@@ -104,6 +104,29 @@ void test_revwalk_mergebase__two_way_merge(void)
 	cl_assert_equal_i(behind,  2);
 }
 
+void test_revwalk_mergebase__ahead_behind_many(void)
+{
+	git_revwalk *walk;
+	git_oid base, targets[32];
+	size_t count = 0, i, ahead[32], behind[32], one_ahead, one_behind;
+
+	cl_git_pass(git_oid_fromstr(&base, "1c30b88f5f3ee66d78df6520a7de9e89b890818b"));
+
+	cl_git_pass(git_revwalk_new(&walk, _repo2));
+	cl_git_pass(git_revwalk_push_glob(walk, "*"));
+	while (count < 32 && git_revwalk_next(&targets[count], walk) == 0)
+		count++;
+	git_revwalk_free(walk);
+
+	cl_git_pass(git_graph_ahead_behind_many(ahead, behind, _repo2, &base, targets, count));
+
+	for (i = 0; i < count; ++i) {
+		cl_git_pass(git_graph_ahead_behind(&one_ahead, &one_behind, _repo2, &base, &targets[i]));
+		cl_assert_equal_i(one_ahead, ahead[i]);
+		cl_assert_equal_i(one_behind, behind[i]);
+	}
+}
+
 void test_revwalk_mergebase__no_common_ancestor_returns_ENOTFOUND(void)
 {
 	git_oid result, one, two;
@@ -0,0 +1,160 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "status_data.h"
+#include "status_helpers.h"
+#include "repository.h"
+
+static git_repository *g_repo;
+
+void test_status_monitor__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("status");
+}
+
+void test_status_monitor__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+#ifdef GIT_FSMONITOR
+
+static void assert_whole_repository(void)
+{
+	status_entry_counts counts;
+
+	memset(&counts, 0x0, sizeof(status_entry_counts));
+	counts.expected_entry_count = entry_count0;
+	counts.expected_paths = entry_paths0;
+	counts.expected_statuses = entry_statuses0;
+
+	cl_git_pass(git_status_foreach(g_repo, cb_status__normal, &counts));
+
+	cl_assert_equal_i(counts.expected_entry_count, counts.entry_count);
+	cl_assert_equal_i(0, counts.wrong_status_flags_count);
+	cl_assert_equal_i(0, counts.wrong_sorted_path);
+}
+
+static int count_statuses(void)
+{
+	int count = 0;
+	cl_git_pass(git_status_foreach(g_repo, cb_status__count, &count));
+	return count;
+}
+
+#endif
+
+void test_status_monitor__unchanged_directories_are_not_read_again(void)
+{
+#ifdef GIT_FSMONITOR
+	git_workdir_monitor_stats stats;
+
+	cl_git_pass(git_repository_set_workdir_monitor(g_repo, 1));
+
+	assert_whole_repository();
+	git_repository_workdir_monitor_stats(&stats, g_repo);
+	cl_assert(stats.enabled);
+	cl_assert_equal_i(2, (int)stats.directories);
+	cl_assert_equal_i(0, (int)stats.hits);
+	cl_assert_equal_i(2, (int)stats.misses);
+
+	assert_whole_repository();
+	git_repository_workdir_monitor_stats(&stats, g_repo);
+	cl_assert_equal_i(2, (int)stats.hits);
+	cl_assert_equal_i(2, (int)stats.misses);
+#endif
+}
+
+void test_status_monitor__written_files_are_seen(void)
+{
+#ifdef GIT_FSMONITOR
+	git_workdir_monitor_stats stats;
+	unsigned int status;
+
+	cl_git_pass(git_repository_set_workdir_monitor(g_repo, 1));
+	assert_whole_repository();
+
+	cl_git_rewritefile("status/current_file", "current_file has changed\n");
+	cl_assert_equal_i(entry_count0 + 1, count_statuses());
+
+	/* the file was stat()ed again, but nothing was read again for it */
+	git_repository_workdir_monitor_stats(&stats, g_repo);
+	cl_assert(stats.updates > 0);
+	cl_assert_equal_i(2, (int)stats.misses);
+
+	cl_git_pass(git_status_file(&status, g_repo, "current_file"));
+	cl_assert_equal_i(GIT_STATUS_WT_MODIFIED, status);
+#endif
+}
+
+void test_status_monitor__added_and_removed_files_are_seen(void)
+{
+#ifdef GIT_FSMONITOR
+	git_workdir_monitor_stats stats;
+	unsigned int status;
+
+	cl_git_pass(git_repository_set_workdir_monitor(g_repo, 1));
+	assert_whole_repository();
+
+	cl_git_mkfile("status/subdir/brand_new_file", "new\n");
+	cl_git_pass(p_unlink("status/subdir/current_file"));
+
+	cl_assert_equal_i(entry_count0 + 2, count_statuses());
+
+	cl_git_pass(git_status_file(&status, g_repo, "subdir/brand_new_file"));
+	cl_assert_equal_i(GIT_STATUS_WT_NEW, status);
+	cl_git_pass(git_status_file(&status, g_repo, "subdir/current_file"));
+	cl_assert_equal_i(GIT_STATUS_WT_DELETED, status);
+
+	/* only the subdirectory was read again */
+	git_repository_workdir_monitor_stats(&stats, g_repo);
+	cl_assert_equal_i(3, (int)stats.misses);
+#endif
+}
+
+void test_status_monitor__removed_directories_are_seen(void)
+{
+#ifdef GIT_FSMONITOR
+	git_workdir_monitor_stats stats;
+	unsigned int status;
+
+	cl_git_pass(git_repository_set_workdir_monitor(g_repo, 1));
+	assert_whole_repository();
+
+	cl_git_pass(git_futils_rmdir_r("status/subdir", NULL, GIT_RMDIR_REMOVE_FILES));
+
+	cl_git_pass(git_status_file(&status, g_repo, "subdir/current_file"));
+	cl_assert_equal_i(GIT_STATUS_WT_DELETED, status);
+
+	count_statuses();
+	git_repository_workdir_monitor_stats(&stats, g_repo);
+	cl_assert_equal_i(1, (int)stats.directories);
+#endif
+}
+
+void test_status_monitor__stopping_forgets_everything(void)
+{
+#ifdef GIT_FSMONITOR
+	git_workdir_monitor_stats stats;
+
+	cl_git_pass(git_repository_set_workdir_monitor(g_repo, 1));
+	assert_whole_repository();
+
+	cl_git_pass(git_repository_set_workdir_monitor(g_repo, 0));
+	git_repository_workdir_monitor_stats(&stats, g_repo);
+	cl_assert(!stats.enabled);
+	cl_assert_equal_i(0, (int)stats.directories);
+
+	assert_whole_repository();
+	git_repository_workdir_monitor_stats(&stats, g_repo);
+	cl_assert_equal_i(0, (int)stats.directories);
+#endif
+}
+
+void test_status_monitor__bare_repositories_cannot_be_watched(void)
+{
+	git_repository *bare;
+
+	cl_git_pass(git_repository_open(&bare, cl_fixture("testrepo.git")));
+	cl_assert_equal_i(GIT_EBAREREPO, git_repository_set_workdir_monitor(bare, 1));
+	git_repository_free(bare);
+}
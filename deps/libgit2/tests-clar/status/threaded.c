@@ -0,0 +1,99 @@
+#include "clar_libgit2.h"
+#include "status_data.h"
+#include "status_helpers.h"
+#include "posix.h"
+#include "repository.h"
+
+void test_status_threaded__initialize(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_WORKDIR_THREADS, 4));
+}
+
+void test_status_threaded__cleanup(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_WORKDIR_THREADS, 1));
+	cl_git_sandbox_cleanup();
+}
+
+void test_status_threaded__option_can_be_read_back(void)
+{
+	unsigned int threads;
+
+	git_libgit2_opts(GIT_OPT_GET_WORKDIR_THREADS, &threads);
+	cl_assert_equal_i(4, threads);
+}
+
+/* same as status::worktree::whole_repository, but scanned and hashed in parallel */
+void test_status_threaded__whole_repository(void)
+{
+	status_entry_counts counts;
+	git_repository *repo = cl_git_sandbox_init("status");
+
+	memset(&counts, 0x0, sizeof(status_entry_counts));
+	counts.expected_entry_count = entry_count0;
+	counts.expected_paths = entry_paths0;
+	counts.expected_statuses = entry_statuses0;
+
+	cl_git_pass(
+		git_status_foreach(repo, cb_status__normal, &counts)
+	);
+
+	cl_assert_equal_i(counts.expected_entry_count, counts.entry_count);
+	cl_assert_equal_i(0, counts.wrong_status_flags_count);
+	cl_assert_equal_i(0, counts.wrong_sorted_path);
+}
+
+/* same as status::worktree::swap_subdir_and_file */
+void test_status_threaded__swap_subdir_and_file(void)
+{
+	status_entry_counts counts;
+	git_repository *repo = cl_git_sandbox_init("status");
+	git_index *index;
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	bool ignore_case;
+
+	cl_git_pass(git_repository_index(&index, repo));
+	ignore_case = index->ignore_case;
+	git_index_free(index);
+
+	cl_git_pass(p_rename("status/current_file", "status/swap"));
+	cl_git_pass(p_rename("status/subdir", "status/current_file"));
+	cl_git_pass(p_rename("status/swap", "status/subdir"));
+
+	cl_git_mkfile("status/.HEADER", "dummy");
+	cl_git_mkfile("status/42-is-not-prime.sigh", "dummy");
+	cl_git_mkfile("status/README.md", "dummy");
+
+	memset(&counts, 0x0, sizeof(status_entry_counts));
+	counts.expected_entry_count = entry_count3;
+	counts.expected_paths = ignore_case ? entry_paths3_icase : entry_paths3;
+	counts.expected_statuses = ignore_case ? entry_statuses3_icase : entry_statuses3;
+
+	opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED |
+		GIT_STATUS_OPT_INCLUDE_IGNORED;
+
+	cl_git_pass(
+		git_status_foreach_ext(repo, &opts, cb_status__normal, &counts)
+	);
+
+	cl_assert_equal_i(counts.expected_entry_count, counts.entry_count);
+	cl_assert_equal_i(0, counts.wrong_status_flags_count);
+	cl_assert_equal_i(0, counts.wrong_sorted_path);
+}
+
+void test_status_threaded__line_endings_are_filtered_by_the_workers(void)
+{
+	git_repository *repo = cl_git_sandbox_init("status");
+	git_config *config;
+	int count = 0;
+
+	cl_git_pass(git_repository_config(&config, repo));
+	cl_git_pass(git_config_set_bool(config, "core.autocrlf", true));
+	git_config_free(config);
+
+	cl_git_rewritefile("status/current_file", "current_file\r\n");
+
+	/* current_file is still current, so it isn't listed */
+	cl_git_pass(git_status_foreach(repo, cb_status__count, &count));
+	cl_assert_equal_i(entry_count0, count);
+}
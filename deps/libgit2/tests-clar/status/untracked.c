@@ -0,0 +1,278 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "status_data.h"
+#include "status_helpers.h"
+#include "repository.h"
+#include "git2/ignore.h"
+
+#ifndef GIT_WIN32
+# include <sys/time.h>
+#endif
+
+static git_repository *g_repo;
+
+void test_status_untracked__initialize(void)
+{
+	git_config *config;
+
+	g_repo = cl_git_sandbox_init("status");
+
+	cl_git_pass(git_repository_config(&config, g_repo));
+	cl_git_pass(git_config_set_bool(config, "core.untrackedCache", true));
+	git_config_free(config);
+}
+
+void test_status_untracked__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+#ifndef GIT_WIN32
+
+/* what changed in the second it was read in isn't trusted */
+static void backdate(const char *path)
+{
+	struct timeval times[2];
+
+	memset(times, 0x0, sizeof(times));
+	times[0].tv_sec = times[1].tv_sec = time(NULL) - 10;
+
+	cl_must_pass(utimes(path, times));
+}
+
+static void backdate_workdir(void)
+{
+	backdate("status");
+	backdate("status/subdir");
+}
+
+/* git_status_foreach, keeping the cache in the index */
+static int status_foreach(git_status_cb cb, void *payload)
+{
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+
+	opts.flags = GIT_STATUS_OPT_INCLUDE_IGNORED |
+		GIT_STATUS_OPT_INCLUDE_UNTRACKED |
+		GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS |
+		GIT_STATUS_OPT_UPDATE_INDEX;
+
+	return git_status_foreach_ext(g_repo, &opts, cb, payload);
+}
+
+static git_untracked_cache *untracked_cache(git_repository *repo)
+{
+	git_index *index;
+
+	cl_git_pass(git_repository_index__weakptr(&index, repo));
+	cl_assert(index->untracked != NULL);
+
+	return index->untracked;
+}
+
+static void assert_whole_repository(void)
+{
+	status_entry_counts counts;
+
+	memset(&counts, 0x0, sizeof(status_entry_counts));
+	counts.expected_entry_count = entry_count0;
+	counts.expected_paths = entry_paths0;
+	counts.expected_statuses = entry_statuses0;
+
+	cl_git_pass(status_foreach(cb_status__normal, &counts));
+
+	cl_assert_equal_i(counts.expected_entry_count, counts.entry_count);
+	cl_assert_equal_i(0, counts.wrong_status_flags_count);
+	cl_assert_equal_i(0, counts.wrong_sorted_path);
+}
+
+static int count_statuses(void)
+{
+	int count = 0;
+	cl_git_pass(status_foreach(cb_status__count, &count));
+	return count;
+}
+
+typedef struct {
+	const char *path;
+	unsigned int status;
+} walked_entry;
+
+static int cb_walked_status(const char *path, unsigned int status, void *payload)
+{
+	walked_entry *entry = payload;
+
+	if (strcmp(path, entry->path) == 0)
+		entry->status = status;
+
+	return 0;
+}
+
+/* unlike git_status_file, which only looks at the one file */
+static unsigned int walked_status(const char *path)
+{
+	walked_entry entry = { path, 0 };
+	cl_git_pass(status_foreach(cb_walked_status, &entry));
+	return entry.status;
+}
+
+#endif
+
+void test_status_untracked__unchanged_directories_are_not_read_again(void)
+{
+#ifndef GIT_WIN32
+	git_untracked_cache *uc;
+
+	backdate_workdir();
+
+	assert_whole_repository();
+	uc = untracked_cache(g_repo);
+	cl_assert_equal_i(0, (int)uc->hits);
+	cl_assert_equal_i(2, (int)uc->misses);
+
+	assert_whole_repository();
+	cl_assert_equal_i(2, (int)uc->hits);
+	cl_assert_equal_i(2, (int)uc->misses);
+
+	/* nothing changed, so nothing was written */
+	cl_assert(!uc->dirty);
+#endif
+}
+
+void test_status_untracked__tracked_files_are_still_checked(void)
+{
+#ifndef GIT_WIN32
+	git_untracked_cache *uc;
+	unsigned int status;
+
+	backdate_workdir();
+	assert_whole_repository();
+
+	cl_git_rewritefile("status/current_file", "current_file has changed\n");
+	cl_assert_equal_i(entry_count0 + 1, count_statuses());
+
+	uc = untracked_cache(g_repo);
+	cl_assert_equal_i(2, (int)uc->hits);
+	cl_assert_equal_i(2, (int)uc->misses);
+
+	cl_git_pass(git_status_file(&status, g_repo, "current_file"));
+	cl_assert_equal_i(GIT_STATUS_WT_MODIFIED, status);
+#endif
+}
+
+void test_status_untracked__added_files_are_seen(void)
+{
+#ifndef GIT_WIN32
+	git_untracked_cache *uc;
+	unsigned int status;
+
+	backdate_workdir();
+	assert_whole_repository();
+
+	cl_git_mkfile("status/subdir/brand_new_file", "new\n");
+	cl_assert_equal_i(entry_count0 + 1, count_statuses());
+
+	/* only the subdirectory was read again */
+	uc = untracked_cache(g_repo);
+	cl_assert_equal_i(1, (int)uc->hits);
+	cl_assert_equal_i(3, (int)uc->misses);
+
+	cl_git_pass(git_status_file(&status, g_repo, "subdir/brand_new_file"));
+	cl_assert_equal_i(GIT_STATUS_WT_NEW, status);
+#endif
+}
+
+void test_status_untracked__changed_ignore_files_are_seen(void)
+{
+#ifndef GIT_WIN32
+	cl_git_mkfile("status/subdir/.gitignore", "nothing\n");
+	backdate_workdir();
+
+	/* once to keep what's there, once to keep what's ignored */
+	cl_assert_equal_i(entry_count0 + 1, count_statuses());
+	cl_assert_equal_i(GIT_STATUS_WT_NEW, walked_status("subdir/new_file"));
+
+	/* doesn't change the mtime of the directory */
+	cl_git_rewritefile("status/subdir/.gitignore", "new_file\n");
+
+	cl_assert_equal_i(GIT_STATUS_IGNORED, walked_status("subdir/new_file"));
+	cl_assert_equal_i(GIT_STATUS_WT_NEW, walked_status("new_file"));
+	cl_assert_equal_i(2, (int)untracked_cache(g_repo)->misses);
+#endif
+}
+
+void test_status_untracked__changed_global_rules_are_seen(void)
+{
+#ifndef GIT_WIN32
+	backdate_workdir();
+
+	cl_assert_equal_i(GIT_STATUS_WT_NEW, walked_status("new_file"));
+	cl_assert_equal_i(GIT_STATUS_WT_NEW, walked_status("new_file"));
+
+	cl_git_pass(git_ignore_add_rule(g_repo, "new_file\n"));
+
+	cl_assert_equal_i(GIT_STATUS_IGNORED, walked_status("new_file"));
+	cl_assert_equal_i(GIT_STATUS_IGNORED, walked_status("subdir/new_file"));
+	cl_assert_equal_i(2, (int)untracked_cache(g_repo)->misses);
+#endif
+}
+
+void test_status_untracked__the_cache_is_kept_in_the_index(void)
+{
+#ifndef GIT_WIN32
+	git_repository *repo;
+	git_untracked_cache *uc;
+	int count = 0;
+
+	backdate_workdir();
+	assert_whole_repository();
+	cl_assert(!untracked_cache(g_repo)->dirty);
+
+	cl_git_pass(git_repository_open(&repo, "status"));
+
+	cl_git_pass(git_status_foreach(repo, cb_status__count, &count));
+	uc = untracked_cache(repo);
+	cl_assert_equal_i(2, (int)uc->hits);
+	cl_assert_equal_i(0, (int)uc->misses);
+
+	git_repository_free(repo);
+#endif
+}
+
+void test_status_untracked__plain_status_leaves_the_index_alone(void)
+{
+#ifndef GIT_WIN32
+	git_buf before = GIT_BUF_INIT, after = GIT_BUF_INIT;
+	int count = 0;
+
+	backdate_workdir();
+	cl_git_pass(git_futils_readbuffer(&before, "status/.git/index"));
+
+	cl_git_pass(git_status_foreach(g_repo, cb_status__count, &count));
+	cl_assert_equal_i(entry_count0, count);
+
+	/* there was something to write, it just wasn't asked for */
+	cl_assert(untracked_cache(g_repo)->dirty);
+
+	cl_git_pass(git_futils_readbuffer(&after, "status/.git/index"));
+	cl_assert_equal_sz(before.size, after.size);
+	cl_assert(memcmp(before.ptr, after.ptr, before.size) == 0);
+
+	git_buf_free(&before);
+	git_buf_free(&after);
+#endif
+}
+
+void test_status_untracked__is_off_by_default(void)
+{
+	git_index *index;
+	int count = 0;
+
+	cl_git_sandbox_cleanup();
+	g_repo = cl_git_sandbox_init("status");
+
+	cl_git_pass(git_status_foreach(g_repo, cb_status__count, &count));
+	cl_assert_equal_i(entry_count0, count);
+
+	cl_git_pass(git_repository_index__weakptr(&index, g_repo));
+	cl_assert(index->untracked == NULL);
+}
@@ -14,7 +14,74 @@ void test_threads_basic__cleanup(void) {
 }
 
 
+#ifdef GIT_THREADS
+
+#define THREADS 8
+#define ROUNDS 20
+
+static git_oid g_oids[2048];
+static size_t g_count;
+
+static int collect_oid(const git_oid *oid, void *payload) {
+   GIT_UNUSED(payload);
+   if (g_count < ARRAY_SIZE(g_oids))
+      git_oid_cpy(&g_oids[g_count++], oid);
+   return 0;
+}
+
+static void *lookup_all(void *data) {
+   size_t round, i, offset = (size_t)data;
+   intptr_t failures = 0;
+
+   for (round = 0; round < ROUNDS; ++round) {
+      for (i = 0; i < g_count; ++i) {
+         const git_oid *oid = &g_oids[(i + offset) % g_count];
+         git_object *object;
+
+         if (git_object_lookup(&object, g_repo, oid, GIT_OBJ_ANY) < 0) {
+            failures++;
+            continue;
+         }
+         if (git_oid_cmp(git_object_id(object), oid) != 0)
+            failures++;
+         git_object_free(object);
+      }
+   }
+
+   return (void *)failures;
+}
+
+#endif
+
 void test_threads_basic__cache(void) {
-   // run several threads polling the cache at the same time
-   cl_assert(1 == 1);
+#ifdef GIT_THREADS
+   // run several threads polling the cache at the same time, with a
+   // budget small enough for lookups to race with evictions
+   git_thread threads[THREADS];
+   git_cache_stats stats;
+   git_odb *odb;
+   size_t i;
+
+   g_count = 0;
+   cl_git_pass(git_repository_odb(&odb, g_repo));
+   cl_git_pass(git_odb_foreach(odb, collect_oid, NULL));
+   git_odb_free(odb);
+   cl_assert(g_count > 0);
+
+   cl_git_pass(git_repository_set_cache_limit(g_repo, GIT_OBJ_ANY, 16 * 1024));
+
+   for (i = 0; i < THREADS; ++i)
+      cl_assert_equal_i(0, git_thread_create(&threads[i], NULL, lookup_all, (void *)(i * 7)));
+
+   for (i = 0; i < THREADS; ++i) {
+      void *failures;
+      cl_assert_equal_i(0, git_thread_join(threads[i], &failures));
+      cl_assert_equal_i(0, (intptr_t)failures);
+   }
+
+   git_repository_cache_stats(&stats, g_repo);
+   cl_assert(stats.hits > 0);
+   cl_assert(stats.evictions > 0);
+   cl_assert(stats.used <= stats.limit);
+#endif
 }
@@ -1,6 +1,10 @@
 // Wraps the binary addon with JS-side features, like
 // field immutability, streaming, events, and more!
 
+var Readable = require('stream').Readable;
+var Writable = require('stream').Writable;
+var util = require('util');
+
 // The module
 try {
   var mod = require('../build/Debug/gitteh')
@@ -9,5 +13,173 @@ try {
 }
 module.exports = mod;
 
-// TODO: do the work here
 
+// Walker streams
+// Each chunk is an OidArray with up to `batchSize` commits. A new batch
+// is only requested from the native side when the consumer asks for more.
+// Pass a CancelToken as `cancel` to stop the walk midway.
+
+function WalkerStream(walker, options) {
+  options = options || {};
+  Readable.call(this, { objectMode: true, highWaterMark: options.highWaterMark || 2 });
+  this.walker = walker;
+  this.batchSize = options.batchSize || 1000;
+  this.cancel = options.cancel || null;
+}
+util.inherits(WalkerStream, Readable);
+
+WalkerStream.prototype._read = function () {
+  var self = this;
+  if (this.walker.busy) {
+    // someone else called next(); look again shortly, since that
+    // batch's callback isn't ours to hook into
+    if (this.retrying) return;
+    this.retrying = true;
+    setTimeout(function () {
+      self.retrying = false;
+      self._read();
+    }, 1);
+    return;
+  }
+  var done = function (err, batch) {
+    if (err) return self.emit('error', err);
+    self.push(batch);
+  };
+  if (this.cancel) this.walker.next(this.batchSize, this.cancel, done);
+  else this.walker.next(this.batchSize, done);
+};
+
+mod.Walker.prototype.createReadStream = function (options) {
+  return new WalkerStream(this, options);
+};
+
+// Blob streams
+// The blob is read in `chunkSize` pieces (64KiB by default) on the
+// repository queue; the next piece is only read when the consumer asks
+// for more, so a slow consumer never has the whole blob in memory.
+
+function BlobReadStream(repo, oid, options) {
+  options = options || {};
+  Readable.call(this, { highWaterMark: options.highWaterMark });
+  this.repo = repo;
+  this.oid = oid;
+  this.chunkSize = options.chunkSize || 64 * 1024;
+  this.cancel = options.cancel || null;
+  this.reader = null;
+  this.destroyed = false;
+}
+util.inherits(BlobReadStream, Readable);
+
+BlobReadStream.prototype._read = function () {
+  var self = this;
+  if (this.destroyed) return;
+  if (this.reader) return this._readChunk();
+  var opened = function (err, reader) {
+    if (self.destroyed) return reader && reader.close();
+    if (err) return self.emit('error', err);
+    self.reader = reader;
+    self.emit('open', reader.size);
+    self._readChunk();
+  };
+  if (this.cancel) mod.Blob.openReader(this.repo, this.oid, this.cancel, opened);
+  else mod.Blob.openReader(this.repo, this.oid, opened);
+};
+
+BlobReadStream.prototype._readChunk = function () {
+  var self = this;
+  if (this.reader.busy) return;
+  this.reader.read(this.chunkSize, function (err, chunk) {
+    // destroyed while reading, the reader was left for us to close
+    if (self.destroyed) return self.reader.close();
+    if (err) {
+      self.reader.close();
+      return self.emit('error', err);
+    }
+    if (!chunk) self.reader.close();
+    self.push(chunk);
+  });
+};
+
+BlobReadStream.prototype.destroy = function () {
+  if (this.destroyed) return;
+  this.destroyed = true;
+  if (this.reader && !this.reader.busy) this.reader.close();
+  this.push(null);
+};
+
+mod.Blob.createReadStream = function (repo, oid, options) {
+  return new BlobReadStream(repo, oid, options);
+};
+
+// Each chunk written is handed to the ODB on the repository queue, which
+// hashes and deflates it right away when `size` is given (or spools it to
+// a temporary file when not); the next chunk is only accepted after that,
+// so nothing accumulates in the JS heap. The new blob's Oid is emitted as
+// 'oid' after 'finish', and passed to `cb` if given.
+
+function BlobWriteStream(repo, size, options) {
+  options = options || {};
+  Writable.call(this, { highWaterMark: options.highWaterMark });
+  this.repo = repo;
+  this.size = (typeof size === 'number') ? size : null;
+  this.cancel = options.cancel || null;
+  this.writer = null;
+  this.once('finish', this._finish);
+}
+util.inherits(BlobWriteStream, Writable);
+
+BlobWriteStream.prototype._open = function (cb) {
+  var self = this;
+  if (this.writer) return cb();
+  var opened = function (err, writer) {
+    if (err) return cb(err);
+    self.writer = writer;
+    self.emit('open');
+    cb();
+  };
+  var args = [this.repo];
+  if (this.size !== null) args.push(this.size);
+  if (this.cancel) args.push(this.cancel);
+  args.push(opened);
+  mod.Blob.openWriter.apply(mod.Blob, args);
+};
+
+BlobWriteStream.prototype._write = function (chunk, encoding, cb) {
+  var self = this;
+  if (!Buffer.isBuffer(chunk)) chunk = new Buffer(chunk, encoding);
+  this._open(function (err) {
+    if (err) return cb(err);
+    self.writer.write(chunk, function (err) {
+      if (err) self.writer.close();
+      cb(err);
+    });
+  });
+};
+
+BlobWriteStream.prototype._finish = function () {
+  var self = this;
+  this._open(function (err) {
+    if (err) return self.emit('error', err);
+    self.writer.finish(function (err, oid) {
+      if (err) return self.emit('error', err);
+      self.oid = oid;
+      self.emit('oid', oid);
+    });
+  });
+};
+
+BlobWriteStream.prototype.destroy = function () {
+  if (this.writer) this.writer.close();
+};
+
+mod.Blob.createWriteStream = function (repo, size, options, cb) {
+  if (typeof size === 'function') { cb = size; size = null; options = null; }
+  else if (typeof size === 'object' && size !== null) { cb = options; options = size; size = null; }
+  if (typeof options === 'function') { cb = options; options = null; }
+  var stream = new BlobWriteStream(repo, size, options);
+  if (cb) {
+    stream.on('error', cb);
+    stream.on('oid', function (oid) { cb(null, oid); });
+  }
+  return stream;
+};
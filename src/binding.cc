@@ -28,13 +28,21 @@
 #include "v8u.hpp"
 #include "version.hpp"
 
+#include "scheduler.h"
+
+#include "cancel.h"
 #include "error.h"
 #include "oid.h"
+#include "oidarray.h"
 #include "object.h"
 #include "reference.h"
 #include "message.h"
+#include "options.h"
 #include "repository.h"
 #include "commit.h"
+#include "blob.h"
+#include "walker.h"
+#include "diff.h"
 
 #define GITTEH_VERSION 0,1,0
 
@@ -54,6 +62,9 @@ inline Local<v8::Object> libgit2Version() {
 }
 
 NODE_DEF_MAIN() {
+  // Work runs on several threads (see Scheduler)
+  git_threads_init();
+
   // Version class & hash
   Version::init(target);
   Local<v8::Object> versions = v8u::Obj();
@@ -70,15 +81,59 @@ NODE_DEF_MAIN() {
   capHash->Set(Symbol("HTTPS"), Int(GIT_CAP_HTTPS));
   target->Set(Symbol("Capability"), capHash);
 
+  //ENUM: object types -- OBJ
+  Local<v8::Object> typeHash = v8u::Obj();
+  typeHash->Set(Symbol("ANY"), Int(GIT_OBJ_ANY));
+  typeHash->Set(Symbol("COMMIT"), Int(GIT_OBJ_COMMIT));
+  typeHash->Set(Symbol("TREE"), Int(GIT_OBJ_TREE));
+  typeHash->Set(Symbol("BLOB"), Int(GIT_OBJ_BLOB));
+  typeHash->Set(Symbol("TAG"), Int(GIT_OBJ_TAG));
+  target->Set(Symbol("ObjectType"), typeHash);
+
+  Local<Object> statusHash = v8u::Obj();
+  statusHash->Set(Symbol("INDEX_NEW"), Int(GIT_STATUS_INDEX_NEW));
+  statusHash->Set(Symbol("INDEX_MODIFIED"), Int(GIT_STATUS_INDEX_MODIFIED));
+  statusHash->Set(Symbol("INDEX_DELETED"), Int(GIT_STATUS_INDEX_DELETED));
+  statusHash->Set(Symbol("INDEX_RENAMED"), Int(GIT_STATUS_INDEX_RENAMED));
+  statusHash->Set(Symbol("INDEX_TYPECHANGE"), Int(GIT_STATUS_INDEX_TYPECHANGE));
+  statusHash->Set(Symbol("WT_NEW"), Int(GIT_STATUS_WT_NEW));
+  statusHash->Set(Symbol("WT_MODIFIED"), Int(GIT_STATUS_WT_MODIFIED));
+  statusHash->Set(Symbol("WT_DELETED"), Int(GIT_STATUS_WT_DELETED));
+  statusHash->Set(Symbol("WT_TYPECHANGE"), Int(GIT_STATUS_WT_TYPECHANGE));
+  statusHash->Set(Symbol("IGNORED"), Int(GIT_STATUS_IGNORED));
+  target->Set(Symbol("Status"), statusHash);
+
+  // Global libgit2 options
+  target->Set(Symbol("setDeltaBaseCacheLimit"), Func(SetDeltaBaseCacheLimit)->GetFunction());
+  target->Set(Symbol("getDeltaBaseCacheLimit"), Func(GetDeltaBaseCacheLimit)->GetFunction());
+  target->Set(Symbol("deltaBaseCacheStats"), Func(GetDeltaBaseCacheStats)->GetFunction());
+  target->Set(Symbol("setIndexerThreads"), Func(SetIndexerThreads)->GetFunction());
+  target->Set(Symbol("getIndexerThreads"), Func(GetIndexerThreads)->GetFunction());
+  target->Set(Symbol("setWorkdirThreads"), Func(SetWorkdirThreads)->GetFunction());
+  target->Set(Symbol("getWorkdirThreads"), Func(GetWorkdirThreads)->GetFunction());
+  target->Set(Symbol("setMwindowLimits"), Func(SetMwindowLimits)->GetFunction());
+  target->Set(Symbol("getMwindowLimits"), Func(GetMwindowLimits)->GetFunction());
+  target->Set(Symbol("mwindowStats"), Func(GetMwindowStats)->GetFunction());
+
+  // Worker threads
+  Scheduler::Init(target);
+
   // Message utilities
   target->Set(Symbol("prettify"), Func(Prettify)->GetFunction());
 
   // Classes initialization
+  CancelToken::init(target);
   Oid::init(target);
+  OidArray::init(target);
   GitObject::init(target);
   Repository::init(target);
   Reference::init(target);
   Commit::init(target);
+  Blob::init(target);
+  BlobReader::init(target);
+  BlobWriter::init(target);
+  Walker::init(target);
+  Diff::init(target);
 } NODE_DEF_MAIN_END(gitteh)
 
 };
@@ -0,0 +1,582 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "blob.h"
+
+#include <algorithm>
+#include <node_buffer.h>
+
+#include "repository.h"
+#include "cancel.h"
+#include "common.h"
+#include "error.h"
+#include "oid.h"
+
+
+using v8u::Symbol;
+using v8u::Func;
+using v8u::Persist;
+using v8::Object;
+using v8::Local;
+using v8::Persistent;
+using v8::Function;
+
+namespace gitteh {
+
+#define GITTEH_BLOB_DEFAULT_CHUNK (64 * 1024)
+#define GITTEH_BLOB_MAX_CHUNK (16 * 1024 * 1024)
+#define GITTEH_BLOB_SPOOL_CHUNK (64 * 1024)
+
+static inline bool toOid(v8::Handle<v8::Value> value, git_oid& out) {
+  if (value->IsObject() && Oid::HasInstance(v8u::Obj(value))) {
+    git_oid_cpy(&out, &node::ObjectWrap::Unwrap<Oid>(v8u::Obj(value))->oid);
+    return true;
+  }
+  v8::String::Utf8Value str (value);
+  return *str && str.length() == GIT_OID_HEXSZ && git_oid_fromstr(&out, *str) == GIT_OK;
+}
+
+BlobReader::BlobReader(git_odb* odb, git_odb_stream* stream, size_t size,
+                       v8::Handle<Object> repo, WorkQueue* queue):
+  odb(odb), stream(stream), size(size), offset(0), repo(Persist(repo)),
+  queue(queue), busy(false), closing(false) {}
+BlobReader::~BlobReader() {
+  if (stream) stream->free(stream);
+  git_odb_free(odb);
+  repo.Dispose();
+}
+
+V8_ESCTOR(BlobReader) { V8_CTOR_NO_JS }
+
+void BlobReader::Close() {
+  if (busy) { closing = true; return; }
+  if (stream) stream->free(stream);
+  stream = NULL;
+}
+
+V8_ESGET(BlobReader, GetSize) {
+  V8_M_UNWRAP(BlobReader, info.Holder());
+  return v8u::Num((double)inst->size);
+}
+
+V8_ESGET(BlobReader, IsBusy) {
+  V8_M_UNWRAP(BlobReader, info.Holder());
+  return v8u::Bool(inst->busy);
+}
+
+V8_SCB(BlobReader::Close) {
+  V8_M_UNWRAP(BlobReader, args.This());
+  inst->Close();
+  return v8::Undefined();
+}
+
+
+
+// READING
+
+//// reader.read(...)
+
+GITTEH_WORK_PRE(blob_read) {
+  BlobReader* reader;
+  Persistent<Object> reader_obj;
+  Persistent<Object> buffer;
+  char* data;
+  size_t length, count;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Reads up to N bytes; the callback gets a Buffer,
+// or null once the whole blob has been read.
+// Stops if either this call's token or the reader's is cancelled.
+V8_SCB(BlobReader::Read) {
+  V8_M_UNWRAP(BlobReader, args.This());
+  if (inst->busy) V8_STHROW(v8u::Err("The reader is busy."));
+  if (!inst->stream) V8_STHROW(v8u::Err("The reader is closed."));
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  blob_read_req* r = new blob_read_req;
+  r->cancel.Take(args, len);
+
+  size_t chunk = GITTEH_BLOB_DEFAULT_CHUNK;
+  if (len >= 1 && v8u::Int(args[0]) > 0) chunk = v8u::Int(args[0]);
+  chunk = std::min(chunk, (size_t)GITTEH_BLOB_MAX_CHUNK);
+
+  r->length = std::min(chunk, inst->size - inst->offset);
+  node::Buffer* buf = node::Buffer::New(r->length);
+  r->buffer = Persist(buf->handle_);
+  r->data = node::Buffer::Data(buf);
+  r->reader = inst;
+  r->reader_obj = Persist(args.This());
+  inst->busy = true;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(blob_read, inst->queue);
+} GITTEH_WORK(blob_read) {
+  git_odb_stream* stream = r->reader->stream;
+  r->count = 0;
+  r->failed = false;
+  if (r->cancel.Requested() || r->reader->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+    return;
+  }
+  while (r->count < r->length) {
+    int bytes = stream->read(stream, r->data + r->count, r->length - r->count);
+    if (bytes == 0) break;
+    if (bytes < 0) {
+      collectErr(bytes, r->err);
+      r->failed = true;
+      return;
+    }
+    r->count += bytes;
+  }
+} GITTEH_WORK_AFTER(blob_read) {
+  BlobReader* reader = r->reader;
+  reader->busy = false;
+  reader->offset += r->count;
+  if (reader->closing) reader->Close();
+  r->reader_obj.Dispose();
+
+  v8::Handle<v8::Value> argv [2];
+  argv[0] = v8::Null();
+  argv[1] = v8::Null();
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+  } else if (r->count == r->length && r->count) {
+    argv[1] = Local<Object>::New(r->buffer);
+  } else if (r->count) {
+    // the object was shorter than its header said
+    argv[1] = node::Buffer::New(r->data, r->count)->handle_;
+  }
+  r->buffer.Dispose();
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+
+
+BlobWriter::BlobWriter(git_odb* odb, git_odb_stream* stream, FILE* spool, size_t size,
+                       v8::Handle<Object> repo, WorkQueue* queue):
+  odb(odb), stream(stream), spool(spool), size(size), written(0),
+  repo(Persist(repo)), queue(queue), busy(false), closing(false) {}
+BlobWriter::~BlobWriter() {
+  if (stream) stream->free(stream);
+  if (spool) fclose(spool);
+  git_odb_free(odb);
+  repo.Dispose();
+}
+
+V8_ESCTOR(BlobWriter) { V8_CTOR_NO_JS }
+
+void BlobWriter::Close() {
+  if (busy) { closing = true; return; }
+  if (stream) stream->free(stream);
+  if (spool) fclose(spool);
+  stream = NULL;
+  spool = NULL;
+}
+
+V8_ESGET(BlobWriter, GetWritten) {
+  V8_M_UNWRAP(BlobWriter, info.Holder());
+  return v8u::Num((double)inst->written);
+}
+
+V8_ESGET(BlobWriter, IsBusy) {
+  V8_M_UNWRAP(BlobWriter, info.Holder());
+  return v8u::Bool(inst->busy);
+}
+
+V8_SCB(BlobWriter::Close) {
+  V8_M_UNWRAP(BlobWriter, args.This());
+  inst->Close();
+  return v8::Undefined();
+}
+
+
+
+// WRITING
+
+//// writer.write(...)
+
+GITTEH_WORK_PRE(blob_write) {
+  BlobWriter* writer;
+  Persistent<Object> writer_obj;
+  Persistent<Object> buffer;
+  const char* data;
+  size_t length;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+V8_SCB(BlobWriter::Write) {
+  V8_M_UNWRAP(BlobWriter, args.This());
+  if (inst->busy) V8_STHROW(v8u::Err("The writer is busy."));
+  if (!(inst->stream || inst->spool)) V8_STHROW(v8u::Err("The writer is closed."));
+  int len = args.Length()-1; // don't count the callback
+  if (len < 1) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  if (!node::Buffer::HasInstance(args[0]))
+    V8_STHROW(v8u::TypeErr("Buffer needed as first argument."));
+  if (!args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  // the buffer stays referenced (and thus alive) until the job is done
+  Local<Object> buf = v8u::Obj(args[0]);
+  blob_write_req* r = new blob_write_req;
+  r->cancel.Take(args, len);
+  r->buffer = Persist(buf);
+  r->data = node::Buffer::Data(buf);
+  r->length = node::Buffer::Length(buf);
+  r->writer = inst;
+  r->writer_obj = Persist(args.This());
+  inst->busy = true;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(blob_write, inst->queue);
+} GITTEH_WORK(blob_write) {
+  BlobWriter* writer = r->writer;
+  r->failed = false;
+  if (r->cancel.Requested() || writer->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+  } else if (writer->stream) {
+    int status = writer->stream->write(writer->stream, r->data, r->length);
+    if (status < 0) {
+      collectErr(status, r->err);
+      r->failed = true;
+    }
+  } else if (fwrite(r->data, 1, r->length, writer->spool) != r->length) {
+    giterr_set_str(GITERR_OS, "Failed to spool the blob contents");
+    collectErr(GIT_ERROR, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(blob_write) {
+  BlobWriter* writer = r->writer;
+  writer->busy = false;
+  if (!r->failed) writer->written += r->length;
+  if (writer->closing) writer->Close();
+  r->writer_obj.Dispose();
+  r->buffer.Dispose();
+
+  v8::Handle<v8::Value> argv [1];
+  argv[0] = r->failed ? composeErr(r->err) : v8::Null();
+  GITTEH_WORK_CALL(1);
+} GITTEH_END
+
+//// writer.finish(...)
+
+GITTEH_WORK_PRE(blob_finish) {
+  BlobWriter* writer;
+  Persistent<Object> writer_obj;
+  git_oid out;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Writes the blob into the ODB and gives its Oid.
+// The writer is closed afterwards, whatever the outcome.
+V8_SCB(BlobWriter::Finish) {
+  V8_M_UNWRAP(BlobWriter, args.This());
+  if (inst->busy) V8_STHROW(v8u::Err("The writer is busy."));
+  if (!(inst->stream || inst->spool)) V8_STHROW(v8u::Err("The writer is closed."));
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  blob_finish_req* r = new blob_finish_req;
+  r->cancel.Take(args, len);
+  r->writer = inst;
+  r->writer_obj = Persist(args.This());
+  inst->busy = true;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(blob_finish, inst->queue);
+} GITTEH_WORK(blob_finish) {
+  BlobWriter* writer = r->writer;
+  int status = GIT_OK;
+  r->failed = false;
+  if (r->cancel.Requested() || writer->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+    return;
+  }
+
+  // now that the size is known, copy the spooled contents into the ODB;
+  // the size is what the writes counted, so offsets past 2GiB don't matter
+  if (!writer->stream) {
+    if (fseek(writer->spool, 0, SEEK_SET) < 0) {
+      giterr_set_str(GITERR_OS, "Failed to rewind the spooled blob contents");
+      status = GIT_ERROR;
+    }
+    if (status == GIT_OK)
+      status = git_odb_open_wstream(&writer->stream, writer->odb, writer->written, GIT_OBJ_BLOB);
+
+    char buf [GITTEH_BLOB_SPOOL_CHUNK];
+    size_t bytes, copied = 0;
+    while (status == GIT_OK && (bytes = fread(buf, 1, sizeof(buf), writer->spool)) > 0) {
+      status = writer->stream->write(writer->stream, buf, bytes);
+      copied += bytes;
+    }
+    if (status == GIT_OK && (ferror(writer->spool) || copied != writer->written)) {
+      giterr_set_str(GITERR_OS, "Failed to read the spooled blob contents");
+      status = GIT_ERROR;
+    }
+  }
+
+  if (status == GIT_OK)
+    status = writer->stream->finalize_write(&r->out, writer->stream);
+  if (status < 0) {
+    collectErr(status, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(blob_finish) {
+  BlobWriter* writer = r->writer;
+  writer->busy = false;
+  writer->Close();
+  r->writer_obj.Dispose();
+
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    argv[0] = v8::Null();
+    argv[1] = (new Oid(r->out))->Wrapped();
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+
+
+V8_ESCTOR(Blob) { V8_CTOR_NO_JS }
+
+// STATIC / FACTORY METHODS
+
+//// Blob.openReader(...)
+
+GITTEH_WORK_PRE(blob_open_reader) {
+  git_oid oid;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  git_odb* odb;
+  git_odb_stream* out;
+  size_t size;
+  error_info err;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+V8_SCB(Blob::OpenReader) {
+  int len = args.Length()-1; // don't count the callback
+  if (len < 2) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  Local<Object> repo_obj;
+  if (!(args[0]->IsObject() && Repository::HasInstance(repo_obj = v8u::Obj(args[0]))))
+    V8_STHROW(v8u::TypeErr("Repository needed as first argument."));
+  if (!args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  blob_open_reader_req* r = new blob_open_reader_req;
+  if (!toOid(args[1], r->oid)) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("OID needed as second argument."));
+  }
+  r->cancel.Take(args, len);
+
+  Repository* repo = node::ObjectWrap::Unwrap<Repository>(repo_obj);
+  r->repo = Persist(repo_obj);
+  r->git_repo = repo->repo;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(blob_open_reader, repo->queue);
+} GITTEH_WORK(blob_open_reader) {
+  r->odb = NULL;
+  r->out = NULL;
+  if (r->cancel.Requested()) {
+    cancelErr(r->err);
+    return;
+  }
+
+  git_otype type;
+  int status = git_repository_odb(&r->odb, r->git_repo);
+  if (status == GIT_OK)
+    status = git_odb_read_header(&r->size, &type, r->odb, &r->oid);
+  if (status == GIT_OK && type != GIT_OBJ_BLOB) {
+    giterr_set_str(GITERR_INVALID, "The object is not a blob");
+    status = GIT_ERROR;
+  }
+  if (status == GIT_OK)
+    status = git_odb_open_rstream(&r->out, r->odb, &r->oid);
+  if (status == GIT_OK) return;
+
+  collectErr(status, r->err);
+  git_odb_free(r->odb);
+  r->out = NULL;
+} GITTEH_WORK_AFTER(blob_open_reader) {
+  Repository* repo = node::ObjectWrap::Unwrap<Repository>(r->repo);
+  v8::Handle<v8::Value> argv [2];
+  if (r->out) {
+    argv[0] = v8::Null();
+    BlobReader* reader = new BlobReader(r->odb, r->out, r->size, r->repo, repo->queue);
+    reader->cancel.Take(r->cancel);
+    argv[1] = reader->Wrapped();
+  } else {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  }
+  r->repo.Dispose();
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+//// Blob.openWriter(...)
+
+GITTEH_WORK_PRE(blob_open_writer) {
+  bool sized;
+  size_t size;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  git_odb* odb;
+  git_odb_stream* stream;
+  FILE* spool;
+  error_info err;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// The size is optional; without it the contents are spooled (see BlobWriter).
+V8_SCB(Blob::OpenWriter) {
+  int len = args.Length()-1; // don't count the callback
+  if (len < 1) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  Local<Object> repo_obj;
+  if (!(args[0]->IsObject() && Repository::HasInstance(repo_obj = v8u::Obj(args[0]))))
+    V8_STHROW(v8u::TypeErr("Repository needed as first argument."));
+  if (!args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  blob_open_writer_req* r = new blob_open_writer_req;
+  r->cancel.Take(args, len);
+  r->sized = len >= 2 && args[1]->IsNumber();
+  r->size = 0;
+  if (r->sized) {
+    double size = v8u::Num(args[1]);
+    if (!(size >= 0 && size == (double)(size_t)size)) {
+      delete r;
+      V8_STHROW(v8u::RangeErr("Invalid blob size."));
+    }
+    r->size = (size_t)size;
+  }
+
+  Repository* repo = node::ObjectWrap::Unwrap<Repository>(repo_obj);
+  r->repo = Persist(repo_obj);
+  r->git_repo = repo->repo;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(blob_open_writer, repo->queue);
+} GITTEH_WORK(blob_open_writer) {
+  r->odb = NULL;
+  r->stream = NULL;
+  r->spool = NULL;
+  if (r->cancel.Requested()) {
+    cancelErr(r->err);
+    return;
+  }
+
+  int status = git_repository_odb(&r->odb, r->git_repo);
+  if (status == GIT_OK && r->sized)
+    status = git_odb_open_wstream(&r->stream, r->odb, r->size, GIT_OBJ_BLOB);
+  if (status == GIT_OK && !r->sized && !(r->spool = tmpfile())) {
+    giterr_set_str(GITERR_OS, "Failed to create a file to spool the blob contents");
+    status = GIT_ERROR;
+  }
+  if (status == GIT_OK) return;
+
+  collectErr(status, r->err);
+  git_odb_free(r->odb);
+  r->odb = NULL;
+} GITTEH_WORK_AFTER(blob_open_writer) {
+  Repository* repo = node::ObjectWrap::Unwrap<Repository>(r->repo);
+  v8::Handle<v8::Value> argv [2];
+  if (r->odb) {
+    argv[0] = v8::Null();
+    BlobWriter* writer = new BlobWriter(r->odb, r->stream, r->spool, r->size, r->repo, repo->queue);
+    writer->cancel.Take(r->cancel);
+    argv[1] = writer->Wrapped();
+  } else {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  }
+  r->repo.Dispose();
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+
+
+NODE_ETYPE(BlobReader, "BlobReader") {
+  V8_DEF_CB("read", Read);
+  V8_DEF_CB("close", Close);
+
+  V8_DEF_GET("size", GetSize);
+  V8_DEF_GET("busy", IsBusy);
+} NODE_TYPE_END()
+
+V8_POST_TYPE(BlobReader)
+
+NODE_ETYPE(BlobWriter, "BlobWriter") {
+  V8_DEF_CB("write", Write);
+  V8_DEF_CB("finish", Finish);
+  V8_DEF_CB("close", Close);
+
+  V8_DEF_GET("written", GetWritten);
+  V8_DEF_GET("busy", IsBusy);
+} NODE_TYPE_END()
+
+V8_POST_TYPE(BlobWriter)
+
+NODE_ETYPE(Blob, "Blob") {
+  Local<Function> func = templ->GetFunction();
+
+  func->Set(Symbol("openReader"), Func(OpenReader)->GetFunction());
+  func->Set(Symbol("openWriter"), Func(OpenWriter)->GetFunction());
+} NODE_TYPE_END()
+
+V8_POST_TYPE(Blob)
+
+};
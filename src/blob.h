@@ -0,0 +1,124 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GITTEH_BLOB_H
+#define	GITTEH_BLOB_H
+
+#include <cstdio>
+
+#include "git2.h"
+
+#include "v8u.hpp"
+
+#include "scheduler.h"
+#include "cancel.h"
+
+namespace gitteh {
+
+/*
+ * Blob contents as a stream, read a chunk at a time on the repository
+ * queue (see `read`), so large blobs never sit whole in memory.
+ * Wrapped as a Readable by Blob.createReadStream (lib/index.js).
+ */
+class BlobReader : public node::ObjectWrap {
+public:
+  BlobReader(git_odb* odb, git_odb_stream* stream, size_t size,
+             v8::Handle<v8::Object> repo, WorkQueue* queue);
+  ~BlobReader();
+  V8_SCTOR();
+
+  static V8_SCB(Read);
+  static V8_SCB(Close);
+
+  V8_SGET(GetSize);
+  V8_SGET(IsBusy);
+
+  NODE_STYPE(BlobReader);
+
+  // Frees the stream, now or (if busy) when the read in flight is done
+  void Close();
+
+  git_odb* const odb;
+  git_odb_stream* stream;
+  const size_t size;
+  size_t offset;
+  v8::Persistent<v8::Object> repo;
+  WorkQueue* const queue;
+  bool busy, closing;
+  // The token given when opening, checked by every job
+  CancelRef cancel;
+};
+
+/*
+ * Writes a new blob a chunk at a time, on the repository queue. When the
+ * size is known up front the chunks go straight into the ODB, which hashes
+ * and deflates them as they arrive; otherwise they're spooled into a
+ * temporary file and copied into the ODB by `finish`, once the size is known.
+ * Wrapped as a Writable by Blob.createWriteStream (lib/index.js).
+ */
+class BlobWriter : public node::ObjectWrap {
+public:
+  BlobWriter(git_odb* odb, git_odb_stream* stream, FILE* spool, size_t size,
+             v8::Handle<v8::Object> repo, WorkQueue* queue);
+  ~BlobWriter();
+  V8_SCTOR();
+
+  static V8_SCB(Write);
+  static V8_SCB(Finish);
+  static V8_SCB(Close);
+
+  V8_SGET(GetWritten);
+  V8_SGET(IsBusy);
+
+  NODE_STYPE(BlobWriter);
+
+  // Discards what was written, now or (if busy) when the job in flight is done
+  void Close();
+
+  git_odb* const odb;
+  git_odb_stream* stream;
+  FILE* spool;
+  const size_t size;
+  size_t written;
+  v8::Persistent<v8::Object> repo;
+  WorkQueue* const queue;
+  bool busy, closing;
+  // The token given when opening, checked by every job
+  CancelRef cancel;
+};
+
+class Blob : public node::ObjectWrap {
+public:
+  V8_SCTOR();
+
+  static V8_SCB(OpenReader);
+  static V8_SCB(OpenWriter);
+
+  NODE_STYPE(Blob);
+};
+
+};
+
+#endif	/* GITTEH_BLOB_H */
@@ -0,0 +1,95 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "cancel.h"
+
+
+namespace gitteh {
+
+// SHARED STATE
+
+Cancellation::Cancellation(): cancelled(false), refs(1) {}
+
+void Cancellation::Ref() { refs++; }
+void Cancellation::Unref() { if (--refs == 0) delete this; }
+
+CancelRef::CancelRef(): state(NULL) {}
+CancelRef::~CancelRef() {
+  if (state) state->Unref();
+}
+
+void CancelRef::Take(const v8::Arguments& args, int& len) {
+  if (len < 1 || !args[len-1]->IsObject()) return;
+  v8::Local<v8::Object> obj = v8u::Obj(args[len-1]);
+  if (!CancelToken::HasInstance(obj)) return;
+
+  if (state) state->Unref();
+  state = node::ObjectWrap::Unwrap<CancelToken>(obj)->state;
+  state->Ref();
+  len--;
+}
+
+void CancelRef::Take(const CancelRef& other) {
+  if (!other.state) return;
+  if (state) state->Unref();
+  state = other.state;
+  state->Ref();
+}
+
+
+
+// JS INTERFACE
+
+CancelToken::CancelToken(): state(new Cancellation) {}
+CancelToken::~CancelToken() {
+  state->Unref();
+}
+
+V8_ECTOR(CancelToken) {
+  V8_WRAP(new CancelToken);
+} V8_CTOR_END()
+
+V8_SCB(CancelToken::Cancel) {
+  V8_M_UNWRAP(CancelToken, args.This());
+  inst->state->cancelled = true;
+  return args.This();
+}
+
+V8_ESGET(CancelToken, IsCancelled) {
+  V8_M_UNWRAP(CancelToken, info.Holder());
+  return v8u::Bool(inst->state->cancelled);
+}
+
+
+
+NODE_ETYPE(CancelToken, "CancelToken") {
+  V8_DEF_CB("cancel", Cancel);
+
+  V8_DEF_GET("cancelled", IsCancelled);
+} NODE_TYPE_END()
+
+V8_POST_TYPE(CancelToken)
+
+};
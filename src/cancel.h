@@ -0,0 +1,102 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GITTEH_CANCEL_H
+#define	GITTEH_CANCEL_H
+
+#include "v8u.hpp"
+
+namespace gitteh {
+
+/*
+ * The flag behind a CancelToken.
+ *
+ * Requests keep a reference to it since they may outlive the token
+ * object. Refs are only touched from the main thread; workers just
+ * read `cancelled`, which only ever goes from false to true.
+ */
+class Cancellation {
+public:
+  Cancellation();
+
+  void Ref();
+  void Unref();
+
+  volatile bool cancelled;
+  int refs;
+};
+
+/*
+ * A request's hold on the token it was given, if any. It is released
+ * when the request is deleted, which happens on the main thread.
+ */
+class CancelRef {
+public:
+  CancelRef();
+  ~CancelRef();
+
+  /*
+   * Async calls take an optional CancelToken right before the callback.
+   * `len` is the callback's index; if the argument before it is a token,
+   * it's taken and `len` is decremented to exclude it.
+   */
+  void Take(const v8::Arguments& args, int& len);
+
+  // Shares the token held by another ref, if any
+  void Take(const CancelRef& other);
+
+  // Safe to call from the worker
+  inline bool Requested() const { return state && state->cancelled; }
+
+private:
+  Cancellation* state;
+};
+
+/*
+ * gitteh.CancelToken, to stop async operations early.
+ *
+ * Jobs still waiting in the queue fail as soon as a worker picks them;
+ * long-running ones (walks, batched lookups) stop at their next check.
+ * Either way the callback gets an error with `cancelled` set to true.
+ * Cancelling is permanent, use a new token for the next operation.
+ */
+class CancelToken : public node::ObjectWrap {
+public:
+  CancelToken();
+  ~CancelToken();
+  V8_SCTOR();
+
+  static V8_SCB(Cancel);
+
+  V8_SGET(IsCancelled);
+
+  NODE_STYPE(CancelToken);
+
+  Cancellation* const state;
+};
+
+};
+
+#endif	/* GITTEH_CANCEL_H */
@@ -25,7 +25,10 @@
 
 #include "commit.h"
 
+#include <vector>
+
 #include "repository.h"
+#include "cancel.h"
 #include "common.h"
 #include "error.h"
 #include "oid.h"
@@ -40,6 +43,7 @@ using v8::Object;
 using v8::Local;
 using v8::Persistent;
 using v8::Function;
+using v8::Array;
 
 namespace gitteh {
 
@@ -62,6 +66,7 @@ GITTEH_WORK_PRE(commit_lookup) {
   Persistent<Object> repo;
   git_commit* out;
   error_info err;
+  CancelRef cancel;
 
   Persistent<Function> cb;
   uv_work_t req;
@@ -78,9 +83,16 @@ V8_SCB(Commit::Lookup) {
   r->repo = Persist(repo_obj);
   memcpy(r->oid.id, node::ObjectWrap::Unwrap<Oid>(oid_obj)->oid.id, GIT_OID_RAWSZ);
 
-  r->cb = Persist(v8u::Cast<Function>(args[2]));
-  GITTEH_WORK_QUEUE(commit_lookup);
+  int len = args.Length()-1; // don't count the callback
+  r->cancel.Take(args, len);
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(commit_lookup, node::ObjectWrap::Unwrap<Repository>(repo_obj)->queue);
 } GITTEH_WORK(commit_lookup) {
+  if (r->cancel.Requested()) {
+    cancelErr(r->err);
+    r->out = NULL;
+    return;
+  }
   int status = git_commit_lookup(&r->out, node::ObjectWrap::Unwrap<Repository>(r->repo)->repo, &r->oid);
   if (status == GIT_OK) return;
   collectErr(status, r->err);
@@ -99,6 +111,47 @@ V8_SCB(Commit::Lookup) {
 } GITTEH_END
 
 
+//// Commit.lookupMany(...)
+
+struct commit_lookup_many_req : lookup_many_req {
+  std::vector<git_oid> oids;
+  std::vector<git_commit*> out;
+
+  int Lookup(size_t i) {
+    int status = git_commit_lookup(&out[i], git_repo, &oids[i]);
+    if (status != GIT_OK) out[i] = NULL;
+    return status;
+  }
+  v8::Handle<v8::Value> Wrap(size_t i) {
+    if (!out[i]) return v8::Null();
+    return (new Commit(out[i]))->Wrapped();
+  }
+};
+
+// See lookup_many_req for the batching (and cancelling) rules.
+V8_SCB(Commit::LookupMany) {
+  int len = args.Length()-1; // don't count the callback
+  if (len < 2) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  Local<Object> repo_obj;
+  if (!(args[0]->IsObject() && Repository::HasInstance(repo_obj = v8u::Obj(args[0]))))
+    V8_STHROW(v8u::TypeErr("Repository needed as first argument."));
+  if (!args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  commit_lookup_many_req* r = new commit_lookup_many_req;
+  r->cancel.Take(args, len);
+  const char* msg = Oid::FromList(args[1], r->oids);
+  if (msg) {
+    delete r;
+    V8_STHROW(v8u::TypeErr(msg));
+  }
+  r->length = r->oids.size();
+  r->out.resize(r->length, NULL);
+
+  return queueLookupMany(r, args, len, repo_obj);
+}
+
+
 
 NODE_ETYPE(Commit, "Commit") {
   //TODO
@@ -106,6 +159,7 @@ NODE_ETYPE(Commit, "Commit") {
   Local<Function> func = templ->GetFunction();
   
   func->Set(Symbol("lookup"), Func(Lookup)->GetFunction());
+  func->Set(Symbol("lookupMany"), Func(LookupMany)->GetFunction());
 //  func->Set(Symbol("lookupSync"), Func(LookupSync)->GetFunction());
   
 } NODE_TYPE_END()
@@ -41,6 +41,7 @@ public:
   V8_SCTOR();
 
   static V8_SCB(Lookup); //static V8_SCB(LookupSync);
+  static V8_SCB(LookupMany);
 
   NODE_STYPE(Commit);
 protected:
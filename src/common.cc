@@ -25,11 +25,88 @@
 
 #include "common.h"
 
+#include <algorithm>
+
+#include "repository.h"
+
 
 namespace gitteh {
 
 GITTEH_ERROR_THROWER(_isAbstract,
   v8u::TypeErr("This function is meant to be overriden."))
 
+
+// LOOKING UP MANY
+
+v8::Handle<v8::Value> queueLookupMany(lookup_many_req* r, const v8::Arguments& args,
+                                      int len, v8::Handle<v8::Object> repo_obj) {
+  r->chunk = r->length;
+  if (len > 2 && args[2]->IsObject()) {
+    v8::Local<v8::Object> opts = v8u::Obj(args[2]);
+    v8::Local<v8::Value> chunk = opts->Get(v8u::Symbol("chunkSize"));
+    v8::Local<v8::Value> progress = opts->Get(v8u::Symbol("progress"));
+    if (chunk->IsNumber() && v8u::Int(chunk) > 0) r->chunk = v8u::Int(chunk);
+    if (progress->IsFunction()) r->progress = v8u::Persist(v8u::Cast<v8::Function>(progress));
+  }
+
+  Repository* repo = node::ObjectWrap::Unwrap<Repository>(repo_obj);
+  r->repo = v8u::Persist(repo_obj);
+  r->git_repo = repo->repo;
+  r->queue = repo->queue;
+  r->offset = 0;
+  r->failed = false;
+  r->result = v8u::Persist(v8u::Arr(r->length));
+
+  r->cb = v8u::Persist(v8u::Cast<v8::Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(lookup_many, r->queue);
+}
+
+GITTEH_WORK(lookup_many) {
+  size_t end = std::min(r->offset + r->chunk, r->length);
+  for (size_t i = r->offset; i < end; i++) {
+    if (r->cancel.Requested()) {
+      cancelErr(r->err);
+      r->failed = true;
+      return;
+    }
+    int status = r->Lookup(i);
+    if (status == GIT_OK || status == GIT_ENOTFOUND) continue;
+    collectErr(status, r->err);
+    r->failed = true;
+    return;
+  }
+} GITTEH_WORK_AFTER(lookup_many) {
+  size_t end = std::min(r->offset + r->chunk, r->length);
+  v8::Local<v8::Array> chunk = v8u::Arr(end - r->offset);
+  for (size_t i = r->offset; i < end; i++) {
+    v8::Handle<v8::Value> item = r->Wrap(i);
+    r->result->Set(i, item);
+    chunk->Set(i - r->offset, item);
+  }
+
+  if (!r->failed && !r->progress.IsEmpty()) {
+    v8::Handle<v8::Value> argv [2] = {chunk, v8u::Uint(r->offset)};
+    GITTEH_WORK_NOTIFY(progress, 2);
+  }
+  r->offset = end;
+  if (!r->failed && r->offset < r->length) {
+    GITTEH_WORK_REQUEUE(lookup_many, r->queue);
+  }
+
+  r->repo.Dispose();
+  v8u::ClearPersistent(r->progress);
+  v8::Local<v8::Array> result = v8::Local<v8::Array>::New(r->result);
+  r->result.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    argv[0] = v8::Null();
+    argv[1] = result;
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
 };
 
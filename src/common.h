@@ -26,8 +26,16 @@
 #ifndef GITTEH_COMMON_H
 #define	GITTEH_COMMON_H
 
+#include <vector>
+
+#include "git2.h"
+
 #include "v8u.hpp"
 
+#include "scheduler.h"
+#include "cancel.h"
+#include "error.h"
+
 namespace gitteh {
 
 #define GITTEH_ERROR_THROWER(IDENTIFIER, ERR)                                  \
@@ -50,9 +58,12 @@ V8_SCB(_isAbstract);
 #define GITTEH_WORK_UNWRAP(IDENTIFIER)                                         \
   IDENTIFIER##_req* r = (IDENTIFIER##_req*)req->data
 #define GITTEH_WORK_QUEUE(IDENTIFIER)                                          \
+  GITTEH_WORK_QUEUE_ON(IDENTIFIER, Scheduler::DefaultQueue())
+// Use this one when the work belongs to a repository (see Scheduler)
+#define GITTEH_WORK_QUEUE_ON(IDENTIFIER, QUEUE)                                \
   r->req.data = r;                                                             \
-  return v8::Integer::New(uv_queue_work(uv_default_loop(), &r->req,            \
-                                        IDENTIFIER##_work, IDENTIFIER##_after))
+  return v8::Integer::New(Scheduler::Queue(QUEUE, &r->req,                     \
+                                           IDENTIFIER##_work, IDENTIFIER##_after))
 #define GITTEH_WORK_CALL(ARGC)                                                 \
   v8::TryCatch try_catch;                                                      \
   r->cb->Call(v8::Context::GetCurrent()->Global(), ARGC, argv);                \
@@ -60,6 +71,17 @@ V8_SCB(_isAbstract);
   delete r;                                                                    \
   if (try_catch.HasCaught()) node::FatalException(try_catch)
 
+// For intermediate callbacks (progress, chunks...), keeps the request alive
+#define GITTEH_WORK_NOTIFY(CB, ARGC) {                                         \
+    v8::TryCatch try_catch;                                                    \
+    r->CB->Call(v8::Context::GetCurrent()->Global(), ARGC, argv);              \
+    if (try_catch.HasCaught()) node::FatalException(try_catch);                \
+  }
+// Run the same request again (i.e. to process the next chunk)
+#define GITTEH_WORK_REQUEUE(IDENTIFIER, QUEUE)                                 \
+  Scheduler::Queue(QUEUE, &r->req, IDENTIFIER##_work, IDENTIFIER##_after);     \
+  return
+
 
 //Work callbacks block-macros
 #define GITTEH_WORK_PRE(IDENTIFIER)                                            \
@@ -81,6 +103,46 @@ V8_SCB(_isAbstract);
 #define GITTEH_CHECK_CB_ARGS(MIN)                                              \
   if (len < 1) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
 
+
+/*
+ * The batching behind the `lookupMany` calls. The whole batch runs as a
+ * single job, unless a chunkSize is given: then every chunk is a job,
+ * and is passed to `progress`. Missing items are given as null. When
+ * cancelled, the callback gets the error and no more chunks.
+ *
+ * Each kind of item subclasses it with the list to look up (`length`
+ * items), how to look one up and how to wrap it.
+ */
+GITTEH_WORK_PRE(lookup_many) {
+  virtual ~lookup_many_req() {}
+
+  // On the worker; GIT_ENOTFOUND leaves the item missing
+  virtual int Lookup(size_t i) = 0;
+  // On the main thread; null if the item is missing
+  virtual v8::Handle<v8::Value> Wrap(size_t i) = 0;
+
+  size_t length, offset, chunk;
+  v8::Persistent<v8::Object> repo;
+  git_repository* git_repo;
+  WorkQueue* queue;
+  v8::Persistent<v8::Array> result;
+  v8::Persistent<v8::Function> progress;
+  bool failed;
+  error_info err;
+  CancelRef cancel;
+
+  v8::Persistent<v8::Function> cb;
+  uv_work_t req;
+};
+
+/*
+ * Queue `r` on the queue of the Repository `repo_obj`, with the options
+ * in args[2] (if any) and the callback; `len` is the callback's index,
+ * once the token (if any) was taken.
+ */
+v8::Handle<v8::Value> queueLookupMany(lookup_many_req* r, const v8::Arguments& args,
+                                      int len, v8::Handle<v8::Object> repo_obj);
+
 };
 
 #endif	/* GITTEH_COMMON_H */
@@ -0,0 +1,289 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "diff.h"
+
+#include <string>
+#include <vector>
+
+#include "cancel.h"
+#include "common.h"
+#include "error.h"
+#include "oidarray.h"
+
+
+using v8u::Int;
+using v8u::Symbol;
+using v8u::Persist;
+using v8::Object;
+using v8::Local;
+using v8::Persistent;
+using v8::Function;
+
+namespace gitteh {
+
+Diff::Diff(git_diff_list* ptr, v8::Handle<Object> repo, WorkQueue* queue):
+  diff(ptr), repo(Persist(repo)), queue(queue), busy(false) {}
+Diff::~Diff() {
+  git_diff_list_free(diff);
+  repo.Dispose();
+}
+
+V8_ESCTOR(Diff) { V8_CTOR_NO_JS }
+
+// The list is made with GIT_DIFF_SKIP_BINARY_CHECK, so that looking at
+// a delta doesn't load its blobs: whether it's binary is left to `patch`.
+// The paths are in `oldPaths` and `newPaths` (the same string when they
+// don't differ), the kind of change in `statuses` (see Diff.Delta), the
+// blobs in the `oldIds` and `newIds` OidArrays (zero for the missing
+// side) and the modes in `oldModes` and `newModes`.
+void Diff::Describe(v8::Handle<Object> obj) {
+  size_t length = git_diff_num_deltas(diff);
+  Local<v8::Array> statuses = v8u::Arr(length);
+  Local<v8::Array> old_paths = v8u::Arr(length);
+  Local<v8::Array> new_paths = v8u::Arr(length);
+  Local<v8::Array> old_modes = v8u::Arr(length);
+  Local<v8::Array> new_modes = v8u::Arr(length);
+  OidArray* old_ids = OidArray::New(length);
+  OidArray* new_ids = OidArray::New(length);
+
+  for (size_t i = 0; i < length; i++) {
+    const git_diff_delta* delta;
+    git_diff_get_patch(NULL, &delta, diff, i);
+
+    Local<v8::String> old_path = v8u::Str(delta->old_file.path);
+    statuses->Set(i, v8u::Uint(delta->status));
+    old_paths->Set(i, old_path);
+    new_paths->Set(i, strcmp(delta->old_file.path, delta->new_file.path) == 0 ?
+                      old_path : v8u::Str(delta->new_file.path));
+    old_modes->Set(i, v8u::Uint(delta->old_file.mode));
+    new_modes->Set(i, v8u::Uint(delta->new_file.mode));
+    git_oid_cpy(&old_ids->oids[i], &delta->old_file.oid);
+    git_oid_cpy(&new_ids->oids[i], &delta->new_file.oid);
+  }
+
+  obj->Set(Symbol("statuses"), statuses);
+  obj->Set(Symbol("oldPaths"), old_paths);
+  obj->Set(Symbol("newPaths"), new_paths);
+  obj->Set(Symbol("oldModes"), old_modes);
+  obj->Set(Symbol("newModes"), new_modes);
+  obj->Set(Symbol("oldIds"), old_ids->Wrapped());
+  obj->Set(Symbol("newIds"), new_ids->Wrapped());
+}
+
+V8_ESGET(Diff, GetLength) {
+  V8_M_UNWRAP(Diff, info.Holder());
+  return v8u::Uint(git_diff_num_deltas(inst->diff));
+}
+
+
+
+// PATCHES
+
+//// diff.patch(...)
+
+struct diff_hunk {
+  git_diff_range range;
+  std::string header;
+  std::string origins; // one GIT_DIFF_LINE_* char per line
+  std::vector<std::string> lines;
+};
+
+GITTEH_WORK_PRE(diff_patch) {
+  Diff* diff;
+  Persistent<Object> diff_obj;
+  size_t index;
+  bool binary;
+  std::vector<diff_hunk> hunks;
+  bool failed;
+  error_info err;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Generates the hunks and lines of the `i`th file. The callback gets an
+// object with `binary` and the `hunks`, each with its `header`, the
+// `oldStart`, `oldLines`, `newStart` and `newLines` of its range, and
+// its `lines` (without their origin), whose origins are the chars of
+// `origins` (see gitteh.Diff.Line). Binary files and unchanged ones have
+// no hunks. Patches of the same diff are generated one after another,
+// so one asked for while another is in flight waits its turn; either way
+// the return value is that of a job accepted by the scheduler.
+V8_SCB(Diff::Patch) {
+  V8_M_UNWRAP(Diff, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  diff_patch_req* r = new diff_patch_req;
+  r->cancel.Take(args, len);
+  if (len < 1 || !args[0]->IsNumber() || Int(args[0]) < 0 ||
+      (size_t)Int(args[0]) >= git_diff_num_deltas(inst->diff)) {
+    delete r;
+    V8_STHROW(v8u::RangeErr("Index of a delta needed as first argument."));
+  }
+
+  r->diff = inst;
+  r->diff_obj = Persist(args.This());
+  r->index = Int(args[0]);
+  r->binary = false;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  r->req.data = r;
+  int queued = 0;
+  if (inst->busy) {
+    inst->waiting.push_back(r);
+  } else {
+    inst->busy = true;
+    queued = Scheduler::Queue(inst->queue, &r->req, diff_patch_work, diff_patch_after);
+  }
+  return v8::Integer::New(queued);
+} GITTEH_WORK(diff_patch) {
+  if (r->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+    return;
+  }
+
+  git_diff_patch* patch;
+  const git_diff_delta* delta;
+  int status = git_diff_get_patch(&patch, &delta, r->diff->diff, r->index);
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+    return;
+  }
+  r->binary = delta->binary == 1;
+  if (!patch) return;
+
+  r->hunks.resize(git_diff_patch_num_hunks(patch));
+  for (size_t h = 0; h < r->hunks.size() && status == GIT_OK; h++) {
+    diff_hunk& hunk = r->hunks[h];
+    const git_diff_range* range;
+    const char* header;
+    size_t header_len, lines;
+    status = git_diff_patch_get_hunk(&range, &header, &header_len, &lines, patch, h);
+    if (status != GIT_OK) break;
+    hunk.range = *range;
+    hunk.header.assign(header, header_len);
+    hunk.origins.resize(lines);
+    hunk.lines.resize(lines);
+
+    for (size_t l = 0; l < lines; l++) {
+      const char* content;
+      size_t content_len;
+      int old_lineno, new_lineno;
+      status = git_diff_patch_get_line_in_hunk(&hunk.origins[l], &content,
+          &content_len, &old_lineno, &new_lineno, patch, h, l);
+      if (status != GIT_OK) break;
+      hunk.lines[l].assign(content, content_len);
+    }
+  }
+  git_diff_patch_free(patch);
+
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(diff_patch) {
+  // on to the next one, if any
+  Diff* diff = r->diff;
+  if (diff->waiting.empty()) {
+    diff->busy = false;
+  } else {
+    diff_patch_req* next = diff->waiting.front();
+    diff->waiting.pop_front();
+    Scheduler::Queue(diff->queue, &next->req, diff_patch_work, diff_patch_after);
+  }
+
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    Local<v8::Array> hunks = v8u::Arr(r->hunks.size());
+    for (size_t h = 0; h < r->hunks.size(); h++) {
+      diff_hunk& hunk = r->hunks[h];
+      Local<Object> obj = v8u::Obj();
+      Local<v8::Array> lines = v8u::Arr(hunk.lines.size());
+      for (size_t l = 0; l < hunk.lines.size(); l++)
+        lines->Set(l, v8::String::New(hunk.lines[l].data(), hunk.lines[l].length()));
+      obj->Set(Symbol("header"), v8::String::New(hunk.header.data(), hunk.header.length()));
+      obj->Set(Symbol("oldStart"), Int(hunk.range.old_start));
+      obj->Set(Symbol("oldLines"), Int(hunk.range.old_lines));
+      obj->Set(Symbol("newStart"), Int(hunk.range.new_start));
+      obj->Set(Symbol("newLines"), Int(hunk.range.new_lines));
+      obj->Set(Symbol("origins"), v8::String::New(hunk.origins.data(), hunk.origins.length()));
+      obj->Set(Symbol("lines"), lines);
+      hunks->Set(h, obj);
+    }
+    Local<Object> result = v8u::Obj();
+    result->Set(Symbol("binary"), v8u::Bool(r->binary));
+    result->Set(Symbol("hunks"), hunks);
+    argv[0] = v8::Null();
+    argv[1] = result;
+  }
+  r->diff_obj.Dispose();
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+
+
+NODE_ETYPE(Diff, "Diff") {
+  V8_DEF_CB("patch", Patch);
+
+  V8_DEF_GET("length", GetLength);
+
+  Local<Function> func = templ->GetFunction();
+
+  //FLAG: kinds of change -- DELTA
+  Local<Object> deltaHash = v8u::Obj();
+  deltaHash->Set(Symbol("UNMODIFIED"), Int(GIT_DELTA_UNMODIFIED));
+  deltaHash->Set(Symbol("ADDED"), Int(GIT_DELTA_ADDED));
+  deltaHash->Set(Symbol("DELETED"), Int(GIT_DELTA_DELETED));
+  deltaHash->Set(Symbol("MODIFIED"), Int(GIT_DELTA_MODIFIED));
+  deltaHash->Set(Symbol("RENAMED"), Int(GIT_DELTA_RENAMED));
+  deltaHash->Set(Symbol("COPIED"), Int(GIT_DELTA_COPIED));
+  deltaHash->Set(Symbol("IGNORED"), Int(GIT_DELTA_IGNORED));
+  deltaHash->Set(Symbol("UNTRACKED"), Int(GIT_DELTA_UNTRACKED));
+  deltaHash->Set(Symbol("TYPECHANGE"), Int(GIT_DELTA_TYPECHANGE));
+  func->Set(Symbol("Delta"), deltaHash);
+
+  //FLAG: origins of lines -- LINE
+  Local<Object> lineHash = v8u::Obj();
+  lineHash->Set(Symbol("CONTEXT"), v8u::Str(std::string(1, GIT_DIFF_LINE_CONTEXT)));
+  lineHash->Set(Symbol("ADDITION"), v8u::Str(std::string(1, GIT_DIFF_LINE_ADDITION)));
+  lineHash->Set(Symbol("DELETION"), v8u::Str(std::string(1, GIT_DIFF_LINE_DELETION)));
+  lineHash->Set(Symbol("ADD_EOFNL"), v8u::Str(std::string(1, GIT_DIFF_LINE_ADD_EOFNL)));
+  lineHash->Set(Symbol("DEL_EOFNL"), v8u::Str(std::string(1, GIT_DIFF_LINE_DEL_EOFNL)));
+  func->Set(Symbol("Line"), lineHash);
+} NODE_TYPE_END()
+
+V8_POST_TYPE(Diff)
+
+};
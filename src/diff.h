@@ -0,0 +1,72 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GITTEH_DIFF_H
+#define	GITTEH_DIFF_H
+
+#include <deque>
+
+#include "git2.h"
+
+#include "v8u.hpp"
+
+#include "scheduler.h"
+
+namespace gitteh {
+
+struct diff_patch_req;
+
+/*
+ * A diff between two trees, see Repository#diff. The list of deltas is
+ * handed over when it's created; the hunks and lines of each file are
+ * only generated when asked for, on the repository queue (see `patch`).
+ */
+class Diff : public node::ObjectWrap {
+public:
+  Diff(git_diff_list* ptr, v8::Handle<v8::Object> repo, WorkQueue* queue);
+  ~Diff();
+  V8_SCTOR();
+
+  // Sets the delta list on `obj`, its wrapper, in one go
+  void Describe(v8::Handle<v8::Object> obj);
+
+  static V8_SCB(Patch);
+
+  V8_SGET(GetLength);
+
+  NODE_STYPE(Diff);
+
+  git_diff_list* const diff;
+  v8::Persistent<v8::Object> repo;
+  WorkQueue* const queue;
+
+  // Patches share the list, so they're generated one at a time
+  bool busy;
+  std::deque<diff_patch_req*> waiting;
+};
+
+};
+
+#endif	/* GITTEH_DIFF_H */
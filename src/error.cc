@@ -35,10 +35,22 @@ void check(int status) {
 }
 
 void collectErr(int status, error_info& info) {
+  info.status = status;
+  info.cancelled = false;
   //TODO
 }
 
+void cancelErr(error_info& info) {
+  info.status = GIT_EUSER;
+  info.cancelled = true;
+}
+
 v8::Local<v8::Value> composeErr(error_info& info) {
+  if (info.cancelled) {
+    v8::Local<v8::Object> err = v8u::Obj(v8u::Err("Operation cancelled."));
+    err->Set(v8u::Symbol("cancelled"), v8::True());
+    return err;
+  }
   //TODO
   return v8u::Err("Native libgit2 error.");
 }
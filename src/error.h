@@ -45,7 +45,10 @@ namespace gitteh {
  */
 struct error_info {
   int status;
+  bool cancelled;
   git_error error;
+
+  error_info() : status(GIT_OK), cancelled(false) {}
 };
 
 /*
@@ -63,6 +66,13 @@ void check(int status);
  */
 void collectErr(int status, error_info& info);
 
+/*
+ * Collect the error for an operation stopped through a CancelToken.
+ * Only these are reported as cancelled: a GIT_EUSER coming from
+ * anywhere else is an ordinary error.
+ */
+void cancelErr(error_info& info);
+
 /*
  * Create the JS error object provided a previous info
  * captured with `collectErr`.
@@ -28,6 +28,7 @@
 #include <node_buffer.h>
 
 #include "error.h"
+#include "oidarray.h"
 
 
 using v8::Handle;
@@ -137,6 +138,31 @@ V8_CB(Oid::ParseArray) {
   V8_RET(output);
 } V8_CB_END()
 
+const char* Oid::FromList(v8::Handle<v8::Value> list, std::vector<git_oid>& out) {
+  if (list->IsObject() && OidArray::HasInstance(v8u::Obj(list))) {
+    OidArray* arr = node::ObjectWrap::Unwrap<OidArray>(v8u::Obj(list));
+    out.assign(arr->oids, arr->oids + arr->length);
+    return NULL;
+  }
+  if (!list->IsArray()) return "Array of OIDs required.";
+  Local<v8::Array> input = v8u::Arr(list);
+  uint32_t len = input->Length();
+  out.resize(len);
+
+  for (uint32_t i = 0; i < len; i++) {
+    Local<v8::Value> item = input->Get(i);
+    if (item->IsObject() && HasInstance(v8u::Obj(item))) {
+      git_oid_cpy(&out[i], &node::ObjectWrap::Unwrap<Oid>(v8u::Obj(item))->oid);
+      continue;
+    }
+    v8::String::Utf8Value str (item);
+    if (*str == NULL || str.length() != GIT_OID_HEXSZ ||
+        git_oid_fromstr(&out[i], *str) != GIT_OK)
+      return "Invalid OID found in the array.";
+  }
+  return NULL;
+}
+
 V8_ESGET(Oid, IsEmpty) { //TODO: translate to standard prop
   V8_M_UNWRAP(Oid, info.Holder());
   return v8u::Bool(git_oid_iszero(&inst->oid));
@@ -26,6 +26,8 @@
 #ifndef GITTEH_OID_H
 #define	GITTEH_OID_H
 
+#include <vector>
+
 #include "git2.h"
 
 #include "v8u.hpp"
@@ -57,6 +59,12 @@ public:
   static V8_SCB(Parse);
   static V8_SCB(ParseArray);
 
+  /*
+   * Read a JS array of Oids (or hex strings), or an OidArray, into `out`.
+   * Returns NULL if everything went fine, or an error message.
+   */
+  static const char* FromList(v8::Handle<v8::Value> list, std::vector<git_oid>& out);
+
   V8_SGET(IsEmpty);
 
   NODE_STYPE(Oid);
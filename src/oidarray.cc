@@ -0,0 +1,197 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "oidarray.h"
+
+#include <stdlib.h>
+#include <vector>
+
+#include <node_buffer.h>
+
+#include "oid.h"
+
+
+using v8::Handle;
+using v8::Local;
+using v8u::Symbol;
+using v8u::Func;
+
+namespace gitteh {
+
+OidArray::OidArray(Handle<v8::Object> buf) {
+  buffer = v8u::Persist(buf);
+  oids = (git_oid*)node::Buffer::Data(buf);
+  length = node::Buffer::Length(buf) / GIT_OID_RAWSZ;
+}
+OidArray::~OidArray() {
+  buffer.Dispose();
+}
+
+OidArray* OidArray::New(size_t length) {
+  node::Buffer* buf = node::Buffer::New(length * GIT_OID_RAWSZ);
+  return new OidArray(Local<v8::Object>::New(buf->handle_));
+}
+
+// Wraps the given Buffer, without copying it
+V8_ECTOR(OidArray) {
+  if (!node::Buffer::HasInstance(args[0]))
+    V8_THROW(v8u::TypeErr("Data must be a Buffer"));
+  Local<v8::Object> buf = v8u::Obj(args[0]);
+  if (node::Buffer::Length(buf) % GIT_OID_RAWSZ)
+    V8_THROW(v8u::RangeErr("Buffer length must be a multiple of 20"));
+  V8_WRAP(new OidArray(buf));
+} V8_CTOR_END()
+
+static inline size_t at_index(OidArray* inst, Handle<v8::Value> value) {
+  int64_t i = value->IntegerValue();
+  if (!value->IsNumber() || i < 0 || (uint64_t)i >= inst->length)
+    V8_THROW(v8u::RangeErr("Index out of bounds."));
+  return i;
+}
+
+// Accepts an Oid, or a full hex string
+static inline void toOid(Handle<v8::Value> value, git_oid& out) {
+  if (value->IsObject() && Oid::HasInstance(v8u::Obj(value))) {
+    git_oid_cpy(&out, &node::ObjectWrap::Unwrap<Oid>(v8u::Obj(value))->oid);
+    return;
+  }
+  v8::String::Utf8Value str (value);
+  if (*str == NULL || str.length() != GIT_OID_HEXSZ ||
+      git_oid_fromstr(&out, *str) != GIT_OK)
+    V8_THROW(v8u::TypeErr("OID or hex string required."));
+}
+
+V8_CB(OidArray::Get) {
+  OidArray* inst = Unwrap(args.This());
+  V8_RET((new Oid(inst->oids[at_index(inst, args[0])]))->Wrapped());
+} V8_CB_END()
+
+V8_CB(OidArray::Hex) {
+  OidArray* inst = Unwrap(args.This());
+  char hex [GIT_OID_HEXSZ];
+  git_oid_fmt(hex, &inst->oids[at_index(inst, args[0])]);
+  V8_RET(v8u::Str(hex, GIT_OID_HEXSZ));
+} V8_CB_END()
+
+V8_CB(OidArray::ToStrings) {
+  OidArray* inst = Unwrap(args.This());
+  size_t start = 0, end = inst->length;
+  if (args.Length() > 1) {
+    int64_t e = args[1]->IntegerValue();
+    if (e >= 0 && e < (int64_t)end) end = e;
+  }
+  if (args.Length() > 0 && args[0]->IntegerValue() > 0)
+    start = args[0]->IntegerValue();
+  if (end < start) end = start;
+
+  Local<v8::Array> ret = v8u::Arr(end - start);
+  char hex [GIT_OID_HEXSZ];
+  for (size_t i = start; i < end; i++) {
+    git_oid_fmt(hex, &inst->oids[i]);
+    ret->Set(i - start, v8u::Str(hex, GIT_OID_HEXSZ));
+  }
+  V8_RET(ret);
+} V8_CB_END()
+
+V8_CB(OidArray::Compare) {
+  OidArray* inst = Unwrap(args.This());
+  git_oid* a = &inst->oids[at_index(inst, args[0])];
+  git_oid* b = &inst->oids[at_index(inst, args[1])];
+  V8_RET(v8u::Int(git_oid_cmp(a, b)));
+} V8_CB_END()
+
+static int oid_cmp(const void* a, const void* b) {
+  return git_oid_cmp((const git_oid*)a, (const git_oid*)b);
+}
+
+V8_CB(OidArray::Sort) {
+  OidArray* inst = Unwrap(args.This());
+  qsort(inst->oids, inst->length, sizeof(git_oid), oid_cmp);
+  V8_RET(args.This());
+} V8_CB_END()
+
+// The array must be sorted! Returns -1 if not found.
+V8_CB(OidArray::Search) {
+  OidArray* inst = Unwrap(args.This());
+  git_oid oid;
+  toOid(args[0], oid);
+
+  size_t lo = 0, hi = inst->length;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = git_oid_cmp(&inst->oids[mid], &oid);
+    if (cmp == 0) V8_RET(v8u::Num(mid));
+    if (cmp < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  V8_RET(v8u::Int(-1));
+} V8_CB_END()
+
+V8_CB(OidArray::Inspect) {
+  OidArray* inst = Unwrap(args.This());
+  char str [64];
+  V8_RET(v8u::Str(str, sprintf(str, "<OidArray %lu>", (unsigned long)inst->length)));
+} V8_CB_END()
+
+V8_CB(OidArray::Parse) {
+  std::vector<git_oid> list;
+  const char* msg = Oid::FromList(args[0], list);
+  if (msg) V8_THROW(v8u::TypeErr(msg));
+
+  OidArray* inst = New(list.size());
+  if (list.size()) memcpy(inst->oids, &list[0], list.size() * sizeof(git_oid));
+  V8_RET(inst->Wrapped());
+} V8_CB_END()
+
+V8_ESGET(OidArray, GetLength) {
+  V8_M_UNWRAP(OidArray, info.Holder());
+  return v8u::Num(inst->length);
+}
+
+V8_ESGET(OidArray, GetBuffer) {
+  V8_M_UNWRAP(OidArray, info.Holder());
+  return inst->buffer;
+}
+
+NODE_ETYPE(OidArray, "OidArray") {
+  V8_DEF_CB("get", Get);
+  V8_DEF_CB("hex", Hex);
+  V8_DEF_CB("toStrings", ToStrings);
+
+  V8_DEF_CB("compare", Compare);
+  V8_DEF_CB("sort", Sort);
+  V8_DEF_CB("search", Search);
+
+  V8_DEF_CB("inspect", Inspect);
+
+  V8_DEF_GET("length", GetLength);
+  V8_DEF_GET("buffer", GetBuffer);
+
+  Local<v8::Function> func = templ->GetFunction();
+  func->Set(Symbol("parse"), Func(Parse)->GetFunction());
+} NODE_TYPE_END()
+V8_POST_TYPE(OidArray)
+
+};
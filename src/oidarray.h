@@ -0,0 +1,77 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GITTEH_OIDARRAY_H
+#define	GITTEH_OIDARRAY_H
+
+#include "git2.h"
+
+#include "v8u.hpp"
+
+namespace gitteh {
+
+/*
+ * A packed list of raw OIDs, stored back to back in a single Buffer.
+ *
+ * Unlike an array of Oid, this is just one object for the GC no matter
+ * how many ids it holds. Individual Oid wrappers are only created when
+ * asked for with `get(i)`.
+ */
+class OidArray : public node::ObjectWrap {
+public:
+  OidArray(v8::Handle<v8::Object> buffer);
+  ~OidArray();
+  V8_SCTOR();
+
+  /*
+   * Allocate an array with room for `length` ids.
+   */
+  static OidArray* New(size_t length);
+
+  static V8_SCB(Get);
+  static V8_SCB(Hex);
+  static V8_SCB(ToStrings);
+
+  static V8_SCB(Compare);
+  static V8_SCB(Sort);
+  static V8_SCB(Search);
+
+  static V8_SCB(Inspect);
+
+  static V8_SCB(Parse);
+
+  V8_SGET(GetLength);
+  V8_SGET(GetBuffer);
+
+  NODE_STYPE(OidArray);
+
+  v8::Persistent<v8::Object> buffer;
+  git_oid* oids;
+  size_t length;
+};
+
+};
+
+#endif	/* GITTEH_OIDARRAY_H */
@@ -0,0 +1,188 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "options.h"
+
+#include "error.h"
+
+
+using v8u::Symbol;
+using v8::Object;
+using v8::Local;
+
+namespace gitteh {
+
+Local<Object> CacheStats(const git_cache_stats& stats) {
+  Local<Object> ret = v8u::Obj();
+  ret->Set(Symbol("count"), v8u::Num(stats.count));
+  ret->Set(Symbol("used"), v8u::Num(stats.used));
+  ret->Set(Symbol("limit"), v8u::Num(stats.limit));
+  ret->Set(Symbol("hits"), v8u::Num(stats.hits));
+  ret->Set(Symbol("misses"), v8u::Num(stats.misses));
+  ret->Set(Symbol("evictions"), v8u::Num(stats.evictions));
+  return ret;
+}
+
+Local<Object> MwindowStats(const git_mwindow_stats& stats) {
+  Local<Object> ret = v8u::Obj();
+  ret->Set(Symbol("windowSize"), v8u::Num(stats.window_size));
+  ret->Set(Symbol("mapped"), v8u::Num(stats.mapped));
+  ret->Set(Symbol("peakMapped"), v8u::Num(stats.peak_mapped));
+  ret->Set(Symbol("mappedLimit"), v8u::Num(stats.mapped_limit));
+  ret->Set(Symbol("openWindows"), v8u::Num(stats.open_windows));
+  ret->Set(Symbol("peakOpenWindows"), v8u::Num(stats.peak_open_windows));
+  ret->Set(Symbol("mmapCalls"), v8u::Num(stats.mmap_calls));
+  ret->Set(Symbol("openFiles"), v8u::Num(stats.open_files));
+  ret->Set(Symbol("peakOpenFiles"), v8u::Num(stats.peak_open_files));
+  ret->Set(Symbol("fileLimit"), v8u::Num(stats.file_limit));
+  ret->Set(Symbol("fileCloses"), v8u::Num(stats.file_closes));
+  return ret;
+}
+
+// The delta base cache is shared by every open pack, in every repository
+V8_SCB(SetDeltaBaseCacheLimit) {
+  if (!args[0]->IsNumber())
+    V8_STHROW(v8u::TypeErr("Size needed."));
+
+  error_info err;
+  int status = git_libgit2_opts(GIT_OPT_SET_DELTA_BASE_CACHE_LIMIT,
+                                (size_t)v8u::Num(args[0]));
+  if (status == GIT_OK) return v8::Undefined();
+  collectErr(status, err);
+  V8_STHROW(composeErr(err));
+}
+
+V8_SCB(GetDeltaBaseCacheLimit) {
+  size_t limit;
+  git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_LIMIT, &limit);
+  return v8u::Num(limit);
+}
+
+V8_SCB(GetDeltaBaseCacheStats) {
+  v8::HandleScope scope;
+  git_cache_stats stats;
+  error_info err;
+
+  int status = git_libgit2_opts(GIT_OPT_GET_DELTA_BASE_CACHE_STATS, &stats);
+  if (status != GIT_OK) {
+    collectErr(status, err);
+    V8_STHROW(composeErr(err));
+  }
+  return scope.Close(CacheStats(stats));
+}
+
+// Threads new pack indexers resolve deltas with; 0 means one per CPU
+V8_SCB(SetIndexerThreads) {
+  if (!args[0]->IsNumber())
+    V8_STHROW(v8u::TypeErr("Thread count needed."));
+
+  int threads = v8u::Int(args[0]);
+  if (threads < 0)
+    V8_STHROW(v8u::RangeErr("Thread count can't be negative."));
+
+  git_libgit2_opts(GIT_OPT_SET_INDEXER_THREADS, (unsigned int)threads);
+  return v8::Undefined();
+}
+
+V8_SCB(GetIndexerThreads) {
+  unsigned int threads;
+  git_libgit2_opts(GIT_OPT_GET_INDEXER_THREADS, &threads);
+  return v8u::Num(threads);
+}
+
+// Threads status and workdir diffs read directories and hash files with;
+// 0 means one per CPU
+V8_SCB(SetWorkdirThreads) {
+  if (!args[0]->IsNumber())
+    V8_STHROW(v8u::TypeErr("Thread count needed."));
+
+  int threads = v8u::Int(args[0]);
+  if (threads < 0)
+    V8_STHROW(v8u::RangeErr("Thread count can't be negative."));
+
+  git_libgit2_opts(GIT_OPT_SET_WORKDIR_THREADS, (unsigned int)threads);
+  return v8::Undefined();
+}
+
+V8_SCB(GetWorkdirThreads) {
+  unsigned int threads;
+  git_libgit2_opts(GIT_OPT_GET_WORKDIR_THREADS, &threads);
+  return v8u::Num(threads);
+}
+
+// Packfile windows: {windowSize, mappedLimit, fileLimit}, all optional.
+// These apply to every repository, on top of their own limits.
+V8_SCB(SetMwindowLimits) {
+  if (!args[0]->IsObject())
+    V8_STHROW(v8u::TypeErr("Limits object needed."));
+  Local<Object> opts = v8u::Obj(args[0]);
+  Local<v8::Value> size = opts->Get(Symbol("windowSize"));
+  Local<v8::Value> mapped = opts->Get(Symbol("mappedLimit"));
+  Local<v8::Value> files = opts->Get(Symbol("fileLimit"));
+
+  error_info err;
+  int status = GIT_OK;
+  if (size->IsNumber())
+    status = git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, (size_t)v8u::Num(size));
+  if (status != GIT_OK) {
+    collectErr(status, err);
+    V8_STHROW(composeErr(err));
+  }
+  if (mapped->IsNumber())
+    git_libgit2_opts(GIT_OPT_SET_MWINDOW_MAPPED_LIMIT, (size_t)v8u::Num(mapped));
+  if (files->IsNumber())
+    git_libgit2_opts(GIT_OPT_SET_MWINDOW_FILE_LIMIT, (unsigned int)v8u::Uint(files));
+  return v8::Undefined();
+}
+
+V8_SCB(GetMwindowLimits) {
+  v8::HandleScope scope;
+  size_t size, mapped;
+  unsigned int files;
+  git_libgit2_opts(GIT_OPT_GET_MWINDOW_SIZE, &size);
+  git_libgit2_opts(GIT_OPT_GET_MWINDOW_MAPPED_LIMIT, &mapped);
+  git_libgit2_opts(GIT_OPT_GET_MWINDOW_FILE_LIMIT, &files);
+
+  Local<Object> ret = v8u::Obj();
+  ret->Set(Symbol("windowSize"), v8u::Num(size));
+  ret->Set(Symbol("mappedLimit"), v8u::Num(mapped));
+  ret->Set(Symbol("fileLimit"), v8u::Num(files));
+  return scope.Close(ret);
+}
+
+V8_SCB(GetMwindowStats) {
+  v8::HandleScope scope;
+  git_mwindow_stats stats;
+  error_info err;
+
+  int status = git_libgit2_opts(GIT_OPT_GET_MWINDOW_STATS, &stats);
+  if (status != GIT_OK) {
+    collectErr(status, err);
+    V8_STHROW(composeErr(err));
+  }
+  return scope.Close(MwindowStats(stats));
+}
+
+};
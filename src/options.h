@@ -0,0 +1,51 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GITTEH_OPTIONS_H
+#define	GITTEH_OPTIONS_H
+
+#include "v8u.hpp"
+#include "git2.h"
+
+namespace gitteh {
+
+// Process-wide libgit2 settings (see git_libgit2_opts)
+V8_SCB(SetDeltaBaseCacheLimit);
+V8_SCB(GetDeltaBaseCacheLimit);
+V8_SCB(GetDeltaBaseCacheStats);
+V8_SCB(SetIndexerThreads);
+V8_SCB(GetIndexerThreads);
+V8_SCB(SetWorkdirThreads);
+V8_SCB(GetWorkdirThreads);
+V8_SCB(SetMwindowLimits);
+V8_SCB(GetMwindowLimits);
+V8_SCB(GetMwindowStats);
+
+v8::Local<v8::Object> CacheStats(const git_cache_stats& stats);
+v8::Local<v8::Object> MwindowStats(const git_mwindow_stats& stats);
+
+};
+
+#endif	/* GITTEH_OPTIONS_H */
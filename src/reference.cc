@@ -25,7 +25,11 @@
 
 #include "reference.h"
 
+#include <string>
+#include <vector>
+
 #include "repository.h"
+#include "cancel.h"
 #include "common.h"
 #include "error.h"
 #include "oid.h"
@@ -40,6 +44,7 @@ using v8::Object;
 using v8::Local;
 using v8::Persistent;
 using v8::Function;
+using v8::Array;
 
 namespace gitteh {
 
@@ -69,6 +74,7 @@ GITTEH_WORK_PRE(ref_lookup) {
   Persistent<Object> repo;
   git_reference* out;
   error_info err;
+  CancelRef cancel;
 
   Persistent<Function> cb;
   uv_work_t req;
@@ -83,9 +89,17 @@ V8_SCB(Reference::Lookup) {
   r->repo = Persist(repo_obj);
   r->name = new v8::String::Utf8Value(args[1]);
 
-  r->cb = Persist(v8u::Cast<Function>(args[2]));
-  GITTEH_WORK_QUEUE(ref_lookup);
+  int len = args.Length()-1; // don't count the callback
+  r->cancel.Take(args, len);
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(ref_lookup, node::ObjectWrap::Unwrap<Repository>(repo_obj)->queue);
 } GITTEH_WORK(ref_lookup) {
+  if (r->cancel.Requested()) {
+    delete r->name;
+    cancelErr(r->err);
+    r->out = NULL;
+    return;
+  }
   int status = git_reference_lookup(&r->out, node::ObjectWrap::Unwrap<Repository>(r->repo)->repo, **r->name);
   delete r->name;
   if (status == GIT_OK) return;
@@ -122,6 +136,50 @@ V8_SCB(Reference::LookupSync) {
 }
 
 
+//// Reference.lookupMany(...)
+
+struct ref_lookup_many_req : lookup_many_req {
+  std::vector<std::string> names;
+  std::vector<git_reference*> out;
+
+  int Lookup(size_t i) {
+    int status = git_reference_lookup(&out[i], git_repo, names[i].c_str());
+    if (status != GIT_OK) out[i] = NULL;
+    return status;
+  }
+  v8::Handle<v8::Value> Wrap(size_t i) {
+    if (!out[i]) return v8::Null();
+    return (new Reference(out[i]))->Wrapped();
+  }
+};
+
+// Same batching (and cancelling) rules as Commit.lookupMany
+V8_SCB(Reference::LookupMany) {
+  int len = args.Length()-1; // don't count the callback
+  if (len < 2) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  Local<Object> repo_obj;
+  if (!(args[0]->IsObject() && Repository::HasInstance(repo_obj = v8u::Obj(args[0]))))
+    V8_STHROW(v8u::TypeErr("Repository needed as first argument."));
+  if (!args[1]->IsArray())
+    V8_STHROW(v8u::TypeErr("Array of names needed as second argument."));
+  if (!args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  ref_lookup_many_req* r = new ref_lookup_many_req;
+  r->cancel.Take(args, len);
+  Local<Array> names = v8u::Arr(args[1]);
+  r->names.resize(names->Length());
+  for (size_t i = 0; i < r->names.size(); i++) {
+    v8::String::Utf8Value name (names->Get(i));
+    r->names[i].assign(*name, name.length());
+  }
+  r->length = r->names.size();
+  r->out.resize(r->length, NULL);
+
+  return queueLookupMany(r, args, len, repo_obj);
+}
+
+
 //// Reference.resolve(...)
 
 GITTEH_WORK_PRE(ref_sresolve) {
@@ -129,6 +187,7 @@ GITTEH_WORK_PRE(ref_sresolve) {
   Persistent<Object> repo;
   git_oid out; bool ok;
   error_info err;
+  CancelRef cancel;
 
   Persistent<Function> cb;
   uv_work_t req;
@@ -143,9 +202,17 @@ V8_SCB(Reference::StaticResolve) {
   r->repo = Persist(repo_obj);
   r->name = new v8::String::Utf8Value(args[1]);
 
-  r->cb = Persist(v8u::Cast<Function>(args[2]));
-  GITTEH_WORK_QUEUE(ref_sresolve);
+  int len = args.Length()-1; // don't count the callback
+  r->cancel.Take(args, len);
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(ref_sresolve, node::ObjectWrap::Unwrap<Repository>(repo_obj)->queue);
 } GITTEH_WORK(ref_sresolve) {
+  if (r->cancel.Requested()) {
+    delete r->name;
+    cancelErr(r->err);
+    r->ok = false;
+    return;
+  }
   int status = git_reference_name_to_id(&r->out, node::ObjectWrap::Unwrap<Repository>(r->repo)->repo, **r->name);
   delete r->name;
   if ((r->ok= status == GIT_OK)) return;
@@ -190,6 +257,7 @@ NODE_ETYPE(Reference, "Reference") {
   
   func->Set(Symbol("lookup"), Func(Lookup)->GetFunction());
   func->Set(Symbol("lookupSync"), Func(LookupSync)->GetFunction());
+  func->Set(Symbol("lookupMany"), Func(LookupMany)->GetFunction());
   
   func->Set(Symbol("resolve"), Func(StaticResolve)->GetFunction());
   func->Set(Symbol("resolveSync"), Func(StaticResolveSync)->GetFunction());
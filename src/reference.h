@@ -43,6 +43,7 @@ public:
   V8_SGET(IsBranch);
 
   static V8_SCB(Lookup); static V8_SCB(LookupSync);
+  static V8_SCB(LookupMany);
   static V8_SCB(StaticResolve); static V8_SCB(StaticResolveSync);
 
   NODE_STYPE(Reference);
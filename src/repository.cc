@@ -25,8 +25,16 @@
 
 #include "repository.h"
 
+#include <algorithm>
+#include <string>
+
+#include "cancel.h"
 #include "common.h"
+#include "diff.h"
 #include "error.h"
+#include "oid.h"
+#include "oidarray.h"
+#include "options.h"
 
 
 using v8u::Int;
@@ -41,9 +49,81 @@ using v8::Function;
 
 namespace gitteh {
 
-Repository::Repository(git_repository* ptr): repo(ptr) {}
+// An Oid is taken as is; a string may be anything
+// revparse understands, and is resolved on the worker.
+static inline bool toCommitSpec(v8::Handle<v8::Value> value, git_oid& oid, std::string& spec) {
+  if (value->IsObject() && Oid::HasInstance(v8u::Obj(value))) {
+    git_oid_cpy(&oid, &node::ObjectWrap::Unwrap<Oid>(v8u::Obj(value))->oid);
+    spec.clear();
+    return true;
+  }
+  if (!value->IsString()) return false;
+  v8::String::Utf8Value str (value);
+  spec.assign(*str, str.length());
+  return !spec.empty();
+}
+
+static int resolveCommit(git_oid& out, git_repository* repo, const std::string& spec) {
+  if (spec.empty()) return GIT_OK;
+  git_object* obj;
+  git_object* commit;
+  int status = git_revparse_single(&obj, repo, spec.c_str());
+  if (status != GIT_OK) return status;
+  status = git_object_peel(&commit, obj, GIT_OBJ_COMMIT);
+  git_object_free(obj);
+  if (status != GIT_OK) return status;
+  git_oid_cpy(&out, git_object_id(commit));
+  git_object_free(commit);
+  return GIT_OK;
+}
+
+// One commit spec, or an array of them.
+static bool toCommitSpecs(v8::Handle<v8::Value> value,
+                          std::vector<git_oid>& oids, std::vector<std::string>& specs) {
+  if (!value->IsArray()) {
+    oids.resize(1);
+    specs.resize(1);
+    return toCommitSpec(value, oids[0], specs[0]);
+  }
+  Local<v8::Array> input = v8u::Arr(value);
+  oids.resize(input->Length());
+  specs.resize(input->Length());
+  for (uint32_t i = 0; i < input->Length(); i++)
+    if (!toCommitSpec(input->Get(i), oids[i], specs[i])) return false;
+  return true;
+}
+
+// Like resolveCommit, but for an object of any type.
+static int resolveObject(git_oid& out, git_repository* repo, const std::string& spec) {
+  if (spec.empty()) return GIT_OK;
+  git_object* obj;
+  int status = git_revparse_single(&obj, repo, spec.c_str());
+  if (status != GIT_OK) return status;
+  git_oid_cpy(&out, git_object_id(obj));
+  git_object_free(obj);
+  return GIT_OK;
+}
+
+// Like resolveObject, but peeled to a tree (a commit gives its tree).
+static int resolveTree(git_tree*& out, git_repository* repo,
+                       const git_oid& oid, const std::string& spec) {
+  git_object* obj;
+  int status = spec.empty() ? git_object_lookup(&obj, repo, &oid, GIT_OBJ_ANY)
+                            : git_revparse_single(&obj, repo, spec.c_str());
+  if (status != GIT_OK) return status;
+  status = git_object_peel(reinterpret_cast<git_object**>(&out), obj, GIT_OBJ_TREE);
+  git_object_free(obj);
+  return status;
+}
+
+Repository::Repository(git_repository* ptr): repo(ptr), queue(new WorkQueue),
+                                              status_queue(new WorkQueue) {
+  status_queue->SetLimit(1);
+}
 Repository::~Repository() {
   git_repository_free(repo);
+  queue->Unref();
+  status_queue->Unref();
 }
 
 V8_ESCTOR(Repository) { V8_CTOR_NO_JS }
@@ -67,7 +147,1167 @@ V8_ESGET(Repository, IsBare) {
   return v8u::Bool(git_repository_is_bare(inst->repo));
 }
 
+V8_ESGET(Repository, GetQueueStats) {
+  V8_M_UNWRAP(Repository, info.Holder());
+  return inst->queue->Stats();
+}
+
+V8_ESGET(Repository, GetStatusQueueStats) {
+  V8_M_UNWRAP(Repository, info.Holder());
+  return inst->status_queue->Stats();
+}
+
+// How many jobs of this repository may run at the same time; zero
+// (the default) means all the scheduler threads but one. Status calls
+// aren't counted, they always run one at a time.
+V8_SCB(Repository::SetQueueLimit) {
+  V8_M_UNWRAP(Repository, args.This());
+  if (!args[0]->IsNumber() || Int(args[0]) < 0)
+    V8_STHROW(v8u::TypeErr("Number of jobs needed."));
+  inst->queue->SetLimit(Int(args[0]));
+  return args.This();
+}
+
+
+
+// OBJECT CACHES
+
+// Applies to both the parsed objects and the raw ODB cache
+V8_SCB(Repository::SetCacheLimit) {
+  V8_M_UNWRAP(Repository, args.This());
+  if (!(args[0]->IsNumber() && args[1]->IsNumber()))
+    V8_STHROW(v8u::TypeErr("Object type and size needed."));
+  git_otype type = (git_otype)Int(args[0]);
+  size_t bytes = (size_t)v8u::Num(args[1]);
+
+  error_info err;
+  git_odb* odb;
+  int status = git_repository_set_cache_limit(inst->repo, type, bytes);
+  if (status == GIT_OK && (status = git_repository_odb(&odb, inst->repo)) == GIT_OK) {
+    status = git_odb_set_cache_limit(odb, type, bytes);
+    git_odb_free(odb);
+  }
+  if (status == GIT_OK) return args.This();
+  collectErr(status, err);
+  V8_STHROW(composeErr(err));
+}
+
+V8_SCB(Repository::GetCacheStats) {
+  v8::HandleScope scope;
+  V8_M_UNWRAP(Repository, args.This());
+  git_cache_stats stats;
+  Local<Object> ret = v8u::Obj();
+
+  git_repository_cache_stats(&stats, inst->repo);
+  ret->Set(Symbol("objects"), CacheStats(stats));
+
+  git_odb* odb;
+  error_info err;
+  int status = git_repository_odb(&odb, inst->repo);
+  if (status != GIT_OK) {
+    collectErr(status, err);
+    V8_STHROW(composeErr(err));
+  }
+  git_odb_cache_stats(&stats, odb);
+  git_odb_free(odb);
+  ret->Set(Symbol("odb"), CacheStats(stats));
+
+  return scope.Close(ret);
+}
+
+
+
+// WORKDIR MONITOR
+
+// Keeps the workdir directories between status calls, and has the
+// kernel say which ones changed; only those are read again. Linux only.
+V8_SCB(Repository::SetWorkdirMonitor) {
+  V8_M_UNWRAP(Repository, args.This());
+  if (!args[0]->IsBoolean())
+    V8_STHROW(v8u::TypeErr("Boolean needed."));
+
+  error_info err;
+  int status = git_repository_set_workdir_monitor(inst->repo, Bool(args[0]));
+  if (status == GIT_OK) return args.This();
+  collectErr(status, err);
+  V8_STHROW(composeErr(err));
+}
+
+V8_SCB(Repository::GetWorkdirMonitorStats) {
+  v8::HandleScope scope;
+  V8_M_UNWRAP(Repository, args.This());
+  git_workdir_monitor_stats stats;
+  git_repository_workdir_monitor_stats(&stats, inst->repo);
+
+  Local<Object> ret = v8u::Obj();
+  ret->Set(Symbol("enabled"), v8u::Bool(stats.enabled != 0));
+  ret->Set(Symbol("directories"), v8u::Num(stats.directories));
+  ret->Set(Symbol("hits"), v8u::Num(stats.hits));
+  ret->Set(Symbol("misses"), v8u::Num(stats.misses));
+  ret->Set(Symbol("updates"), v8u::Num(stats.updates));
+  ret->Set(Symbol("overflows"), v8u::Num(stats.overflows));
+  return scope.Close(ret);
+}
+
+
+
+// PACKFILE WINDOWS
+
+// {windowSize, mappedLimit, fileLimit}; a missing or zero limit
+// leaves only the global one (see gitteh.setMwindowLimits)
+V8_SCB(Repository::SetMwindowLimits) {
+  V8_M_UNWRAP(Repository, args.This());
+  if (!args[0]->IsObject())
+    V8_STHROW(v8u::TypeErr("Limits object needed."));
+  Local<Object> opts = v8u::Obj(args[0]);
+  Local<v8::Value> size = opts->Get(Symbol("windowSize"));
+  Local<v8::Value> mapped = opts->Get(Symbol("mappedLimit"));
+  Local<v8::Value> files = opts->Get(Symbol("fileLimit"));
+
+  error_info err;
+  git_odb* odb;
+  int status = git_repository_odb(&odb, inst->repo);
+  if (status == GIT_OK) {
+    status = git_odb_set_mwindow_limits(odb,
+        size->IsNumber() ? (size_t)v8u::Num(size) : 0,
+        mapped->IsNumber() ? (size_t)v8u::Num(mapped) : 0,
+        files->IsNumber() ? v8u::Uint(files) : 0);
+    git_odb_free(odb);
+  }
+  if (status == GIT_OK) return args.This();
+  collectErr(status, err);
+  V8_STHROW(composeErr(err));
+}
+
+V8_SCB(Repository::GetMwindowStats) {
+  v8::HandleScope scope;
+  V8_M_UNWRAP(Repository, args.This());
+  git_mwindow_stats stats;
+  git_odb* odb;
+  error_info err;
+
+  int status = git_repository_odb(&odb, inst->repo);
+  if (status == GIT_OK) {
+    status = git_odb_mwindow_stats(&stats, odb);
+    git_odb_free(odb);
+  }
+  if (status != GIT_OK) {
+    collectErr(status, err);
+    V8_STHROW(composeErr(err));
+  }
+  return scope.Close(MwindowStats(stats));
+}
+
+
+
+// OBJECT HEADERS
+
+//// Repository#objectInfo(...)
+
+GITTEH_WORK_PRE(repo_object_info) {
+  std::vector<git_oid> oids;
+  std::vector<size_t> sizes;
+  std::vector<git_otype> types;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Reads only the headers: for packed deltas, that's the size
+// varints of each delta in the chain, never the whole object.
+// Missing objects are given as null.
+V8_SCB(Repository::ObjectInfo) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (len < 1) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  if (!args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_object_info_req* r = new repo_object_info_req;
+  r->cancel.Take(args, len);
+  const char* msg = Oid::FromList(args[0], r->oids);
+  if (msg) {
+    delete r;
+    V8_STHROW(v8u::TypeErr(msg));
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_object_info, inst->queue);
+} GITTEH_WORK(repo_object_info) {
+  git_odb* odb;
+  int status = git_repository_odb(&odb, r->git_repo);
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+    return;
+  }
+
+  r->sizes.resize(r->oids.size(), 0);
+  r->types.resize(r->oids.size(), GIT_OBJ_BAD);
+  for (size_t i = 0; i < r->oids.size(); i++) {
+    if (r->cancel.Requested()) {
+      cancelErr(r->err);
+      r->failed = true;
+      break;
+    }
+    status = git_odb_read_header(&r->sizes[i], &r->types[i], odb, &r->oids[i]);
+    if (status == GIT_OK) continue;
+    r->types[i] = GIT_OBJ_BAD;
+    if (status == GIT_ENOTFOUND) continue;
+    collectErr(status, r->err);
+    r->failed = true;
+    break;
+  }
+  git_odb_free(odb);
+} GITTEH_WORK_AFTER(repo_object_info) {
+  r->repo.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    Local<v8::Array> result = v8u::Arr(r->oids.size());
+    for (size_t i = 0; i < r->oids.size(); i++) {
+      if (r->types[i] == GIT_OBJ_BAD) {
+        result->Set(i, v8::Null());
+        continue;
+      }
+      Local<Object> item = v8u::Obj();
+      item->Set(Symbol("type"), Int(r->types[i]));
+      item->Set(Symbol("size"), v8u::Num((double)r->sizes[i]));
+      result->Set(i, item);
+    }
+    argv[0] = v8::Null();
+    argv[1] = result;
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+//// Repository#writeCommitGraph(...)
+
+GITTEH_WORK_PRE(repo_write_commit_graph) {
+  std::vector<git_oid> tips;
+  bool all_refs;
+  size_t count;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Writes (or refreshes) objects/info/commit-graph with the history of the
+// given commits, or of every reference if none are given. Commits already
+// in the graph are kept without being read again. Gives the commit count.
+V8_SCB(Repository::WriteCommitGraph) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_write_commit_graph_req* r = new repo_write_commit_graph_req;
+  r->cancel.Take(args, len);
+  r->all_refs = len < 1 || args[0]->IsUndefined() || args[0]->IsNull();
+  if (!r->all_refs) {
+    const char* msg = Oid::FromList(args[0], r->tips);
+    if (msg) {
+      delete r;
+      V8_STHROW(v8u::TypeErr(msg));
+    }
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_write_commit_graph, inst->queue);
+} GITTEH_WORK(repo_write_commit_graph) {
+  if (r->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+    return;
+  }
+
+  git_oid none;
+  const git_oid* tips = r->tips.empty() ? &none : &r->tips[0];
+  int status = git_graph_write(&r->count, r->git_repo,
+                               r->all_refs ? NULL : tips, r->tips.size());
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(repo_write_commit_graph) {
+  r->repo.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    argv[0] = v8::Null();
+    argv[1] = v8u::Num((double)r->count);
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+//// Repository#aheadBehindMany(...)
+
+GITTEH_WORK_PRE(repo_ahead_behind_many) {
+  git_oid base;
+  std::string base_spec;
+  std::vector<git_oid> targets;
+  std::vector<std::string> specs;
+  std::vector<bool> found;
+  std::vector<size_t> ahead, behind;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Counts the commits of each target that aren't in the base (ahead) and
+// the other way around (behind), sharing one walk between all of them.
+// Targets that can't be resolved are given as null.
+V8_SCB(Repository::AheadBehindMany) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (!(len >= 0 && args[len]->IsFunction()))
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_ahead_behind_many_req* r = new repo_ahead_behind_many_req;
+  r->cancel.Take(args, len);
+  if (len < 2) {
+    delete r;
+    V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  }
+  if (!toCommitSpec(args[0], r->base, r->base_spec)) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("Oid or revision needed as first argument."));
+  }
+  if (!args[1]->IsArray()) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("Array of Oids or revisions needed as second argument."));
+  }
+
+  Local<v8::Array> input = v8u::Arr(args[1]);
+  uint32_t count = input->Length();
+  r->targets.resize(count);
+  r->specs.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    if (!toCommitSpec(input->Get(i), r->targets[i], r->specs[i])) {
+      delete r;
+      V8_STHROW(v8u::TypeErr("Invalid Oid or revision found in the array."));
+    }
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_ahead_behind_many, inst->queue);
+} GITTEH_WORK(repo_ahead_behind_many) {
+  int status = resolveCommit(r->base, r->git_repo, r->base_spec);
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+    return;
+  }
+
+  // only the targets that resolve go into the walk
+  std::vector<git_oid> targets;
+  r->found.resize(r->targets.size(), false);
+  for (size_t i = 0; i < r->targets.size(); i++) {
+    if (r->cancel.Requested()) {
+      cancelErr(r->err);
+      r->failed = true;
+      return;
+    }
+    status = resolveCommit(r->targets[i], r->git_repo, r->specs[i]);
+    if (status == GIT_ENOTFOUND) continue;
+    if (status != GIT_OK) {
+      collectErr(status, r->err);
+      r->failed = true;
+      return;
+    }
+    r->found[i] = true;
+    targets.push_back(r->targets[i]);
+  }
+
+  r->ahead.resize(targets.size() + 1);
+  r->behind.resize(targets.size() + 1);
+  status = git_graph_ahead_behind_many(&r->ahead[0], &r->behind[0], r->git_repo,
+      &r->base, targets.empty() ? &r->base : &targets[0], targets.size());
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(repo_ahead_behind_many) {
+  r->repo.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    Local<v8::Array> result = v8u::Arr(r->targets.size());
+    for (size_t i = 0, j = 0; i < r->targets.size(); i++) {
+      if (!r->found[i]) {
+        result->Set(i, v8::Null());
+        continue;
+      }
+      Local<Object> item = v8u::Obj();
+      item->Set(Symbol("ahead"), v8u::Num((double)r->ahead[j]));
+      item->Set(Symbol("behind"), v8u::Num((double)r->behind[j]));
+      result->Set(i, item);
+      j++;
+    }
+    argv[0] = v8::Null();
+    argv[1] = result;
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+
+
+//// Repository#writeBitmaps(...)
+
+GITTEH_WORK_PRE(repo_write_bitmaps) {
+  std::string pack;
+  size_t count;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Writes reachability bitmaps for a pack (given by path, the biggest one
+// if omitted), which speed up writePack and isReachable. Gives the number
+// of commits that got a bitmap.
+V8_SCB(Repository::WriteBitmaps) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_write_bitmaps_req* r = new repo_write_bitmaps_req;
+  r->cancel.Take(args, len);
+  if (len >= 1 && !args[0]->IsUndefined() && !args[0]->IsNull()) {
+    if (!args[0]->IsString()) {
+      delete r;
+      V8_STHROW(v8u::TypeErr("Pack path needed as first argument."));
+    }
+    v8::String::Utf8Value path (args[0]);
+    r->pack.assign(*path, path.length());
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_write_bitmaps, inst->queue);
+} GITTEH_WORK(repo_write_bitmaps) {
+  if (r->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+    return;
+  }
+
+  int status = git_pack_write_bitmaps(&r->count, r->git_repo,
+                                      r->pack.empty() ? NULL : r->pack.c_str());
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(repo_write_bitmaps) {
+  r->repo.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    argv[0] = v8::Null();
+    argv[1] = v8u::Num((double)r->count);
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
 
+//// Repository#isReachable(...)
+
+GITTEH_WORK_PRE(repo_is_reachable) {
+  git_oid target;
+  std::string target_spec;
+  std::vector<git_oid> from;
+  std::vector<std::string> specs;
+  bool reachable;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Tells whether an object (of any type) can be reached from one or more
+// commits. An object that doesn't exist isn't reachable.
+V8_SCB(Repository::IsReachable) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (!(len >= 0 && args[len]->IsFunction()))
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_is_reachable_req* r = new repo_is_reachable_req;
+  r->cancel.Take(args, len);
+  if (len < 2) {
+    delete r;
+    V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  }
+  if (!toCommitSpec(args[0], r->target, r->target_spec)) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("Oid or revision needed as first argument."));
+  }
+  if (!toCommitSpecs(args[1], r->from, r->specs)) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("Oid, revision or array of them needed as second argument."));
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_is_reachable, inst->queue);
+} GITTEH_WORK(repo_is_reachable) {
+  r->reachable = false;
+  int status = resolveObject(r->target, r->git_repo, r->target_spec);
+  if (status == GIT_ENOTFOUND) {
+    giterr_clear();
+    return;
+  }
+
+  for (size_t i = 0; status == GIT_OK && i < r->from.size(); i++)
+    status = resolveCommit(r->from[i], r->git_repo, r->specs[i]);
+
+  if (status == GIT_OK && r->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+    return;
+  }
+
+  if (status == GIT_OK) {
+    status = git_graph_reachable_from_any(r->git_repo, &r->target,
+        r->from.empty() ? NULL : &r->from[0], r->from.size());
+    r->reachable = status == 1;
+    if (status == GIT_ENOTFOUND) {
+      giterr_clear();
+      return;
+    }
+  }
+
+  if (status < 0) {
+    collectErr(status, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(repo_is_reachable) {
+  r->repo.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    argv[0] = v8::Null();
+    argv[1] = v8::Boolean::New(r->reachable);
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+//// Repository#writePack(...)
+
+GITTEH_WORK_PRE(repo_write_pack) {
+  std::string path;
+  std::vector<git_oid> wants, haves;
+  std::vector<std::string> want_specs, have_specs;
+  uint32_t count;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  error_info err;
+  bool failed;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Writes a pack file with everything reachable from the wants but not
+// from the haves, as a fetch or clone would get it. Objects are found
+// through the reachability bitmaps when the repository has them. Haves
+// that aren't in the repository are ignored. Gives the object count.
+V8_SCB(Repository::WritePack) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (!(len >= 0 && args[len]->IsFunction()))
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_write_pack_req* r = new repo_write_pack_req;
+  r->cancel.Take(args, len);
+  if (len < 2) {
+    delete r;
+    V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  }
+  if (!args[0]->IsString()) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("Pack path needed as first argument."));
+  }
+  v8::String::Utf8Value path (args[0]);
+  r->path.assign(*path, path.length());
+
+  if (!toCommitSpecs(args[1], r->wants, r->want_specs)) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("Oid, revision or array of them needed as second argument."));
+  }
+  if (len >= 3 && !args[2]->IsUndefined() && !args[2]->IsNull() &&
+      !toCommitSpecs(args[2], r->haves, r->have_specs)) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("Oid, revision or array of them needed as third argument."));
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_write_pack, inst->queue);
+} GITTEH_WORK(repo_write_pack) {
+  int status = GIT_OK;
+  for (size_t i = 0; status == GIT_OK && i < r->wants.size(); i++)
+    status = resolveObject(r->wants[i], r->git_repo, r->want_specs[i]);
+
+  // haves the repository doesn't know of are dropped
+  std::vector<git_oid> haves;
+  for (size_t i = 0; status == GIT_OK && i < r->haves.size(); i++) {
+    status = resolveObject(r->haves[i], r->git_repo, r->have_specs[i]);
+    if (status == GIT_OK) haves.push_back(r->haves[i]);
+    else if (status == GIT_ENOTFOUND) {
+      giterr_clear();
+      status = GIT_OK;
+    }
+  }
+
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+    return;
+  }
+
+  git_packbuilder* pb;
+  status = git_packbuilder_new(&pb, r->git_repo);
+  if (status == GIT_OK) {
+    status = git_packbuilder_insert_reachable(pb,
+        r->wants.empty() ? NULL : &r->wants[0], r->wants.size(),
+        haves.empty() ? NULL : &haves[0], haves.size());
+
+    // enumerating is the long part, writing gets its own check
+    if (status == GIT_OK && r->cancel.Requested()) {
+      git_packbuilder_free(pb);
+      cancelErr(r->err);
+      r->failed = true;
+      return;
+    }
+
+    if (status == GIT_OK) status = git_packbuilder_write(pb, r->path.c_str());
+    r->count = git_packbuilder_object_count(pb);
+    git_packbuilder_free(pb);
+  }
+
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(repo_write_pack) {
+  r->repo.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    argv[0] = v8::Null();
+    argv[1] = v8u::Num((double)r->count);
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+//// Repository#refs(...)
+
+GITTEH_WORK_PRE(repo_refs) {
+  std::string glob;
+  bool has_glob, resolve, peel;
+  std::vector<std::string> names, symbolic;
+  std::vector<git_oid> targets, peeled;
+  bool listed;
+  size_t offset, chunk;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  WorkQueue* queue;
+  Persistent<Function> progress;
+  bool failed;
+  error_info err;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+static int repo_refs_add(const git_reference_target_entry* entry, void* payload) {
+  repo_refs_req* r = static_cast<repo_refs_req*>(payload);
+  if (r->cancel.Requested()) return 1;
+  r->names.push_back(entry->name);
+  r->symbolic.push_back(entry->symbolic ? entry->symbolic : "");
+  r->targets.push_back(entry->target);
+  r->peeled.push_back(entry->peeled);
+  return 0;
+}
+
+// Peels what the packed-refs file didn't tell; a zero Oid is left
+// for dangling refs and missing objects.
+static int repo_refs_peel(git_oid& peeled, git_odb* odb, git_repository* repo,
+                          const git_oid& target) {
+  if (!git_oid_iszero(&peeled) || git_oid_iszero(&target)) return GIT_OK;
+  size_t size;
+  git_otype type;
+  int status = git_odb_read_header(&size, &type, odb, &target);
+  if (status == GIT_ENOTFOUND) {
+    giterr_clear();
+    return GIT_OK;
+  }
+  if (status != GIT_OK) return status;
+  if (type != GIT_OBJ_TAG) {
+    git_oid_cpy(&peeled, &target);
+    return GIT_OK;
+  }
+
+  git_tag* tag;
+  git_object* object;
+  if ((status = git_tag_lookup(&tag, repo, &target)) != GIT_OK) return status;
+  status = git_tag_peel(&object, tag);
+  git_tag_free(tag);
+  if (status == GIT_ENOTFOUND) {
+    giterr_clear();
+    return GIT_OK;
+  }
+  if (status != GIT_OK) return status;
+  git_oid_cpy(&peeled, git_object_id(object));
+  git_object_free(object);
+  return GIT_OK;
+}
+
+static Local<Object> repo_refs_result(repo_refs_req* r, size_t begin, size_t end) {
+  Local<Object> result = v8u::Obj();
+  Local<v8::Array> names = v8u::Arr(end - begin);
+  Local<Object> symbolic = v8u::Obj();
+  OidArray* targets = OidArray::New(end - begin);
+  for (size_t i = begin; i < end; i++) {
+    Local<v8::String> name = v8::String::New(r->names[i].data(), r->names[i].length());
+    names->Set(i - begin, name);
+    if (!r->symbolic[i].empty())
+      symbolic->Set(name, v8::String::New(r->symbolic[i].data(), r->symbolic[i].length()));
+  }
+  if (end > begin)
+    memcpy(targets->oids, &r->targets[begin], (end - begin) * sizeof(git_oid));
+  result->Set(Symbol("names"), names);
+  result->Set(Symbol("targets"), targets->Wrapped());
+  result->Set(Symbol("symbolic"), symbolic);
+  if (r->peel) {
+    OidArray* peeled = OidArray::New(end - begin);
+    if (end > begin)
+      memcpy(peeled->oids, &r->peeled[begin], (end - begin) * sizeof(git_oid));
+    result->Set(Symbol("peeled"), peeled->Wrapped());
+  }
+  return result;
+}
+
+// Lists the references (matching `glob`, if given) with their targets in
+// one go: the packed-refs file is read once, instead of once per lookup.
+// The result has the `names`, an OidArray of their `targets`, and what
+// the symbolic ones point to in `symbolic`; with `resolve: false` their
+// target is left as a zero Oid. With `peel: true`, `peeled` has the
+// targets peeled past annotated tags. With a `progress` function, the
+// results are given to it in chunks of `chunkSize` instead, and the
+// callback only gets the count.
+V8_SCB(Repository::Refs) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_refs_req* r = new repo_refs_req;
+  r->cancel.Take(args, len);
+  r->has_glob = false;
+  r->resolve = true;
+  r->peel = false;
+  r->chunk = 0;
+  if (len >= 1 && args[0]->IsObject()) {
+    Local<Object> opts = v8u::Obj(args[0]);
+    Local<v8::Value> glob = opts->Get(Symbol("glob"));
+    Local<v8::Value> resolve = opts->Get(Symbol("resolve"));
+    Local<v8::Value> peel = opts->Get(Symbol("peel"));
+    Local<v8::Value> chunk = opts->Get(Symbol("chunkSize"));
+    Local<v8::Value> progress = opts->Get(Symbol("progress"));
+    if (glob->IsString()) {
+      v8::String::Utf8Value str (glob);
+      r->glob.assign(*str, str.length());
+      r->has_glob = true;
+    }
+    if (!resolve->IsUndefined()) r->resolve = Bool(resolve);
+    if (!peel->IsUndefined()) r->peel = Bool(peel);
+    if (progress->IsFunction()) {
+      r->progress = Persist(v8u::Cast<Function>(progress));
+      r->chunk = 1000;
+      if (chunk->IsNumber() && Int(chunk) > 0) r->chunk = Int(chunk);
+    }
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->queue = inst->queue;
+  r->listed = false;
+  r->offset = 0;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_refs, r->queue);
+} GITTEH_WORK(repo_refs) {
+  int status;
+  if (!r->listed) {
+    status = git_reference_foreach_target(r->git_repo,
+        r->has_glob ? r->glob.c_str() : NULL, r->resolve, repo_refs_add, r);
+    if (status == GIT_EUSER && r->cancel.Requested()) {
+      cancelErr(r->err);
+      r->failed = true;
+      return;
+    }
+    if (status != GIT_OK) {
+      collectErr(status, r->err);
+      r->failed = true;
+      return;
+    }
+    r->listed = true;
+    if (!r->chunk) r->chunk = std::max<size_t>(r->names.size(), 1);
+  }
+  if (!r->peel) return;
+
+  // peeling is the slow part, so it's done a chunk at a time
+  git_odb* odb;
+  if ((status = git_repository_odb(&odb, r->git_repo)) != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+    return;
+  }
+  size_t end = std::min(r->offset + r->chunk, r->names.size());
+  for (size_t i = r->offset; i < end; i++) {
+    if (r->cancel.Requested()) {
+      cancelErr(r->err);
+      r->failed = true;
+      break;
+    }
+    status = repo_refs_peel(r->peeled[i], odb, r->git_repo, r->targets[i]);
+    if (status != GIT_OK) {
+      collectErr(status, r->err);
+      r->failed = true;
+      break;
+    }
+  }
+  git_odb_free(odb);
+} GITTEH_WORK_AFTER(repo_refs) {
+  size_t total = r->names.size();
+  if (!r->failed && !r->progress.IsEmpty()) {
+    size_t end = std::min(r->offset + r->chunk, total);
+    if (end > r->offset) {
+      v8::Handle<v8::Value> argv [2] = {repo_refs_result(r, r->offset, end), v8u::Uint(r->offset)};
+      GITTEH_WORK_NOTIFY(progress, 2);
+    }
+    r->offset = end;
+    if (r->offset < total) {
+      GITTEH_WORK_REQUEUE(repo_refs, r->queue);
+    }
+  }
+
+  r->repo.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else if (!r->progress.IsEmpty()) {
+    argv[0] = v8::Null();
+    argv[1] = v8u::Num((double)total);
+  } else {
+    argv[0] = v8::Null();
+    argv[1] = repo_refs_result(r, 0, total);
+  }
+  v8u::ClearPersistent(r->progress);
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+//// Repository#status(...)
+
+GITTEH_WORK_PRE(repo_status) {
+  unsigned int flags;
+  std::vector<std::string> pathspec;
+  std::vector<std::string> paths;
+  std::vector<unsigned int> statuses;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  bool failed;
+  error_info err;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+static int repo_status_add(const char* path, unsigned int status, void* payload) {
+  repo_status_req* r = static_cast<repo_status_req*>(payload);
+  if (r->cancel.Requested()) return 1;
+  r->paths.push_back(path);
+  r->statuses.push_back(status);
+  return 0;
+}
+
+// Gives the status of the working directory and the index, as an object
+// mapping each changed path to its flags (see gitteh.Status). Untracked
+// files are listed unless `untracked: false`; ignored ones only with
+// `ignored: true`. Untracked directories are given as a whole unless
+// `recurseUntracked: true`. `pathspec` may restrict the paths looked at.
+// The directories are read, and the files hashed, on as many threads as
+// gitteh.setWorkdirThreads() says. After setWorkdirMonitor(true), only
+// what changed since the last call is looked at again. With
+// `updateIndex: true`, the untracked cache (if enabled) is saved in the
+// index for the next call; otherwise nothing is ever written. Calls on
+// the same repository run one after another, on their own queue (see
+// the `statusQueue` stats), so firing several at once only queues them.
+V8_SCB(Repository::Status) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_status_req* r = new repo_status_req;
+  r->cancel.Take(args, len);
+  r->flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+  if (len >= 1 && args[0]->IsObject()) {
+    Local<Object> opts = v8u::Obj(args[0]);
+    Local<v8::Value> untracked = opts->Get(Symbol("untracked"));
+    Local<v8::Value> ignored = opts->Get(Symbol("ignored"));
+    Local<v8::Value> recurse = opts->Get(Symbol("recurseUntracked"));
+    Local<v8::Value> pathspec = opts->Get(Symbol("pathspec"));
+    Local<v8::Value> update = opts->Get(Symbol("updateIndex"));
+    if (!untracked->IsUndefined() && !Bool(untracked))
+      r->flags &= ~GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+    if (Bool(ignored)) r->flags |= GIT_STATUS_OPT_INCLUDE_IGNORED;
+    if (Bool(recurse)) r->flags |= GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
+    if (Bool(update)) r->flags |= GIT_STATUS_OPT_UPDATE_INDEX;
+    if (pathspec->IsString()) {
+      v8::String::Utf8Value str (pathspec);
+      r->pathspec.push_back(std::string(*str, str.length()));
+    } else if (pathspec->IsArray()) {
+      Local<v8::Array> arr = v8u::Arr(pathspec);
+      for (uint32_t i = 0; i < arr->Length(); i++) {
+        v8::String::Utf8Value str (arr->Get(i));
+        r->pathspec.push_back(std::string(*str, str.length()));
+      }
+    } else if (!pathspec->IsUndefined() && !pathspec->IsNull()) {
+      delete r;
+      V8_STHROW(v8u::TypeErr("Pathspec must be a string or an array."));
+    }
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->failed = false;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_status, inst->status_queue);
+} GITTEH_WORK(repo_status) {
+  std::vector<char*> pathspec;
+  for (size_t i = 0; i < r->pathspec.size(); i++)
+    pathspec.push_back(const_cast<char*>(r->pathspec[i].c_str()));
+
+  git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+  opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+  opts.flags = r->flags;
+  opts.pathspec.strings = pathspec.empty() ? NULL : &pathspec[0];
+  opts.pathspec.count = pathspec.size();
+
+  int status = git_status_foreach_ext(r->git_repo, &opts, repo_status_add, r);
+  if (status == GIT_EUSER && r->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+  } else if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->failed = true;
+  }
+} GITTEH_WORK_AFTER(repo_status) {
+  r->repo.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  } else {
+    Local<Object> result = v8u::Obj();
+    for (size_t i = 0; i < r->paths.size(); i++)
+      result->Set(v8::String::New(r->paths[i].data(), r->paths[i].length()),
+                  v8u::Uint(r->statuses[i]));
+    argv[0] = v8::Null();
+    argv[1] = result;
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+//// Repository#diff(...)
+
+GITTEH_WORK_PRE(repo_diff) {
+  bool has_old, has_new;
+  git_oid old_oid, new_oid;
+  std::string old_spec, new_spec;
+  git_diff_options opts;
+  std::vector<std::string> pathspec;
+  git_diff_list* out;
+  Persistent<Object> repo;
+  git_repository* git_repo;
+  WorkQueue* queue;
+  error_info err;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Diffs two trees (Oids or anything revparse understands, peeled to a
+// tree; null for an empty one). The callback gets a Diff with the whole
+// list of deltas, but no patch: those are generated with `patch(i)`,
+// only for the files that are looked at. `context` and `interhunk` set
+// the lines around and between hunks, `pathspec` may restrict the paths
+// looked at, and `ignoreWhitespace` and `reverse` do what they say.
+V8_SCB(Repository::DiffTrees) {
+  V8_M_UNWRAP(Repository, args.This());
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  repo_diff_req* r = new repo_diff_req;
+  r->cancel.Take(args, len);
+  if (len < 2) {
+    delete r;
+    V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  }
+  r->has_old = !args[0]->IsNull() && !args[0]->IsUndefined();
+  r->has_new = !args[1]->IsNull() && !args[1]->IsUndefined();
+  if ((r->has_old && !toCommitSpec(args[0], r->old_oid, r->old_spec)) ||
+      (r->has_new && !toCommitSpec(args[1], r->new_oid, r->new_spec))) {
+    delete r;
+    V8_STHROW(v8u::TypeErr("Trees must be given as Oids or strings."));
+  }
+
+  git_diff_options defaults = GIT_DIFF_OPTIONS_INIT;
+  r->opts = defaults;
+  r->opts.flags = GIT_DIFF_SKIP_BINARY_CHECK;
+  if (len >= 3 && args[2]->IsObject()) {
+    Local<Object> opts = v8u::Obj(args[2]);
+    Local<v8::Value> context = opts->Get(Symbol("context"));
+    Local<v8::Value> interhunk = opts->Get(Symbol("interhunk"));
+    Local<v8::Value> whitespace = opts->Get(Symbol("ignoreWhitespace"));
+    Local<v8::Value> reverse = opts->Get(Symbol("reverse"));
+    Local<v8::Value> pathspec = opts->Get(Symbol("pathspec"));
+    if (context->IsNumber()) r->opts.context_lines = Int(context);
+    if (interhunk->IsNumber()) r->opts.interhunk_lines = Int(interhunk);
+    if (Bool(whitespace)) r->opts.flags |= GIT_DIFF_IGNORE_WHITESPACE;
+    if (Bool(reverse)) r->opts.flags |= GIT_DIFF_REVERSE;
+    if (pathspec->IsString()) {
+      v8::String::Utf8Value str (pathspec);
+      r->pathspec.push_back(std::string(*str, str.length()));
+    } else if (pathspec->IsArray()) {
+      Local<v8::Array> arr = v8u::Arr(pathspec);
+      for (uint32_t i = 0; i < arr->Length(); i++) {
+        v8::String::Utf8Value str (arr->Get(i));
+        r->pathspec.push_back(std::string(*str, str.length()));
+      }
+    } else if (!pathspec->IsUndefined() && !pathspec->IsNull()) {
+      delete r;
+      V8_STHROW(v8u::TypeErr("Pathspec must be a string or an array."));
+    }
+  }
+
+  r->repo = Persist(args.This());
+  r->git_repo = inst->repo;
+  r->queue = inst->queue;
+  r->out = NULL;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(repo_diff, r->queue);
+} GITTEH_WORK(repo_diff) {
+  if (r->cancel.Requested()) {
+    cancelErr(r->err);
+    return;
+  }
+
+  std::vector<char*> pathspec;
+  for (size_t i = 0; i < r->pathspec.size(); i++)
+    pathspec.push_back(const_cast<char*>(r->pathspec[i].c_str()));
+  r->opts.pathspec.strings = pathspec.empty() ? NULL : &pathspec[0];
+  r->opts.pathspec.count = pathspec.size();
+
+  git_tree* old_tree = NULL;
+  git_tree* new_tree = NULL;
+  int status = GIT_OK;
+  if (r->has_old)
+    status = resolveTree(old_tree, r->git_repo, r->old_oid, r->old_spec);
+  if (status == GIT_OK && r->has_new)
+    status = resolveTree(new_tree, r->git_repo, r->new_oid, r->new_spec);
+  if (status == GIT_OK)
+    status = git_diff_tree_to_tree(&r->out, r->git_repo, old_tree, new_tree, &r->opts);
+  git_tree_free(old_tree);
+  git_tree_free(new_tree);
+
+  if (status != GIT_OK) {
+    collectErr(status, r->err);
+    r->out = NULL;
+  }
+} GITTEH_WORK_AFTER(repo_diff) {
+  v8::Handle<v8::Value> argv [2];
+  if (r->out) {
+    Diff* diff = new Diff(r->out, r->repo, r->queue);
+    Local<Object> obj = diff->Wrapped();
+    diff->Describe(obj);
+    argv[0] = v8::Null();
+    argv[1] = obj;
+  } else {
+    argv[0] = composeErr(r->err);
+    argv[1] = v8::Null();
+  }
+  r->repo.Dispose();
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
 
 // STATIC / FACTORY METHODS
 
@@ -79,6 +1319,7 @@ GITTEH_WORK_PRE(repo_discover) {
   char* ceiling_dirs;
   char* out;
   error_info err;
+  CancelRef cancel;
 
   Persistent<Function> cb;
   uv_work_t req;
@@ -86,18 +1327,28 @@ GITTEH_WORK_PRE(repo_discover) {
 
 V8_SCB(Repository::Discover) {
   int len = args.Length()-1; // don't count the callback
-  if (len < 1) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
-  if (len > 3) len = 3;
-  
   repo_discover_req* r = new repo_discover_req;
+  r->cancel.Take(args, len);
+  if (len < 1) {
+    delete r;
+    V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  }
+  if (len > 3) len = 3;
+
   r->start = new v8::String::Utf8Value(args[0]);
   
   r->across_fs = len>=2 ? v8u::Bool(args[1]) : false;
   r->ceiling_dirs = NULL; //FIXME:ceiling
   
-  r->cb = Persist(v8u::Cast<Function>(args[len]));
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
   GITTEH_WORK_QUEUE(repo_discover);
 } GITTEH_WORK(repo_discover) { //FIXME: error vs null
+  if (r->cancel.Requested()) {
+    delete r->start;
+    cancelErr(r->err);
+    r->out = NULL;
+    return;
+  }
   int len = r->start->length()+7; //one for \0, more for "/.git/"
   r->out = new char[len];
 
@@ -144,6 +1395,7 @@ GITTEH_WORK_PRE(repo_open) {
   bool ext;
   char* ceiling_dirs;
   error_info err;
+  CancelRef cancel;
 
   Persistent<Function> cb;
   uv_work_t req;
@@ -152,10 +1404,14 @@ GITTEH_WORK_PRE(repo_open) {
 //TODO: make an exists(...) pair
 V8_SCB(Repository::Open) {
   int len = args.Length()-1; // don't count the callback
-  if (len < 1) V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  repo_open_req* r = new repo_open_req;
+  r->cancel.Take(args, len);
+  if (len < 1) {
+    delete r;
+    V8_STHROW(v8u::RangeErr("Not enough arguments!"));
+  }
   if (len > 3) len = 3;
 
-  repo_open_req* r = new repo_open_req;
   r->path = new v8::String::Utf8Value(args[0]);
   if ((r->ext = len > 1)) {
     // enter extended mode if not only the path is given
@@ -164,9 +1420,15 @@ V8_SCB(Repository::Open) {
     else**/ r->ceiling_dirs = NULL;
   }
 
-  r->cb = Persist(v8u::Cast<Function>(args[len]));
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
   GITTEH_WORK_QUEUE(repo_open);
 } GITTEH_WORK(repo_open) {
+  if (r->cancel.Requested()) {
+    delete r->path;
+    cancelErr(r->err);
+    r->out = NULL;
+    return;
+  }
   int status;
   if (r->ext) status = git_repository_open_ext(&r->out, **r->path, r->flags, r->ceiling_dirs);
   else        status = git_repository_open    (&r->out, **r->path);
@@ -215,6 +1477,25 @@ NODE_ETYPE(Repository, "Repository") {
   V8_DEF_GET("workdir", GetWorkdir);
   V8_DEF_GET("path", GetPath);
   V8_DEF_GET("bare", IsBare);
+  V8_DEF_GET("queue", GetQueueStats);
+  V8_DEF_GET("statusQueue", GetStatusQueueStats);
+
+  V8_DEF_CB("setQueueLimit", SetQueueLimit);
+  V8_DEF_CB("setCacheLimit", SetCacheLimit);
+  V8_DEF_CB("cacheStats", GetCacheStats);
+  V8_DEF_CB("setMwindowLimits", SetMwindowLimits);
+  V8_DEF_CB("mwindowStats", GetMwindowStats);
+  V8_DEF_CB("setWorkdirMonitor", SetWorkdirMonitor);
+  V8_DEF_CB("workdirMonitorStats", GetWorkdirMonitorStats);
+  V8_DEF_CB("objectInfo", ObjectInfo);
+  V8_DEF_CB("writeCommitGraph", WriteCommitGraph);
+  V8_DEF_CB("aheadBehindMany", AheadBehindMany);
+  V8_DEF_CB("writeBitmaps", WriteBitmaps);
+  V8_DEF_CB("isReachable", IsReachable);
+  V8_DEF_CB("writePack", WritePack);
+  V8_DEF_CB("refs", Refs);
+  V8_DEF_CB("status", Status);
+  V8_DEF_CB("diff", DiffTrees);
 
   Local<Function> func = templ->GetFunction();
 
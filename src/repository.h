@@ -30,6 +30,8 @@
 
 #include "v8u.hpp"
 
+#include "scheduler.h"
+
 namespace gitteh {
 
 class Repository : public node::ObjectWrap {
@@ -41,6 +43,25 @@ public:
   V8_SGET(GetWorkdir);
   V8_SGET(GetPath);
   V8_SGET(IsBare);
+  V8_SGET(GetQueueStats);
+  V8_SGET(GetStatusQueueStats);
+
+  static V8_SCB(SetQueueLimit);
+  static V8_SCB(SetCacheLimit);
+  static V8_SCB(GetCacheStats);
+  static V8_SCB(SetMwindowLimits);
+  static V8_SCB(GetMwindowStats);
+  static V8_SCB(SetWorkdirMonitor);
+  static V8_SCB(GetWorkdirMonitorStats);
+  static V8_SCB(ObjectInfo);
+  static V8_SCB(WriteCommitGraph);
+  static V8_SCB(AheadBehindMany);
+  static V8_SCB(WriteBitmaps);
+  static V8_SCB(IsReachable);
+  static V8_SCB(WritePack);
+  static V8_SCB(Refs);
+  static V8_SCB(Status);
+  static V8_SCB(DiffTrees);
 
   // NOTE: Due to the allocation technique, this will
   // only succeed if absolute paths are given.
@@ -50,6 +71,10 @@ public:
   NODE_STYPE(Repository);
 //protected:
   git_repository* const repo;
+  WorkQueue* const queue;
+  // status() jobs, one at a time: they share the index's untracked
+  // cache and the workdir monitor, which libgit2 doesn't lock
+  WorkQueue* const status_queue;
 };
 
 };
@@ -0,0 +1,263 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "scheduler.h"
+
+#include <stdlib.h>
+
+
+using v8u::Int;
+using v8u::Num;
+using v8u::Symbol;
+using v8u::Func;
+using v8::Object;
+using v8::Local;
+
+namespace gitteh {
+
+#define GITTEH_DEFAULT_THREADS 4
+#define GITTEH_MAX_THREADS 128
+
+static uv_mutex_t lock;
+static uv_cond_t cond;
+static uv_async_t async;
+
+static uv_thread_t threads [GITTEH_MAX_THREADS];
+static int spawned = 0; // threads actually started
+static int wanted = 0;  // threads allowed to take work
+
+static std::deque<WorkQueue*> ring; // queues with runnable jobs
+static std::deque<WorkQueue::job> done;
+static size_t outstanding = 0; // jobs whose `after` hasn't run yet
+
+static WorkQueue* default_queue = NULL;
+
+
+// WORK QUEUES
+
+WorkQueue::WorkQueue(): limit(0), pending(0), running(0), completed(0),
+                        total_wait(0), max_wait(0), ready(false), refs(1) {}
+
+// Refs are only touched from the main thread, jobs hold one each
+void WorkQueue::Ref() { refs++; }
+void WorkQueue::Unref() { if (--refs == 0) delete this; }
+
+static inline int effective_limit(WorkQueue* q) {
+  if (q->limit > 0) return q->limit;
+  return wanted > 1 ? wanted - 1 : 1;
+}
+
+static inline bool can_run(WorkQueue* q) {
+  return !q->jobs.empty() && (int)q->running < effective_limit(q);
+}
+
+// must hold the lock
+static inline void make_ready(WorkQueue* q) {
+  if (q->ready || !can_run(q)) return;
+  q->ready = true;
+  ring.push_back(q);
+  // sleeping workers above `wanted` would swallow a plain signal
+  if (spawned > wanted) uv_cond_broadcast(&cond);
+  else uv_cond_signal(&cond);
+}
+
+void WorkQueue::SetLimit(int n) {
+  uv_mutex_lock(&lock);
+  limit = n > 0 ? n : 0;
+  // a higher limit may let more of its jobs run right away
+  make_ready(this);
+  uv_mutex_unlock(&lock);
+}
+
+Local<Object> WorkQueue::Stats() {
+  v8::HandleScope scope;
+  Local<Object> ret = v8u::Obj();
+  uv_mutex_lock(&lock);
+  ret->Set(Symbol("pending"), Num(pending));
+  ret->Set(Symbol("running"), Num(running));
+  ret->Set(Symbol("completed"), Num(completed));
+  ret->Set(Symbol("limit"), Int(effective_limit(this)));
+  // wait times in milliseconds
+  ret->Set(Symbol("waitTime"), Num(total_wait / 1e6));
+  ret->Set(Symbol("maxWaitTime"), Num(max_wait / 1e6));
+  ret->Set(Symbol("averageWaitTime"), Num(completed ? total_wait / 1e6 / completed : 0));
+  uv_mutex_unlock(&lock);
+  return scope.Close(ret);
+}
+
+
+// WORKERS
+
+static void worker(void* arg) {
+  int index = (int)(intptr_t)arg;
+
+  uv_mutex_lock(&lock);
+  for (;;) {
+    while (index >= wanted || ring.empty()) uv_cond_wait(&cond, &lock);
+
+    WorkQueue* q = ring.front();
+    ring.pop_front();
+    q->ready = false;
+
+    WorkQueue::job job = q->jobs.front();
+    q->jobs.pop_front();
+    q->pending--;
+    q->running++;
+
+    uint64_t wait = uv_hrtime() - job.queued_at;
+    q->total_wait += wait;
+    if (wait > q->max_wait) q->max_wait = wait;
+
+    // put it back at the tail, so other queues get their turn first
+    make_ready(q);
+
+    uv_mutex_unlock(&lock);
+    job.work(job.req);
+    uv_mutex_lock(&lock);
+
+    q->running--;
+    q->completed++;
+    make_ready(q);
+
+    done.push_back(job);
+    uv_async_send(&async);
+  }
+}
+
+static void spawn(int n) {
+  if (n > GITTEH_MAX_THREADS) n = GITTEH_MAX_THREADS;
+  while (spawned < n) {
+    if (uv_thread_create(&threads[spawned], worker, (void*)(intptr_t)spawned))
+      break;
+    spawned++;
+  }
+}
+
+static void after_work(uv_async_t* handle, int status) {
+  std::deque<WorkQueue::job> finished;
+  uv_mutex_lock(&lock);
+  finished.swap(done);
+  uv_mutex_unlock(&lock);
+
+  for (size_t i = 0; i < finished.size(); i++) {
+    WorkQueue::job& job = finished[i];
+    job.after(job.req);
+    job.queue->Unref();
+  }
+
+  outstanding -= finished.size();
+  if (outstanding == 0) uv_unref((uv_handle_t*)&async);
+}
+
+
+// SCHEDULER
+
+WorkQueue* Scheduler::DefaultQueue() {
+  return default_queue;
+}
+
+int Scheduler::Queue(WorkQueue* queue, uv_work_t* req, work_cb work, work_cb after) {
+  WorkQueue::job job;
+  job.req = req;
+  job.work = work;
+  job.after = after;
+  job.queue = queue;
+
+  queue->Ref();
+  if (outstanding++ == 0) uv_ref((uv_handle_t*)&async);
+
+  uv_mutex_lock(&lock);
+  if (spawned < wanted) spawn(wanted);
+  job.queued_at = uv_hrtime();
+  queue->jobs.push_back(job);
+  queue->pending++;
+  make_ready(queue);
+  uv_mutex_unlock(&lock);
+  return 0;
+}
+
+void Scheduler::SetThreads(int n) {
+  if (n < 1) n = 1;
+  if (n > GITTEH_MAX_THREADS) n = GITTEH_MAX_THREADS;
+  uv_mutex_lock(&lock);
+  wanted = n;
+  // only spawn if the pool is already running, otherwise wait for work
+  if (spawned) spawn(wanted);
+  // queues held back by the old limits come back as their jobs finish
+  uv_cond_broadcast(&cond);
+  uv_mutex_unlock(&lock);
+}
+
+int Scheduler::GetThreads() {
+  return wanted;
+}
+
+void Scheduler::Init(v8::Handle<v8::Object> target) {
+  uv_mutex_init(&lock);
+  uv_cond_init(&cond);
+  uv_async_init(uv_default_loop(), &async, after_work);
+  uv_unref((uv_handle_t*)&async);
+
+  wanted = GITTEH_DEFAULT_THREADS;
+  const char* env = getenv("GITTEH_THREADPOOL_SIZE");
+  if (env && atoi(env) > 0) SetThreads(atoi(env));
+
+  default_queue = new WorkQueue;
+
+  Local<Object> hash = v8u::Obj();
+  hash->Set(Symbol("setThreads"), Func(JsSetThreads)->GetFunction());
+  hash->Set(Symbol("getThreads"), Func(JsGetThreads)->GetFunction());
+  hash->Set(Symbol("stats"), Func(JsStats)->GetFunction());
+  target->Set(Symbol("scheduler"), hash);
+}
+
+
+// JS INTERFACE
+
+V8_SCB(Scheduler::JsSetThreads) {
+  if (!args[0]->IsNumber())
+    V8_STHROW(v8u::TypeErr("Thread count needed as first argument."));
+  SetThreads(Int(args[0]));
+  return v8::Undefined();
+}
+
+V8_SCB(Scheduler::JsGetThreads) {
+  return Int(GetThreads());
+}
+
+V8_SCB(Scheduler::JsStats) {
+  v8::HandleScope scope;
+  Local<Object> ret = v8u::Obj();
+  ret->Set(Symbol("defaultQueue"), default_queue->Stats());
+  uv_mutex_lock(&lock);
+  ret->Set(Symbol("threads"), Int(wanted));
+  ret->Set(Symbol("spawned"), Int(spawned));
+  ret->Set(Symbol("readyQueues"), Num(ring.size()));
+  uv_mutex_unlock(&lock);
+  ret->Set(Symbol("outstanding"), Num(outstanding));
+  return scope.Close(ret);
+}
+
+};
@@ -0,0 +1,110 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GITTEH_SCHEDULER_H
+#define	GITTEH_SCHEDULER_H
+
+#include <deque>
+
+#include "v8u.hpp"
+
+namespace gitteh {
+
+typedef void (*work_cb)(uv_work_t* req);
+
+/*
+ * A queue of pending jobs on the gitteh scheduler.
+ *
+ * Every Repository owns one, so that a single busy repository
+ * can't keep the workers away from the rest. Work that isn't tied
+ * to a repository (i.e. opening one) goes to the default queue.
+ */
+class WorkQueue {
+public:
+  WorkQueue();
+
+  void Ref();
+  void Unref();
+
+  /*
+   * Maximum jobs of this queue that may run at the same time.
+   * Zero means "all threads but one" (and at least one). Read under
+   * the scheduler lock, so change it with SetLimit.
+   */
+  int limit;
+  void SetLimit(int n);
+
+  // Stats, protected by the scheduler lock
+  size_t pending;
+  size_t running;
+  uint64_t completed;
+  uint64_t total_wait; // nanoseconds
+  uint64_t max_wait;   // nanoseconds
+
+  v8::Local<v8::Object> Stats();
+
+  struct job {
+    uv_work_t* req;
+    work_cb work;
+    work_cb after;
+    WorkQueue* queue;
+    uint64_t queued_at;
+  };
+
+  std::deque<job> jobs;
+  bool ready; // currently in the scheduler ring
+  int refs;
+};
+
+/*
+ * Gitteh-owned pool of worker threads.
+ *
+ * Libgit2 calls can block for a long time (disk, inflating, walking)
+ * so we keep them off libuv's threadpool, where they would compete
+ * with filesystem and DNS requests. Queues are served round-robin.
+ */
+class Scheduler {
+public:
+  static void Init(v8::Handle<v8::Object> target);
+
+  static WorkQueue* DefaultQueue();
+
+  /*
+   * Queue a job. `work` is called on a worker thread, `after` on the
+   * main loop. Returns 0 or a negative value if the job was rejected.
+   */
+  static int Queue(WorkQueue* queue, uv_work_t* req, work_cb work, work_cb after);
+
+  static void SetThreads(int n);
+  static int GetThreads();
+
+  static V8_SCB(JsSetThreads);
+  static V8_SCB(JsGetThreads);
+  static V8_SCB(JsStats);
+};
+
+};
+
+#endif	/* GITTEH_SCHEDULER_H */
@@ -0,0 +1,276 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "walker.h"
+
+#include <vector>
+
+#include "repository.h"
+#include "cancel.h"
+#include "common.h"
+#include "error.h"
+#include "oid.h"
+#include "oidarray.h"
+
+
+using v8u::Int;
+using v8u::Symbol;
+using v8u::Func;
+using v8u::Persist;
+using v8::Object;
+using v8::Local;
+using v8::Persistent;
+using v8::Function;
+
+namespace gitteh {
+
+#define GITTEH_WALKER_DEFAULT_BATCH 1000
+#define GITTEH_WALKER_MAX_BATCH 100000
+
+Walker::Walker(git_revwalk* ptr, v8::Handle<Object> repo, WorkQueue* queue):
+  walk(ptr), repo(Persist(repo)), queue(queue), busy(false) {}
+Walker::~Walker() {
+  git_revwalk_free(walk);
+  repo.Dispose();
+}
+
+V8_ESCTOR(Walker) { V8_CTOR_NO_JS }
+
+// The walker can't be touched while a batch is being computed
+#define GITTEH_WALKER_UNWRAP()                                                 \
+  V8_M_UNWRAP(Walker, args.This());                                            \
+  if (inst->busy) V8_STHROW(v8u::Err("The walker is busy."))
+
+#define GITTEH_WALKER_CHECK(CALL) {                                            \
+    int status = CALL;                                                         \
+    if (status != GIT_OK) {                                                    \
+      error_info err;                                                          \
+      collectErr(status, err);                                                 \
+      V8_STHROW(composeErr(err));                                              \
+    }                                                                          \
+  }                                                                            \
+  return args.This()
+
+static inline bool toOid(v8::Handle<v8::Value> value, git_oid& out) {
+  if (value->IsObject() && Oid::HasInstance(v8u::Obj(value))) {
+    git_oid_cpy(&out, &node::ObjectWrap::Unwrap<Oid>(v8u::Obj(value))->oid);
+    return true;
+  }
+  v8::String::Utf8Value str (value);
+  return *str && str.length() == GIT_OID_HEXSZ && git_oid_fromstr(&out, *str) == GIT_OK;
+}
+
+
+
+// SETTING UP THE WALK
+
+V8_SCB(Walker::Sort) {
+  GITTEH_WALKER_UNWRAP();
+  git_revwalk_sorting(inst->walk, v8u::Uint(args[0]));
+  return args.This();
+}
+
+V8_SCB(Walker::Push) {
+  GITTEH_WALKER_UNWRAP();
+  git_oid oid;
+  if (!toOid(args[0], oid)) V8_STHROW(v8u::TypeErr("OID needed as first argument."));
+  GITTEH_WALKER_CHECK(git_revwalk_push(inst->walk, &oid));
+}
+
+V8_SCB(Walker::PushGlob) {
+  GITTEH_WALKER_UNWRAP();
+  v8::String::Utf8Value glob (args[0]);
+  GITTEH_WALKER_CHECK(git_revwalk_push_glob(inst->walk, *glob));
+}
+
+V8_SCB(Walker::PushHead) {
+  GITTEH_WALKER_UNWRAP();
+  GITTEH_WALKER_CHECK(git_revwalk_push_head(inst->walk));
+}
+
+V8_SCB(Walker::PushRef) {
+  GITTEH_WALKER_UNWRAP();
+  v8::String::Utf8Value name (args[0]);
+  GITTEH_WALKER_CHECK(git_revwalk_push_ref(inst->walk, *name));
+}
+
+V8_SCB(Walker::Hide) {
+  GITTEH_WALKER_UNWRAP();
+  git_oid oid;
+  if (!toOid(args[0], oid)) V8_STHROW(v8u::TypeErr("OID needed as first argument."));
+  GITTEH_WALKER_CHECK(git_revwalk_hide(inst->walk, &oid));
+}
+
+V8_SCB(Walker::HideGlob) {
+  GITTEH_WALKER_UNWRAP();
+  v8::String::Utf8Value glob (args[0]);
+  GITTEH_WALKER_CHECK(git_revwalk_hide_glob(inst->walk, *glob));
+}
+
+V8_SCB(Walker::HideHead) {
+  GITTEH_WALKER_UNWRAP();
+  GITTEH_WALKER_CHECK(git_revwalk_hide_head(inst->walk));
+}
+
+V8_SCB(Walker::HideRef) {
+  GITTEH_WALKER_UNWRAP();
+  v8::String::Utf8Value name (args[0]);
+  GITTEH_WALKER_CHECK(git_revwalk_hide_ref(inst->walk, *name));
+}
+
+V8_SCB(Walker::Reset) {
+  GITTEH_WALKER_UNWRAP();
+  git_revwalk_reset(inst->walk);
+  return args.This();
+}
+
+V8_ESGET(Walker, IsBusy) {
+  V8_M_UNWRAP(Walker, info.Holder());
+  return v8u::Bool(inst->busy);
+}
+
+
+
+// WALKING
+
+//// walker.next(...)
+
+GITTEH_WORK_PRE(walker_next) {
+  Walker* walker;
+  Persistent<Object> walker_obj;
+  std::vector<git_oid> out;
+  size_t count;
+  bool failed;
+  error_info err;
+  CancelRef cancel;
+
+  Persistent<Function> cb;
+  uv_work_t req;
+};
+
+// Fetches up to N commits (1000 by default, 100000 at most); the
+// callback gets an OidArray, or null when the walk is over. Cancelling
+// checks between commits, the ones walked so far in the batch are dropped.
+V8_SCB(Walker::Next) {
+  GITTEH_WALKER_UNWRAP();
+  int len = args.Length()-1; // don't count the callback
+  if (len < 0 || !args[len]->IsFunction())
+    V8_STHROW(v8u::TypeErr("Callback needed as last argument."));
+
+  walker_next_req* r = new walker_next_req;
+  r->cancel.Take(args, len);
+  int max = len >= 1 ? Int(args[0]) : 0;
+  if (max <= 0) max = GITTEH_WALKER_DEFAULT_BATCH;
+  if (max > GITTEH_WALKER_MAX_BATCH) max = GITTEH_WALKER_MAX_BATCH;
+  r->out.resize(max);
+  r->walker = inst;
+  r->walker_obj = Persist(args.This());
+  inst->busy = true;
+
+  r->cb = Persist(v8u::Cast<Function>(args[args.Length()-1]));
+  GITTEH_WORK_QUEUE_ON(walker_next, inst->queue);
+} GITTEH_WORK(walker_next) {
+  int status = GIT_OK;
+  r->count = 0;
+  r->failed = false;
+  while (r->count < r->out.size() && !r->cancel.Requested() &&
+         (status = git_revwalk_next(&r->out[r->count], r->walker->walk)) == GIT_OK)
+    r->count++;
+  if (r->cancel.Requested()) {
+    cancelErr(r->err);
+    r->failed = true;
+    return;
+  }
+  if (status == GIT_OK || status == GIT_ITEROVER) return;
+  collectErr(status, r->err);
+  r->failed = true;
+} GITTEH_WORK_AFTER(walker_next) {
+  r->walker->busy = false;
+  r->walker_obj.Dispose();
+  v8::Handle<v8::Value> argv [2];
+  argv[0] = v8::Null();
+  argv[1] = v8::Null();
+  if (r->failed) {
+    argv[0] = composeErr(r->err);
+  } else if (r->count) {
+    OidArray* batch = OidArray::New(r->count);
+    memcpy(batch->oids, &r->out[0], r->count * sizeof(git_oid));
+    argv[1] = batch->Wrapped();
+  }
+  GITTEH_WORK_CALL(2);
+} GITTEH_END
+
+
+
+// STATIC / FACTORY METHODS
+
+V8_SCB(Walker::Create) {
+  Local<Object> repo_obj;
+  if (!(args[0]->IsObject() && Repository::HasInstance(repo_obj = v8u::Obj(args[0]))))
+    V8_STHROW(v8u::TypeErr("Repository needed as first argument."));
+  Repository* repo = node::ObjectWrap::Unwrap<Repository>(repo_obj);
+
+  git_revwalk* walk;
+  int status = git_revwalk_new(&walk, repo->repo);
+  if (status == GIT_OK) return (new Walker(walk, repo_obj, repo->queue))->Wrapped();
+  error_info err;
+  collectErr(status, err);
+  V8_STHROW(composeErr(err));
+}
+
+
+
+NODE_ETYPE(Walker, "Walker") {
+  V8_DEF_CB("sort", Sort);
+  V8_DEF_CB("push", Push);
+  V8_DEF_CB("pushGlob", PushGlob);
+  V8_DEF_CB("pushHead", PushHead);
+  V8_DEF_CB("pushRef", PushRef);
+  V8_DEF_CB("hide", Hide);
+  V8_DEF_CB("hideGlob", HideGlob);
+  V8_DEF_CB("hideHead", HideHead);
+  V8_DEF_CB("hideRef", HideRef);
+  V8_DEF_CB("reset", Reset);
+
+  V8_DEF_CB("next", Next);
+
+  V8_DEF_GET("busy", IsBusy);
+
+  Local<Function> func = templ->GetFunction();
+
+  func->Set(Symbol("create"), Func(Create)->GetFunction());
+
+  //FLAG: sorting modes -- SORT
+  Local<Object> sortHash = v8u::Obj();
+  sortHash->Set(Symbol("NONE"), Int(GIT_SORT_NONE));
+  sortHash->Set(Symbol("TOPOLOGICAL"), Int(GIT_SORT_TOPOLOGICAL));
+  sortHash->Set(Symbol("TIME"), Int(GIT_SORT_TIME));
+  sortHash->Set(Symbol("REVERSE"), Int(GIT_SORT_REVERSE));
+  func->Set(Symbol("Sort"), sortHash);
+} NODE_TYPE_END()
+
+V8_POST_TYPE(Walker)
+
+};
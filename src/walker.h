@@ -0,0 +1,74 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2010 Sam Day
+ * Copyright (c) 2012 Xavier Mendez
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GITTEH_WALKER_H
+#define	GITTEH_WALKER_H
+
+#include "git2.h"
+
+#include "v8u.hpp"
+
+#include "scheduler.h"
+
+namespace gitteh {
+
+/*
+ * Revision walker. The walk itself runs on the repository queue and
+ * hands its results back in batches (as OidArrays), see `next`.
+ */
+class Walker : public node::ObjectWrap {
+public:
+  Walker(git_revwalk* ptr, v8::Handle<v8::Object> repo, WorkQueue* queue);
+  ~Walker();
+  V8_SCTOR();
+
+  static V8_SCB(Sort);
+  static V8_SCB(Push);
+  static V8_SCB(PushGlob);
+  static V8_SCB(PushHead);
+  static V8_SCB(PushRef);
+  static V8_SCB(Hide);
+  static V8_SCB(HideGlob);
+  static V8_SCB(HideHead);
+  static V8_SCB(HideRef);
+  static V8_SCB(Reset);
+
+  static V8_SCB(Next);
+
+  V8_SGET(IsBusy);
+
+  static V8_SCB(Create);
+
+  NODE_STYPE(Walker);
+
+  git_revwalk* const walk;
+  v8::Persistent<v8::Object> repo;
+  WorkQueue* const queue;
+  bool busy;
+};
+
+};
+
+#endif	/* GITTEH_WALKER_H */
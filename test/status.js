@@ -0,0 +1,29 @@
+var gitteh = require("../lib/index");
+var path = require("path");
+require("should");
+
+describe("Repository#status", function () {
+  var repo = gitteh.Repository.openSync(path.join(__dirname, ".."));
+
+  it("runs parallel calls on one repository one at a time", function (done) {
+    var calls = 8, left = calls, results = [];
+
+    for (var i = 0; i < calls; i++) {
+      repo.status({ updateIndex: true }, function (err, result) {
+        if (err) return done(err);
+        results.push(result);
+        if (--left) return;
+
+        for (var j = 1; j < calls; j++)
+          results[j].should.eql(results[0]);
+        repo.statusQueue.completed.should.be.above(calls - 1);
+        done();
+      });
+    }
+
+    var queue = repo.statusQueue;
+    queue.limit.should.equal(1);
+    queue.running.should.be.below(2);
+    (queue.pending + queue.running + queue.completed).should.equal(calls);
+  });
+});